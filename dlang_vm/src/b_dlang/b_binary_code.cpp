@@ -0,0 +1,238 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include "b_binary_code.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Records are written and mapped as they are, so they must have no padding
+static_assert(sizeof(ThreadedInstruction) == 3 * sizeof(int32_t));
+
+BBinaryCode::BBinaryCode(const std::string& filename) {
+  // Map the whole file in memory
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw InvalidBytecode("cannot open " + filename);
+  }
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) < 0 ||
+      static_cast<size_t>(fileStat.st_size) < sizeof(Header)) {
+    close(fd);
+    throw InvalidBytecode("missing header in " + filename);
+  }
+  mappingSize_ = fileStat.st_size;
+  mapping_ = mmap(nullptr, mappingSize_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping_ == MAP_FAILED) {
+    throw InvalidBytecode("cannot map " + filename);
+  }
+
+  try {
+    // Check the header
+    const auto* header = static_cast<const Header*>(mapping_);
+    if (!std::equal(kMagic, kMagic + 4, header->magic)) {
+      throw InvalidBytecode("wrong magic number in " + filename);
+    }
+    if (header->version != kVersion) {
+      throw InvalidBytecode("unsupported version in " + filename);
+    }
+    if (header->size !=
+        (mappingSize_ - sizeof(Header)) / sizeof(ThreadedInstruction) ||
+        (mappingSize_ - sizeof(Header)) % sizeof(ThreadedInstruction)) {
+      throw InvalidBytecode("wrong size in " + filename);
+    }
+    size_ = header->size;
+    instructions_ = reinterpret_cast<const ThreadedInstruction*>(header + 1);
+
+    // The rest of the vm can assume the code is well formed
+    verify(instructions_, size_);
+  } catch (const InvalidBytecode&) {
+    munmap(mapping_, mappingSize_);
+    throw;
+  }
+}
+
+BBinaryCode::~BBinaryCode() {
+  munmap(mapping_, mappingSize_);
+}
+
+bool BBinaryCode::isBinary(const std::string& filename) {
+  char magic[4] = {};
+  std::ifstream fileStream(filename, std::ios::binary);
+  fileStream.read(magic, 4);
+  return fileStream && std::equal(kMagic, kMagic + 4, magic);
+}
+
+void BBinaryCode::write(const Code<BInstruction>& code,
+                        const std::string& filename) {
+  std::vector<ThreadedInstruction> instructions;
+  for (const auto& instruction : code) {
+    instructions.push_back(instruction->getThreadedInstruction());
+  }
+  verify(instructions.data(), instructions.size());
+
+  Header header;
+  std::copy(kMagic, kMagic + 4, header.magic);
+  header.version = kVersion;
+  header.size = instructions.size();
+
+  std::ofstream fileStream(filename, std::ios::binary);
+  fileStream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  fileStream.write(reinterpret_cast<const char*>(instructions.data()),
+                   instructions.size() * sizeof(ThreadedInstruction));
+  if (!fileStream) {
+    throw InvalidBytecode("cannot write " + filename);
+  }
+}
+
+void BBinaryCode::verify(const ThreadedInstruction* instructions,
+                         size_t size) {
+  using Opcode = ThreadedInstruction::Opcode;
+
+  auto fail = [](const std::string& message, size_t cp) {
+    throw InvalidBytecode(message + " at cp = " + std::to_string(cp));
+  };
+  auto isTarget = [&](int32_t cp, Opcode opcode) {
+    return cp >= 0 && static_cast<size_t>(cp) < size &&
+           instructions[cp].opcode == opcode;
+  };
+
+  // Execution can start from the first instruction or from any function
+  std::vector<std::pair<size_t, int64_t>> toVisit;
+  for (size_t cp = 0; cp < size; cp++) {
+    if (instructions[cp].opcode > Opcode::Case) {
+      fail("unknown opcode", cp);
+    }
+    if (instructions[cp].opcode == Opcode::Function) {
+      toVisit.push_back({cp, 0});
+    }
+  }
+  toVisit.push_back({0, 0});
+
+  // Visit all reachable instructions, computing the stack depth (relative
+  // to the current frame) before each of them, which must be unique
+  std::vector<int64_t> depth(size, -1);
+  while (!toVisit.empty()) {
+    auto [cp, currentDepth] = toVisit.back();
+    toVisit.pop_back();
+
+    if (cp >= size) {
+      fail("execution past the end of the code", cp);
+    }
+    if (depth[cp] >= 0) {
+      if (depth[cp] != currentDepth) {
+        fail("inconsistent stack depth", cp);
+      }
+      continue;
+    }
+    depth[cp] = currentDepth;
+
+    // Items needed on the stack and change in stack depth
+    const auto& instruction = instructions[cp];
+    int64_t needed = 0, delta = 0;
+    bool fallsThrough = true;
+    switch (instruction.opcode) {
+      case Opcode::Not: case Opcode::Neg: case Opcode::Read:
+      case Opcode::Fst: case Opcode::Snd:
+      case Opcode::MkInl: case Opcode::MkInr:
+      case Opcode::Deref: case Opcode::MkRef:
+        needed = 1;
+        break;
+      case Opcode::And: case Opcode::Or: case Opcode::Eq: case Opcode::Lt:
+      case Opcode::Add: case Opcode::Sub: case Opcode::Mul: case Opcode::Div:
+      case Opcode::MkPair: case Opcode::Apply: case Opcode::Assign:
+        needed = 2;
+        delta = -1;
+        break;
+      case Opcode::PushUnit: case Opcode::PushBool: case Opcode::PushInt:
+        delta = 1;
+        break;
+      case Opcode::LookupStack:
+        // Argument, closure, or an item of the current frame
+        if (instruction.arg0 != -2 && instruction.arg0 != -1 &&
+            (instruction.arg0 < 2 || instruction.arg0 >= currentDepth + 2)) {
+          fail("stack lookup out of the frame", cp);
+        }
+        delta = 1;
+        break;
+      case Opcode::LookupHeap:
+        if (instruction.arg0 < 0) {
+          fail("negative heap lookup", cp);
+        }
+        delta = 1;
+        break;
+      case Opcode::Return:
+        needed = 1;
+        fallsThrough = false;
+        break;
+      case Opcode::MkClosure:
+        if (!isTarget(instruction.arg0, Opcode::Function)) {
+          fail("closure code is not a function", cp);
+        }
+        if (instruction.arg1 < 0) {
+          fail("negative closure size", cp);
+        }
+        needed = instruction.arg1;
+        delta = 1 - instruction.arg1;
+        break;
+      case Opcode::Swap:
+        needed = 2;
+        break;
+      case Opcode::Pop:
+        needed = 1;
+        delta = -1;
+        break;
+      case Opcode::Label: case Opcode::Function:
+        break;
+      case Opcode::Halt:
+        fallsThrough = false;
+        break;
+      case Opcode::Goto:
+        fallsThrough = false;
+        break;
+      case Opcode::Test:
+        needed = 1;
+        delta = -1;
+        break;
+      case Opcode::Case:
+        needed = 1;
+        break;
+      default:
+        // Superinstructions are rejected as unknown opcodes
+        break;
+    }
+    if (currentDepth < needed) {
+      fail("stack underflow", cp);
+    }
+
+    // Visit the successors
+    if (instruction.opcode == Opcode::Goto ||
+        instruction.opcode == Opcode::Test ||
+        instruction.opcode == Opcode::Case) {
+      if (!isTarget(instruction.arg0, Opcode::Label)) {
+        fail("jump target is not a label", cp);
+      }
+      toVisit.push_back({instruction.arg0, currentDepth + delta});
+    }
+    if (fallsThrough) {
+      toVisit.push_back({cp + 1, currentDepth + delta});
+    }
+  }
+}
+
+size_t BBinaryCode::size() const {
+  return size_;
+}
+
+const ThreadedInstruction* BBinaryCode::data() const {
+  return instructions_;
+}
@@ -0,0 +1,50 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "b_instruction.h"
+#include "../data_structures/code.h"
+#include "../threaded_interpreter/threaded_instruction.h"
+
+// Binary bytecode file, made of a header and one fixed-width record per
+// instruction with labels already resolved to code indices.
+// The file is mapped in memory and verified when it is opened.
+class BBinaryCode {
+ public:
+  explicit BBinaryCode(const std::string& filename);
+  ~BBinaryCode();
+
+  BBinaryCode(const BBinaryCode& other) = delete;
+  BBinaryCode& operator=(const BBinaryCode& other) = delete;
+
+  // Returns true if the file starts with the binary bytecode header
+  static bool isBinary(const std::string& filename);
+
+  // Writes code to a binary bytecode file (the code is verified first)
+  static void write(const Code<BInstruction>& code,
+                    const std::string& filename);
+
+  // Checks jump targets and stack effects of the instructions
+  static void verify(const ThreadedInstruction* instructions, size_t size);
+
+  size_t size() const;
+  const ThreadedInstruction* data() const;
+
+ private:
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t size;
+  };
+
+  static constexpr char kMagic[4] = {'D', 'L', 'B', 'C'};
+  static constexpr uint32_t kVersion = 1;
+
+  void* mapping_;
+  size_t mappingSize_;
+  const ThreadedInstruction* instructions_;
+  size_t size_;
+};
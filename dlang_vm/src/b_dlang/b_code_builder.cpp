@@ -6,6 +6,10 @@
 #include <sstream>
 #include <vector>
 
+#include "b_fused.h"
+
+using Opcode = ThreadedInstruction::Opcode;
+
 Code<BInstruction> BCodeBuilder::fromString(std::string codeString) {
   Code<BInstruction> code;
   std::stringstream codeStringStream;
@@ -140,3 +144,234 @@ std::shared_ptr<BInstruction> BCodeBuilder::getInstructionFromTokens(
     throw UnkownInstruction(tokens.at(0), tokens);
   }
 }
+
+Code<BInstruction> BCodeBuilder::fromBinary(const BBinaryCode& binaryCode) {
+  Code<BInstruction> code;
+  for (size_t cp = 0; cp < binaryCode.size(); cp++) {
+    code.add(getInstructionFromThreaded(binaryCode.data()[cp], cp));
+  }
+  return code;
+}
+
+std::shared_ptr<BInstruction> BCodeBuilder::getInstructionFromThreaded(
+    const ThreadedInstruction& instruction, size_t cp) {
+  switch (instruction.opcode) {
+    case Opcode::Not:
+      return std::make_shared<BUnary>(cp, BUnary::Op::Not);
+    case Opcode::Neg:
+      return std::make_shared<BUnary>(cp, BUnary::Op::Neg);
+    case Opcode::Read:
+      return std::make_shared<BUnary>(cp, BUnary::Op::Read);
+    case Opcode::And:
+      return std::make_shared<BOper>(cp, BOper::Op::And);
+    case Opcode::Or:
+      return std::make_shared<BOper>(cp, BOper::Op::Or);
+    case Opcode::Eq:
+      return std::make_shared<BOper>(cp, BOper::Op::Eq);
+    case Opcode::Lt:
+      return std::make_shared<BOper>(cp, BOper::Op::Lt);
+    case Opcode::Add:
+      return std::make_shared<BOper>(cp, BOper::Op::Add);
+    case Opcode::Sub:
+      return std::make_shared<BOper>(cp, BOper::Op::Sub);
+    case Opcode::Mul:
+      return std::make_shared<BOper>(cp, BOper::Op::Mul);
+    case Opcode::Div:
+      return std::make_shared<BOper>(cp, BOper::Op::Div);
+    case Opcode::MkPair:
+      return std::make_shared<BMkPair>(cp);
+    case Opcode::Fst:
+      return std::make_shared<BFst>(cp);
+    case Opcode::Snd:
+      return std::make_shared<BSnd>(cp);
+    case Opcode::MkInl:
+      return std::make_shared<BMkInl>(cp);
+    case Opcode::MkInr:
+      return std::make_shared<BMkInr>(cp);
+    case Opcode::PushUnit:
+      return std::make_shared<BPush>(cp, BPush::Tag::Unit, 0);
+    case Opcode::PushBool:
+      return std::make_shared<BPush>(cp, BPush::Tag::Bool, instruction.arg0);
+    case Opcode::PushInt:
+      return std::make_shared<BPush>(cp, BPush::Tag::Int, instruction.arg0);
+    case Opcode::Apply:
+      return std::make_shared<BApply>(cp);
+    case Opcode::LookupStack:
+      return std::make_shared<BLookup>(cp, BLookup::Location::Stack,
+                                       instruction.arg0);
+    case Opcode::LookupHeap:
+      return std::make_shared<BLookup>(cp, BLookup::Location::Heap,
+                                       instruction.arg0);
+    case Opcode::Return:
+      return std::make_shared<BReturn>(cp);
+    case Opcode::MkClosure:
+      return std::make_shared<BMkClosure>(cp, instruction.arg0,
+                                          instruction.arg1);
+    case Opcode::Swap:
+      return std::make_shared<BSwap>(cp);
+    case Opcode::Pop:
+      return std::make_shared<BPop>(cp);
+    case Opcode::Label:
+      return std::make_shared<BLabel>(cp);
+    case Opcode::Function:
+      return std::make_shared<BFunction>(cp);
+    case Opcode::Deref:
+      return std::make_shared<BDeref>(cp);
+    case Opcode::MkRef:
+      return std::make_shared<BMkRef>(cp);
+    case Opcode::Assign:
+      return std::make_shared<BAssign>(cp);
+    case Opcode::Halt:
+      return std::make_shared<BHalt>(cp);
+    case Opcode::Goto:
+      return std::make_shared<BGoto>(cp, instruction.arg0);
+    case Opcode::Test:
+      return std::make_shared<BTest>(cp, instruction.arg0);
+    case Opcode::Case:
+      return std::make_shared<BCase>(cp, instruction.arg0);
+    default:
+      // Superinstructions are not read from binary files
+      break;
+  }
+  throw InternalError();
+}
+
+// Collected by running the programs in tests/inputs, only with instructions
+// which do not allocate and cannot be jumped to (and with jumps only at the
+// end of the sequence)
+const std::vector<BCodeBuilder::NGram> BCodeBuilder::kNGrams = {
+    {232, Opcode::EqTest, {Opcode::Eq, Opcode::Test}},
+    {209, Opcode::LookupStackPushInt, {Opcode::LookupStack, Opcode::PushInt}},
+    {173, Opcode::LookupHeapLookupStack,
+     {Opcode::LookupHeap, Opcode::LookupStack}},
+    {167, Opcode::LookupHeapDeref, {Opcode::LookupHeap, Opcode::Deref}},
+    {164, Opcode::LookupHeapLookupHeap,
+     {Opcode::LookupHeap, Opcode::LookupHeap}},
+    {150, Opcode::PushIntEqTest, {Opcode::PushInt, Opcode::Eq, Opcode::Test}},
+    {118, Opcode::LookupStackLookupStack,
+     {Opcode::LookupStack, Opcode::LookupStack}},
+    {111, Opcode::LookupStackPushIntEq,
+     {Opcode::LookupStack, Opcode::PushInt, Opcode::Eq}},
+    {93, Opcode::LookupStackLookupHeap,
+     {Opcode::LookupStack, Opcode::LookupHeap}},
+    {86, Opcode::PushIntSub, {Opcode::PushInt, Opcode::Sub}},
+    {81, Opcode::PushUnitEqTest, {Opcode::PushUnit, Opcode::Eq, Opcode::Test}},
+    {65, Opcode::LookupStackPushIntSub,
+     {Opcode::LookupStack, Opcode::PushInt, Opcode::Sub}},
+    {41, Opcode::PushIntAdd, {Opcode::PushInt, Opcode::Add}},
+    {37, Opcode::AndTest, {Opcode::And, Opcode::Test}},
+    {19, Opcode::LtTest, {Opcode::Lt, Opcode::Test}},
+};
+
+std::shared_ptr<BInstruction> BCodeBuilder::getSuperinstruction(
+    Opcode fused, size_t cp,
+    const BSuperinstruction::Instructions& instructions) {
+  using Location = VirtualMachine::Location;
+  using LookupStack = BLookupHandler<Location::Stack>;
+  using LookupHeap = BLookupHandler<Location::Heap>;
+  using PushUnit = BPushHandler<Tag::Unit>;
+  using PushInt = BPushHandler<Tag::Int>;
+  using Test = BTestHandler;
+  switch (fused) {
+    case Opcode::EqTest:
+      return std::make_shared<BFused<Opcode::EqTest, BOperHandler<Eq>, Test>>(
+          cp, instructions);
+    case Opcode::LtTest:
+      return std::make_shared<BFused<Opcode::LtTest, BOperHandler<Lt>, Test>>(
+          cp, instructions);
+    case Opcode::AndTest:
+      return std::make_shared<BFused<Opcode::AndTest, BOperHandler<And>,
+                                     Test>>(cp, instructions);
+    case Opcode::PushIntAdd:
+      return std::make_shared<BFused<Opcode::PushIntAdd, PushInt,
+                                     BOperHandler<Add>>>(cp, instructions);
+    case Opcode::PushIntSub:
+      return std::make_shared<BFused<Opcode::PushIntSub, PushInt,
+                                     BOperHandler<Sub>>>(cp, instructions);
+    case Opcode::PushIntEqTest:
+      return std::make_shared<BFused<Opcode::PushIntEqTest, PushInt,
+                                     BOperHandler<Eq>, Test>>(cp, instructions);
+    case Opcode::PushUnitEqTest:
+      return std::make_shared<BFused<Opcode::PushUnitEqTest, PushUnit,
+                                     BOperHandler<Eq>, Test>>(cp, instructions);
+    case Opcode::LookupStackPushInt:
+      return std::make_shared<BFused<Opcode::LookupStackPushInt, LookupStack,
+                                     PushInt>>(cp, instructions);
+    case Opcode::LookupStackPushIntEq:
+      return std::make_shared<BFused<Opcode::LookupStackPushIntEq, LookupStack,
+                                     PushInt, BOperHandler<Eq>>>(
+          cp, instructions);
+    case Opcode::LookupStackPushIntSub:
+      return std::make_shared<BFused<Opcode::LookupStackPushIntSub,
+                                     LookupStack, PushInt, BOperHandler<Sub>>>(
+          cp, instructions);
+    case Opcode::LookupStackLookupStack:
+      return std::make_shared<BFused<Opcode::LookupStackLookupStack,
+                                     LookupStack, LookupStack>>(
+          cp, instructions);
+    case Opcode::LookupStackLookupHeap:
+      return std::make_shared<BFused<Opcode::LookupStackLookupHeap,
+                                     LookupStack, LookupHeap>>(
+          cp, instructions);
+    case Opcode::LookupHeapLookupStack:
+      return std::make_shared<BFused<Opcode::LookupHeapLookupStack,
+                                     LookupHeap, LookupStack>>(
+          cp, instructions);
+    case Opcode::LookupHeapLookupHeap:
+      return std::make_shared<BFused<Opcode::LookupHeapLookupHeap,
+                                     LookupHeap, LookupHeap>>(
+          cp, instructions);
+    case Opcode::LookupHeapDeref:
+      return std::make_shared<BFused<Opcode::LookupHeapDeref, LookupHeap,
+                                     BDerefHandler>>(cp, instructions);
+    default:
+      break;
+  }
+  throw InternalError();
+}
+
+Code<BInstruction> BCodeBuilder::fuseSuperinstructions(
+    const Code<BInstruction>& code) {
+  // Match the n-grams on the flat form
+  std::vector<ThreadedInstruction> instructions;
+  for (const auto& instruction : code) {
+    instructions.push_back(instruction->getThreadedInstruction());
+  }
+
+  // Choose greedily the n-gram saving the most dispatches in the benchmarks
+  // (the instructions keep their cps, and the superinstruction replaces the
+  // first one, so the following ones are only reached by the compiler)
+  Code<BInstruction> fusedCode;
+  for (size_t cp = 0; cp < instructions.size();) {
+    const NGram* best = nullptr;
+    size_t bestSaved = 0;
+    for (const auto& nGram : kNGrams) {
+      auto size = nGram.opcodes.size();
+      auto saved = nGram.count * (size - 1);
+      bool matches = saved > bestSaved && cp + size <= instructions.size();
+      for (size_t i = 0; matches && i < size; i++) {
+        matches = instructions[cp + i].opcode == nGram.opcodes[i];
+      }
+      if (matches) {
+        best = &nGram;
+        bestSaved = saved;
+      }
+    }
+    if (!best) {
+      fusedCode.add(code.getInstruction(cp));
+      cp++;
+    } else {
+      auto length = best->opcodes.size();
+      BSuperinstruction::Instructions fused;
+      for (size_t i = 0; i < length; i++) {
+        fused.push_back(code.getInstruction(cp + i));
+      }
+      fusedCode.add(getSuperinstruction(best->fused, cp, fused));
+      for (size_t i = 1; i < length; i++) {
+        fusedCode.add(code.getInstruction(cp + i));
+      }
+      cp += length;
+    }
+  }
+  return fusedCode;
+}
@@ -7,15 +7,38 @@
 #include <string>
 #include <vector>
 
+#include "b_binary_code.h"
 #include "b_instruction.h"
 #include "../data_structures/code.h"
 
 class BCodeBuilder {
  public:
   static Code<BInstruction> fromString(std::string codeString);
+  static Code<BInstruction> fromBinary(const BBinaryCode& binaryCode);
+
+  // Fuses the most frequent sequences of instructions into superinstructions
+  // (placed at the cp of their first instruction, the cps do not change)
+  static Code<BInstruction> fuseSuperinstructions(
+      const Code<BInstruction>& code);
 
  private:
   static std::shared_ptr<BInstruction> getInstructionFromTokens(
       std::vector<std::string> tokens, size_t cp,
       const std::map<std::string, size_t>& labels);
+  static std::shared_ptr<BInstruction> getInstructionFromThreaded(
+      const ThreadedInstruction& instruction, size_t cp);
+
+  // Sequences of instructions which can be fused, with the number of times
+  // they run in the benchmark programs (per thousand instructions)
+  struct NGram {
+    size_t count;
+    ThreadedInstruction::Opcode fused;
+    std::vector<ThreadedInstruction::Opcode> opcodes;
+  };
+  static const std::vector<NGram> kNGrams;
+
+  // Superinstruction running the handlers of the fused instructions
+  static std::shared_ptr<BInstruction> getSuperinstruction(
+      ThreadedInstruction::Opcode fused, size_t cp,
+      const BSuperinstruction::Instructions& instructions);
 };
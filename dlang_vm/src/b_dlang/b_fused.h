@@ -0,0 +1,25 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include <array>
+
+#include "b_handlers.h"
+#include "b_instruction.h"
+#include "../threaded_interpreter/threaded_instruction.h"
+
+// Superinstruction running the handlers of the fused instructions one after
+// the other, with a single dispatch (if a handler fails, the instructions
+// from that one onwards run in the generic form)
+template<ThreadedInstruction::Opcode opcode, typename... Handlers>
+class BFused : public BSuperinstruction {
+ public:
+  BFused(size_t cp, Instructions instructions);
+  void interpret(const VMPtr& vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
+ private:
+  // Arguments of the flat forms of the fused instructions
+  std::array<int32_t, sizeof...(Handlers)> args_;
+};
+
+#include "b_fused.tpp"
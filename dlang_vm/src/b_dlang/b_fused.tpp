@@ -0,0 +1,42 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include "b_fused.h"
+
+#include <utility>
+#include <vector>
+
+template<ThreadedInstruction::Opcode opcode, typename... Handlers>
+BFused<opcode, Handlers...>::BFused(size_t cp, Instructions instructions)
+    : BSuperinstruction(cp, std::move(instructions)) {
+  // The flat form of the superinstruction has two arguments
+  static_assert((Handlers::kHasArg + ... + 0) <= 2);
+  for (size_t i = 0; i < args_.size(); i++) {
+    args_[i] = getInstructions().at(i)->getThreadedInstruction().arg0;
+  }
+}
+
+template<ThreadedInstruction::Opcode opcode, typename... Handlers>
+void BFused<opcode, Handlers...>::interpret(const VMPtr& vm) const {
+  auto ran = runHandlers<Handlers...>(vm.get(), args_.data());
+  const auto& instructions = getInstructions();
+  for (size_t i = ran; i < instructions.size(); i++) {
+    instructions[i]->interpret(vm);
+  }
+}
+
+template<ThreadedInstruction::Opcode opcode, typename... Handlers>
+ThreadedInstruction BFused<opcode, Handlers...>::getThreadedInstruction()
+    const {
+  // The arguments of the instructions which have one, in order
+  constexpr bool kHasArg[] = {Handlers::kHasArg...};
+  std::vector<int32_t> args;
+  for (size_t i = 0; i < args_.size(); i++) {
+    if (kHasArg[i]) {
+      args.push_back(args_[i]);
+    }
+  }
+  args.resize(2);
+  return {opcode, args[0], args[1]};
+}
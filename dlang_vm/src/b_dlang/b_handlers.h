@@ -0,0 +1,81 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../virtual_machine/memory.h"
+#include "../virtual_machine/operations.h"
+#include "../virtual_machine/virtual_machine.h"
+
+// Registers of the vm and cells of its memory, used by the handlers of the
+// quickened instructions and superinstructions (which write sp and cp back to
+// the vm only when they finish)
+class BHandlerState {
+ public:
+  explicit BHandlerState(VirtualMachine* vm);
+
+  // Writes the registers back to the vm
+  void commit();
+
+  // Cell at the index, or nullptr if it is not allocated (the generic
+  // instruction then allocates it, or reports the error)
+  Cell* stackAt(size_t idx);
+  Cell* heapAt(size_t idx);
+
+  size_t sp, fp, cp;
+
+ private:
+  VirtualMachine* vm_;
+  Cell* stack_;
+  Cell* heap_;
+  size_t stackSize_;
+  size_t heapSize_;
+};
+
+// Each handler runs an instruction on the argument of its flat form (if it
+// has one), or returns false without changing the state if the instruction
+// must run in the generic form (for unexpected tags, or cells which are not
+// allocated)
+
+template<UnaryOp op>
+struct BUnaryHandler {
+  static constexpr bool kHasArg = false;
+  static bool run(BHandlerState& state, int32_t arg);
+};
+
+template<BinaryOp op>
+struct BOperHandler {
+  static constexpr bool kHasArg = false;
+  static bool run(BHandlerState& state, int32_t arg);
+};
+
+template<Tag tag>
+struct BPushHandler {
+  static constexpr bool kHasArg = tag != Tag::Unit;
+  static bool run(BHandlerState& state, int32_t arg);
+};
+
+template<VirtualMachine::Location location>
+struct BLookupHandler {
+  static constexpr bool kHasArg = true;
+  static bool run(BHandlerState& state, int32_t arg);
+};
+
+struct BDerefHandler {
+  static constexpr bool kHasArg = false;
+  static bool run(BHandlerState& state, int32_t arg);
+};
+
+struct BTestHandler {
+  static constexpr bool kHasArg = true;
+  static bool run(BHandlerState& state, int32_t arg);
+};
+
+// Runs the handlers in order on their arguments, stopping at the first one
+// which fails, and writes back the registers (returns how many handlers ran)
+template<typename... Handlers>
+size_t runHandlers(VirtualMachine* vm, const int32_t* args);
+
+#include "b_handlers.tpp"
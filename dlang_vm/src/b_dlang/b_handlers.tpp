@@ -0,0 +1,148 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include "b_handlers.h"
+
+#include <utility>
+
+inline BHandlerState::BHandlerState(VirtualMachine* vm)
+    : sp(vm->sp), fp(vm->fp), cp(vm->cp), vm_(vm),
+      stack_(vm->stack.size() ? &vm->stack[0] : nullptr),
+      heap_(vm->heap.size() ? &vm->heap[0] : nullptr),
+      stackSize_(vm->stack.size()), heapSize_(vm->heap.size()) {}
+
+inline void BHandlerState::commit() {
+  vm_->sp = sp;
+  vm_->cp = cp;
+}
+
+inline Cell* BHandlerState::stackAt(size_t idx) {
+  return idx < stackSize_ ? stack_ + idx : nullptr;
+}
+
+inline Cell* BHandlerState::heapAt(size_t idx) {
+  return idx < heapSize_ ? heap_ + idx : nullptr;
+}
+
+template<UnaryOp op>
+bool BUnaryHandler<op>::run(BHandlerState& state, int32_t arg) {
+  auto a = state.stackAt(state.sp - 1);
+  if constexpr (op == Not) {
+    if (!a || a->getTag() != Tag::Bool) { return false; }
+    *a = {Tag::Bool, !static_cast<bool>(a->getValue())};
+  } else if constexpr (op == Neg) {
+    if (!a || a->getTag() != Tag::Int) { return false; }
+    *a = {Tag::Int, static_cast<size_t>(-static_cast<int>(a->getValue()))};
+  } else {
+    return false;
+  }
+  state.cp++;
+  return true;
+}
+
+template<BinaryOp op>
+bool BOperHandler<op>::run(BHandlerState& state, int32_t arg) {
+  auto a = state.stackAt(state.sp - 2);
+  auto b = state.stackAt(state.sp - 1);
+  if (!a || !b) { return false; }
+  auto tagA = a->getTag();
+  auto tagB = b->getTag();
+  auto x = static_cast<int>(a->getValue());
+  auto y = static_cast<int>(b->getValue());
+  if constexpr (op == And || op == Or) {
+    if (tagA != Tag::Bool || tagB != Tag::Bool) { return false; }
+    auto p = static_cast<bool>(a->getValue());
+    auto q = static_cast<bool>(b->getValue());
+    *a = {Tag::Bool, op == And ? p && q : p || q};
+  } else if constexpr (op == Eq) {
+    // Units are always equal, and items with different tags never are
+    *a = {Tag::Bool, tagA == tagB && (tagA == Tag::Unit || x == y)};
+  } else {
+    if (tagA != Tag::Int || tagB != Tag::Int) { return false; }
+    if constexpr (op == Lt) {
+      *a = {Tag::Bool, x < y};
+    } else if constexpr (op == Add) {
+      *a = {Tag::Int, static_cast<size_t>(x + y)};
+    } else if constexpr (op == Sub) {
+      *a = {Tag::Int, static_cast<size_t>(x - y)};
+    } else if constexpr (op == Mul) {
+      *a = {Tag::Int, static_cast<size_t>(x * y)};
+    } else if constexpr (op == Div) {
+      if (b->getValue() == 0) { return false; }
+      *a = {Tag::Int, static_cast<size_t>(x / y)};
+    }
+  }
+  state.sp--;
+  state.cp++;
+  return true;
+}
+
+template<Tag tag>
+bool BPushHandler<tag>::run(BHandlerState& state, int32_t arg) {
+  auto a = state.stackAt(state.sp);
+  if (!a) { return false; }
+  if constexpr (tag == Tag::Unit) {
+    *a = {Tag::Unit, {}};
+  } else if constexpr (tag == Tag::Bool) {
+    *a = {Tag::Bool, static_cast<bool>(arg)};
+  } else {
+    *a = {tag, static_cast<size_t>(arg)};
+  }
+  state.sp++;
+  state.cp++;
+  return true;
+}
+
+template<VirtualMachine::Location location>
+bool BLookupHandler<location>::run(BHandlerState& state, int32_t arg) {
+  auto a = state.stackAt(state.sp);
+  Cell* b = nullptr;
+  if constexpr (location == VirtualMachine::Stack) {
+    b = state.stackAt(state.fp + arg);
+  } else {
+    auto closure = state.stackAt(state.fp - 1);
+    if (!closure || closure->getTag() != Tag::HeapIndex) { return false; }
+    b = state.heapAt(closure->getValue() + arg + 1);
+  }
+  if (!a || !b) { return false; }
+  *a = *b;
+  state.sp++;
+  state.cp++;
+  return true;
+}
+
+inline bool BDerefHandler::run(BHandlerState& state, int32_t arg) {
+  auto a = state.stackAt(state.sp - 1);
+  if (!a || a->getTag() != Tag::HeapRef) { return false; }
+  auto b = state.heapAt(a->getValue());
+  if (!b) { return false; }
+  *a = *b;
+  state.cp++;
+  return true;
+}
+
+inline bool BTestHandler::run(BHandlerState& state, int32_t arg) {
+  auto a = state.stackAt(state.sp - 1);
+  if (!a || a->getTag() != Tag::Bool) { return false; }
+  state.cp = a->getValue() ? state.cp + 1 : static_cast<size_t>(arg);
+  state.sp--;
+  return true;
+}
+
+template<typename... Handlers, size_t... indices>
+size_t runHandlers(BHandlerState& state, const int32_t* args,
+                   std::index_sequence<indices...>) {
+  size_t ran = 0;
+  ((Handlers::run(state, args[indices]) && ++ran) && ...);
+  return ran;
+}
+
+template<typename... Handlers>
+size_t runHandlers(VirtualMachine* vm, const int32_t* args) {
+  BHandlerState state(vm);
+  auto ran = runHandlers<Handlers...>(
+      state, args, std::index_sequence_for<Handlers...>());
+  state.commit();
+  return ran;
+}
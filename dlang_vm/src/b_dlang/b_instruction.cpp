@@ -2,58 +2,87 @@
 
 #include "b_instruction.h"
 
-BInstruction::BInstruction(size_t cp) : cp_(cp) {}
+#include <utility>
+
+BInstruction::BInstruction(size_t cp, Kind kind) : cp_(cp), kind_(kind) {}
+
+BInstruction::Kind BInstruction::getKind() const { return kind_; }
 
 size_t BInstruction::getCp() const { return cp_; }
 
-BUnary::BUnary(size_t cp, Op op) : BInstruction(cp), op_(op) {}
+size_t BInstruction::getLength() const { return 1; }
+
+BUnary::BUnary(size_t cp, Op op) : BInstruction(cp, Kind::Unary), op_(op) {}
 
-BOper::BOper(size_t cp, Op op) : BInstruction(cp), op_(op) {}
+BOper::BOper(size_t cp, Op op) : BInstruction(cp, Kind::Oper), op_(op) {}
 
-BMkPair::BMkPair(size_t cp) : BInstruction(cp) {}
+BMkPair::BMkPair(size_t cp) : BInstruction(cp, Kind::MkPair) {}
 
-BFst::BFst(size_t cp) : BInstruction(cp) {}
+BFst::BFst(size_t cp) : BInstruction(cp, Kind::Fst) {}
 
-BSnd::BSnd(size_t cp) : BInstruction(cp) {}
+BSnd::BSnd(size_t cp) : BInstruction(cp, Kind::Snd) {}
 
-BMkInl::BMkInl(size_t cp) : BInstruction(cp) {}
+BMkInl::BMkInl(size_t cp) : BInstruction(cp, Kind::MkInl) {}
 
-BMkInr::BMkInr(size_t cp) : BInstruction(cp) {}
+BMkInr::BMkInr(size_t cp) : BInstruction(cp, Kind::MkInr) {}
 
 BPush::BPush(size_t cp, Tag tag, int value)
-    : BInstruction(cp), tag_(tag), value_(value) {}
+    : BInstruction(cp, Kind::Push), tag_(tag), value_(value) {}
 
-BApply::BApply(size_t cp) : BInstruction(cp) {}
+BApply::BApply(size_t cp) : BInstruction(cp, Kind::Apply) {}
 
 BLookup::BLookup(size_t cp, Location location, int offset)
-    : BInstruction(cp), location_(location), offset_(offset) {}
+    : BInstruction(cp, Kind::Lookup), location_(location), offset_(offset) {}
 
-BReturn::BReturn(size_t cp) : BInstruction(cp) {}
+BReturn::BReturn(size_t cp) : BInstruction(cp, Kind::Return) {}
 
 BMkClosure::BMkClosure(size_t cp, size_t location, size_t size)
-    : BInstruction(cp), location_(location), size_(size) {}
+    : BInstruction(cp, Kind::MkClosure), location_(location), size_(size) {}
 
-BSwap::BSwap(size_t cp) : BInstruction(cp) {}
+BSwap::BSwap(size_t cp) : BInstruction(cp, Kind::Swap) {}
 
-BPop::BPop(size_t cp) : BInstruction(cp) {}
+BPop::BPop(size_t cp) : BInstruction(cp, Kind::Pop) {}
 
-BLabel::BLabel(size_t cp) : BInstruction(cp) {}
+BLabel::BLabel(size_t cp) : BInstruction(cp, Kind::Label) {}
 
-BFunction::BFunction(size_t cp) : BInstruction(cp) {}
+BFunction::BFunction(size_t cp) : BInstruction(cp, Kind::Function) {}
 
-BDeref::BDeref(size_t cp) : BInstruction(cp) {}
+BDeref::BDeref(size_t cp) : BInstruction(cp, Kind::Deref) {}
 
-BMkRef::BMkRef(size_t cp) : BInstruction(cp) {}
+BMkRef::BMkRef(size_t cp) : BInstruction(cp, Kind::MkRef) {}
 
-BAssign::BAssign(size_t cp) : BInstruction(cp) {}
+BAssign::BAssign(size_t cp) : BInstruction(cp, Kind::Assign) {}
 
-BHalt::BHalt(size_t cp) : BInstruction(cp) {}
+BHalt::BHalt(size_t cp) : BInstruction(cp, Kind::Halt) {}
 
 BGoto::BGoto(size_t cp, size_t destination)
-    : BInstruction(cp), destination_(destination) {}
+    : BInstruction(cp, Kind::Goto), destination_(destination) {}
 
 BTest::BTest(size_t cp, size_t destination)
-    : BInstruction(cp), destination_(destination) {}
+    : BInstruction(cp, Kind::Test), destination_(destination) {}
 
 BCase::BCase(size_t cp, size_t destination)
-    : BInstruction(cp), destination_(destination) {}
+    : BInstruction(cp, Kind::Case), destination_(destination) {}
+
+BSuperinstruction::BSuperinstruction(size_t cp, Instructions instructions)
+    : BInstruction(cp, Kind::Superinstruction),
+      instructions_(std::move(instructions)) {
+  // Groups can start where the first instruction starts them, and end where
+  // the last one ends them
+  const auto& first = instructions_.front();
+  const auto& last = instructions_.back();
+  BGroupRole<Block>::isStart_ = first->BGroupRole<Block>::isStart();
+  BGroupRole<Block>::isEnd_ = last->BGroupRole<Block>::isEnd();
+  BGroupRole<Function>::isStart_ = first->BGroupRole<Function>::isStart();
+  BGroupRole<Function>::isEnd_ = last->BGroupRole<Function>::isEnd();
+  BGroupRole<Function>::isEntry_ = first->BGroupRole<Function>::isEntry();
+  BGroupRole<Function>::isBeforeEntry_ =
+      last->BGroupRole<Function>::isBeforeEntry();
+}
+
+size_t BSuperinstruction::getLength() const { return instructions_.size(); }
+
+const BSuperinstruction::Instructions&
+    BSuperinstruction::getInstructions() const {
+  return instructions_;
+}
@@ -3,14 +3,17 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include "b_group.h"
+#include "../data_structures/kind_cast.h"
 #include "../virtual_machine/operations.h"
 #include "../virtual_machine/virtual_machine.h"
 #include "../data_structures/code.h"
 #include "../virtual_machine/exception.h"
 
 class UInstruction;
+struct ThreadedInstruction;
 
 // Virtual class representing an individual instruction
 class BInstruction : virtual public BGroupRole<Function>,
@@ -22,228 +25,315 @@ class BInstruction : virtual public BGroupRole<Function>,
   using VMPtr = std::shared_ptr<VirtualMachine>;
 
  public:
-  explicit BInstruction(size_t cp);
+  // The kinds of instructions, one for each class (for kindCast), scoped so
+  // that they do not hide the groups
+  enum class Kind {
+    Unary, Oper, MkPair, Fst, Snd, MkInl, MkInr, Push, Apply, Lookup, Return,
+    MkClosure, Swap, Pop, Label, Function, Deref, MkRef, Assign, Halt, Goto,
+    Test, Case, Superinstruction
+  };
+
+  BInstruction(size_t cp, Kind kind);
+  Kind getKind() const;
 
   // Modifies the vm state according to the instruction definition
   // (i.e. the instruction is interpreted)
-  virtual void interpret(VMPtr vm) const = 0;
+  virtual void interpret(const VMPtr& vm) const = 0;
 
   virtual Code<UInstruction> getUInstructions(VMPtr vm) const = 0;
 
+  // Lowers the instruction to the flat form used by the threaded interpreter
+  virtual ThreadedInstruction getThreadedInstruction() const = 0;
+
+  // Specialized form of the instruction, which replaces it in the code run by
+  // the interpreter (or nullptr if it always runs in the generic form)
+  virtual std::shared_ptr<BInstruction> quicken() const;
+
   size_t getCp() const;
 
+  // Number of cps covered by the instruction
+  virtual size_t getLength() const;
+
  private:
   const size_t cp_;
+  const Kind kind_;
 };
 
-class BUnary : virtual public BInstruction,
+class BUnary : public BInstruction,
                public StartOf<Block> {
  public:
   using Op = UnaryOp;
   explicit BUnary(size_t cp, Op op);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::Unary; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
+  std::shared_ptr<BInstruction> quicken() const;
  private:
   Op op_;
 };
 
-class BOper : virtual public BInstruction,
+class BOper : public BInstruction,
               public StartOf<Block> {
  public:
   using Op = BinaryOp;
   explicit BOper(size_t cp, Op op);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::Oper; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
+  std::shared_ptr<BInstruction> quicken() const;
  private:
   Op op_;
 };
 
-class BMkPair : virtual public BInstruction,
+class BMkPair : public BInstruction,
                 public StartOf<Block> {
  public:
   explicit BMkPair(size_t cp);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::MkPair; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
 };
 
-class BFst : virtual public BInstruction,
+class BFst : public BInstruction,
              public StartOf<Block> {
  public:
   explicit BFst(size_t cp);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::Fst; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
 };
 
-class BSnd : virtual public BInstruction,
+class BSnd : public BInstruction,
              public StartOf<Block> {
  public:
   explicit BSnd(size_t cp);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::Snd; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
 };
 
-class BMkInl : virtual public BInstruction,
+class BMkInl : public BInstruction,
                public StartOf<Block> {
  public:
   explicit BMkInl(size_t cp);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::MkInl; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
 };
 
-class BMkInr : virtual public BInstruction,
+class BMkInr : public BInstruction,
                public StartOf<Block> {
  public:
   explicit BMkInr(size_t cp);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::MkInr; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
 };
 
-class BPush : virtual public BInstruction,
+class BPush : public BInstruction,
               public StartOf<Block> {
  public:
   enum Tag { Unit, Bool, Int };
   BPush(size_t cp, Tag tag, int value);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::Push; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
+  std::shared_ptr<BInstruction> quicken() const;
  private:
   Tag tag_;
   int value_;
 };
 
-class BApply : virtual public BInstruction,
+class BApply : public BInstruction,
                public EndOf<Block>,
                public BeforeEntryOf<Function> {
  public:
   explicit BApply(size_t cp);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::Apply; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
 };
 
-class BLookup : virtual public BInstruction,
+class BLookup : public BInstruction,
                 public StartOf<Block> {
  public:
   using Location = VirtualMachine::Location;
   BLookup(size_t cp, Location location, int offset);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::Lookup; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
+  std::shared_ptr<BInstruction> quicken() const;
  private:
   Location location_;
   int offset_;
 };
 
-class BReturn : virtual public BInstruction,
+class BReturn : public BInstruction,
                 public EndOf<Block>,
                 public EndOf<Function>  {
  public:
   explicit BReturn(size_t cp);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::Return; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
 };
 
-class BMkClosure : virtual public BInstruction,
+class BMkClosure : public BInstruction,
                    public StartOf<Block> {
  public:
   BMkClosure(size_t cp, size_t location, size_t size);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::MkClosure; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
  private:
   size_t location_;
   size_t size_;
 };
 
-class BSwap : virtual public BInstruction,
+class BSwap : public BInstruction,
               public StartOf<Block> {
  public:
   explicit BSwap(size_t cp);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::Swap; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
 };
 
-class BPop : virtual public BInstruction,
+class BPop : public BInstruction,
              public StartOf<Block> {
  public:
   explicit BPop(size_t cp);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::Pop; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
 };
 
-class BLabel : virtual public BInstruction,
+class BLabel : public BInstruction,
                public StartOf<Block> {
  public:
   explicit BLabel(size_t cp);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::Label; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
 };
 
-class BFunction: virtual public BInstruction,
-                 public StartOf<Block>,
-                 public StartOf<Function>,
-                 public BeforeEntryOf<Function> {
+class BFunction : public BInstruction,
+                  public StartOf<Block>,
+                  public StartOf<Function>,
+                  public BeforeEntryOf<Function> {
  public:
   explicit BFunction(size_t cp);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::Function; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
 };
 
-class BDeref : virtual public BInstruction,
+class BDeref : public BInstruction,
                public StartOf<Block> {
  public:
   explicit BDeref(size_t cp);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::Deref; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
 };
 
-class BMkRef : virtual public BInstruction,
+class BMkRef : public BInstruction,
                public StartOf<Block> {
  public:
   explicit BMkRef(size_t cp);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::MkRef; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
 };
 
-class BAssign : virtual public BInstruction,
+class BAssign : public BInstruction,
                 public StartOf<Block> {
  public:
   explicit BAssign(size_t cp);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::Assign; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
 };
 
-class BHalt : virtual public BInstruction,
+class BHalt : public BInstruction,
               public EndOf<Block>,
               public EndOf<Function> {
  public:
   explicit BHalt(size_t cp);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::Halt; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
 };
 
-class BGoto : virtual public BInstruction,
+class BGoto : public BInstruction,
               public EndOf<Block> {
  public:
   BGoto(size_t cp, size_t destination);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::Goto; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
  private:
   size_t destination_;
 };
 
-class BTest : virtual public BInstruction,
+class BTest : public BInstruction,
               public EndOf<Block> {
  public:
   BTest(size_t cp, size_t destination);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::Test; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
+  std::shared_ptr<BInstruction> quicken() const;
  private:
   size_t destination_;
 };
 
-class BCase : virtual public BInstruction,
+class BCase : public BInstruction,
               public EndOf<Block> {
  public:
   BCase(size_t cp, size_t destination);
-  void interpret(VMPtr vm) const;
+  static bool isKind(Kind kind) { return kind == Kind::Case; }
+  void interpret(const VMPtr& vm) const;
   Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
  private:
   size_t destination_;
 };
+
+// Sequence of consecutive instructions fused into a single one, which is
+// dispatched once (only the last instruction can jump)
+class BSuperinstruction : public BInstruction {
+ public:
+  using Instructions = std::vector<std::shared_ptr<BInstruction>>;
+  BSuperinstruction(size_t cp, Instructions instructions);
+  static bool isKind(Kind kind) { return kind == Kind::Superinstruction; }
+  void interpret(const VMPtr& vm) const;
+  Code<UInstruction> getUInstructions(VMPtr vm) const;
+  ThreadedInstruction getThreadedInstruction() const;
+  size_t getLength() const;
+  const Instructions& getInstructions() const;
+ private:
+  Instructions instructions_;
+};
@@ -4,7 +4,7 @@
 
 #include "../virtual_machine/runtime_system.h"
 
-void BUnary::interpret(VMPtr vm) const {
+void BUnary::interpret(const VMPtr& vm) const {
   auto a = vm->stack.get(vm->sp - 1);
   if (op_ == Not && a.tag == Tag::Bool) {
     vm->stack.set(vm->sp - 1, {a.tag, !static_cast<bool>(a.value)});
@@ -20,7 +20,7 @@ void BUnary::interpret(VMPtr vm) const {
   vm->cp++;
 }
 
-void BOper::interpret(VMPtr vm) const {
+void BOper::interpret(const VMPtr& vm) const {
   auto a = vm->stack.get(vm->sp - 2);
   auto b = vm->stack.get(vm->sp - 1);
   if (op_ == And && a.tag == Tag::Bool && b.tag == Tag::Bool) {
@@ -63,7 +63,7 @@ void BOper::interpret(VMPtr vm) const {
   vm->sp--;
 }
 
-void BMkPair::interpret(VMPtr vm) const {
+void BMkPair::interpret(const VMPtr& vm) const {
   vm->heap.set(vm->hp, {Tag::PairHeader, 3});
   vm->heap.set(vm->hp + 1, vm->stack.get(vm->sp - 2));
   vm->heap.set(vm->hp + 2, vm->stack.get(vm->sp - 1));
@@ -73,21 +73,21 @@ void BMkPair::interpret(VMPtr vm) const {
   vm->cp++;
 }
 
-void BFst::interpret(VMPtr vm) const {
+void BFst::interpret(const VMPtr& vm) const {
   auto heapIdx = vm->stack.getAndCheck(vm->sp - 1, Tag::HeapIndex).value;
   vm->heap.checkTag(heapIdx, Tag::PairHeader);
   vm->stack.set(vm->sp - 1, vm->heap.get(heapIdx + 1));
   vm->cp++;
 }
 
-void BSnd::interpret(VMPtr vm) const {
+void BSnd::interpret(const VMPtr& vm) const {
   auto heapIdx = vm->stack.getAndCheck(vm->sp - 1, Tag::HeapIndex).value;
   vm->heap.checkTag(heapIdx, Tag::PairHeader);
   vm->stack.set(vm->sp - 1, vm->heap.get(heapIdx + 2));
   vm->cp++;
 }
 
-void BMkInl::interpret(VMPtr vm) const {
+void BMkInl::interpret(const VMPtr& vm) const {
   vm->heap.set(vm->hp, {Tag::InlHeader, 2});
   vm->heap.set(vm->hp + 1, vm->stack.get(vm->sp - 1));
   vm->stack.set(vm->sp - 1, {Tag::HeapIndex, vm->hp});
@@ -95,7 +95,7 @@ void BMkInl::interpret(VMPtr vm) const {
   vm->cp++;
 }
 
-void BMkInr::interpret(VMPtr vm) const {
+void BMkInr::interpret(const VMPtr& vm) const {
   vm->heap.set(vm->hp, {Tag::InrHeader, 2});
   vm->heap.set(vm->hp + 1, vm->stack.get(vm->sp - 1));
   vm->stack.set(vm->sp - 1, {Tag::HeapIndex, vm->hp});
@@ -103,7 +103,7 @@ void BMkInr::interpret(VMPtr vm) const {
   vm->cp++;
 }
 
-void BPush::interpret(VMPtr vm) const {
+void BPush::interpret(const VMPtr& vm) const {
   if (tag_ == Unit) {
     vm->stack.set(vm->sp, {::Tag::Unit, {}});
   } else if (tag_ == Bool) {
@@ -115,7 +115,7 @@ void BPush::interpret(VMPtr vm) const {
   vm->cp++;
 }
 
-void BApply::interpret(VMPtr vm) const {
+void BApply::interpret(const VMPtr& vm) const {
   vm->stack.set(vm->sp, {Tag::FramePointer, vm->fp});
   vm->stack.set(vm->sp + 1, {Tag::ReturnAddress, vm->cp + 1});
   auto heapIdx = vm->stack.getAndCheck(vm->sp - 1, Tag::HeapIndex).value;
@@ -124,7 +124,7 @@ void BApply::interpret(VMPtr vm) const {
   vm->sp += 2;
 }
 
-void BLookup::interpret(VMPtr vm) const {
+void BLookup::interpret(const VMPtr& vm) const {
   if (location_ == Location::Stack) {
     vm->stack.set(vm->sp, vm->stack.get(vm->fp + offset_));
   } else if (location_ == Location::Heap) {
@@ -135,14 +135,14 @@ void BLookup::interpret(VMPtr vm) const {
   vm->cp++;
 }
 
-void BReturn::interpret(VMPtr vm) const {
+void BReturn::interpret(const VMPtr& vm) const {
   vm->stack.set(vm->fp - 2, vm->stack.get(vm->sp - 1));
   vm->sp = vm->fp - 1;
   vm->cp = vm->stack.getAndCheck(vm->fp + 1, Tag::ReturnAddress).value;
   vm->fp = vm->stack.getAndCheck(vm->fp, Tag::FramePointer).value;
 }
 
-void BMkClosure::interpret(VMPtr vm) const {
+void BMkClosure::interpret(const VMPtr& vm) const {
   vm->heap.set(vm->hp, {Tag::ClosureHeader, 2 + size_});
   vm->heap.set(vm->hp + 1, {Tag::CodeIndex, location_});
   for (int i = 0; i < size_; i++) {
@@ -154,7 +154,7 @@ void BMkClosure::interpret(VMPtr vm) const {
   vm->cp++;
 }
 
-void BSwap::interpret(VMPtr vm) const {
+void BSwap::interpret(const VMPtr& vm) const {
   auto a = vm->stack.get(vm->sp - 2);
   auto b = vm->stack.get(vm->sp - 1);
   vm->stack.set(vm->sp - 1, a);
@@ -162,33 +162,33 @@ void BSwap::interpret(VMPtr vm) const {
   vm->cp++;
 }
 
-void BPop::interpret(VMPtr vm) const {
+void BPop::interpret(const VMPtr& vm) const {
   vm->sp--;
   vm->cp++;
 }
 
-void BLabel::interpret(VMPtr vm) const {
+void BLabel::interpret(const VMPtr& vm) const {
   vm->cp++;
 }
 
-void BFunction::interpret(VMPtr vm) const {
+void BFunction::interpret(const VMPtr& vm) const {
   vm->cp++;
 }
 
-void BDeref::interpret(VMPtr vm) const {
+void BDeref::interpret(const VMPtr& vm) const {
   auto heapIdx = vm->stack.getAndCheck(vm->sp - 1, Tag::HeapRef).value;
   vm->stack.set(vm->sp - 1, vm->heap.get(heapIdx));
   vm->cp++;
 }
 
-void BMkRef::interpret(VMPtr vm) const {
+void BMkRef::interpret(const VMPtr& vm) const {
   vm->heap.set(vm->hp, vm->stack.get(vm->sp - 1));
   vm->stack.set(vm->sp - 1, {Tag::HeapRef, vm->hp});
   vm->hp++;
   vm->cp++;
 }
 
-void BAssign::interpret(VMPtr vm) const {
+void BAssign::interpret(const VMPtr& vm) const {
   auto item = vm->stack.get(vm->sp - 1);
   auto heapIdx = vm->stack.getAndCheck(vm->sp - 2, Tag::HeapRef).value;
   vm->heap.set(heapIdx, item);
@@ -197,15 +197,15 @@ void BAssign::interpret(VMPtr vm) const {
   vm->cp++;
 }
 
-void BHalt::interpret(VMPtr vm) const {
+void BHalt::interpret(const VMPtr& vm) const {
   vm->status = VirtualMachine::Status::Halted;
 }
 
-void BGoto::interpret(VMPtr vm) const {
+void BGoto::interpret(const VMPtr& vm) const {
   vm->cp = destination_;
 }
 
-void BTest::interpret(VMPtr vm) const {
+void BTest::interpret(const VMPtr& vm) const {
   if (vm->stack.getAndCheck(vm->sp - 1, Tag::Bool).value) {
     vm->cp++;
   } else {
@@ -214,7 +214,7 @@ void BTest::interpret(VMPtr vm) const {
   vm->sp--;
 }
 
-void BCase::interpret(VMPtr vm) const {
+void BCase::interpret(const VMPtr& vm) const {
   auto heapIdx = vm->stack.getAndCheck(vm->sp - 1, Tag::HeapIndex).value;
   auto item = vm->heap.get(heapIdx);
   vm->stack.set(vm->sp - 1, vm->heap.get(heapIdx + 1));
@@ -226,3 +226,10 @@ void BCase::interpret(VMPtr vm) const {
     throw RuntimeError();
   }
 }
+
+void BSuperinstruction::interpret(const VMPtr& vm) const {
+  // Each instruction moves cp to the next one
+  for (const auto& instruction : instructions_) {
+    instruction->interpret(vm);
+  }
+}
@@ -0,0 +1,121 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include "b_instruction.h"
+
+#include "../threaded_interpreter/threaded_instruction.h"
+
+using Opcode = ThreadedInstruction::Opcode;
+
+ThreadedInstruction BUnary::getThreadedInstruction() const {
+  if (op_ == Not) { return {Opcode::Not}; }
+  if (op_ == Neg) { return {Opcode::Neg}; }
+  if (op_ == Read) { return {Opcode::Read}; }
+  throw InternalError();
+}
+
+ThreadedInstruction BOper::getThreadedInstruction() const {
+  if (op_ == And) { return {Opcode::And}; }
+  if (op_ == Or) { return {Opcode::Or}; }
+  if (op_ == Eq) { return {Opcode::Eq}; }
+  if (op_ == Lt) { return {Opcode::Lt}; }
+  if (op_ == Add) { return {Opcode::Add}; }
+  if (op_ == Sub) { return {Opcode::Sub}; }
+  if (op_ == Mul) { return {Opcode::Mul}; }
+  if (op_ == Div) { return {Opcode::Div}; }
+  throw InternalError();
+}
+
+ThreadedInstruction BMkPair::getThreadedInstruction() const {
+  return {Opcode::MkPair};
+}
+
+ThreadedInstruction BFst::getThreadedInstruction() const {
+  return {Opcode::Fst};
+}
+
+ThreadedInstruction BSnd::getThreadedInstruction() const {
+  return {Opcode::Snd};
+}
+
+ThreadedInstruction BMkInl::getThreadedInstruction() const {
+  return {Opcode::MkInl};
+}
+
+ThreadedInstruction BMkInr::getThreadedInstruction() const {
+  return {Opcode::MkInr};
+}
+
+ThreadedInstruction BPush::getThreadedInstruction() const {
+  if (tag_ == Unit) { return {Opcode::PushUnit}; }
+  if (tag_ == Bool) { return {Opcode::PushBool, static_cast<bool>(value_)}; }
+  if (tag_ == Int) { return {Opcode::PushInt, value_}; }
+  throw InternalError();
+}
+
+ThreadedInstruction BApply::getThreadedInstruction() const {
+  return {Opcode::Apply};
+}
+
+ThreadedInstruction BLookup::getThreadedInstruction() const {
+  if (location_ == Location::Stack) { return {Opcode::LookupStack, offset_}; }
+  if (location_ == Location::Heap) { return {Opcode::LookupHeap, offset_}; }
+  throw InternalError();
+}
+
+ThreadedInstruction BReturn::getThreadedInstruction() const {
+  return {Opcode::Return};
+}
+
+ThreadedInstruction BMkClosure::getThreadedInstruction() const {
+  return {Opcode::MkClosure, static_cast<int32_t>(location_),
+          static_cast<int32_t>(size_)};
+}
+
+ThreadedInstruction BSwap::getThreadedInstruction() const {
+  return {Opcode::Swap};
+}
+
+ThreadedInstruction BPop::getThreadedInstruction() const {
+  return {Opcode::Pop};
+}
+
+ThreadedInstruction BLabel::getThreadedInstruction() const {
+  return {Opcode::Label};
+}
+
+ThreadedInstruction BFunction::getThreadedInstruction() const {
+  return {Opcode::Function};
+}
+
+ThreadedInstruction BDeref::getThreadedInstruction() const {
+  return {Opcode::Deref};
+}
+
+ThreadedInstruction BMkRef::getThreadedInstruction() const {
+  return {Opcode::MkRef};
+}
+
+ThreadedInstruction BAssign::getThreadedInstruction() const {
+  return {Opcode::Assign};
+}
+
+ThreadedInstruction BHalt::getThreadedInstruction() const {
+  return {Opcode::Halt};
+}
+
+ThreadedInstruction BGoto::getThreadedInstruction() const {
+  return {Opcode::Goto, static_cast<int32_t>(destination_)};
+}
+
+ThreadedInstruction BTest::getThreadedInstruction() const {
+  return {Opcode::Test, static_cast<int32_t>(destination_)};
+}
+
+ThreadedInstruction BCase::getThreadedInstruction() const {
+  return {Opcode::Case, static_cast<int32_t>(destination_)};
+}
+
+ThreadedInstruction BSuperinstruction::getThreadedInstruction() const {
+  // The flat form has the fused instructions at their own cps
+  return instructions_.front()->getThreadedInstruction();
+}
@@ -52,18 +52,22 @@ Code<UInstruction> BOper::getUInstructions(VMPtr vm) const {
 Code<UInstruction> BMkPair::getUInstructions(VMPtr vm) const {
   return UCodeBuilder(getCp(), vm)
     .add<ULabel>()
+    // Let the garbage collector run if needed
+    .add<USafepoint>()
+    // Allocate the cells
+    .add<UAllocate>(3)
     // Create the heap header
-    .add<USetAndCheck>(VMUArg::HP(+0, VMUArg::Tag), VMUArg::uImm(PairHeader))
-    .add<USetAndCheck>(VMUArg::HP(+0, VMUArg::Val), VMUArg::uImm(3))
+    .add<USet>(VMUArg::HP(+0, VMUArg::Tag), VMUArg::uImm(PairHeader))
+    .add<USet>(VMUArg::HP(+0, VMUArg::Val), VMUArg::uImm(3))
     // Store the item on the heap
-    .add<UMoveAndCheck>(VMUArg::r0, VMUArg::SP(-2, VMUArg::Tag),
-                        VMUArg::HP(+1, VMUArg::Tag))
-    .add<UMoveAndCheck>(VMUArg::r0, VMUArg::SP(-2, VMUArg::Val),
-                        VMUArg::HP(+1, VMUArg::Val))
-    .add<UMoveAndCheck>(VMUArg::r0, VMUArg::SP(-1, VMUArg::Tag),
-                        VMUArg::HP(+2, VMUArg::Tag))
-    .add<UMoveAndCheck>(VMUArg::r0, VMUArg::SP(-1, VMUArg::Val),
-                        VMUArg::HP(+2, VMUArg::Val))
+    .add<UMoveToHeap>(VMUArg::r0, VMUArg::SP(-2, VMUArg::Tag),
+                      VMUArg::HP(+1, VMUArg::Tag))
+    .add<UMoveToHeap>(VMUArg::r0, VMUArg::SP(-2, VMUArg::Val),
+                      VMUArg::HP(+1, VMUArg::Val))
+    .add<UMoveToHeap>(VMUArg::r0, VMUArg::SP(-1, VMUArg::Tag),
+                      VMUArg::HP(+2, VMUArg::Tag))
+    .add<UMoveToHeap>(VMUArg::r0, VMUArg::SP(-1, VMUArg::Val),
+                      VMUArg::HP(+2, VMUArg::Val))
     .add<UMakeHeapPointer>(VMUArg::SP(-2, VMUArg::Val), VMUArg::uImm(HeapIndex))
     // Update the registers
     .add<UOper>(Add, VMUArg::hp, VMUArg::hp, VMUArg::uImm(3))
@@ -108,14 +112,18 @@ Code<UInstruction> BSnd::getUInstructions(VMPtr vm) const {
 Code<UInstruction> BMkInl::getUInstructions(VMPtr vm) const {
   return UCodeBuilder(getCp(), vm)
     .add<ULabel>()
+    // Let the garbage collector run if needed
+    .add<USafepoint>()
+    // Allocate the cells
+    .add<UAllocate>(2)
     // Create the heap header
-    .add<USetAndCheck>(VMUArg::HP(0, VMUArg::Tag), VMUArg::uImm(InlHeader))
-    .add<USetAndCheck>(VMUArg::HP(0, VMUArg::Val), VMUArg::uImm(2))
+    .add<USet>(VMUArg::HP(0, VMUArg::Tag), VMUArg::uImm(InlHeader))
+    .add<USet>(VMUArg::HP(0, VMUArg::Val), VMUArg::uImm(2))
     // Store the item on the heap
-    .add<UMoveAndCheck>(VMUArg::r0, VMUArg::SP(-1, VMUArg::Tag),
-                        VMUArg::HP(+1, VMUArg::Tag))
-    .add<UMoveAndCheck>(VMUArg::r0, VMUArg::SP(-1, VMUArg::Val),
-                        VMUArg::HP(+1, VMUArg::Val))
+    .add<UMoveToHeap>(VMUArg::r0, VMUArg::SP(-1, VMUArg::Tag),
+                      VMUArg::HP(+1, VMUArg::Tag))
+    .add<UMoveToHeap>(VMUArg::r0, VMUArg::SP(-1, VMUArg::Val),
+                      VMUArg::HP(+1, VMUArg::Val))
     .add<UMakeHeapPointer>(VMUArg::SP(-1, VMUArg::Val), VMUArg::uImm(HeapIndex))
     // Update the registers
     .add<UOper>(Add, VMUArg::hp, VMUArg::hp, VMUArg::uImm(2))
@@ -125,14 +133,18 @@ Code<UInstruction> BMkInl::getUInstructions(VMPtr vm) const {
 Code<UInstruction> BMkInr::getUInstructions(VMPtr vm) const {
   return UCodeBuilder(getCp(), vm)
     .add<ULabel>()
+    // Let the garbage collector run if needed
+    .add<USafepoint>()
+    // Allocate the cells
+    .add<UAllocate>(2)
     // Create the heap header
-    .add<USetAndCheck>(VMUArg::HP(0, VMUArg::Tag), VMUArg::uImm(InrHeader))
-    .add<USetAndCheck>(VMUArg::HP(0, VMUArg::Val), VMUArg::uImm(2))
+    .add<USet>(VMUArg::HP(0, VMUArg::Tag), VMUArg::uImm(InrHeader))
+    .add<USet>(VMUArg::HP(0, VMUArg::Val), VMUArg::uImm(2))
     // Store the item on the heap
-    .add<UMoveAndCheck>(VMUArg::r0, VMUArg::SP(-1, VMUArg::Tag),
-                        VMUArg::HP(+1, VMUArg::Tag))
-    .add<UMoveAndCheck>(VMUArg::r0, VMUArg::SP(-1, VMUArg::Val),
-                        VMUArg::HP(+1, VMUArg::Val))
+    .add<UMoveToHeap>(VMUArg::r0, VMUArg::SP(-1, VMUArg::Tag),
+                      VMUArg::HP(+1, VMUArg::Tag))
+    .add<UMoveToHeap>(VMUArg::r0, VMUArg::SP(-1, VMUArg::Val),
+                      VMUArg::HP(+1, VMUArg::Val))
     .add<UMakeHeapPointer>(VMUArg::SP(-1, VMUArg::Val), VMUArg::uImm(HeapIndex))
     // Update the registers
     .add<UOper>(Add, VMUArg::hp, VMUArg::hp, VMUArg::uImm(2))
@@ -222,20 +234,24 @@ Code<UInstruction> BReturn::getUInstructions(VMPtr vm) const {
 Code<UInstruction> BMkClosure::getUInstructions(VMPtr vm) const {
   Code<UInstruction> uCode = UCodeBuilder(getCp(), vm)
     .add<ULabel>()
+    // Let the garbage collector run if needed
+    .add<USafepoint>()
+    // Allocate the cells
+    .add<UAllocate>(size_ + 2)
     // Create the heap header
-    .add<USetAndCheck>(VMUArg::HP(+0, VMUArg::Tag), VMUArg::uImm(ClosureHeader))
-    .add<USetAndCheck>(VMUArg::HP(+0, VMUArg::Val), VMUArg::uImm(2 + size_))
+    .add<USet>(VMUArg::HP(+0, VMUArg::Tag), VMUArg::uImm(ClosureHeader))
+    .add<USet>(VMUArg::HP(+0, VMUArg::Val), VMUArg::uImm(2 + size_))
     // Store the code pointer on the heap
-    .add<USetAndCheck>(VMUArg::HP(+1, VMUArg::Tag), VMUArg::uImm(CodeIndex))
-    .add<USetAndCheck>(VMUArg::HP(+1, VMUArg::Val), VMUArg::uImm(location_));
+    .add<USet>(VMUArg::HP(+1, VMUArg::Tag), VMUArg::uImm(CodeIndex))
+    .add<USet>(VMUArg::HP(+1, VMUArg::Val), VMUArg::uImm(location_));
 
   for (int i = 0; i < size_; i++) {
     uCode += UCodeBuilder(getCp(), vm)
       // Store the variables on the heap
-      .add<UMoveAndCheck>(VMUArg::r0, VMUArg::SP(-1 - i, VMUArg::Tag),
-                          VMUArg::HP(+2 + i, VMUArg::Tag))
-      .add<UMoveAndCheck>(VMUArg::r0, VMUArg::SP(-1 - i, VMUArg::Val),
-                          VMUArg::HP(+2 + i, VMUArg::Val));
+      .add<UMoveToHeap>(VMUArg::r0, VMUArg::SP(-1 - i, VMUArg::Tag),
+                        VMUArg::HP(+2 + i, VMUArg::Tag))
+      .add<UMoveToHeap>(VMUArg::r0, VMUArg::SP(-1 - i, VMUArg::Val),
+                        VMUArg::HP(+2 + i, VMUArg::Val));
   }
 
   uCode += UCodeBuilder(getCp(), vm)
@@ -305,11 +321,15 @@ Code<UInstruction> BDeref::getUInstructions(VMPtr vm) const {
 Code<UInstruction> BMkRef::getUInstructions(VMPtr vm) const {
   return UCodeBuilder(getCp(), vm)
     .add<ULabel>()
+    // Let the garbage collector run if needed
+    .add<USafepoint>()
+    // Allocate the cells
+    .add<UAllocate>(1)
     // Store the item on the heap
-    .add<UMoveAndCheck>(VMUArg::r0, VMUArg::SP(-1, VMUArg::Tag),
-                        VMUArg::HP(+0, VMUArg::Tag))
-    .add<UMoveAndCheck>(VMUArg::r0, VMUArg::SP(-1, VMUArg::Val),
-                        VMUArg::HP(+0, VMUArg::Val))
+    .add<UMoveToHeap>(VMUArg::r0, VMUArg::SP(-1, VMUArg::Tag),
+                      VMUArg::HP(+0, VMUArg::Tag))
+    .add<UMoveToHeap>(VMUArg::r0, VMUArg::SP(-1, VMUArg::Val),
+                      VMUArg::HP(+0, VMUArg::Val))
     .add<UMakeHeapPointer>(VMUArg::SP(-1, VMUArg::Val), VMUArg::uImm(HeapRef))
     // Update the registers
     .add<UOper>(Add, VMUArg::hp, VMUArg::hp, VMUArg::uImm(1))
@@ -378,3 +398,11 @@ Code<UInstruction> BCase::getUInstructions(VMPtr vm) const {
     .add<UBranch>(VMUArg::r0, destination_)
     .add<UGuard>();
 }
+
+Code<UInstruction> BSuperinstruction::getUInstructions(VMPtr vm) const {
+  Code<UInstruction> uCode;
+  for (const auto& instruction : instructions_) {
+    uCode += instruction->getUInstructions(vm);
+  }
+  return uCode;
+}
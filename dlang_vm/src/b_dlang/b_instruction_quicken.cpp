@@ -0,0 +1,57 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include "b_instruction.h"
+
+#include "b_quickened.h"
+
+std::shared_ptr<BInstruction> BInstruction::quicken() const {
+  return nullptr;
+}
+
+std::shared_ptr<BInstruction> BUnary::quicken() const {
+  switch (op_) {
+    case Not: return std::make_shared<BQuickUnary<Not>>(getCp());
+    case Neg: return std::make_shared<BQuickUnary<Neg>>(getCp());
+    default: return nullptr;
+  }
+}
+
+std::shared_ptr<BInstruction> BOper::quicken() const {
+  switch (op_) {
+    case And: return std::make_shared<BQuickOper<And>>(getCp());
+    case Or: return std::make_shared<BQuickOper<Or>>(getCp());
+    case Eq: return std::make_shared<BQuickOper<Eq>>(getCp());
+    case Lt: return std::make_shared<BQuickOper<Lt>>(getCp());
+    case Add: return std::make_shared<BQuickOper<Add>>(getCp());
+    case Sub: return std::make_shared<BQuickOper<Sub>>(getCp());
+    case Mul: return std::make_shared<BQuickOper<Mul>>(getCp());
+    case Div: return std::make_shared<BQuickOper<Div>>(getCp());
+  }
+  return nullptr;
+}
+
+std::shared_ptr<BInstruction> BPush::quicken() const {
+  switch (tag_) {
+    case Unit:
+      return std::make_shared<BQuickPush<::Tag::Unit>>(getCp(), value_);
+    case Bool:
+      return std::make_shared<BQuickPush<::Tag::Bool>>(getCp(), value_);
+    case Int:
+      return std::make_shared<BQuickPush<::Tag::Int>>(getCp(), value_);
+  }
+  return nullptr;
+}
+
+std::shared_ptr<BInstruction> BLookup::quicken() const {
+  switch (location_) {
+    case Location::Stack:
+      return std::make_shared<BQuickLookup<Location::Stack>>(getCp(), offset_);
+    case Location::Heap:
+      return std::make_shared<BQuickLookup<Location::Heap>>(getCp(), offset_);
+  }
+  return nullptr;
+}
+
+std::shared_ptr<BInstruction> BTest::quicken() const {
+  return std::make_shared<BQuickTest>(getCp(), destination_);
+}
@@ -0,0 +1,52 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include "b_handlers.h"
+#include "b_instruction.h"
+
+// Quickened instructions replace the generic ones in the code run by the
+// interpreter: each runs the handler specialized on its operation and operand
+// location, and falls back to the generic form when the handler's guard fails
+
+template<UnaryOp op>
+class BQuickUnary : public BUnary {
+ public:
+  explicit BQuickUnary(size_t cp);
+  void interpret(const VMPtr& vm) const;
+};
+
+template<BinaryOp op>
+class BQuickOper : public BOper {
+ public:
+  explicit BQuickOper(size_t cp);
+  void interpret(const VMPtr& vm) const;
+};
+
+template<::Tag tag>
+class BQuickPush : public BPush {
+ public:
+  BQuickPush(size_t cp, int value);
+  void interpret(const VMPtr& vm) const;
+ private:
+  const int32_t arg_;
+};
+
+template<VirtualMachine::Location location>
+class BQuickLookup : public BLookup {
+ public:
+  BQuickLookup(size_t cp, int offset);
+  void interpret(const VMPtr& vm) const;
+ private:
+  const int32_t arg_;
+};
+
+class BQuickTest : public BTest {
+ public:
+  BQuickTest(size_t cp, size_t destination);
+  void interpret(const VMPtr& vm) const;
+ private:
+  const int32_t arg_;
+};
+
+#include "b_quickened.tpp"
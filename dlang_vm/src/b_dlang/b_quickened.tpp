@@ -0,0 +1,75 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include "b_quickened.h"
+
+template<UnaryOp op>
+BQuickUnary<op>::BQuickUnary(size_t cp) : BUnary(cp, op) {}
+
+template<UnaryOp op>
+void BQuickUnary<op>::interpret(const VMPtr& vm) const {
+  BHandlerState state(vm.get());
+  if (BUnaryHandler<op>::run(state, 0)) {
+    state.commit();
+  } else {
+    BUnary::interpret(vm);
+  }
+}
+
+template<BinaryOp op>
+BQuickOper<op>::BQuickOper(size_t cp) : BOper(cp, op) {}
+
+template<BinaryOp op>
+void BQuickOper<op>::interpret(const VMPtr& vm) const {
+  BHandlerState state(vm.get());
+  if (BOperHandler<op>::run(state, 0)) {
+    state.commit();
+  } else {
+    BOper::interpret(vm);
+  }
+}
+
+template<::Tag tag>
+BQuickPush<tag>::BQuickPush(size_t cp, int value)
+    : BPush(cp,
+            tag == ::Tag::Unit ? BPush::Unit :
+            tag == ::Tag::Bool ? BPush::Bool : BPush::Int,
+            value),
+      arg_(value) {}
+
+template<::Tag tag>
+void BQuickPush<tag>::interpret(const VMPtr& vm) const {
+  BHandlerState state(vm.get());
+  if (BPushHandler<tag>::run(state, arg_)) {
+    state.commit();
+  } else {
+    BPush::interpret(vm);
+  }
+}
+
+template<VirtualMachine::Location location>
+BQuickLookup<location>::BQuickLookup(size_t cp, int offset)
+    : BLookup(cp, location, offset), arg_(offset) {}
+
+template<VirtualMachine::Location location>
+void BQuickLookup<location>::interpret(const VMPtr& vm) const {
+  BHandlerState state(vm.get());
+  if (BLookupHandler<location>::run(state, arg_)) {
+    state.commit();
+  } else {
+    BLookup::interpret(vm);
+  }
+}
+
+inline BQuickTest::BQuickTest(size_t cp, size_t destination)
+    : BTest(cp, destination), arg_(static_cast<int32_t>(destination)) {}
+
+inline void BQuickTest::interpret(const VMPtr& vm) const {
+  BHandlerState state(vm.get());
+  if (BTestHandler::run(state, arg_)) {
+    state.commit();
+  } else {
+    BTest::interpret(vm);
+  }
+}
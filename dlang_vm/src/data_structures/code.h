@@ -10,7 +10,8 @@ class Code {
  public:
   Code();
 
-  std::shared_ptr<T> getInstruction(int index) const;
+  const std::shared_ptr<T>& getInstruction(int index) const;
+  void setInstruction(int index, std::shared_ptr<T> instruction);
 
   size_t size() const;
   auto begin() const;
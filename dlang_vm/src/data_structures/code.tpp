@@ -8,10 +8,15 @@ template<typename T>
 Code<T>::Code() = default;
 
 template<typename T>
-std::shared_ptr<T> Code<T>::getInstruction(int index) const {
+const std::shared_ptr<T>& Code<T>::getInstruction(int index) const {
   return instructions_.at(index);
 }
 
+template<typename T>
+void Code<T>::setInstruction(int index, std::shared_ptr<T> instruction) {
+  instructions_.at(index) = instruction;
+}
+
 template<typename T>
 size_t Code<T>::size() const {
   return instructions_.size();
@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <deque>
 #include <unordered_map>
 #include <memory>
 #include <optional>
@@ -18,27 +19,33 @@ class Node {
   std::shared_ptr<T> getValue();
   void setValue(std::shared_ptr<T> val);
 
-  const std::vector<std::shared_ptr<Node>>& getSuccessors();
-  const std::vector<std::shared_ptr<Node>>& getPredecessors();
+  const std::vector<Node*>& getSuccessors();
+  const std::vector<Node*>& getPredecessors();
 
  private:
   size_t id_;
   std::shared_ptr<T> val_;
 
   friend FlowGraph<T>;
-  std::vector<std::shared_ptr<Node>> succ_;
-  std::vector<std::shared_ptr<Node>> pred_;
-  std::shared_ptr<Node> nextLine_ = nullptr;
+  std::vector<Node*> succ_;
+  std::vector<Node*> pred_;
+  Node* nextLine_ = nullptr;
 };
 
+// The nodes are owned by the graph, and freed all at once with it (the edges
+// between them are plain pointers)
 template<typename T>
 class FlowGraph {
  public:
   using ValPtr = std::shared_ptr<T>;
-  using NodePtr = std::shared_ptr<Node<T>>;
+  using NodePtr = Node<T>*;
   using Line = std::vector<NodePtr>;
   using Blocks = std::vector<std::vector<NodePtr>>;
 
+  FlowGraph() = default;
+  FlowGraph(const FlowGraph&) = delete;
+  FlowGraph& operator=(const FlowGraph&) = delete;
+
   void addNodeLine(int id, ValPtr val);
   void addNode(int id, ValPtr val);
   void addEdge(int id);
@@ -52,8 +59,9 @@ class FlowGraph {
   void connectEdges(NodePtr node);
   void addEdge(NodePtr nodeFrom, NodePtr nodeTo);
 
+  std::deque<Node<T>> nodes_;
   std::optional<int> startId_;
-  NodePtr lastNode_;
+  NodePtr lastNode_ = nullptr;
   std::unordered_map<size_t, NodePtr> idFirstNode_;
   std::unordered_map<size_t, std::vector<NodePtr>> missingEdges_;
 };
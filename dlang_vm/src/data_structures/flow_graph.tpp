@@ -23,12 +23,12 @@ void Node<T>::setValue(std::shared_ptr<T> val) {
 }
 
 template<typename T>
-const std::vector<std::shared_ptr<Node<T>>>& Node<T>::getSuccessors() {
+const std::vector<Node<T>*>& Node<T>::getSuccessors() {
   return succ_;
 }
 
 template<typename T>
-const std::vector<std::shared_ptr<Node<T>>>& Node<T>::getPredecessors() {
+const std::vector<Node<T>*>& Node<T>::getPredecessors() {
   return pred_;
 }
 
@@ -40,7 +40,7 @@ void FlowGraph<T>::addNodeLine(int id, ValPtr val) {
   }
 
   // Add the node to the graph
-  auto node = std::make_shared<Node<T>>(id, val);
+  auto node = &nodes_.emplace_back(id, val);
   if (lastNode_) {
     addEdge(lastNode_, node);
     lastNode_->nextLine_ = node;
@@ -59,7 +59,7 @@ void FlowGraph<T>::addNode(int id, ValPtr val) {
   }
 
   // Add the node to the graph
-  auto node = std::make_shared<Node<T>>(id, val);
+  auto node = &nodes_.emplace_back(id, val);
   lastNode_ = node;
 
   // Connect the edges
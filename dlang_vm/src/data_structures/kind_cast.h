@@ -0,0 +1,15 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include <memory>
+
+// Cast to a derived class checked on the kind carried by the object, instead
+// of through RTTI (T::isKind tells the kinds of the objects of class T)
+template<typename T, typename U>
+std::shared_ptr<T> kindCast(const std::shared_ptr<U>& ptr) {
+  if (!ptr || !T::isKind(ptr->getKind())) {
+    return nullptr;
+  }
+  return std::static_pointer_cast<T>(ptr);
+}
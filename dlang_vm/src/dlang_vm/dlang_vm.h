@@ -2,7 +2,13 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include "execution_statistics.h"
@@ -12,6 +18,7 @@
 #include "../jit/jit_state.h"
 #include "../jit_policies/jit_policy.h"
 #include "../optimizations/optimizations_sequence.h"
+#include "../threaded_interpreter/threaded_interpreter.h"
 #include "../virtual_machine/virtual_machine.h"
 
 enum LogLevel {
@@ -28,15 +35,49 @@ class DlangVM {
   DlangVM(const Code<BInstruction>& code,
           std::shared_ptr<JITPolicy> jitPolicy,
           std::shared_ptr<MemoryManager> memoryManager,
-          std::shared_ptr<OptimizationsSequence> optimizationsSequence);
+          std::shared_ptr<OptimizationsSequence> optimizationsSequence,
+          std::shared_ptr<ThreadedInterpreter> threadedInterpreter = nullptr,
+          bool backgroundJIT = false);
 
   int run();
 
  private:
   void vmLoop();
 
-  // Code of the DLANG program
-  const Code<BInstruction>& code_;
+  // Interprets the whole program, if the jit policy never compiles
+  void interpretLoop();
+
+  // Runs compiled code, chaining the compiled regions
+  void runCompiled();
+
+  // Stores the tags of the current frame, when a trace starts being recorded
+  void observeFrame();
+
+  // Compiled code for a jit sequence starting at cp
+  struct Compilation {
+    size_t cp;
+    JITSequence jitSequence;
+    Code<UInstruction> uCode;
+    Code<UInstruction> uCodeOptimized;
+    Code<UInstruction> uCodeSpecialized;
+    std::shared_ptr<CompiledInstructions> compiled;
+    int64_t compilationTimeNS;
+  };
+
+  // Generates, optimizes and compiles the u-code (on any thread)
+  Compilation compile(size_t startCp, const JITSequence& jitSequence);
+
+  // Stores the compiled code for all its entry points (on the vm thread)
+  void install(const Compilation& compilation);
+
+  // Compile thread: takes the requested sequences and publishes the results,
+  // which the vm thread installs while interpreting
+  void requestCompilation(size_t cp, const JITSequence& jitSequence);
+  void installCompiled();
+  void compileLoop();
+
+  // Code of the DLANG program, with the instructions quickened in place
+  Code<BInstruction> code_;
 
   // Virtual Machine used by the program
   std::shared_ptr<VirtualMachine> vm_ = std::make_shared<VirtualMachine>();
@@ -44,10 +85,37 @@ class DlangVM {
   // Structure holding JIT compiled instructions
   std::vector<std::shared_ptr<CompiledInstructions>> compiled_;
 
+  // Addresses of the compiled code, for the native calls of compiled code
+  std::vector<void*> compiledCode_;
+
   std::shared_ptr<JITPolicy> jitPolicy_;
+  const bool profilesCalls_;
   std::shared_ptr<MemoryManager> memoryManager_;
   std::shared_ptr<OptimizationsSequence> optimizationsSequence_;
 
+  // If present, it runs the whole program instead of vmLoop
+  std::shared_ptr<ThreadedInterpreter> threadedInterpreter_;
+
+  // State shared with the compile thread (if compiling in the background)
+  const bool backgroundJIT_;
+  std::thread compileThread_;
+  std::mutex compileMutex_;
+  std::condition_variable compileRequested_;
+  std::deque<std::pair<size_t, JITSequence>> compileRequests_;
+  std::vector<Compilation> compileResults_;
+  std::atomic<bool> hasCompileResults_ = false;
+  bool stopCompiling_ = false;
+
+  // Cps whose sequence is being compiled in the background
+  std::vector<bool> compilePending_;
+
+  // Tags of the frame observed when the last trace started being recorded,
+  // from the item at fp + recordingOffset_ (if types are specialized)
+  const bool specializesTypes_;
+  size_t recordingCp_ = 0;
+  int recordingOffset_ = 0;
+  std::vector<Tag> recordingTags_;
+
   // Objects storing execution information
   ExecutionStatistics statistics_;
   Timer timer_;
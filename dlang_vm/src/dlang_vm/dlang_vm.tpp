@@ -5,6 +5,7 @@
 #include "dlang_vm.h"
 
 #include <iostream>
+#include <unordered_map>
 
 #include "../t_dlang/t_instruction.h"
 #include "../t_dlang/out/t_instruction_out.h"
@@ -18,13 +19,29 @@ template<LogLevel logLevel>
 DlangVM<logLevel>::DlangVM(const Code<BInstruction>& code,
                  std::shared_ptr<JITPolicy> jitPolicy,
                  std::shared_ptr<MemoryManager> memoryManager,
-                 std::shared_ptr<OptimizationsSequence> optimizationsSequence)
+                 std::shared_ptr<OptimizationsSequence> optimizationsSequence,
+                 std::shared_ptr<ThreadedInterpreter> threadedInterpreter,
+                 bool backgroundJIT)
     : code_(code),
       compiled_(code_.size()),
+      compiledCode_(code_.size()),
       statistics_(code_.size()),
       jitPolicy_(jitPolicy),
+      profilesCalls_(jitPolicy->profilesCalls()),
       memoryManager_(memoryManager),
-      optimizationsSequence_(optimizationsSequence) {}
+      optimizationsSequence_(optimizationsSequence),
+      threadedInterpreter_(threadedInterpreter),
+      backgroundJIT_(backgroundJIT),
+      compilePending_(code_.size()),
+      specializesTypes_(optimizationsSequence->getTypeSpecialization()) {
+  // The specialized forms depend only on the operands of the instructions,
+  // so they replace the generic ones when the code is loaded
+  for (size_t cp = 0; cp < code_.size(); cp++) {
+    if (auto quickened = code_.getInstruction(cp)->quicken()) {
+      code_.setInstruction(cp, quickened);
+    }
+  }
+}
 
 template<LogLevel logLevel>
 int DlangVM<logLevel>::run() {
@@ -35,13 +52,31 @@ int DlangVM<logLevel>::run() {
   vm_->stack.set(1, {Tag::ReturnAddress, 0});
   vm_->sp = 2;
 
+  // Let compiled code call other compiled code
+  JITVM::compiledCode = compiledCode_.data();
+
   // Get start time for timing statistics
   if constexpr (logLevel >= Time) {
     timer_.start();
   }
 
   // Run the Virtual Machine
-  vmLoop();
+  if (threadedInterpreter_) {
+    threadedInterpreter_->run(vm_, memoryManager_);
+  } else if (!jitPolicy_->compiles()) {
+    interpretLoop();
+  } else if (backgroundJIT_) {
+    compileThread_ = std::thread(&DlangVM::compileLoop, this);
+    vmLoop();
+    {
+      std::lock_guard<std::mutex> lock(compileMutex_);
+      stopCompiling_ = true;
+    }
+    compileRequested_.notify_one();
+    compileThread_.join();
+  } else {
+    vmLoop();
+  }
 
   // Print timing statistics
   if constexpr (logLevel >= Time) {
@@ -77,74 +112,291 @@ void DlangVM<logLevel>::vmLoop() {
       std::cerr << Out::print(vm_);
     }
 
-    // Run Garbage Collection
-    memoryManager_->collectGarbage(vm_);
+    // Run Garbage Collection (compiled code returns here when hp reaches the
+    // limit before allocating)
+    if (vm_->hp >= vm_->hpLimit) {
+      memoryManager_->collectGarbage(vm_);
+    }
 
-    // Count landings for this instruction
+    // Count landings for this instruction (observing the frame when a trace
+    // starts being recorded here, to specialize it)
+    bool isObserving = specializesTypes_ && !jitPolicy_->isRecording();
     jitPolicy_->notifyLanding(vm_->cp);
+    if (isObserving && jitPolicy_->isRecording()) {
+      observeFrame();
+    }
+
+    // Install the code compiled in the background since the last instruction
+    if (hasCompileResults_.load(std::memory_order_acquire)) {
+      installCompiled();
+    }
 
-    if (!compiled_[vm_->cp]) {
-      // Get the jit compilation policy
+    // The sequence at cp is built once when it is queued for compilation,
+    // the landings until its result is installed keep interpreting
+    bool isPending = compilePending_[vm_->cp];
+    if ((!compiled_[vm_->cp] && !isPending) || jitPolicy_->isRecording()) {
+      // Get the jit compilation policy (also at compiled code while recording,
+      // since recorded sequences end there)
       auto jitSequence = jitPolicy_->makeJITSequence(code_, vm_->cp);
 
+      // Compile now, or keep interpreting while it is compiled
       if (!jitSequence.isEmpty()) {
-        // Create u-code instructions
-        Code<UInstruction> uCode;
-        for (auto cp : jitSequence.getCps()) {
-          uCode += code_.getInstruction(cp)->getUInstructions(vm_);
+        auto startCp = jitSequence.getCps().front();
+        if (specializesTypes_ && startCp == recordingCp_) {
+          jitSequence.setEntryTags(recordingOffset_, recordingTags_);
         }
-
-        // Optimize u-code
-        Code<UInstruction> uCodeOptimized;
-        if (jitSequence.isFunction()) {
-          uCodeOptimized = optimizationsSequence_->optimizeFunction(uCode);
+        if (backgroundJIT_) {
+          requestCompilation(startCp, jitSequence);
         } else {
-          uCodeOptimized = optimizationsSequence_->optimizeTrace(uCode);
-        }
-
-        // Compile u-code while keeping group-level jit state
-        auto jit = std::make_shared<JITState>(jitSequence, vm_);
-        for (auto uInstruction : uCodeOptimized) {
-          uInstruction->jitCompile(vm_, jit);
-        }
-
-        // Store the pointer for the main and all secondary entry points
-        compiled_[vm_->cp] =
-            std::make_shared<CompiledInstructions>(jit->compile(vm_));
-        statistics_.addCompiled(vm_->cp, jitSequence.getCps().size());
-        for (const auto& [cp, size] : jitSequence.getEntryPoints()) {
-          compiled_[cp] = compiled_[vm_->cp];
-          statistics_.addCompiled(cp, size);
-        }
-
-        // Print compilation statistics
-        if constexpr (logLevel >= Statistics) {
-          std::cout << "Compiled instructions: ";
-          for (auto cp : jitSequence.getCps()) {
-            std::cout << cp << " ";
-          }
-          std::cout << std::endl;
-          std::cout << Out::print(uCode) << std::endl;
-          std::cout << Out::print(uCodeOptimized) << std::endl;
-          std::cout << "Original code size: " << uCode.size() << std::endl;
-          std::cout << "Optimized code size: " << uCodeOptimized.size()
-                    << std::endl << std::endl;
+          install(compile(startCp, jitSequence));
         }
       }
     }
 
     // Interpret the instruction or run its compiled code
     if (compiled_[vm_->cp]) {
-      statistics_.countRunJIT(vm_->cp);
-      jitPolicy_->notifyRunJIT(vm_->cp);
-      compiled_[vm_->cp]->run();
+      runCompiled();
     } else {
       statistics_.countInterpreted(vm_->cp);
+      auto cp = vm_->cp;
+      const auto& instruction = code_.getInstruction(cp);
       try {
-        code_.getInstruction(vm_->cp)->interpret(vm_);
+        instruction->interpret(vm_);
       } catch (const RuntimeError&) {
         vm_->status = VirtualMachine::Status::RuntimeError;
       }
+
+      // Profile the closures applied at each call site, if the policy uses
+      // them (checking first for a jump, which is cheaper than the cast)
+      if (profilesCalls_ && vm_->cp != cp + 1 &&
+          vm_->status == VirtualMachine::Running &&
+          kindCast<BApply>(instruction)) {
+        jitPolicy_->notifyCall(cp, vm_->cp);
+      }
+    }
+  }
+}
+
+template<LogLevel logLevel>
+void DlangVM<logLevel>::interpretLoop() {
+  // Nothing is compiled, so the policy is not notified of the landings
+  while (vm_->status == VirtualMachine::Running) {
+    if constexpr (logLevel >= Debug) {
+      std::cerr << Out::print(vm_);
+    }
+    if (vm_->hp >= vm_->hpLimit) {
+      memoryManager_->collectGarbage(vm_);
+    }
+    statistics_.countInterpreted(vm_->cp);
+    try {
+      code_.getInstruction(vm_->cp)->interpret(vm_);
+    } catch (const RuntimeError&) {
+      vm_->status = VirtualMachine::Status::RuntimeError;
     }
   }
 }
+
+template<LogLevel logLevel>
+void DlangVM<logLevel>::runCompiled() {
+  // When a region exits to a cp that is also compiled, run that region
+  // directly, going back to the vm loop (and the interpreter) only when the
+  // code is not compiled, when a collection is needed, or when the jit policy
+  // is recording landings
+  do {
+    statistics_.countRunJIT(vm_->cp);
+    jitPolicy_->notifyRunJIT(vm_->cp);
+    compiled_[vm_->cp]->run();
+  } while (logLevel < Debug && vm_->status == VirtualMachine::Running &&
+           compiled_[vm_->cp] && vm_->hp < vm_->hpLimit &&
+           !jitPolicy_->isRecording());
+}
+
+template<LogLevel logLevel>
+void DlangVM<logLevel>::observeFrame() {
+  // The items from the argument of the function to the top of the stack
+  auto first = vm_->fp >= 2 ? vm_->fp - 2 : 0;
+  recordingCp_ = vm_->cp;
+  recordingOffset_ = static_cast<int>(first) - static_cast<int>(vm_->fp);
+  recordingTags_.clear();
+  for (auto i = first; i < vm_->sp; i++) {
+    recordingTags_.push_back(vm_->stack.get(i).tag);
+  }
+}
+
+template<LogLevel logLevel>
+typename DlangVM<logLevel>::Compilation
+    DlangVM<logLevel>::compile(size_t startCp,
+                               const JITSequence& jitSequence) {
+  // Time the compilation for the statistics
+  Timer timer;
+  if constexpr (logLevel >= Statistics) {
+    timer.start();
+  }
+
+  // Create u-code instructions
+  Code<UInstruction> uCode;
+  for (auto cp : jitSequence.getCps()) {
+    uCode += code_.getInstruction(cp)->getUInstructions(vm_);
+  }
+
+  // Optimize u-code
+  Code<UInstruction> uCodeOptimized;
+  if (jitSequence.isFunction()) {
+    uCodeOptimized = optimizationsSequence_->optimizeFunction(uCode);
+  } else {
+    uCodeOptimized = optimizationsSequence_->optimizeTrace(uCode);
+  }
+
+  // Place the code of each inlined callee after its call (optimized on its
+  // own, as if it was compiled separately), the cp check at the label of the
+  // callee guards the code index of the applied closure
+  if (!jitSequence.getInlined().empty()) {
+    std::unordered_map<size_t, Code<UInstruction>> calleesUCode;
+    for (const auto& [cp, calleeCps] : jitSequence.getInlined()) {
+      Code<UInstruction> calleeUCode;
+      for (auto calleeCp : calleeCps) {
+        calleeUCode += code_.getInstruction(calleeCp)->getUInstructions(vm_);
+      }
+      calleesUCode[cp] = optimizationsSequence_->optimizeFunction(calleeUCode);
+    }
+    Code<UInstruction> uCodeInlined;
+    for (const auto& uInstruction : uCodeOptimized) {
+      uCodeInlined.add(uInstruction);
+      if (kindCast<UApply>(uInstruction) &&
+          calleesUCode.count(uInstruction->cp)) {
+        uCodeInlined += calleesUCode.at(uInstruction->cp);
+      }
+    }
+    uCodeOptimized = uCodeInlined;
+  }
+
+  // Specialize traces on the tags observed when they were recorded, the
+  // guards are placed after the label at the start of the trace
+  Code<UInstruction> guards, uCodeSpecialized;
+  auto typeSpecialization = optimizationsSequence_->getTypeSpecialization();
+  if (typeSpecialization) {
+    guards = typeSpecialization->makeGuards(uCode, jitSequence);
+  }
+  if (guards.size() > 0) {
+    auto uCodeBody = optimizationsSequence_->optimizeTrace(uCode, guards);
+    auto label = kindCast<ULabel>(uCodeBody.getInstruction(0));
+    if (label && label->cp == startCp) {
+      uCodeSpecialized.add(label);
+      uCodeSpecialized += guards;
+      for (size_t i = 1; i < uCodeBody.size(); i++) {
+        uCodeSpecialized.add(uCodeBody.getInstruction(i));
+      }
+    }
+  }
+
+  // Compile u-code while keeping group-level jit state, the specialized code
+  // comes first, and the unspecialized code runs if a guard fails
+  auto jit = std::make_shared<JITState>(jitSequence, vm_);
+  if (uCodeSpecialized.size() > 0) {
+    bool isLoopInvariant =
+        typeSpecialization->isLoopInvariant(uCode, guards, jitSequence);
+    for (size_t i = 0; i < uCodeSpecialized.size(); i++) {
+      uCodeSpecialized.getInstruction(i)->jitCompile(vm_, jit);
+      if (i == guards.size() && isLoopInvariant) {
+        jit->skipGuards(startCp);
+      }
+    }
+    jit->startUnspecialized();
+  }
+  for (auto uInstruction : uCodeOptimized) {
+    uInstruction->jitCompile(vm_, jit);
+  }
+  auto compiled = std::make_shared<CompiledInstructions>(jit->compile(vm_));
+
+  if constexpr (logLevel >= Statistics) {
+    timer.stop();
+  }
+  return {startCp, jitSequence, uCode, uCodeOptimized, uCodeSpecialized,
+          compiled, timer.getDurationNS()};
+}
+
+template<LogLevel logLevel>
+void DlangVM<logLevel>::install(const Compilation& compilation) {
+  const auto& jitSequence = compilation.jitSequence;
+
+  // Store the pointer for the main and all secondary entry points
+  compiled_[compilation.cp] = compilation.compiled;
+  compiledCode_[compilation.cp] = compilation.compiled->getAddress();
+  statistics_.addCompiled(compilation.cp, jitSequence.getCps().size());
+  statistics_.addCompilationTime(compilation.compilationTimeNS);
+  for (const auto& [cp, size] : jitSequence.getEntryPoints()) {
+    compiled_[cp] = compilation.compiled;
+    compiledCode_[cp] = compilation.compiled->getAddress();
+    statistics_.addCompiled(cp, size);
+  }
+
+  // Print compilation statistics
+  if constexpr (logLevel >= Statistics) {
+    std::cout << "Compiled instructions: ";
+    for (auto cp : jitSequence.getCps()) {
+      std::cout << cp << " ";
+    }
+    std::cout << std::endl;
+    std::cout << Out::print(compilation.uCode) << std::endl;
+    std::cout << Out::print(compilation.uCodeOptimized) << std::endl;
+    if (compilation.uCodeSpecialized.size() > 0) {
+      std::cout << Out::print(compilation.uCodeSpecialized) << std::endl;
+    }
+    std::cout << "Original code size: " << compilation.uCode.size()
+              << std::endl;
+    std::cout << "Optimized code size: "
+              << compilation.uCodeOptimized.size() << std::endl << std::endl;
+  }
+}
+
+template<LogLevel logLevel>
+void DlangVM<logLevel>::requestCompilation(size_t cp,
+                                           const JITSequence& jitSequence) {
+  // The same cp is not compiled twice
+  if (compilePending_[cp]) {
+    return;
+  }
+  compilePending_[cp] = true;
+  {
+    std::lock_guard<std::mutex> lock(compileMutex_);
+    compileRequests_.emplace_back(cp, jitSequence);
+  }
+  compileRequested_.notify_one();
+}
+
+template<LogLevel logLevel>
+void DlangVM<logLevel>::installCompiled() {
+  std::vector<Compilation> compilations;
+  {
+    std::lock_guard<std::mutex> lock(compileMutex_);
+    compilations.swap(compileResults_);
+    hasCompileResults_.store(false, std::memory_order_relaxed);
+  }
+  for (const auto& compilation : compilations) {
+    compilePending_[compilation.cp] = false;
+    install(compilation);
+  }
+}
+
+template<LogLevel logLevel>
+void DlangVM<logLevel>::compileLoop() {
+  std::unique_lock<std::mutex> lock(compileMutex_);
+  while (true) {
+    compileRequested_.wait(lock, [this] {
+      return stopCompiling_ || !compileRequests_.empty();
+    });
+    if (stopCompiling_) {
+      return;
+    }
+    auto [cp, jitSequence] = compileRequests_.front();
+    compileRequests_.pop_front();
+
+    // Compile without holding the lock, so the vm thread is never blocked
+    lock.unlock();
+    auto compilation = compile(cp, jitSequence);
+    lock.lock();
+
+    compileResults_.push_back(compilation);
+    hasCompileResults_.store(true, std::memory_order_release);
+  }
+}
@@ -11,6 +11,11 @@ void ExecutionStatistics::addCompiled(size_t cp, size_t size) {
   length_[cp] = size;
 }
 
+void ExecutionStatistics::addCompilationTime(int64_t durationNS) {
+  compilationsCount_++;
+  compilationTime_ += durationNS;
+}
+
 void ExecutionStatistics::countRunJIT(size_t cp) {
   compiledCount_ += length_[cp];
   compiledUsage_[cp]++;
@@ -39,3 +44,11 @@ size_t ExecutionStatistics::getInterpretedCount() const {
 size_t ExecutionStatistics::getCompiledCount() const {
   return compiledCount_;
 }
+
+size_t ExecutionStatistics::getCompilationsCount() const {
+  return compilationsCount_;
+}
+
+int64_t ExecutionStatistics::getCompilationTimeNS() const {
+  return compilationTime_;
+}
@@ -3,6 +3,7 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -12,6 +13,8 @@ class ExecutionStatistics {
 
   void addCompiled(size_t cp, size_t size);
 
+  void addCompilationTime(int64_t durationNS);
+
   void countRunJIT(size_t cp);
   void countInterpreted(size_t cp);
 
@@ -20,6 +23,8 @@ class ExecutionStatistics {
   size_t getCompiledUsage(size_t cp) const;
   size_t getInterpretedCount() const;
   size_t getCompiledCount() const;
+  size_t getCompilationsCount() const;
+  int64_t getCompilationTimeNS() const;
 
  private:
   size_t codeSize_;
@@ -27,4 +32,6 @@ class ExecutionStatistics {
   std::vector<size_t> compiledUsage_;
   size_t interpretedCount_ = 0;
   size_t compiledCount_ = 0;
+  size_t compilationsCount_ = 0;
+  int64_t compilationTime_ = 0;
 };
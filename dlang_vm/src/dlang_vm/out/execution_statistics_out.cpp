@@ -12,6 +12,10 @@ std::string Out::print(const ExecutionStatistics& statistics) {
                      statistics.getInterpretedCount()) + "\n";
   str += printSpaced("Total number of compiled instructions executed:",
                      statistics.getCompiledCount()) + "\n";
+  str += printSpaced("Total number of compilations:",
+                     statistics.getCompilationsCount()) + "\n";
+  str += printSpaced("Total compilation time (us):",
+                     statistics.getCompilationTimeNS() / 1'000) + "\n";
   str += printSpaced("Usage of compiled instructions:") + "\n";
   str += printRow(10, "", "cp", "length", "compiled") + "\n";
   for (int cp = 0; cp < statistics.getCodeSize(); cp++) {
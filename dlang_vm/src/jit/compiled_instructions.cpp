@@ -2,9 +2,15 @@
 
 #include "compiled_instructions.h"
 
-CompiledInstructions::CompiledInstructions(void* compiledFunction)
-    : compiledFunction_((VoidFunction) compiledFunction) {}
+CompiledInstructions::CompiledInstructions(
+    void* compiledFunction, std::shared_ptr<std::vector<void*>> entryTable)
+    : compiledFunction_((VoidFunction) compiledFunction),
+      entryTable_(entryTable) {}
 
 void CompiledInstructions::run() {
   compiledFunction_();
 }
+
+void* CompiledInstructions::getAddress() const {
+  return reinterpret_cast<void*>(compiledFunction_);
+}
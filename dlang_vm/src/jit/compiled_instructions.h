@@ -2,13 +2,24 @@
 
 #pragma once
 
+#include <memory>
+#include <vector>
+
 // A group of jit compiled instructions
 class CompiledInstructions {
  public:
-  explicit CompiledInstructions(void* compiled_function);
+  explicit CompiledInstructions(
+      void* compiledFunction,
+      std::shared_ptr<std::vector<void*>> entryTable = nullptr);
   void run();
 
+  // Address of the compiled function, which can be called by compiled code
+  void* getAddress() const;
+
  private:
   typedef void (*VoidFunction)();
   VoidFunction compiledFunction_;
+
+  // Addresses of the entry points, read by the compiled code
+  std::shared_ptr<std::vector<void*>> entryTable_;
 };
@@ -9,6 +9,6 @@ extern "C" {
 // Static class providing utilities for common operations in JIT compilation
 class JIT {
  protected:
-  // State of the current JIT context
-  inline static jit_state_t* _jit;
+  // State of the current JIT context (each thread compiles its own code)
+  inline static thread_local jit_state_t* _jit;
 };
@@ -7,12 +7,10 @@
 
 JITState::JITState(const JITSequence& jitSequence,
                    std::shared_ptr<VirtualMachine> vm)
-    : cps_(jitSequence.getCps()) {
+    : cps_(jitSequence.getCompiledCps()),
+      isFunction_(jitSequence.isFunction()) {
   // Initialize jit compilation the first time
-  if (!jitInitialized_) {
-    jitInitialized_ = true;
-    init_jit(nullptr);
-  }
+  std::call_once(jitInitialized_, [] { init_jit(nullptr); });
 
   // Create a new jit_state_t object
   _jit = jit_new_state();
@@ -24,20 +22,60 @@ JITState::JITState(const JITSequence& jitSequence,
   jit_frame(0);
 
   // Load vm state into registers
-  jit_ldi(JITVM::sp, &vm->sp);
-  jit_ldi(JITVM::fp, &vm->fp);
-  jit_ldi(JITVM::cp, &vm->cp);
-  jit_ldi(JITVM::hp, &vm->hp);
+  JITVM::loadState(vm);
+
+  for (const auto& [cp, _] : jitSequence.getInlined()) {
+    inlinedCalls_.push_back(cp);
+  }
 
+  // The code is entered at the first cp, unless there are other entry points
+  knownCp_ = cps_.front();
   for (const auto& [cp, _] : jitSequence.getEntryPoints()) {
-    addDirectBranch(jit_beqi(JITVM::cp, cp), cp);
+    entryPoints_.push_back(cp);
   }
+  if (entryPoints_.empty()) {
+    return;
+  }
+
+  // Otherwise jump to the entry point through a table indexed by cp
+  entryPoints_.push_back(cps_.front());
+  entryTableBase_ = *std::min_element(entryPoints_.begin(), entryPoints_.end());
+  auto entryTableSize =
+      *std::max_element(entryPoints_.begin(), entryPoints_.end()) -
+      entryTableBase_ + 1;
+  entryTable_ = std::make_shared<std::vector<void*>>(entryTableSize);
+  jit_subi(JITVM::tmp, JITVM::cp, entryTableBase_);
+  jit_lshi(JITVM::tmp, JITVM::tmp, __builtin_ctz(sizeof(void*)));
+  jit_addi(JITVM::tmp, JITVM::tmp, (jit_word_t) entryTable_->data());
+  jit_ldr(JITVM::tmp, JITVM::tmp);
+  jit_jmpr(JITVM::tmp);
 }
 
 void JITState::addLabel(size_t cp, jit_node_t* label) {
   labels_.insert({cp, label});
 }
 
+bool JITState::isEntryPoint(size_t cp) const {
+  return std::find(entryPoints_.begin(), entryPoints_.end(), cp) !=
+         entryPoints_.end();
+}
+
+bool JITState::needsCpCheck(size_t cp) {
+  // Every instruction falls through with cp + 1, or its cp if it is the same
+  bool needsCheck = !knownCp_ || (*knownCp_ != cp && *knownCp_ + 1 != cp);
+  knownCp_ = cp;
+  return needsCheck;
+}
+
+bool JITState::callsNatively(size_t cp) const {
+  return isFunction_ && std::find(inlinedCalls_.begin(), inlinedCalls_.end(),
+                                  cp) == inlinedCalls_.end();
+}
+
+void JITState::setCpUnknown() {
+  knownCp_.reset();
+}
+
 void JITState::addDirectBranch(jit_node_t* label, size_t cp) {
   if (std::find(cps_.begin(), cps_.end(), cp) != cps_.end()) {
     internalBranches_.push_back({label, cp});
@@ -50,16 +88,75 @@ void JITState::addIndirectBranch(jit_node_t* label) {
   externalBranches_.push_back(label);
 }
 
-void JITState::addRuntimeErrorBranch(jit_node_t* label) {
-  runtimeErrorBranches_.push_back(label);
+void JITState::addRuntimeErrorBranch(jit_node_t* label,
+                                     std::optional<ErrorState> state) {
+  runtimeErrorBranches_.push_back({label, state});
+}
+
+void JITState::addAllocationBranch(jit_node_t* label, jit_node_t* retry,
+                                   Memory* memory,
+                                   std::optional<ErrorState> state) {
+  allocationBranches_.push_back({label, retry, memory, state});
+}
+
+void JITState::addGuardBranch(jit_node_t* label) {
+  guardBranches_.push_back(label);
+}
+
+void JITState::skipGuards(size_t cp) {
+  labels_[cp] = jit_label();
+}
+
+void JITState::startUnspecialized() {
+  // The specialized code never falls through to the unspecialized code
+  addIndirectBranch(jit_jmpi());
+
+  // Patch the branches of the specialized code to its labels
+  for (const auto& [source, destCp] : internalBranches_) {
+    jit_patch_at(source, labels_.at(destCp));
+  }
+  internalBranches_.clear();
+  labels_.clear();
+
+  // Guards fail at the start of the code, where cp is the first cp
+  auto label = jit_label();
+  for (const auto& source : guardBranches_) {
+    jit_patch_at(source, label);
+  }
+  guardBranches_.clear();
+  knownCp_ = cps_.front();
 }
 
 CompiledInstructions JITState::compile(std::shared_ptr<VirtualMachine> vm) {
   // Skip error handling if no error has occurred
   auto noErrorJump = jit_jmpi();
 
+  // Allocate memory out of line, and retry the bounds check (the memory may
+  // have moved)
+  for (const auto& [source, retry, memory, state] : allocationBranches_) {
+    jit_patch(source);
+    JITVM::call(JITVM::tmp, Memory::allocateStatic, memory);
+    addRuntimeErrorBranch(jit_bnei(JITVM::tmp, 0), state);
+    JITVM::loadData(vm);
+    jit_patch_at(jit_jmpi(), retry);
+  }
+
+  // Restore the state of the vm where moved checks fail (sp is scaled)
+  std::vector<jit_node_t*> restoredBranches;
+  for (const auto& [source, state] : runtimeErrorBranches_) {
+    if (!state) { continue; }
+    jit_patch(source);
+    jit_movi(JITVM::cp, state->cp);
+    jit_addi(JITVM::sp, JITVM::sp,
+             state->spDelta * static_cast<jit_word_t>(sizeof(Cell)));
+    restoredBranches.push_back(jit_jmpi());
+  }
+
   // Patch all branches caused by runtime errors
-  for (const auto& source : runtimeErrorBranches_) {
+  for (const auto& [source, state] : runtimeErrorBranches_) {
+    if (!state) { jit_patch(source); }
+  }
+  for (const auto& source : restoredBranches) {
     jit_patch(source);
   }
 
@@ -71,7 +168,7 @@ CompiledInstructions JITState::compile(std::shared_ptr<VirtualMachine> vm) {
   jit_patch(noErrorJump);
 
   // Create a label at the end of the group of code
-  auto endLabel = jit_label();
+  auto endLabel = entryTable_ ? jit_indirect() : jit_label();
 
   // Patch all branches whose destination is inside the group of code
   for (const auto& [source, destCp] : internalBranches_) {
@@ -84,14 +181,19 @@ CompiledInstructions JITState::compile(std::shared_ptr<VirtualMachine> vm) {
   }
 
   // Restore vm state from registers
-  jit_sti(&vm->sp, JITVM::sp);
-  jit_sti(&vm->fp, JITVM::fp);
-  jit_sti(&vm->cp, JITVM::cp);
-  jit_sti(&vm->hp, JITVM::hp);
+  JITVM::storeState(vm);
 
   // Compile group of code and save its address
   jit_epilog();
-  auto compiled = CompiledInstructions(jit_emit());
+  auto compiled = CompiledInstructions(jit_emit(), entryTable_);
+
+  // Fill the entry table, cps which are not entry points leave the code
+  if (entryTable_) {
+    std::fill(entryTable_->begin(), entryTable_->end(), jit_address(endLabel));
+    for (auto cp : entryPoints_) {
+      (*entryTable_)[cp - entryTableBase_] = jit_address(labels_.at(cp));
+    }
+  }
   jit_clear_state();
   return compiled;
 }
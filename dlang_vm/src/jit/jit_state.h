@@ -3,6 +3,9 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <tuple>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -20,7 +23,19 @@ class JITState : public JIT {
   void addLabel(size_t cp, jit_node_t* label);
 
   // Entry points are the possible values of JITVM::cp when the code is called
-  std::vector<size_t> getEntryPoints() const;
+  // (their labels are reached through the entry table, so they are indirect)
+  bool isEntryPoint(size_t cp) const;
+
+  // True if JITVM::cp can differ from cp when reaching its label, that is if
+  // the code before it can set cp to something other than the next cp
+  bool needsCpCheck(size_t cp);
+
+  // True if the call at cp is followed by the code of the caller (in traces
+  // and for inlined calls it is followed by the callee instead)
+  bool callsNatively(size_t cp) const;
+
+  // The value of JITVM::cp is not known after calls, returns and halts
+  void setCpUnknown();
 
   // Add a branch with fixed destination
   void addDirectBranch(jit_node_t* label, size_t cp);
@@ -28,24 +43,67 @@ class JITState : public JIT {
   // Add a branch with non-fixed destination
   void addIndirectBranch(jit_node_t* label);
 
-  // Add a branch to the runtime error handling code
-  void addRuntimeErrorBranch(jit_node_t* label);
+  // State of the vm where a check moved away from its cp fails: cp, and the
+  // distance of sp there from sp where the check runs
+  struct ErrorState {
+    size_t cp;
+    int spDelta;
+  };
+
+  // Add a branch to the runtime error handling code, which restores state
+  // first if given
+  void addRuntimeErrorBranch(jit_node_t* label,
+                             std::optional<ErrorState> state = {});
+
+  // Add a branch to code emitted out of line, which allocates more memory
+  // and jumps back to retry (the allocation is rarely needed)
+  void addAllocationBranch(jit_node_t* label, jit_node_t* retry,
+                           Memory* memory,
+                           std::optional<ErrorState> state = {});
+
+  // Add a branch taken when a type guard fails, to the unspecialized code
+  void addGuardBranch(jit_node_t* label);
+
+  // Branches to cp in the specialized code skip the type guards emitted so
+  // far (the guarded tags are known to hold when jumping back to cp)
+  void skipGuards(size_t cp);
+
+  // Ends the specialized code, the following code runs when a guard fails,
+  // and its branches go to its own labels
+  void startUnspecialized();
 
   // JIT Compile the emitted instructions
   CompiledInstructions compile(std::shared_ptr<VirtualMachine> vm);
 
  private:
-  // Code pointers for this instruction
+  // Code pointers for this instruction (including inlined callees)
   const std::vector<size_t> cps_;
 
   // Labels for this code section
   std::unordered_map<size_t, jit_node_t*> labels_;
 
+  // Entry points, and the table of their addresses indexed by cp - base
+  // (it is shared with the compiled code, which reads it when called)
+  std::vector<size_t> entryPoints_;
+  std::shared_ptr<std::vector<void*>> entryTable_;
+  size_t entryTableBase_ = 0;
+
+  // Kind of sequence, and calls followed by the inlined callee
+  const bool isFunction_;
+  std::vector<size_t> inlinedCalls_;
+
+  // Value of JITVM::cp when falling through the last label, if known
+  std::optional<size_t> knownCp_;
+
   // Branches into the code, outside of the code or to the error handler
   std::vector<std::pair<jit_node_t*, size_t>> internalBranches_;
   std::vector<jit_node_t*> externalBranches_;
-  std::vector<jit_node_t*> runtimeErrorBranches_;
+  std::vector<std::pair<jit_node_t*, std::optional<ErrorState>>>
+      runtimeErrorBranches_;
+  std::vector<jit_node_t*> guardBranches_;
+  std::vector<std::tuple<jit_node_t*, jit_node_t*, Memory*,
+                         std::optional<ErrorState>>> allocationBranches_;
 
-  // True if init_jit was called, false otherwise
-  inline static bool jitInitialized_ = false;
+  // Makes sure init_jit is called once, by the first compiling thread
+  inline static std::once_flag jitInitialized_;
 };
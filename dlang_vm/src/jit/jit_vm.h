@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <memory>
+
 #include "../jit/jit.h"
 #include "../virtual_machine/virtual_machine.h"
 
@@ -14,11 +16,52 @@ class JITVM : public JIT {
   static constexpr jit_reg_t hp  = JIT_V3;
   static constexpr jit_reg_t tmp = JIT_V4;
 
+  // The data pointers of the stack and the heap are kept in the next
+  // callee-saved registers, if there are enough of them (otherwise they are
+  // loaded from memory by each access)
+  static constexpr bool kCachesStack = JIT_V_NUM > 5;
+  static constexpr bool kCachesHeap = JIT_V_NUM > 6;
+  static constexpr int kCachedData = kCachesStack + kCachesHeap;
+  static constexpr jit_reg_t stackData = JIT_V(5);
+  static constexpr jit_reg_t heapData = JIT_V(6);
+
+  // In compiled code sp, fp and hp hold byte offsets (index * sizeof(Cell)),
+  // so that memory accesses need no multiplication or division
+  static constexpr int kCellShift = sizeof(Cell) == 16 ? 4 : 3;
+  static_assert(sizeof(Cell) == 1 << kCellShift);
+  static bool isScaled(jit_reg_t reg);
+
+  // At most this many caller-saved registers are used by compiled code
+  static constexpr int kMaxCallerSaved = 8;
+
+  // Load the vm state into registers, and store it back (converting offsets
+  // back to indices in place)
+  static void loadState(const std::shared_ptr<VirtualMachine>& vm);
+  static void storeState(const std::shared_ptr<VirtualMachine>& vm);
+
+  // Load the cached data pointers again (the memory is moved when it grows,
+  // by allocations and by calls to other code), and return the register
+  // holding the data pointer of the memory (tmp if it is not cached)
+  static void loadData(const std::shared_ptr<VirtualMachine>& vm);
+  static jit_reg_t getData(const std::shared_ptr<VirtualMachine>& vm,
+                           Memory* memory);
+
+  // Compiled code for each cp (or null), called directly by compiled code when
+  // applying closures, as long as the native calls are not too deep
+  inline static void* const* compiledCode = nullptr;
+  inline static size_t callDepth = 0;
+  static constexpr size_t kMaxCallDepth = 1024;
+
+  // Registers are passed by value, other arguments as immediates
   template<typename FuncType, typename... ArgsTypes>
   static void call(jit_reg_t reg, FuncType func, ArgsTypes... args);
 
  private:
-  inline static size_t spillR0, spillR1, spillR2;
+  template<typename ArgType>
+  static void pushArg(ArgType arg);
+
+  // Only the vm thread runs compiled code, so the slots can be shared
+  inline static size_t spillR[kMaxCallerSaved];
 };
 
 #include "jit_vm.tpp"
@@ -4,23 +4,72 @@
 
 #include "jit_vm.h"
 
+#include <type_traits>
+
+inline bool JITVM::isScaled(jit_reg_t reg) {
+  return reg == sp || reg == fp || reg == hp;
+}
+
+inline void JITVM::loadState(const std::shared_ptr<VirtualMachine>& vm) {
+  jit_ldi(sp, &vm->sp);
+  jit_ldi(fp, &vm->fp);
+  jit_ldi(cp, &vm->cp);
+  jit_ldi(hp, &vm->hp);
+  jit_lshi(sp, sp, kCellShift);
+  jit_lshi(fp, fp, kCellShift);
+  jit_lshi(hp, hp, kCellShift);
+  loadData(vm);
+}
+
+inline void JITVM::storeState(const std::shared_ptr<VirtualMachine>& vm) {
+  jit_rshi(sp, sp, kCellShift);
+  jit_rshi(fp, fp, kCellShift);
+  jit_rshi(hp, hp, kCellShift);
+  jit_sti(&vm->sp, sp);
+  jit_sti(&vm->fp, fp);
+  jit_sti(&vm->cp, cp);
+  jit_sti(&vm->hp, hp);
+}
+
+inline void JITVM::loadData(const std::shared_ptr<VirtualMachine>& vm) {
+  if (kCachesStack) { jit_ldi_l(stackData, vm->stack.getDataPtr()); }
+  if (kCachesHeap) { jit_ldi_l(heapData, vm->heap.getDataPtr()); }
+}
+
+inline jit_reg_t JITVM::getData(const std::shared_ptr<VirtualMachine>& vm,
+                                Memory* memory) {
+  if (kCachesStack && memory == &vm->stack) { return stackData; }
+  if (kCachesHeap && memory == &vm->heap) { return heapData; }
+  jit_ldi_l(tmp, memory->getDataPtr());
+  return tmp;
+}
+
 template<typename FuncType, typename... ArgsTypes>
 void JITVM::call(jit_reg_t reg, FuncType func, ArgsTypes... args) {
   // Save caller-saved registers
-  jit_sti(&spillR0, JIT_R0);
-  jit_sti(&spillR1, JIT_R1);
-  jit_sti(&spillR2, JIT_R2);
+  for (int i = 0; i < JIT_R_NUM && i < kMaxCallerSaved; i++) {
+    jit_sti(&spillR[i], JIT_R(i));
+  }
 
   // Prepare arguments
   jit_prepare();
-  (jit_pushargi(reinterpret_cast<jit_word_t>(args)), ...);
+  (pushArg(args), ...);
 
   // Call function and store return value
   jit_finishi(reinterpret_cast<void*>(func));
   jit_retval(reg);
 
   // Restore caller-saved registers (unless the register has the result)
-  if (reg != JIT_R0) jit_ldi(JIT_R0, &spillR0);
-  if (reg != JIT_R1) jit_ldi(JIT_R1, &spillR1);
-  if (reg != JIT_R2) jit_ldi(JIT_R2, &spillR2);
+  for (int i = 0; i < JIT_R_NUM && i < kMaxCallerSaved; i++) {
+    if (reg != JIT_R(i)) { jit_ldi(JIT_R(i), &spillR[i]); }
+  }
+}
+
+template<typename ArgType>
+void JITVM::pushArg(ArgType arg) {
+  if constexpr (std::is_same_v<ArgType, jit_reg_t>) {
+    jit_pushargr(arg);
+  } else {
+    jit_pushargi(reinterpret_cast<jit_word_t>(arg));
+  }
 }
@@ -0,0 +1,18 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include "call_profile.h"
+
+void CallProfile::record(size_t cp, size_t target) {
+  auto [it, inserted] = targets_.insert({cp, target});
+  if (!inserted && it->second != target) {
+    it->second = kPolymorphic;
+  }
+}
+
+std::optional<size_t> CallProfile::getTarget(size_t cp) const {
+  auto it = targets_.find(cp);
+  if (it == targets_.end() || it->second == kPolymorphic) {
+    return {};
+  }
+  return it->second;
+}
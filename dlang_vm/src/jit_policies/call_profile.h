@@ -0,0 +1,21 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+
+// Code indices of the closures applied at each call site
+class CallProfile {
+ public:
+  void record(size_t cp, size_t target);
+
+  // The target of the call site, if it is the only one seen there
+  std::optional<size_t> getTarget(size_t cp) const;
+
+ private:
+  // Call sites with more than one target are marked as polymorphic
+  static constexpr size_t kPolymorphic = SIZE_MAX;
+  std::unordered_map<size_t, size_t> targets_;
+};
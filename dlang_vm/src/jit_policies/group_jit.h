@@ -4,21 +4,34 @@
 
 #include <vector>
 
+#include "call_profile.h"
 #include "jit_policy.h"
 
 template<BGroup group>
 class GroupJIT : public JITPolicy {
  public:
-  explicit GroupJIT(size_t jitThreshold);
+  // Callees of monomorphic calls are inlined in functions, as long as the
+  // inlined instructions of each function do not exceed the budget
+  explicit GroupJIT(size_t jitThreshold, size_t inlineBudget = 0);
 
   virtual void notifyLanding(size_t cp);
   virtual void notifyRunJIT(size_t cp);
+  virtual void notifyCall(size_t cp, size_t target);
+  virtual bool profilesCalls() const;
+  virtual bool isRecording() const;
+  virtual bool compiles() const;
   virtual JITSequence makeJITSequence(const Code<BInstruction>& code,
                                       size_t startCp);
 
  private:
+  // Cps from startCp to the end of its group
+  static JITSequence::Cps getGroupCps(const Code<BInstruction>& code,
+                                      size_t startCp);
+
   size_t jitThreshold_;
+  size_t inlineBudget_;
   std::vector<size_t> landings_{256};
+  CallProfile callProfile_;
 };
 
 #include "group_jit.tpp"
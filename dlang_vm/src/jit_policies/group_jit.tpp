@@ -5,7 +5,8 @@
 #include "group_jit.h"
 
 template<BGroup group>
-GroupJIT<group>::GroupJIT(size_t jitThreshold) : jitThreshold_(jitThreshold) {}
+GroupJIT<group>::GroupJIT(size_t jitThreshold, size_t inlineBudget)
+    : jitThreshold_(jitThreshold), inlineBudget_(inlineBudget) {}
 
 template<BGroup group>
 void GroupJIT<group>::notifyLanding(size_t cp) {
@@ -18,6 +19,27 @@ void GroupJIT<group>::notifyLanding(size_t cp) {
 template<BGroup group>
 void GroupJIT<group>::notifyRunJIT(size_t cp) {}
 
+template<BGroup group>
+void GroupJIT<group>::notifyCall(size_t cp, size_t target) {
+  callProfile_.record(cp, target);
+}
+
+template<BGroup group>
+bool GroupJIT<group>::profilesCalls() const {
+  // The profile is only used to inline callees in functions
+  return group == Function && inlineBudget_ > 0;
+}
+
+template<BGroup group>
+bool GroupJIT<group>::isRecording() const {
+  return false;
+}
+
+template<BGroup group>
+bool GroupJIT<group>::compiles() const {
+  return true;
+}
+
 template<BGroup group>
 JITSequence GroupJIT<group>::makeJITSequence(const Code<BInstruction>& code,
                                              size_t startCp) {
@@ -28,11 +50,7 @@ JITSequence GroupJIT<group>::makeJITSequence(const Code<BInstruction>& code,
   }
 
   // Get the range of cps
-  JITSequence::Cps cps;
-  cps.push_back(startCp);
-  while (!code.getInstruction(cps.back())->BGroupRole<group>::isEnd()) {
-    cps.push_back(cps.back() + 1);
-  }
+  auto cps = getGroupCps(code, startCp);
 
   // Get the entry points to the jit compiled code (and their lengths)
   JITSequence::EntryPoints entryPoints;
@@ -41,11 +59,40 @@ JITSequence GroupJIT<group>::makeJITSequence(const Code<BInstruction>& code,
       entryPoints.emplace_back(cp, cps.back() - cp + 1);
     }
     if (code.getInstruction(cp)->BGroupRole<group>::isBeforeEntry()) {
-      entryPoints.emplace_back(cp + 1, cps.back() - (cp + 1) + 1);
+      auto next = cp + code.getInstruction(cp)->getLength();
+      entryPoints.emplace_back(next, cps.back() - next + 1);
     }
   }
 
   JITSequence jitSequence{cps, entryPoints};
   if (group == Function) { jitSequence.setFunction(); }
+
+  // Inline the functions applied by monomorphic calls (only one level deep)
+  size_t budget = inlineBudget_;
+  for (auto cp : cps) {
+    auto target = callProfile_.getTarget(cp);
+    if (group != Function || !target ||
+        !code.getInstruction(*target)->BGroupRole<group>::isStart()) {
+      continue;
+    }
+    auto calleeCps = getGroupCps(code, *target);
+    if (calleeCps.size() <= budget) {
+      budget -= calleeCps.size();
+      jitSequence.addInlined(cp, calleeCps);
+    }
+  }
+
   return jitSequence;
 }
+
+template<BGroup group>
+JITSequence::Cps GroupJIT<group>::getGroupCps(const Code<BInstruction>& code,
+                                              size_t startCp) {
+  JITSequence::Cps cps;
+  cps.push_back(startCp);
+  // (skipping the instructions fused in superinstructions)
+  while (!code.getInstruction(cps.back())->BGroupRole<group>::isEnd()) {
+    cps.push_back(cps.back() + code.getInstruction(cps.back())->getLength());
+  }
+  return cps;
+}
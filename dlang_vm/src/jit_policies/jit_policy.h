@@ -10,6 +10,20 @@ class JITPolicy {
  public:
   virtual void notifyLanding(size_t cp) = 0;
   virtual void notifyRunJIT(size_t cp) = 0;
+
+  // Notified when the interpreter applies the closure with code index target
+  // (only if the policy profiles calls, which the interpreter checks once)
+  virtual void notifyCall(size_t cp, size_t target) = 0;
+  virtual bool profilesCalls() const = 0;
+
+  // True while the policy needs to be notified of every landing, so compiled
+  // regions cannot be chained without going back to the vm loop
+  virtual bool isRecording() const = 0;
+
+  // False if the policy never compiles, so the interpreter runs without
+  // notifying it
+  virtual bool compiles() const = 0;
+
   virtual JITSequence makeJITSequence(const Code<BInstruction>& code,
                                       size_t startCp) = 0;
 };
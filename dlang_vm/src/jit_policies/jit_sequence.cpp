@@ -24,3 +24,39 @@ void JITSequence::setFunction() {
 bool JITSequence::isFunction() const {
   return isFunction_;
 }
+
+void JITSequence::addInlined(size_t cp, Cps calleeCps) {
+  inlined_.emplace_back(cp, calleeCps);
+}
+
+const JITSequence::Inlined JITSequence::getInlined() const {
+  return inlined_;
+}
+
+const JITSequence::Cps JITSequence::getCompiledCps() const {
+  auto cps = *cps_;
+  for (const auto& [_, calleeCps] : inlined_) {
+    cps.insert(cps.end(), calleeCps.begin(), calleeCps.end());
+  }
+  return cps;
+}
+
+void JITSequence::setEntryTags(int firstOffset, std::vector<Tag> tags) {
+  entryFirstOffset_ = firstOffset;
+  entryTags_ = tags;
+}
+
+std::optional<Tag> JITSequence::getEntryTag(int offset) const {
+  int index = offset - entryFirstOffset_;
+  if (index < 0 || index >= static_cast<int>(entryTags_.size())) {
+    return {};
+  }
+  return entryTags_[index];
+}
+
+std::optional<int> JITSequence::getEntrySpOffset() const {
+  if (entryTags_.empty()) {
+    return {};
+  }
+  return entryFirstOffset_ + static_cast<int>(entryTags_.size());
+}
@@ -6,10 +6,13 @@
 #include <utility>
 #include <vector>
 
+#include "../virtual_machine/memory.h"
+
 class JITSequence {
  public:
   using Cps = std::vector<size_t>;
   using EntryPoints = std::vector<std::pair<size_t, size_t>>;
+  using Inlined = std::vector<std::pair<size_t, Cps>>;
 
   JITSequence() = default;
   JITSequence(Cps cps, EntryPoints entryPoints);
@@ -20,8 +23,25 @@ class JITSequence {
   void setFunction();
   bool isFunction() const;
 
+  // Callees whose code is placed after the call at the given cp
+  void addInlined(size_t cp, Cps calleeCps);
+  const Inlined getInlined() const;
+
+  // Cps of the sequence followed by the cps of the inlined callees
+  const Cps getCompiledCps() const;
+
+  // Tags of the items of the frame observed when the sequence was recorded,
+  // starting from the item at fp + firstOffset up to the item below sp
+  // (offsets are relative to fp, items not observed have no tag)
+  void setEntryTags(int firstOffset, std::vector<Tag> tags);
+  std::optional<Tag> getEntryTag(int offset) const;
+  std::optional<int> getEntrySpOffset() const;
+
  private:
   std::optional<Cps> cps_;
   std::optional<EntryPoints> entryPoints_;
   bool isFunction_ = false;
+  Inlined inlined_;
+  int entryFirstOffset_ = 0;
+  std::vector<Tag> entryTags_;
 };
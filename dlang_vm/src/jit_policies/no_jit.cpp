@@ -4,5 +4,9 @@
 
 void NoJIT::notifyLanding(size_t cp) {}
 void NoJIT::notifyRunJIT(size_t cp) {}
+void NoJIT::notifyCall(size_t cp, size_t target) {}
+bool NoJIT::profilesCalls() const { return false; }
+bool NoJIT::isRecording() const { return false; }
+bool NoJIT::compiles() const { return false; }
 JITSequence NoJIT::makeJITSequence(const Code<BInstruction>& code,
                                    size_t startCp) { return {}; }
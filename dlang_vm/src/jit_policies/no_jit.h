@@ -8,6 +8,10 @@ class NoJIT : public JITPolicy {
  public:
   virtual void notifyLanding(size_t cp);
   virtual void notifyRunJIT(size_t cp);
+  virtual void notifyCall(size_t cp, size_t target);
+  virtual bool profilesCalls() const;
+  virtual bool isRecording() const;
+  virtual bool compiles() const;
   virtual JITSequence makeJITSequence(const Code<BInstruction>& code,
                                       size_t startCp);
 };
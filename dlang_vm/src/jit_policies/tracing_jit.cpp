@@ -6,51 +6,69 @@ TracingJIT::TracingJIT(size_t jitThreshold, size_t maxLength)
     : jitThreshold_(jitThreshold), maxLength_(maxLength) {}
 
 void TracingJIT::notifyLanding(size_t cp) {
-  if (trace_.empty()) {
-    if (cp < prevCp_) {
-      if (cp > landings_.size()) {
-        landings_.resize(2 * cp);
-      }
-      landings_[cp]++;
-      if (landings_[cp] >= jitThreshold_) {
-        trace_.push_back(cp);
-        skipCnt_ = 0;
-      }
-    }
-  } else if (skipCnt_) {
-    skipCnt_++;
-  } else {
+  if (!trace_.empty()) {
     trace_.push_back(cp);
+  } else if (afterRun_) {
+    // Landing after compiled code, at one of its exits
+    startTrace(cp, &exits_[cp]);
+  } else if (cp < prevCp_) {
+    // Landing after a backward jump, at a loop header
+    if (cp >= landings_.size()) {
+      landings_.resize(2 * cp + 1);
+    }
+    startTrace(cp, &landings_[cp]);
   }
 
   prevCp_ = cp;
+  afterRun_ = false;
 }
 
 void TracingJIT::notifyRunJIT(size_t cp) {
-  if (!skipCnt_) {
-    if (trace_.size() == 1) {
-      trace_.clear();
-    } else {
-      skipCnt_ = 1;
-    }
-  }
-  prevCp_ = 1'000'000'000;
+  // Traces are ended before reaching compiled code, so this only happens if
+  // the trace started there
+  trace_.clear();
+  afterRun_ = true;
+}
+
+void TracingJIT::notifyCall(size_t cp, size_t target) {}
+
+bool TracingJIT::profilesCalls() const {
+  return false;
+}
+
+bool TracingJIT::isRecording() const {
+  return !trace_.empty();
+}
+
+bool TracingJIT::compiles() const {
+  return true;
 }
 
 JITSequence TracingJIT::makeJITSequence(const Code<BInstruction>& code,
                                         size_t cp) {
-  if (trace_.size() + skipCnt_ >= maxLength_) {
-    trace_.clear();
-    skipCnt_ = 0;
+  if (trace_.size() < 2) {
     return {};
   }
 
-  if (trace_.size() + skipCnt_ > 1 && trace_.front() == cp) {
+  // The trace ends when it gets back to its start, or to another trace
+  if (cp == trace_.front() || anchors_.count(cp)) {
     std::vector<size_t> traceCopy(trace_.begin(), trace_.end() - 1);
     trace_.clear();
-    skipCnt_ = 0;
+    anchors_.insert(traceCopy.front());
     return {traceCopy, {}};
   }
 
+  // Give up on traces which are too long
+  if (trace_.size() >= maxLength_) {
+    trace_.clear();
+  }
+
   return {};
 }
+
+void TracingJIT::startTrace(size_t cp, size_t* counter) {
+  if (++*counter >= jitThreshold_ && !anchors_.count(cp)) {
+    *counter = 0;
+    trace_.push_back(cp);
+  }
+}
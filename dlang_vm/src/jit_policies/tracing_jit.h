@@ -2,24 +2,43 @@
 
 #pragma once
 
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
 #include "jit_policy.h"
-#include "../data_structures/int_set.h"
 
+// Records traces starting at hot loop headers, and ending when they get back
+// to their start. Exits from compiled code are counted too, and a hot exit
+// starts a branch trace, which ends when it reaches any compiled trace (so
+// the traces of a loop form a tree, linked by chaining compiled code)
 class TracingJIT : public JITPolicy {
  public:
   explicit TracingJIT(size_t jitThreshold, size_t maxLength = 256);
   virtual void notifyLanding(size_t cp);
   virtual void notifyRunJIT(size_t cp);
+  virtual void notifyCall(size_t cp, size_t target);
+  virtual bool profilesCalls() const;
+  virtual bool isRecording() const;
+  virtual bool compiles() const;
   virtual JITSequence makeJITSequence(const Code<BInstruction>& code,
                                       size_t startCp);
  private:
+  // Starts recording at cp if it is hot, and not already compiled
+  void startTrace(size_t cp, size_t* counter);
+
+  // Cps of the trace being recorded (empty if not recording)
   std::vector<size_t> trace_;
+
+  // Landings at the targets of backward jumps, and exits to each cp
   std::vector<size_t> landings_{256};
+  std::unordered_map<size_t, size_t> exits_;
+
+  // Start cps of the traces returned for compilation
+  std::unordered_set<size_t> anchors_;
+
   size_t prevCp_ = 0;
+  bool afterRun_ = false;
   const size_t jitThreshold_;
   const size_t maxLength_;
-  size_t skipCnt_ = 0;
 };
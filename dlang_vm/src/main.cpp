@@ -3,21 +3,31 @@
 #include <fstream>
 #include <iostream>
 
+#include "b_dlang/b_binary_code.h"
 #include "b_dlang/b_code_builder.h"
 #include "options/options.h"
 #include "dlang_vm/dlang_vm.h"
 #include "memory_managers/amortized_allocation.h"
+#include "memory_managers/generational_gc.h"
 #include "memory_managers/no_allocation.h"
 #include "memory_managers/mark_and_sweep_gc.h"
 #include "jit_policies/no_jit.h"
 #include "jit_policies/group_jit.h"
 #include "jit_policies/tracing_jit.h"
+#include "optimizations/bounds_checks.h"
 #include "optimizations/constant_folding.h"
 #include "optimizations/copy_propagation.h"
 #include "optimizations/dead_code.h"
+#include "optimizations/loop_invariants.h"
 #include "optimizations/optimizations_sequence.h"
 #include "optimizations/redundant_checks.h"
+#include "optimizations/register_allocation.h"
+#include "optimizations/scalar_replacement.h"
+#include "optimizations/stack_promotion.h"
+#include "optimizations/type_specialization.h"
 #include "optimizations/unused_writes.h"
+#include "optimizations/value_numbering.h"
+#include "threaded_interpreter/threaded_interpreter.h"
 
 int main(int argc, char** argv) {
   // Parse command line arguments
@@ -37,10 +47,13 @@ int main(int argc, char** argv) {
 
   // Get the options from the command line
   auto verbosityOption = options["verbosity"].as<std::string>();
+  auto interpreterOption = options["interpreter"].as<std::string>();
   auto threshold = options["jit-threshold"].as<size_t>();
+  auto inlineBudget = options["inline-budget"].as<size_t>();
   auto jitPolicyOption = options["jit-policy"].as<std::string>();
   auto memoryOption = options["memory"].as<std::string>();
   auto optimizationsOption = options["optimizations"].as<std::string>();
+  bool backgroundJIT = options.count("background-jit");
 
   std::shared_ptr<JITPolicy> jitPolicy;
   std::shared_ptr<MemoryManager> memoryManager;
@@ -55,7 +68,7 @@ int main(int argc, char** argv) {
   } else if (jitPolicyOption == "block") {
     jitPolicy = std::make_shared<GroupJIT<Block>>(threshold);
   } else if (jitPolicyOption == "function") {
-    jitPolicy = std::make_shared<GroupJIT<Function>>(threshold);
+    jitPolicy = std::make_shared<GroupJIT<Function>>(threshold, inlineBudget);
   } else {
     std::cout << "Sequence " << jitPolicyOption << " is not valid" << std::endl;
     return EXIT_FAILURE;
@@ -67,6 +80,8 @@ int main(int argc, char** argv) {
     memoryManager = std::make_shared<AmortizedAllocation>();
   } else if (memoryOption == "mark-and-sweep") {
     memoryManager = std::make_shared<MarkAndSweepGC>();
+  } else if (memoryOption == "generational") {
+    memoryManager = std::make_shared<GenerationalGC>();
   } else {
     std::cout << "Memory " << memoryOption << " is not valid" << std::endl;
     return EXIT_FAILURE;
@@ -89,6 +104,24 @@ int main(int argc, char** argv) {
         optimizationsSequence->add(std::make_shared<DeadCodeElimination>());
       } else if (optimization == "constant-folding") {
         optimizationsSequence->add(std::make_shared<ConstantFolding>());
+      } else if (optimization == "stack-promotion") {
+        optimizationsSequence->add(std::make_shared<StackPromotion>());
+      } else if (optimization == "gvn") {
+        optimizationsSequence->add(std::make_shared<GlobalValueNumbering>());
+      } else if (optimization == "licm") {
+        optimizationsSequence->add(
+            std::make_shared<LoopInvariantCodeMotion>());
+      } else if (optimization == "bounds-checks") {
+        optimizationsSequence->add(
+            std::make_shared<BoundsCheckElimination>());
+      } else if (optimization == "scalar-replacement") {
+        optimizationsSequence->add(std::make_shared<ScalarReplacement>());
+      } else if (optimization == "type-specialization") {
+        optimizationsSequence->setTypeSpecialization(
+            std::make_shared<TypeSpecialization>());
+      } else if (optimization == "register-allocation") {
+        optimizationsSequence->setRegisterAllocation(
+            std::make_shared<RegisterAllocation>());
       } else {
         std::cout << "Optimization " << optimization
                   << " is not valid" << std::endl;
@@ -97,28 +130,83 @@ int main(int argc, char** argv) {
     }
   }
 
-  // Read contents of the bytecode file
+  if (interpreterOption == "threaded" && jitPolicyOption != "no") {
+    std::cout << "Interpreter " << interpreterOption
+              << " requires jit-policy no" << std::endl;
+    return EXIT_FAILURE;
+  } else if (interpreterOption != "threaded" &&
+             interpreterOption != "standard") {
+    std::cout << "Interpreter " << interpreterOption
+              << " is not valid" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Load the bytecode file, either binary (mapped) or text (parsed)
   std::string filename = options["file"].as<std::string>();
-  std::ifstream fileStream(filename);
-  std::string codeString((std::istreambuf_iterator<char>(fileStream)),
-                          std::istreambuf_iterator<char>());
-  auto code = BCodeBuilder::fromString(codeString);
+  Code<BInstruction> code;
+  std::shared_ptr<ThreadedInterpreter> threadedInterpreter;
+  try {
+    if (BBinaryCode::isBinary(filename)) {
+      BBinaryCode binaryCode(filename);
+      code = BCodeBuilder::fromBinary(binaryCode);
+      if (interpreterOption == "threaded") {
+        threadedInterpreter = std::make_shared<ThreadedInterpreter>(
+            binaryCode.data(), binaryCode.size());
+      }
+    } else {
+      std::ifstream fileStream(filename);
+      std::string codeString((std::istreambuf_iterator<char>(fileStream)),
+                              std::istreambuf_iterator<char>());
+      code = BCodeBuilder::fromString(codeString);
+      if (interpreterOption == "threaded") {
+        threadedInterpreter = std::make_shared<ThreadedInterpreter>(code);
+      }
+    }
+  } catch (const InvalidBytecode& e) {
+    std::cout << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Convert the bytecode file and stop if arguments include "--to-binary"
+  if (options.count("to-binary")) {
+    try {
+      BBinaryCode::write(code, options["to-binary"].as<std::string>());
+    } catch (const InvalidBytecode& e) {
+      std::cout << e.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  // Fuse the superinstructions (also in the code of the threaded
+  // interpreter, if used)
+  if (options.count("superinstructions")) {
+    code = BCodeBuilder::fuseSuperinstructions(code);
+    if (threadedInterpreter) {
+      threadedInterpreter = std::make_shared<ThreadedInterpreter>(code);
+    }
+  }
 
   if (verbosityOption == "quiet") {
     DlangVM<Quiet>(code, jitPolicy, memoryManager,
-                   optimizationsSequence).run();
+                   optimizationsSequence, threadedInterpreter,
+                   backgroundJIT).run();
   } else if (verbosityOption == "output") {
     DlangVM<Output>(code, jitPolicy, memoryManager,
-                    optimizationsSequence).run();
+                    optimizationsSequence, threadedInterpreter,
+                    backgroundJIT).run();
   } else if (verbosityOption == "time") {
     DlangVM<Time>(code, jitPolicy, memoryManager,
-                  optimizationsSequence).run();
+                  optimizationsSequence, threadedInterpreter,
+                  backgroundJIT).run();
   } else if (verbosityOption == "statistics") {
     DlangVM<Statistics>(code, jitPolicy, memoryManager,
-                        optimizationsSequence).run();
+                        optimizationsSequence, threadedInterpreter,
+                        backgroundJIT).run();
   } else if (verbosityOption == "debug") {
     DlangVM<Debug>(code, jitPolicy, memoryManager,
-                   optimizationsSequence).run();
+                   optimizationsSequence, threadedInterpreter,
+                   backgroundJIT).run();
   } else {
     std::cout << "Verbosity " << verbosityOption
               << " is not valid" << std::endl;
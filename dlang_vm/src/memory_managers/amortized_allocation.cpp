@@ -3,9 +3,10 @@
 #include "amortized_allocation.h"
 
 #include <algorithm>
+#include <limits>
 #include <memory>
 
-#include "../virtual_machine/memory.h"
+#include "../virtual_machine/virtual_machine.h"
 
 void AmortizedAllocation::allocateMemory(Memory* memory) {
   Memory newMemory(std::max(static_cast<size_t>(4), 2 * memory->size()));
@@ -13,4 +14,6 @@ void AmortizedAllocation::allocateMemory(Memory* memory) {
   *memory = newMemory;
 }
 
-void AmortizedAllocation::collectGarbage(std::shared_ptr<VirtualMachine> vm) {}
+void AmortizedAllocation::collectGarbage(std::shared_ptr<VirtualMachine> vm) {
+  vm->hpLimit = std::numeric_limits<size_t>::max();
+}
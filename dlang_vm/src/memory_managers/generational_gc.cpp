@@ -0,0 +1,105 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include "generational_gc.h"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+
+#include "../virtual_machine/virtual_machine.h"
+
+static constexpr size_t kNotCopied = std::numeric_limits<size_t>::max();
+
+static bool isPointer(const Cell& cell) {
+  return cell.getTag() == HeapIndex || cell.getTag() == HeapRef;
+}
+
+static bool isHeader(const Cell& cell) {
+  return cell.getTag() == PairHeader || cell.getTag() == InlHeader ||
+         cell.getTag() == InrHeader || cell.getTag() == ClosureHeader;
+}
+
+GenerationalGC::GenerationalGC(size_t nurserySize, size_t oldSize)
+    : nurserySize_(nurserySize), oldSize_(oldSize), oldLimit_(oldSize) {}
+
+void GenerationalGC::collectGarbage(std::shared_ptr<VirtualMachine> vm) {
+  // Collection starts when the nursery is full
+  if (vm->hp >= oldTop_ + nurserySize_) {
+    if (oldTop_ < oldLimit_) {
+      // Minor collection, the old space is not moved
+      evacuate(vm, oldTop_);
+    } else {
+      // Major collection, the whole heap is compacted
+      evacuate(vm, 0);
+      oldLimit_ = std::max(oldSize_, 2 * oldTop_);
+    }
+  }
+  vm->hpLimit = oldTop_ + nurserySize_;
+}
+
+void GenerationalGC::recordWrite(Memory* memory, size_t idx) {
+  if (!isRemembered_[idx]) {
+    isRemembered_[idx] = true;
+    remembered_.push_back(idx);
+  }
+}
+
+void GenerationalGC::evacuate(std::shared_ptr<VirtualMachine> vm,
+                              size_t base) {
+  forward_.assign(vm->hp - base, kNotCopied);
+  toSpace_.clear();
+
+  // Copy the objects pointed by the stack and by the remembered set
+  for (size_t idx = 0; idx < vm->sp; idx++) {
+    if (isPointer(vm->stack[idx])) {
+      vm->stack[idx].setValue(copy(vm, vm->stack[idx], base));
+    }
+  }
+  for (size_t idx : remembered_) {
+    if (idx < base && isPointer(vm->heap[idx])) {
+      vm->heap[idx].setValue(copy(vm, vm->heap[idx], base));
+    }
+  }
+
+  // Scan the copied items breadth first, copying the objects they point to
+  for (size_t scan = 0; scan < toSpace_.size(); scan++) {
+    if (isPointer(toSpace_[scan])) {
+      auto newIdx = copy(vm, toSpace_[scan], base);
+      toSpace_[scan].setValue(newIdx);
+    }
+  }
+
+  // The survivors become part of the old space
+  std::copy(toSpace_.begin(), toSpace_.end(), &vm->heap[base]);
+  oldTop_ = base + toSpace_.size();
+  vm->hp = oldTop_;
+
+  // Only writes to the old space need to be remembered
+  for (size_t idx : remembered_) {
+    isRemembered_[idx] = false;
+  }
+  remembered_.clear();
+  isRemembered_.resize(oldTop_);
+  vm->heap.setWriteBarrier(oldTop_);
+}
+
+size_t GenerationalGC::copy(std::shared_ptr<VirtualMachine> vm, Cell pointer,
+                            size_t base) {
+  // Objects below base are not moved
+  size_t idx = pointer.getValue();
+  if (idx < base || idx >= vm->hp) { return idx; }
+  if (forward_[idx - base] != kNotCopied) { return forward_[idx - base]; }
+
+  // References point to one item, indices to a header and its body
+  size_t size = 1;
+  if (pointer.getTag() == HeapIndex && isHeader(vm->heap[idx])) {
+    size = std::clamp<size_t>(vm->heap[idx].getValue(), 1, vm->hp - idx);
+  }
+
+  size_t newIdx = base + toSpace_.size();
+  for (size_t i = 0; i < size; i++) {
+    toSpace_.push_back(vm->heap[idx + i]);
+    forward_[idx + i - base] = newIdx + i;
+  }
+  return newIdx;
+}
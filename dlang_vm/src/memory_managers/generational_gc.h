@@ -0,0 +1,38 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "amortized_allocation.h"
+#include "../virtual_machine/memory.h"
+
+// Generational copying collector: objects are allocated in a nursery at the
+// end of the heap, and the survivors are copied right after the old space.
+// Old items written by the program are kept in a remembered set, so minor
+// collections only visit the nursery. The whole heap is collected when the
+// old space is full.
+class GenerationalGC : public AmortizedAllocation {
+ public:
+  explicit GenerationalGC(size_t nurserySize = 65'536,
+                          size_t oldSize = 1'048'576);
+
+  virtual void collectGarbage(std::shared_ptr<VirtualMachine> vm);
+  virtual void recordWrite(Memory* memory, size_t idx);
+
+ private:
+  // Copies the objects above base reachable from the roots to base
+  void evacuate(std::shared_ptr<VirtualMachine> vm, size_t base);
+  size_t copy(std::shared_ptr<VirtualMachine> vm, Cell pointer, size_t base);
+
+  const size_t nurserySize_;
+  const size_t oldSize_;
+  size_t oldTop_ = 0;
+  size_t oldLimit_;
+
+  std::vector<size_t> remembered_;
+  std::vector<bool> isRemembered_;
+  std::vector<size_t> forward_;
+  std::vector<Cell> toSpace_;
+};
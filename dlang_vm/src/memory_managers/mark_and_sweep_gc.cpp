@@ -2,6 +2,8 @@
 
 #include "mark_and_sweep_gc.h"
 
+#include <algorithm>
+#include <bitset>
 #include <memory>
 
 #include "../virtual_machine/virtual_machine.h"
@@ -11,58 +13,90 @@ MarkAndSweepGC::MarkAndSweepGC(size_t initialSize)
 
 void MarkAndSweepGC::collectGarbage(std::shared_ptr<VirtualMachine> vm) {
   // Use a policy to determine if collection starts
-  if (10 * vm->hp < 9 * vm->heap.size()) { return; }
+  if (10 * vm->hp >= 9 * vm->heap.size()) {
+    collect(vm);
+  }
+
+  // Called again when the heap is 90% full, or at the next allocation
+  vm->hpLimit = std::max((9 * vm->heap.size() + 9) / 10, vm->hp + 1);
+}
+
+void MarkAndSweepGC::collect(std::shared_ptr<VirtualMachine> vm) {
+  size_t heapSize = vm->heap.size();
+  size_t blocks = (heapSize + kBlockBits - 1) / kBlockBits;
+
+  // Mark phase - starting from the pointers in the stack
+  marked_.assign(blocks, 0);
+  markStack_.clear();
+  for (size_t idx = 0; idx < vm->sp; idx++) {
+    auto tag = vm->stack[idx].getTag();
+    if (tag == HeapIndex || tag == HeapRef) {
+      mark(vm->stack[idx].getValue());
+    }
+  }
+  while (!markStack_.empty()) {
+    size_t idx = markStack_.back();
+    markStack_.pop_back();
+    Item item = vm->heap[idx];
+
+    // Follow pointers
+    if (item.tag == HeapIndex || item.tag == HeapRef) {
+      mark(item.value);
+    }
 
-  // Mark phase
-  marked_.clear();
-  for (int idx = 0; idx < vm->sp; idx++) {
-    if (vm->stack[idx].tag == HeapIndex || vm->stack[idx].tag == HeapRef) {
-      markRecursive(vm->stack[idx].value, vm);
+    // Mark the entire body for this header
+    if (item.tag == PairHeader || item.tag == InlHeader ||
+        item.tag == InrHeader || item.tag == ClosureHeader) {
+      for (size_t i = 1; i < item.value; i++) {
+        mark(idx + i);
+      }
     }
   }
 
-  // Sweep phase - creating a new compressed heap
-  Memory newHeap(vm->heap.size());
-  newIndex_.clear();
-  size_t nextIdx = 0;
-  for (size_t idx : marked_) {
-    newIndex_[idx] = nextIdx;
-    newHeap[nextIdx] = vm->heap[idx];
-    nextIdx++;
+  // Forwarding phase - prefix sums of the marked items in each block
+  blockOffset_.resize(blocks + 1);
+  blockOffset_[0] = 0;
+  for (size_t block = 0; block < blocks; block++) {
+    blockOffset_[block + 1] =
+        blockOffset_[block] + std::bitset<kBlockBits>(marked_[block]).count();
   }
-  vm->heap = newHeap;
-  vm->hp = marked_.size();
 
-  // Sweep phase - adjusting indices to the new heap
-  for (int idx = 0; idx < vm->sp; idx++) {
-    if (vm->stack[idx].tag == HeapIndex || vm->stack[idx].tag == HeapRef) {
-      vm->stack[idx].value = newIndex_.at(vm->stack[idx].value);
+  // Sweep phase - adjusting indices to the compacted heap
+  for (size_t idx = 0; idx < vm->sp; idx++) {
+    auto tag = vm->stack[idx].getTag();
+    if (tag == HeapIndex || tag == HeapRef) {
+      vm->stack[idx].setValue(forward(vm->stack[idx].getValue()));
     }
   }
-  for (int idx = 0; idx < vm->hp; idx++) {
-    if (vm->heap[idx].tag == HeapIndex || vm->heap[idx].tag == HeapRef) {
-      vm->heap[idx].value = newIndex_.at(vm->heap[idx].value);
+  for (size_t idx = 0; idx < heapSize; idx++) {
+    auto tag = vm->heap[idx].getTag();
+    if (isMarked(idx) && (tag == HeapIndex || tag == HeapRef)) {
+      vm->heap[idx].setValue(forward(vm->heap[idx].getValue()));
     }
   }
-}
 
-void MarkAndSweepGC::markRecursive(size_t idx,
-                                   std::shared_ptr<VirtualMachine> vm) {
-  if (marked_.count(idx)) { return; }
-  marked_.insert(idx);
+  // Sweep phase - sliding the marked items, which keep their order
+  for (size_t idx = 0; idx < heapSize; idx++) {
+    if (isMarked(idx)) {
+      vm->heap[forward(idx)] = vm->heap[idx];
+    }
+  }
+  vm->hp = blockOffset_[blocks];
+}
 
-  const auto& item = vm->heap[idx];
+void MarkAndSweepGC::mark(size_t idx) {
+  if (isMarked(idx)) { return; }
+  marked_[idx / kBlockBits] |= static_cast<uint64_t>(1) << (idx % kBlockBits);
+  markStack_.push_back(idx);
+}
 
-  // Follow pointers
-  if (item.tag == HeapIndex || item.tag == HeapRef) {
-    markRecursive(item.value, vm);
-  }
+bool MarkAndSweepGC::isMarked(size_t idx) const {
+  return (marked_[idx / kBlockBits] >> (idx % kBlockBits)) & 1;
+}
 
-  // Mark the entire body for this header
-  if (item.tag == PairHeader || item.tag == InlHeader ||
-      item.tag == InrHeader || item.tag == ClosureHeader) {
-    for (size_t i = 1; i < item.value; i++) {
-      markRecursive(idx + i, vm);
-    }
-  }
+size_t MarkAndSweepGC::forward(size_t idx) const {
+  auto before = marked_[idx / kBlockBits] &
+                ((static_cast<uint64_t>(1) << (idx % kBlockBits)) - 1);
+  return blockOffset_[idx / kBlockBits] +
+         std::bitset<kBlockBits>(before).count();
 }
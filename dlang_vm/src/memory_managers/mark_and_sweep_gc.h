@@ -2,12 +2,14 @@
 
 #pragma once
 
+#include <cstdint>
 #include <memory>
-#include <set>
-#include <unordered_map>
+#include <vector>
 
 #include "no_allocation.h"
 
+// Mark and compact collector: live items are marked in a bitmap using an
+// explicit stack, then slid to the start of the heap in place
 class MarkAndSweepGC : public NoAllocation {
  public:
   explicit MarkAndSweepGC(size_t initialSize = 1'000);
@@ -15,8 +17,17 @@ class MarkAndSweepGC : public NoAllocation {
   virtual void collectGarbage(std::shared_ptr<VirtualMachine> vm);
 
  private:
-  void markRecursive(size_t idx, std::shared_ptr<VirtualMachine> vm);
+  static constexpr size_t kBlockBits = 64;
 
-  std::set<size_t> marked_;
-  std::unordered_map<size_t, size_t> newIndex_;
+  void collect(std::shared_ptr<VirtualMachine> vm);
+  void mark(size_t idx);
+  bool isMarked(size_t idx) const;
+
+  // New index of a marked item, after the compaction
+  size_t forward(size_t idx) const;
+
+  std::vector<uint64_t> marked_;
+  std::vector<size_t> markStack_;
+  // Number of marked items before each block of the bitmap
+  std::vector<size_t> blockOffset_;
 };
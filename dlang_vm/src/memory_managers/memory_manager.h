@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <memory>
 
 class Memory;
@@ -11,4 +12,7 @@ class MemoryManager {
  public:
   virtual void allocateMemory(Memory* memory) = 0;
   virtual void collectGarbage(std::shared_ptr<VirtualMachine> vm) = 0;
+
+  // Called on writes below the write barrier of a memory (if it is set)
+  virtual void recordWrite(Memory* memory, size_t idx) {}
 };
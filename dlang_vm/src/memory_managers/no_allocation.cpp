@@ -2,10 +2,11 @@
 
 #include "no_allocation.h"
 
+#include <limits>
 #include <memory>
 
-#include "../virtual_machine/memory.h"
 #include "../virtual_machine/exception.h"
+#include "../virtual_machine/virtual_machine.h"
 
 NoAllocation::NoAllocation(size_t initialSize) : initialSize_(initialSize) {}
 
@@ -17,4 +18,6 @@ void NoAllocation::allocateMemory(Memory* memory) {
   }
 }
 
-void NoAllocation::collectGarbage(std::shared_ptr<VirtualMachine> vm) {}
+void NoAllocation::collectGarbage(std::shared_ptr<VirtualMachine> vm) {
+  vm->hpLimit = std::numeric_limits<size_t>::max();
+}
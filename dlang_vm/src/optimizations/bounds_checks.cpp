@@ -0,0 +1,272 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include "bounds_checks.h"
+
+#include <algorithm>
+#include <optional>
+#include <unordered_set>
+
+#include "../u_dlang/u_instruction.h"
+
+Code<TInstruction> BoundsCheckElimination::optimize(
+    const Code<TInstruction>& tCode) {
+  std::vector<TInstructionPtr> line(tCode.begin(), tCode.end());
+  bool isFunction = !line.empty() && line.front()->isFunction();
+
+  // The frame can only be checked at the entries if sp moves by constants
+  // and fp never changes, except to make a call or to return (the callee
+  // restores them), and traces are entered only at the start, with no calls
+  // or returns (their frame is only known relative to sp)
+  std::unordered_set<size_t> destinations;
+  bool isFrameFixed = true;
+  bool isLeaving = false;
+  for (auto it = line.rbegin(); it != line.rend(); it++) {
+    const auto& instruction = *it;
+    if (auto branch = kindCast<TInstructionBranch>(instruction)) {
+      destinations.insert(branch->destination);
+    }
+    isLeaving = kindCast<TApply>(instruction) ||
+                kindCast<TReturn>(instruction) ||
+                (isLeaving && !kindCast<TLabel>(instruction));
+    if (!isFunction && isLeaving) {
+      isFrameFixed = false;
+    }
+    for (const auto& arg : instruction->getWriteArgs()) {
+      auto reg = kindCast<URegister>(arg->getUArgument());
+      int delta = 0;
+      if (reg && !isLeaving &&
+          (reg->getReg() == JITVM::fp ||
+           (reg->getReg() == JITVM::sp &&
+            !isConstantMove(instruction, reg, &delta)))) {
+        isFrameFixed = false;
+      }
+    }
+  }
+
+  // The instructions replacing some of the code, and the ones added after
+  // the labels of the entries, by index
+  std::unordered_map<size_t, std::vector<TInstructionPtr>> replaced;
+  std::unordered_map<size_t, std::vector<TInstructionPtr>> added;
+
+  // The last entry, while hp has moved only by constants since it
+  std::optional<size_t> heapEntry;
+
+  // The checks of each pointer since it last changed by an unknown amount
+  std::unordered_map<jit_reg_t, Range> ranges;
+  std::unordered_map<jit_reg_t, int> deltas;
+  auto close = [&](jit_reg_t reg) {
+    deltas.erase(reg);
+    auto it = ranges.find(reg);
+    if (it == ranges.end()) { return; }
+    const auto& range = it->second;
+    if (range.checks.size() > 1) {
+      for (auto check : range.checks) {
+        replaced[check] = {};
+      }
+      auto anchor = kindCast<TMemCheck>(line[range.anchor]);
+      if (range.entry) {
+        // The heap grown since the entry is checked there
+        auto checks = makeChecks(anchor, range.min, range.max);
+        auto& entryAdded = added[*range.entry];
+        entryAdded.insert(entryAdded.end(), checks.begin(), checks.end());
+      } else {
+        replaced[range.anchor] = makeChecks(anchor,
+                                            range.min - range.anchorDelta,
+                                            range.max - range.anchorDelta);
+      }
+    }
+    ranges.erase(it);
+  };
+  auto closeAll = [&]() {
+    while (!ranges.empty()) {
+      close(ranges.begin()->first);
+    }
+    deltas.clear();
+  };
+
+  // The checks of the frame, by offset from fp, and the entries with the
+  // offset of sp from its value at the start
+  std::vector<size_t> frameChecks;
+  int frameMin = 0, frameMax = 0;
+  std::vector<std::pair<size_t, int>> entries;
+  std::unordered_map<size_t, int> labelOffsets;
+  int spOffset = 0;
+  bool isFrameKnown = isFrameFixed;
+
+  size_t labels = 0;
+  bool afterApply = false;
+  for (size_t i = 0; i < line.size(); i++) {
+    const auto& instruction = line[i];
+
+    // New values can reach a label from an entry or a branch
+    if (kindCast<TLabel>(instruction)) {
+      size_t cp = instruction->getUInstruction()->cp;
+      bool isEntry = afterApply || (isFunction ? labels == 1 : labels == 0);
+      if (isEntry || labels == 0 || destinations.count(cp)) {
+        closeAll();
+        heapEntry.reset();
+      }
+      if (isEntry) {
+        heapEntry = i;
+      }
+      isFrameKnown = isFrameFixed;
+      if (labelOffsets.count(cp)) {
+        spOffset = labelOffsets.at(cp);
+      } else {
+        labelOffsets[cp] = spOffset;
+      }
+      if (isFrameFixed && isEntry) {
+        entries.emplace_back(i, spOffset);
+      }
+      afterApply = false;
+      labels++;
+    }
+    if (auto branch = kindCast<TInstructionBranch>(instruction)) {
+      labelOffsets[branch->destination] = spOffset;
+    }
+
+    // Add the check to the frame or to the range of its pointer
+    if (auto check = kindCast<TMemCheck>(instruction)) {
+      auto loc = kindCast<ULocation>(check->a->getUArgument());
+      auto reg = loc->getPtr()->getReg();
+      bool isFrame = reg == JITVM::sp || (isFunction && reg == JITVM::fp);
+      if (isFrameKnown && isFrame) {
+        if (!entries.empty()) {
+          int offset =
+              loc->getOffset() + (reg == JITVM::sp ? spOffset + 2 : 0);
+          frameMin = frameChecks.empty() ? offset : std::min(frameMin, offset);
+          frameMax = frameChecks.empty() ? offset : std::max(frameMax, offset);
+          frameChecks.push_back(i);
+        }
+      } else {
+        int offset = loc->getOffset() + deltas[reg];
+        if (!ranges.count(reg)) {
+          auto entry = reg == JITVM::hp ? heapEntry : std::nullopt;
+          ranges[reg] = {i, deltas[reg], offset, offset, {}, entry};
+        }
+        auto& range = ranges.at(reg);
+        range.min = std::min(range.min, offset);
+        range.max = std::max(range.max, offset);
+        range.checks.push_back(i);
+      }
+    }
+
+    // Calls and returns move all the pointers (and the callee allocates)
+    if (kindCast<TApply>(instruction) ||
+        kindCast<TReturn>(instruction) ||
+        kindCast<THalt>(instruction)) {
+      closeAll();
+      heapEntry.reset();
+      if (kindCast<TApply>(instruction)) {
+        spOffset -= 3;
+        afterApply = true;
+      }
+    }
+
+    // Follow the pointers moved by constants, a new instruction (cp) does not
+    // keep the checks of the values it loads in the other registers
+    for (const auto& arg : instruction->getWriteArgs()) {
+      auto reg = kindCast<URegister>(arg->getUArgument());
+      if (!reg) { continue; }
+      int delta = 0;
+      if (isConstantMove(instruction, reg, &delta)) {
+        deltas[reg->getReg()] += delta;
+        spOffset += reg->getReg() == JITVM::sp ? delta : 0;
+      } else {
+        close(reg->getReg());
+        isFrameKnown &= reg->getReg() != JITVM::sp &&
+                        reg->getReg() != JITVM::fp;
+        if (reg->getReg() == JITVM::hp) { heapEntry.reset(); }
+      }
+      if (reg->getReg() == JITVM::cp) {
+        std::vector<jit_reg_t> values;
+        for (const auto& [ptr, range] : ranges) {
+          if (ptr != JITVM::sp && ptr != JITVM::fp && ptr != JITVM::hp) {
+            values.push_back(ptr);
+          }
+        }
+        for (auto ptr : values) {
+          close(ptr);
+        }
+      }
+    }
+  }
+  closeAll();
+
+  // Check the whole frame at the entries, if it saves checks
+  if (!frameChecks.empty() && 2 * entries.size() <= frameChecks.size()) {
+    for (auto check : frameChecks) {
+      replaced[check] = {};
+    }
+    auto frameCheck = kindCast<TMemCheck>(line[frameChecks.front()]);
+    auto loc = kindCast<ULocation>(frameCheck->a->getUArgument());
+    bool isSP = loc->getPtr()->getReg() == JITVM::sp;
+    for (const auto& [entry, offset] : entries) {
+      int shift = isSP ? offset + 2 : 0;
+      auto checks = makeChecks(frameCheck, frameMin - shift, frameMax - shift);
+      auto& entryAdded = added[entry];
+      entryAdded.insert(entryAdded.begin(), checks.begin(), checks.end());
+    }
+  }
+
+  Code<TInstruction> tCodeOptimized;
+  for (size_t i = 0; i < line.size(); i++) {
+    if (!replaced.count(i)) {
+      tCodeOptimized.add(line[i]);
+    } else {
+      for (const auto& instruction : replaced.at(i)) {
+        tCodeOptimized.add(instruction);
+      }
+    }
+    if (added.count(i)) {
+      for (const auto& instruction : added.at(i)) {
+        tCodeOptimized.add(instruction);
+      }
+    }
+  }
+  return tCodeOptimized;
+}
+
+ULocation::Ptr BoundsCheckElimination::makeLocation(const URegister::Ptr& ptr,
+                                                    int offset,
+                                                    VirtualMachine::Type type) {
+  if (ptr->getReg() == JITVM::sp) {
+    return VMUArg::SP(offset, type);
+  }
+  if (ptr->getReg() == JITVM::fp) {
+    return VMUArg::FP(offset, type);
+  }
+  return VMUArg::Heap(ptr, offset, type);
+}
+
+std::vector<BoundsCheckElimination::TInstructionPtr>
+    BoundsCheckElimination::makeChecks(const std::shared_ptr<TMemCheck>& anchor,
+                                       int min, int max) {
+  auto loc = kindCast<ULocation>(anchor->a->getUArgument());
+  std::vector<int> offsets = {min};
+  if (max != min) { offsets.push_back(max); }
+  std::vector<TInstructionPtr> checks;
+  for (auto offset : offsets) {
+    auto a = std::make_shared<TVariable>(
+        makeLocation(loc->getPtr(), offset, loc->getType()));
+    checks.push_back(std::make_shared<TMemCheck>(anchor->getUInstruction(),
+                                                 anchor->isFunction(), a,
+                                                 anchor->ptr));
+  }
+  return checks;
+}
+
+bool BoundsCheckElimination::isConstantMove(const TInstructionPtr& instruction,
+                                            const URegister::Ptr& reg,
+                                            int* delta) {
+  auto oper = kindCast<TOper>(instruction);
+  auto uOper = oper ? kindCast<UOper>(oper->getUInstruction()) : nullptr;
+  auto b = uOper ? kindCast<URegister>(uOper->b) : nullptr;
+  auto c = uOper ? kindCast<UImmediate>(uOper->c) : nullptr;
+  if (!b || !c || b->getReg() != reg->getReg() ||
+      (uOper->op != Add && uOper->op != Sub)) {
+    return false;
+  }
+  *delta = uOper->op == Add ? c->getValue() : -c->getValue();
+  return true;
+}
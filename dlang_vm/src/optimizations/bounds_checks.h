@@ -0,0 +1,53 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "optimization.h"
+#include "../u_dlang/u_argument.h"
+
+// Bounds check elimination by range analysis.
+// The offsets of the locations checked are followed across the code, relative
+// to their pointer register, which moves by known amounts (sp and hp) or
+// changes to unknown values. The checks of a pointer made while it is known
+// are replaced by a check of the lowest and one of the highest location,
+// where the first of them was made, or at the entry of the code if hp has
+// moved only by constants since then (checking the heap grown by the
+// allocations up front). If the frame does not move (except by constants of
+// sp), all its checks are replaced by a check of the whole frame at every
+// entry (traces are only entered at the start, and their frame is known
+// relative to sp).
+class BoundsCheckElimination : public Optimization {
+ public:
+  virtual Code<TInstruction> optimize(const Code<TInstruction>& tCode);
+
+ private:
+  using TInstructionPtr = std::shared_ptr<TInstruction>;
+
+  // The checks of a pointer, with their offsets from where it was when the
+  // first of them was made (the anchor), and the entry where they are made
+  // instead if the offsets are from where it was there
+  struct Range {
+    size_t anchor;
+    int anchorDelta;
+    int min, max;
+    std::vector<size_t> checks;
+    std::optional<size_t> entry;
+  };
+
+  // Location at an offset from ptr
+  static ULocation::Ptr makeLocation(const URegister::Ptr& ptr, int offset,
+                                     VirtualMachine::Type type);
+
+  // Checks of the lowest and of the highest location, made by the anchor
+  static std::vector<TInstructionPtr> makeChecks(
+      const std::shared_ptr<TMemCheck>& anchor, int min, int max);
+
+  // True if the instruction moves reg by a constant, added to delta
+  static bool isConstantMove(const TInstructionPtr& instruction,
+                             const URegister::Ptr& reg, int* delta);
+};
@@ -9,14 +9,14 @@ void CopyPropagation::optimizeLine(FlowGraph<TInstruction>::Line line) {
     auto& node = *it;
 
     // Check if this is a move instruction
-    auto move = std::dynamic_pointer_cast<TMove>(node->getValue());
-    if (!move || std::dynamic_pointer_cast<UGet>(move->getUInstruction())) {
+    auto move = kindCast<TMove>(node->getValue());
+    if (!move || kindCast<UGet>(move->getUInstruction())) {
       continue;
     }
 
-    auto varA = std::dynamic_pointer_cast<TVariable>(move->a);
+    auto varA = kindCast<TVariable>(move->a);
     if (!varA) { continue; }
-    auto varB = std::dynamic_pointer_cast<TVariable>(move->b);
+    auto varB = kindCast<TVariable>(move->b);
 
     // Iterate over the next instructions in the block
     for (auto itProp = std::next(it); itProp != line.end(); itProp++) {
@@ -28,7 +28,7 @@ void CopyPropagation::optimizeLine(FlowGraph<TInstruction>::Line line) {
       // Stop if a or b is modified
       bool breakLoop = false;
       for (auto arg : nodeProp->getValue()->getWriteArgs()) {
-        auto var = std::dynamic_pointer_cast<TVariable>(arg);
+        auto var = kindCast<TVariable>(arg);
         if (*var == *varA) { breakLoop = true; }
         if (varB && *var == *varB) { breakLoop = true; }
       }
@@ -25,12 +25,12 @@ void DeadCodeElimination::optimizeGraph(GraphPtr graph) {
         live[node].insert(live[succ]);
       }
       for (const auto& arg : node->getValue()->getWriteArgs()) {
-        if (auto var = std::dynamic_pointer_cast<TVariable>(arg)) {
+        if (auto var = kindCast<TVariable>(arg)) {
           live[node].erase(var->getUID());
         }
       }
       for (const auto& arg : node->getValue()->getReadArgs()) {
-        if (auto var = std::dynamic_pointer_cast<TVariable>(arg)) {
+        if (auto var = kindCast<TVariable>(arg)) {
           live[node].insert(var->getUID());
         }
       }
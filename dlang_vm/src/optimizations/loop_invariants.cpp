@@ -0,0 +1,182 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include "loop_invariants.h"
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "../u_dlang/u_instruction.h"
+
+void LoopInvariantCodeMotion::optimizeGraph(GraphPtr graph) {
+  // Only the code of functions has back edges
+  auto start = graph->getStartNode();
+  if (!start || !start->getValue()->isFunction()) {
+    return;
+  }
+  SSAForm ssa(graph);
+  NaturalLoops loops(ssa);
+  auto line = graph->getLine();
+  for (const auto& loop : loops.getLoops()) {
+    if (NaturalLoops::getPreheader(loop, line)) {
+      hoistInvariants(ssa, loop);
+    }
+  }
+}
+
+void LoopInvariantCodeMotion::hoistInvariants(const SSAForm& ssa,
+                                              const NaturalLoops::Loop& loop) {
+  const auto& values = ssa.getValues();
+
+  // The registers written by a single node of the loop can be loaded once
+  std::unordered_set<size_t> written, writtenTwice;
+  for (const auto& node : loop.body) {
+    for (auto value : ssa.getDefinitions(node)) {
+      if (values[value].kind != SSAForm::Value::Phi &&
+          !written.insert(values[value].uid).second) {
+        writtenTwice.insert(values[value].uid);
+      }
+    }
+  }
+
+  // The nodes walked so far, with the value of sp when they run (relative to
+  // its value at the header) and their instruction before being moved
+  std::unordered_map<TNodePtr, std::pair<int, std::shared_ptr<TInstruction>>>
+      walked;
+  std::unordered_set<TNodePtr> hoistedNodes;
+  auto shift = [](const TArgument::Ptr& arg, int spDelta) -> TArgument::Ptr {
+    auto loc = kindCast<ULocSP>(arg->getUArgument());
+    if (!loc || spDelta == 0) { return arg; }
+    return kindCast<TVariable>(arg)->copy(
+        VMUArg::SP(loc->getOffset() + spDelta, loc->getType()));
+  };
+
+  // The argument holding the value read by a walked node before the loop,
+  // following the copies made by the walked nodes (nullptr if there is none)
+  auto findOrigin = [&](TArgument::Ptr arg, TNodePtr at) -> TArgument::Ptr {
+    while (SSAForm::isVariable(arg) && walked.count(at)) {
+      auto uid = kindCast<TVariable>(arg)->getUID();
+      const auto& value = values.at(ssa.getReads(at).at(uid));
+      if (!loop.body.count(value.node)) {
+        return shift(arg, walked.at(at).first);
+      }
+      if (value.kind != SSAForm::Value::Write || !walked.count(value.node)) {
+        return nullptr;
+      }
+      auto move = kindCast<TMove>(walked.at(value.node).second);
+      if (!move) {
+        return nullptr;
+      }
+      if (hoistedNodes.count(value.node)) {
+        return move->a;
+      }
+      arg = move->b;
+      at = value.node;
+    }
+    return nullptr;
+  };
+
+  // Walk the nodes run whenever the header is, up to the first branch, join
+  // or call
+  int spDelta = 0;
+  bool isChecked = true;
+  std::unordered_set<size_t> readBefore;
+  auto node = loop.header;
+  while (node->getSuccessors().size() == 1) {
+    node = node->getSuccessors().front();
+    if (!node || node == loop.header || !loop.body.count(node) ||
+        node->getPredecessors().size() != 1) {
+      break;
+    }
+    auto instruction = node->getValue();
+    if (kindCast<TApply>(instruction) ||
+        kindCast<TSafepoint>(instruction) ||
+        kindCast<TReturn>(instruction) ||
+        kindCast<THalt>(instruction)) {
+      break;
+    }
+    walked[node] = {spDelta, instruction};
+    const auto& reads = ssa.getReads(node);
+
+    // A variable is invariant if its value is defined outside of the loop,
+    // and so is the location of a slot (in functions it is named after fp)
+    auto isInvariant = [&](const TArgument::Ptr& arg) {
+      if (!SSAForm::isVariable(arg)) { return false; }
+      auto uid = kindCast<TVariable>(arg)->getUID();
+      return !loop.body.count(values.at(reads.at(uid)).node);
+    };
+    auto isHeapInvariant = [&](const TArgument::Ptr& ptr) {
+      return reads.count(SSAForm::kHeap) &&
+             !loop.body.count(values.at(reads.at(SSAForm::kHeap)).node) &&
+             isInvariant(ptr);
+    };
+
+    // Find the instruction to run before the loop instead (moved checks
+    // which fail report the cp of their instruction, and its sp)
+    std::shared_ptr<TInstruction> hoisted;
+    auto uInstruction = instruction->getUInstruction();
+    bool isFunction = instruction->isFunction();
+    if (auto check = kindCast<TMemCheck>(instruction)) {
+      auto loc = check->a->getUArgument();
+      if (!kindCast<ULocHeap>(loc) ||
+          isInvariant(check->ptr)) {
+        auto uCheck = kindCast<UMemCheck>(uInstruction);
+        uCheck->movedSp = uCheck->movedSp.value_or(0) + spDelta;
+        hoisted = std::make_shared<TMemCheck>(uInstruction, isFunction,
+                                              shift(check->a, spDelta),
+                                              check->ptr);
+      }
+    } else if (auto check = kindCast<TTagCheck>(instruction)) {
+      if (auto origin = findOrigin(check->a, node)) {
+        auto uCheck = kindCast<UTagCheck>(uInstruction);
+        uCheck->movedSp = uCheck->movedSp.value_or(0) + spDelta;
+        hoisted = std::make_shared<TTagCheck>(uInstruction, isFunction, origin,
+                                              check->tagA, check->tagB);
+      } else {
+        isChecked = false;
+      }
+    } else if (auto move = kindCast<TMove>(instruction)) {
+      // Loads are only moved after the checks guarding them
+      auto a = kindCast<TVariable>(move->a);
+      bool isLoad = SSAForm::isVariable(a) && !SSAForm::isSlot(a) &&
+                    !writtenTwice.count(a->getUID()) &&
+                    !readBefore.count(a->getUID()) && isChecked;
+      bool isHeapLoad = kindCast<ULocHeap>(move->b->getUArgument()) &&
+          move->ptr;
+      if (isLoad && ((SSAForm::isSlot(move->b) && isInvariant(move->b)) ||
+                     (isHeapLoad && isHeapInvariant(move->ptr)))) {
+        hoisted = std::make_shared<TMove>(uInstruction, isFunction, move->a,
+                                          shift(move->b, spDelta), move->ptr);
+      }
+    } else if (auto unary = kindCast<TUnary>(instruction)) {
+      // Checks failing before the loop would skip reading the input
+      if (kindCast<UUnary>(uInstruction)->op == Read) {
+        break;
+      }
+    }
+
+    if (hoisted) {
+      node->setValue(hoisted);
+      moveNodeBefore(node, loop.header);
+      hoistedNodes.insert(node);
+    }
+    for (const auto& [uid, value] : reads) {
+      readBefore.insert(uid);
+    }
+
+    // Follow the moves of sp by constants, and stop at any other write
+    for (const auto& arg : instruction->getWriteArgs()) {
+      if (arg->getUArgument() != VMUArg::sp) { continue; }
+      auto oper = kindCast<TOper>(instruction);
+      auto uOper = oper ? kindCast<UOper>(oper->getUInstruction()) : nullptr;
+      auto c = uOper ? kindCast<UImmediate>(uOper->c)
+                     : nullptr;
+      if (!c || uOper->b != VMUArg::sp ||
+          (uOper->op != Add && uOper->op != Sub)) {
+        return;
+      }
+      spDelta += uOper->op == Add ? c->getValue() : -c->getValue();
+    }
+  }
+}
@@ -0,0 +1,19 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include "natural_loops.h"
+#include "optimization.h"
+#include "ssa_form.h"
+
+// Moves the bounds checks, tag checks and loads made at the start of every
+// iteration of a loop before the loop, when they only depend on values
+// defined outside of it (the loops are only found in functions, where the
+// slots have the same names in the whole code)
+class LoopInvariantCodeMotion : public OptimizationGraph {
+ public:
+  virtual void optimizeGraph(GraphPtr graph);
+
+ private:
+  void hoistInvariants(const SSAForm& ssa, const NaturalLoops::Loop& loop);
+};
@@ -0,0 +1,70 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include "natural_loops.h"
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+
+NaturalLoops::NaturalLoops(const SSAForm& ssa) {
+  // Find the back edges, grouped by header
+  std::unordered_map<NodePtr, size_t> loopOf;
+  for (const auto& node : ssa.getOrder()) {
+    for (const auto& succ : node->getSuccessors()) {
+      if (!succ || !ssa.dominates(succ, node)) { continue; }
+      if (!loopOf.count(succ)) {
+        loopOf[succ] = loops_.size();
+        loops_.push_back({succ, {}, {succ}});
+      }
+      loops_.at(loopOf.at(succ)).latches.push_back(node);
+    }
+  }
+
+  // Walk backwards from the latches up to the header
+  for (auto& loop : loops_) {
+    std::vector<NodePtr> stack;
+    for (const auto& latch : loop.latches) {
+      if (loop.body.insert(latch).second) { stack.push_back(latch); }
+    }
+    while (!stack.empty()) {
+      auto node = stack.back();
+      stack.pop_back();
+      for (const auto& pred : node->getPredecessors()) {
+        if (ssa.dominates(loop.header, pred) &&
+            loop.body.insert(pred).second) {
+          stack.push_back(pred);
+        }
+      }
+    }
+  }
+
+  // Inner loops are contained in the outer ones, so they are smaller
+  std::stable_sort(loops_.begin(), loops_.end(),
+                   [](const Loop& a, const Loop& b) {
+                     return a.body.size() < b.body.size();
+                   });
+}
+
+const std::vector<NaturalLoops::Loop>& NaturalLoops::getLoops() const {
+  return loops_;
+}
+
+NaturalLoops::NodePtr NaturalLoops::getPreheader(
+    const Loop& loop, const std::vector<NodePtr>& line) {
+  auto it = std::find(line.begin(), line.end(), loop.header);
+  if (it == line.begin() || it == line.end()) {
+    return nullptr;
+  }
+  auto prev = *std::prev(it);
+  if (loop.body.count(prev) ||
+      kindCast<TInstructionBranch>(prev->getValue())) {
+    return nullptr;
+  }
+  for (const auto& pred : loop.header->getPredecessors()) {
+    if (pred != prev && !loop.body.count(pred)) {
+      return nullptr;
+    }
+  }
+  const auto& succs = prev->getSuccessors();
+  return std::count(succs.begin(), succs.end(), loop.header) ? prev : nullptr;
+}
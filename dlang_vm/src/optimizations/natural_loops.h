@@ -0,0 +1,35 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include <unordered_set>
+#include <vector>
+
+#include "ssa_form.h"
+
+// Natural loops of a flow graph: each edge to a node dominating its source is
+// a back edge, and the loop of a header is made of the nodes reaching one of
+// its back edges without going through the header
+class NaturalLoops {
+ public:
+  using NodePtr = SSAForm::NodePtr;
+
+  struct Loop {
+    NodePtr header;
+    std::vector<NodePtr> latches;
+    std::unordered_set<NodePtr> body;
+  };
+
+  explicit NaturalLoops(const SSAForm& ssa);
+
+  // The loops, with the inner ones before the ones containing them
+  const std::vector<Loop>& getLoops() const;
+
+  // The node before the header in the code, which enters the loop only by
+  // falling through to the header (nullptr if the loop has no such node)
+  static NodePtr getPreheader(const Loop& loop,
+                              const std::vector<NodePtr>& line);
+
+ private:
+  std::vector<Loop> loops_;
+};
@@ -14,19 +14,32 @@ Code<TInstruction> OptimizationGraph::optimize(const Code<TInstruction>& code) {
     tInstruction->makeFlowGraph(graph);
   }
 
-  // Optimize the graph by removing nodes
+  // Optimize the graph by removing and moving nodes
   optimizeGraph(graph);
 
-  // Re-construct code from non-removed nodes
+  // Re-construct code from non-removed nodes, in their new positions
   Code<TInstruction> optimizedCode;
   for (auto node : graph->getLine()) {
+    if (toBeMoved.count(node)) {
+      for (const auto& moved : toBeMoved.at(node)) {
+        optimizedCode.add(moved->getValue());
+      }
+    }
     if (!toBeRemoved.count(node)) {
       optimizedCode.add(node->getValue());
     }
   }
+  toBeRemoved.clear();
+  toBeMoved.clear();
   return optimizedCode;
 }
 
 void OptimizationGraph::removeNode(const TNodePtr& node) {
   toBeRemoved.insert(node);
 }
+
+void OptimizationGraph::moveNodeBefore(const TNodePtr& node,
+                                       const TNodePtr& before) {
+  toBeRemoved.insert(node);
+  toBeMoved[before].push_back(node);
+}
@@ -3,7 +3,9 @@
 #pragma once
 
 #include <memory>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "../data_structures/code.h"
 #include "../data_structures/flow_graph.h"
@@ -24,7 +26,9 @@ class OptimizationGraph : public Optimization {
 
   virtual void optimizeGraph(GraphPtr graph) = 0;
   void removeNode(const TNodePtr& node);
+  void moveNodeBefore(const TNodePtr& node, const TNodePtr& before);
 
  private:
   std::unordered_set<TNodePtr> toBeRemoved;
+  std::unordered_map<TNodePtr, std::vector<TNodePtr>> toBeMoved;
 };
@@ -2,6 +2,8 @@
 
 #include "optimizations_sequence.h"
 
+#include <unordered_set>
+
 #include "../u_dlang/u_instruction.h"
 #include "../virtual_machine/exception.h"
 
@@ -9,6 +11,21 @@ void OptimizationsSequence::add(std::shared_ptr<Optimization> optimization) {
   optimizations_.push_back(optimization);
 }
 
+void OptimizationsSequence::setRegisterAllocation(
+    std::shared_ptr<RegisterAllocation> registerAllocation) {
+  registerAllocation_ = registerAllocation;
+}
+
+void OptimizationsSequence::setTypeSpecialization(
+    std::shared_ptr<TypeSpecialization> typeSpecialization) {
+  typeSpecialization_ = typeSpecialization;
+}
+
+std::shared_ptr<TypeSpecialization>
+    OptimizationsSequence::getTypeSpecialization() const {
+  return typeSpecialization_;
+}
+
 Code<UInstruction>
     OptimizationsSequence::optimizeFunction(const Code<UInstruction>& uCode) {
   auto tState = std::make_shared<TState>();
@@ -21,10 +38,11 @@ Code<UInstruction>
 }
 
 Code<UInstruction>
-    OptimizationsSequence::optimizeTrace(const Code<UInstruction>& uCode) {
+    OptimizationsSequence::optimizeTrace(const Code<UInstruction>& uCode,
+                                         const Code<UInstruction>& guards) {
   auto tState = std::make_shared<TState>();
   try {
-    return optimize(uCode, tState);
+    return optimize(uCode, tState, guards);
   } catch (const OptimizationError&) {
     return uCode;
   }
@@ -32,9 +50,16 @@ Code<UInstruction>
 
 Code<UInstruction>
     OptimizationsSequence::optimize(const Code<UInstruction>& uCode,
-                                    std::shared_ptr<TState> tState) {
-  // Create t-code instructions
+                                    std::shared_ptr<TState> tState,
+                                    const Code<UInstruction>& guards) {
+  // Create t-code instructions, starting with the guards
   Code<TInstruction> tCode;
+  std::unordered_set<std::shared_ptr<TInstruction>> tGuards;
+  for (auto instruction : guards) {
+    auto tGuard = instruction->getTInstruction(tState);
+    tGuards.insert(tGuard);
+    tCode.add(tGuard);
+  }
   for (auto instruction : uCode) {
     tCode.add(instruction->getTInstruction(tState));
   }
@@ -47,7 +72,15 @@ Code<UInstruction>
   // Create optimized u-code instructions
   Code<UInstruction> uCodeOptimized;
   for (auto instruction : tCode) {
-    uCodeOptimized.add(instruction->getUInstruction());
+    if (!tGuards.count(instruction)) {
+      uCodeOptimized.add(instruction->getUInstruction());
+    }
+  }
+
+  // Allocate registers after all the other optimizations
+  if (registerAllocation_) {
+    uCodeOptimized = registerAllocation_->allocate(uCodeOptimized,
+                                                    tState->isFunction());
   }
 
   return uCodeOptimized;
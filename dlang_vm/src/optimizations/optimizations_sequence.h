@@ -6,14 +6,28 @@
 #include <vector>
 
 #include "optimization.h"
+#include "register_allocation.h"
+#include "type_specialization.h"
 
 class OptimizationsSequence {
  public:
   void add(std::shared_ptr<Optimization> optimization);
+  void setRegisterAllocation(
+      std::shared_ptr<RegisterAllocation> registerAllocation);
+  void setTypeSpecialization(
+      std::shared_ptr<TypeSpecialization> typeSpecialization);
+  std::shared_ptr<TypeSpecialization> getTypeSpecialization() const;
   Code<UInstruction> optimizeFunction(const Code<UInstruction>& code);
-  Code<UInstruction> optimizeTrace(const Code<UInstruction>& code);
+
+  // The guards are assumed to hold at the start of the trace, and they are
+  // not part of the optimized code
+  Code<UInstruction> optimizeTrace(const Code<UInstruction>& code,
+                                   const Code<UInstruction>& guards = {});
  private:
   Code<UInstruction> optimize(const Code<UInstruction>& code,
-                              std::shared_ptr<TState> tState);
+                              std::shared_ptr<TState> tState,
+                              const Code<UInstruction>& guards = {});
   std::vector<std::shared_ptr<Optimization>> optimizations_;
+  std::shared_ptr<RegisterAllocation> registerAllocation_;
+  std::shared_ptr<TypeSpecialization> typeSpecialization_;
 };
@@ -2,7 +2,9 @@
 
 #include "redundant_checks.h"
 
+#include <iterator>
 #include <unordered_map>
+#include <utility>
 
 #include "../u_dlang/u_instruction.h"
 
@@ -20,10 +22,8 @@ void RemoveRedundantChecks::optimizeGraph(GraphPtr graph) {
   do {
     availHasChanged = false;
     for (const auto& node : graph->getLine()) {
-      auto availOld = avail[node];
-
-      avail[node] = node->getPredecessors().empty() ? ExprSet::makeEmpty()
-                                                    : ExprSet::makeUniverse();
+      auto availNew = node->getPredecessors().empty() ? ExprSet::makeEmpty()
+                                                      : ExprSet::makeUniverse();
       for (auto pred : node->getPredecessors()) {
         // Set of predecessors
         ExprSet predSet = avail[pred];
@@ -40,19 +40,23 @@ void RemoveRedundantChecks::optimizeGraph(GraphPtr graph) {
         if (auto check = pred->getValue()->getEffects().getMemCheck()) {
           predSet.insert(check);
         }
+        if (auto move = kindCast<TMove>(pred->getValue())) {
+          predSet.copyTags(move->b, move->a);
+        }
         if (auto write = pred->getValue()->getEffects().getWrite()) {
-          if (auto uSet = std::dynamic_pointer_cast<USet>(
-              pred->getValue()->getUInstruction())) {
-            if (auto uImm = std::dynamic_pointer_cast<UImmTag>(uSet->b)) {
+          if (auto uSet =
+                  kindCast<USet>(pred->getValue()->getUInstruction())) {
+            if (auto uImm = kindCast<UImmTag>(uSet->b)) {
               predSet.insert(*write, uImm->getValue());
             }
           }
         }
 
         // Intersect with other predecessors
-        avail[node].intersect(predSet);
+        availNew.intersect(std::move(predSet));
       }
-      availHasChanged |= availOld != avail[node];
+      availHasChanged |= availNew != avail[node];
+      avail[node] = std::move(availNew);
     }
   } while (availHasChanged);
 
@@ -81,13 +85,13 @@ RemoveRedundantChecks::ExprSet RemoveRedundantChecks::ExprSet::makeUniverse() {
 }
 
 void RemoveRedundantChecks::ExprSet::insert(const TEffects::Check& effect) {
-  if (auto var = std::dynamic_pointer_cast<TVariable>(effect.first)) {
+  if (auto var = kindCast<TVariable>(effect.first)) {
     insert(kNumTags_ * var->getUID() + static_cast<int>(effect.second.first));
   }
 }
 
 void RemoveRedundantChecks::ExprSet::insert(const TArgument::Ptr effect) {
-  if (auto var = std::dynamic_pointer_cast<TVariable>(effect)) {
+  if (auto var = kindCast<TVariable>(effect)) {
     insert(kNumTags_ * var->getUID() + kNumTags_ - 1);
   }
 }
@@ -96,16 +100,29 @@ void RemoveRedundantChecks::ExprSet::insert(const TVariable& var, int tag) {
   insert(kNumTags_ * var.getUID() + tag);
 }
 
+void RemoveRedundantChecks::ExprSet::copyTags(TArgument::Ptr from,
+                                              TArgument::Ptr to) {
+  auto varFrom = kindCast<TVariable>(from);
+  auto varTo = kindCast<TVariable>(to);
+  if (varFrom && varTo) {
+    for (size_t i = 0; i < kNumTags_ - 1; i++) {
+      if (get(kNumTags_ * varFrom->getUID() + i)) {
+        insert(kNumTags_ * varTo->getUID() + i);
+      }
+    }
+  }
+}
+
 void RemoveRedundantChecks::ExprSet::erase(TArgument::Ptr arg) {
-  if (auto var = std::dynamic_pointer_cast<TVariable>(arg)) {
-    for (int i = 0; i < kNumTags_; i++) {
+  if (auto var = kindCast<TVariable>(arg)) {
+    for (size_t i = 0; i < kNumTags_; i++) {
       erase(kNumTags_ * var->getUID() + i);
     }
   }
 }
 
 bool RemoveRedundantChecks::ExprSet::get(const TEffects::Check& effect) {
-  if (auto var = std::dynamic_pointer_cast<TVariable>(effect.first)) {
+  if (auto var = kindCast<TVariable>(effect.first)) {
     return get(kNumTags_ * var->getUID()
                + static_cast<int>(effect.second.first));
   }
@@ -113,38 +130,28 @@ bool RemoveRedundantChecks::ExprSet::get(const TEffects::Check& effect) {
 }
 
 bool RemoveRedundantChecks::ExprSet::get(TArgument::Ptr effect) {
-  if (auto var = std::dynamic_pointer_cast<TVariable>(effect)) {
+  if (auto var = kindCast<TVariable>(effect)) {
     return get(kNumTags_ * var->getUID() + kNumTags_ - 1);
   }
   return false;
 }
 
-void RemoveRedundantChecks::ExprSet::intersect(const ExprSet& other) {
-  std::unordered_set<int> newVal;
-  if (!conj_) {
-    for (auto x : val_) {
-      if (other.get(x)) {
-        newVal.insert(x);
-      }
+void RemoveRedundantChecks::ExprSet::intersect(ExprSet other) {
+  if (conj_ && val_.empty()) {
+    // The universe set takes the other set
+    *this = std::move(other);
+  } else if (!conj_) {
+    for (auto it = val_.begin(); it != val_.end();) {
+      it = other.get(*it) ? std::next(it) : val_.erase(it);
     }
-  } else {
-    if (!other.conj_) {
-      for (auto x : other.val_) {
-        if (get(x)) {
-          newVal.insert(x);
-        }
-      }
-      conj_ = false;
-    } else {
-      for (auto x : val_) {
-        newVal.insert(x);
-      }
-      for (auto x : other.val_) {
-        newVal.insert(x);
-      }
+  } else if (!other.conj_) {
+    for (auto it = other.val_.begin(); it != other.val_.end();) {
+      it = get(*it) ? std::next(it) : other.val_.erase(it);
     }
+    *this = std::move(other);
+  } else {
+    val_.insert(other.val_.begin(), other.val_.end());
   }
-  val_ = newVal;
 }
 
 bool RemoveRedundantChecks::ExprSet::operator!=(const ExprSet& other) {
@@ -18,9 +18,12 @@ class RemoveRedundantChecks : public OptimizationGraph {
     void insert(TArgument::Ptr effect);
     void insert(const TVariable& var, int tag);
     void erase(TArgument::Ptr arg);
+
+    // The tags checked for from are known for to as well
+    void copyTags(TArgument::Ptr from, TArgument::Ptr to);
     bool get(const TEffects::Check& effect);
     bool get(TArgument::Ptr effect);
-    void intersect(const ExprSet& other);
+    void intersect(ExprSet other);
     bool operator!=(const ExprSet& other);
 
    private:
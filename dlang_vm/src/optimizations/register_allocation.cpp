@@ -0,0 +1,920 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include "register_allocation.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <numeric>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "natural_loops.h"
+#include "ssa_form.h"
+#include "../t_dlang/t_state.h"
+#include "../virtual_machine/exception.h"
+
+RegisterAllocation::RegisterAllocation()
+    : registers_(VMUArg::allocatable()) {}
+
+RegisterAllocation::RegisterAllocation(std::vector<URegister::Ptr> registers)
+    : registers_(registers) {}
+
+Code<UInstruction>
+    RegisterAllocation::allocate(const Code<UInstruction>& uCode,
+                                 bool isFunction) const {
+  // Slots of functions are promoted first, and their registers are pinned
+  std::unordered_set<jit_reg_t> pinned;
+  auto uCodePromoted = isFunction ? promoteSlots(uCode, pinned) : uCode;
+  std::vector<URegister::Ptr> registers;
+  for (const auto& reg : registers_) {
+    if (!pinned.count(reg->getReg())) { registers.push_back(reg); }
+  }
+
+  // Branch destinations can be reached with any value in the registers
+  std::unordered_set<size_t> destinations;
+  for (auto instruction : uCodePromoted) {
+    if (auto uGoto = kindCast<UGoto>(instruction)) {
+      destinations.insert(uGoto->destination);
+    }
+    if (auto uBranch = kindCast<UBranch>(instruction)) {
+      destinations.insert(uBranch->destination);
+    }
+  }
+
+  // Split the code in segments starting at branch destinations and at entry
+  // points (the instruction after the function label or after an application)
+  std::vector<Segment> segments(1);
+  size_t labels = 0;
+  bool afterApply = false;
+  for (auto instruction : uCodePromoted) {
+    if (kindCast<ULabel>(instruction)) {
+      bool isEntry = afterApply || (isFunction && labels == 1);
+      if (isEntry || destinations.count(instruction->cp)) {
+        segments.emplace_back();
+      }
+      afterApply = false;
+      labels++;
+    }
+    if (kindCast<UApply>(instruction)) {
+      afterApply = true;
+    }
+    segments.back().push_back(instruction);
+  }
+
+  // Segments continue at the destinations of their branches, and at the
+  // next segment unless they end with a jump (exits leave no registers live)
+  std::unordered_map<size_t, size_t> segmentAt;
+  for (size_t s = 1; s < segments.size(); s++) {
+    segmentAt.insert({segments[s].front()->cp, s});
+  }
+  auto getDestination = [&](const UInstructionPtr& instruction)
+      -> std::optional<size_t> {
+    auto uGoto = kindCast<UGoto>(instruction);
+    auto uBranch = kindCast<UBranch>(instruction);
+    auto it = segmentAt.find(uGoto ? uGoto->destination
+                             : uBranch ? uBranch->destination : SIZE_MAX);
+    if (it == segmentAt.end()) { return std::nullopt; }
+    return it->second;
+  };
+  auto fallsThrough = [&](size_t s) {
+    for (auto it = segments[s].rbegin(); it != segments[s].rend(); it++) {
+      if (kindCast<UGuard>(*it)) { continue; }
+      return !kindCast<UGoto>(*it) && !kindCast<UReturn>(*it) &&
+             !kindCast<UHalt>(*it) && s + 1 < segments.size();
+    }
+    return s + 1 < segments.size();
+  };
+
+  // Registers live out of each segment (at its end or at its branches) hold
+  // values used by other segments, which must not be renamed, and are
+  // computed backwards through the instructions until nothing changes
+  auto isGP = [&](const URegister::Ptr& reg) {
+    return kindCast<URegGP>(reg) != nullptr && !pinned.count(reg->getReg());
+  };
+  std::vector<std::unordered_set<jit_reg_t>> liveIn(segments.size());
+  std::vector<std::unordered_set<jit_reg_t>> liveOut(segments.size());
+  bool hasChanged;
+  do {
+    hasChanged = false;
+    for (size_t s = segments.size(); s-- > 0;) {
+      std::unordered_set<jit_reg_t> live;
+      if (fallsThrough(s)) { live = liveIn[s + 1]; }
+      auto out = live;
+      for (auto it = segments[s].rbegin(); it != segments[s].rend(); it++) {
+        if (auto destination = getDestination(*it)) {
+          live.insert(liveIn[*destination].begin(),
+                      liveIn[*destination].end());
+          out.insert(liveIn[*destination].begin(),
+                     liveIn[*destination].end());
+        }
+        mapRegisters(*it,
+            [&](const URegister::Ptr& reg) { return reg; },
+            [&](const URegister::Ptr& reg) {
+              live.erase(reg->getReg());
+              return reg;
+            });
+        mapRegisters(*it,
+            [&](const URegister::Ptr& reg) {
+              if (isGP(reg)) { live.insert(reg->getReg()); }
+              return reg;
+            },
+            [&](const URegister::Ptr& reg) { return reg; });
+      }
+      if (live != liveIn[s] || out != liveOut[s]) {
+        liveIn[s] = live;
+        liveOut[s] = out;
+        hasChanged = true;
+      }
+    }
+  } while (hasChanged);
+
+  // Allocate the registers of each segment, or keep it as it is
+  Code<UInstruction> uCodeAllocated;
+  for (size_t s = 0; s < segments.size(); s++) {
+    auto allocated = allocateSegment(segments[s], liveOut[s], registers,
+                                     pinned);
+    for (const auto& instruction : allocated ? *allocated : segments[s]) {
+      uCodeAllocated.add(instruction);
+    }
+  }
+  return uCodeAllocated;
+}
+
+Code<UInstruction>
+    RegisterAllocation::promoteSlots(const Code<UInstruction>& uCode,
+                                     std::unordered_set<jit_reg_t>& pinned)
+    const {
+  // Only the registers not used by the u-code can hold slots
+  std::unordered_set<jit_reg_t> used;
+  RegisterMap use = [&](const URegister::Ptr& reg) {
+    used.insert(reg->getReg());
+    return reg;
+  };
+  for (const auto& instruction : uCode) {
+    mapRegisters(instruction, use, use);
+  }
+  std::vector<URegister::Ptr> free;
+  for (const auto& reg : registers_) {
+    if (!used.count(reg->getReg())) { free.push_back(reg); }
+  }
+  if (free.empty()) {
+    return uCode;
+  }
+
+  // Build the graph of the code, with the depth of the stack before each
+  // instruction (which is not known from when sp is set to anything but
+  // itself plus a constant, until the next label)
+  size_t n = uCode.size();
+  auto tState = std::make_shared<TState>();
+  tState->setFunction();
+  auto graph = std::make_shared<FlowGraph<TInstruction>>();
+  std::vector<int> depths;
+  std::vector<std::optional<size_t>> lostDepth;
+  std::optional<size_t> lost;
+  try {
+    for (size_t i = 0; i < n; i++) {
+      auto instruction = uCode.getInstruction(i);
+      if (kindCast<ULabel>(instruction)) { lost.reset(); }
+      depths.push_back(tState->getSp());
+      lostDepth.push_back(lost);
+      instruction->getTInstruction(tState)->makeFlowGraph(graph);
+
+      auto oper = kindCast<UOper>(instruction);
+      auto move = kindCast<UMove>(instruction);
+      auto a = oper ? oper->a : move ? move->a : nullptr;
+      auto b = oper ? kindCast<URegister>(oper->b) : nullptr;
+      bool isShift = b && b->getReg() == JITVM::sp &&
+                     kindCast<UImmediate>(oper->c) &&
+                     (oper->op == Add || oper->op == Sub);
+      if (a && a->getReg() == JITVM::sp && !isShift && !lost) { lost = i; }
+    }
+  } catch (const OptimizationError&) {
+    return uCode;
+  }
+  depths.push_back(tState->getSp());
+
+  // Guards leave a function only at the end of the code, or if the cp is
+  // checked by the label after them (when it is not known, as done by the
+  // jit), otherwise they fall through to the next instruction
+  std::vector<bool> isExit(n, true);
+  size_t knownCp = n ? uCode.getInstruction(0)->cp : 0;
+  bool isCpKnown = true;
+  for (size_t i = 0; i < n; i++) {
+    auto instruction = uCode.getInstruction(i);
+    if (kindCast<UApply>(instruction) || kindCast<UReturn>(instruction) ||
+        kindCast<UHalt>(instruction)) {
+      isCpKnown = false;
+    } else if (kindCast<ULabel>(instruction)) {
+      auto cp = instruction->cp;
+      bool isChecked = !isCpKnown || (knownCp != cp && knownCp + 1 != cp);
+      for (auto j = i; j-- > 0 && kindCast<UGuard>(uCode.getInstruction(j));) {
+        isExit[j] = isChecked;
+      }
+      knownCp = cp;
+      isCpKnown = true;
+    }
+  }
+
+  auto line = graph->getLine();
+  std::unordered_map<SSAForm::NodePtr, size_t> indexOf;
+  for (size_t i = 0; i < line.size(); i++) {
+    indexOf[line[i]] = i;
+  }
+  SSAForm ssa(graph);
+  const auto& order = ssa.getOrder();
+  const auto& values = ssa.getValues();
+  if (order.empty()) {
+    return uCode;
+  }
+
+  // Accesses in loops weigh more
+  std::unordered_map<SSAForm::NodePtr, size_t> weights;
+  for (const auto& node : order) {
+    weights[node] = 1;
+  }
+  NaturalLoops loops(ssa);
+  for (const auto& loop : loops.getLoops()) {
+    for (const auto& node : loop.body) {
+      weights[node] = std::min(weights[node] * kLoopWeight, kMaxWeight);
+    }
+  }
+
+  // The value read or written by a get, set or tag check of a slot
+  auto isAccess = [&](size_t i) {
+    auto instruction = uCode.getInstruction(i);
+    return kindCast<UGet>(instruction) || kindCast<USet>(instruction) ||
+           (kindCast<UTagCheck>(instruction) &&
+            !kindCast<UTypeGuard>(instruction));
+  };
+  auto getAccessed = [&](size_t i) -> std::optional<size_t> {
+    if (!isAccess(i)) { return std::nullopt; }
+    auto node = line[i];
+    bool isSet = kindCast<USet>(uCode.getInstruction(i)) != nullptr;
+    const auto& accessed = isSet ? ssa.getWrites(node) : ssa.getReads(node);
+    for (const auto& arg : isSet ? node->getValue()->getWriteArgs()
+                                 : node->getValue()->getReadArgs()) {
+      if (!SSAForm::isSlot(arg)) { continue; }
+      auto it = accessed.find(kindCast<TVariable>(arg)->getUID());
+      if (it != accessed.end()) { return it->second; }
+    }
+    return std::nullopt;
+  };
+
+  // The offset from fp and the type of each slot, which can be promoted if
+  // it is only accessed by gets, sets and tag checks at known depths (calls
+  // and returns read it from memory), and if its values are not truncated
+  struct Slot {
+    int offset = 0;
+    VirtualMachine::Type type = VMUArg::Val;
+    bool isPromotable = true;
+  };
+  std::unordered_map<size_t, Slot> slots;
+  for (const auto& node : order) {
+    auto i = indexOf.at(node);
+    auto instruction = uCode.getInstruction(i);
+    bool isCall =
+        kindCast<UApply>(instruction) || kindCast<UReturn>(instruction);
+    auto instructionT = node->getValue();
+    for (const auto& args : {instructionT->getReadArgs(),
+                             instructionT->getWriteArgs()}) {
+      for (const auto& arg : args) {
+        if (!SSAForm::isSlot(arg)) { continue; }
+        auto& slot = slots[kindCast<TVariable>(arg)->getUID()];
+        auto loc = kindCast<ULocation>(arg->getUArgument());
+        if (isAccess(i)) {
+          bool isSP = kindCast<ULocSP>(loc) != nullptr;
+          slot.offset = loc->getOffset() + (isSP ? depths[i] + 2 : 0);
+          slot.type = loc->getType();
+          slot.isPromotable &= !(isSP && lostDepth[i]) &&
+                               (!Cell::kCompact || slot.type == VMUArg::Tag);
+        } else if (!isCall) {
+          slot.isPromotable = false;
+        }
+      }
+    }
+  }
+
+  // Values already in memory: the loaded ones, and the phis joining them
+  std::vector<bool> isInMemory(values.size());
+  for (size_t i = 0; i < values.size(); i++) {
+    isInMemory[i] = values[i].kind != SSAForm::Value::Write;
+  }
+  bool hasChanged;
+  do {
+    hasChanged = false;
+    for (size_t i = 0; i < values.size(); i++) {
+      if (values[i].kind != SSAForm::Value::Phi || !isInMemory[i]) {
+        continue;
+      }
+      for (auto operand : values[i].operands) {
+        if (!isInMemory[operand]) {
+          isInMemory[i] = false;
+          hasChanged = true;
+          break;
+        }
+      }
+    }
+  } while (hasChanged);
+
+  // Values not in memory are stored where the SSA form needs them there (if
+  // the code is left there), or before sp is set when its depth is lost,
+  // unless they are above sp (which is not part of the state of the vm)
+  auto getStoreSite = [&](size_t i) {
+    return lostDepth[i] ? *lostDepth[i] : i;
+  };
+  auto isStored = [&](size_t value, size_t i) {
+    return isExit[i] && !isInMemory[value] &&
+           slots.at(values[value].uid).offset < depths[getStoreSite(i)] + 2;
+  };
+
+  // Values read by accesses, or stored where they are needed in memory, and
+  // the values joined by their phis
+  std::vector<bool> isLive(values.size());
+  std::vector<size_t> workList;
+  auto setLive = [&](size_t value) {
+    if (!isLive[value]) {
+      isLive[value] = true;
+      workList.push_back(value);
+    }
+  };
+  for (const auto& node : order) {
+    auto i = indexOf.at(node);
+    auto value = getAccessed(i);
+    if (value && !kindCast<USet>(uCode.getInstruction(i))) {
+      setLive(*value);
+    }
+    for (auto materialized : ssa.getMaterialized(node)) {
+      if (isStored(materialized, i)) { setLive(materialized); }
+    }
+  }
+  while (!workList.empty()) {
+    auto value = workList.back();
+    workList.pop_back();
+    for (auto operand : values[value].operands) {
+      setLive(operand);
+    }
+  }
+
+  // The live values of a slot joined by phis form a web, held in one
+  // register
+  std::vector<size_t> webOf(values.size());
+  std::iota(webOf.begin(), webOf.end(), 0);
+  auto find = [&](size_t value) {
+    while (webOf[value] != value) {
+      webOf[value] = webOf[webOf[value]];
+      value = webOf[value];
+    }
+    return value;
+  };
+  for (size_t i = 0; i < values.size(); i++) {
+    if (values[i].kind == SSAForm::Value::Phi && isLive[i] &&
+        slots.count(values[i].uid)) {
+      for (auto operand : values[i].operands) {
+        webOf[find(operand)] = find(i);
+      }
+    }
+  }
+
+  // The benefit of each web is the weight of its accesses, which become
+  // moves, and its cost is the weight of its loads and stores
+  struct Web {
+    size_t benefit = 0;
+    size_t cost = 0;
+    bool isPromotable = true;
+  };
+  std::vector<Web> webs(values.size());
+  for (size_t i = 0; i < values.size(); i++) {
+    if (slots.count(values[i].uid)) {
+      webs[find(i)].isPromotable &= slots.at(values[i].uid).isPromotable;
+    }
+  }
+  for (const auto& node : order) {
+    if (auto value = getAccessed(indexOf.at(node))) {
+      webs[find(*value)].benefit += weights.at(node);
+    }
+  }
+
+  // Loaded items are read after the label where the code is entered (at the
+  // start or after a call) if the label is reached only from there, and if
+  // they are below sp, so that they are allocated
+  std::map<size_t, std::vector<size_t>> loads;
+  for (size_t i = 0; i < values.size(); i++) {
+    if (values[i].kind != SSAForm::Value::Memory || !isLive[i] ||
+        !slots.count(values[i].uid)) {
+      continue;
+    }
+    auto node = values[i].node;
+    auto j = indexOf.at(node);
+    std::optional<size_t> site;
+    if (node == order.front()) {
+      if (node->getPredecessors().empty()) { site = j; }
+    } else {
+      for (j++; j < n && kindCast<UGuard>(uCode.getInstruction(j)); j++) {}
+      if (j < n && line[j]->getPredecessors().size() == 1) { site = j; }
+    }
+    if (site && *site + 1 < n &&
+        kindCast<ULabel>(uCode.getInstruction(*site)) &&
+        !lostDepth[*site + 1] &&
+        slots.at(values[i].uid).offset < depths[*site + 1] + 2) {
+      loads[*site].push_back(i);
+      webs[find(i)].cost += weights.count(line[*site])
+                                ? weights.at(line[*site]) : 1;
+    } else {
+      webs[find(i)].isPromotable = false;
+    }
+  }
+
+  // Stores before sp is set must not skip writes to the slots
+  std::map<size_t, std::vector<size_t>> stores;
+  for (const auto& node : order) {
+    auto i = indexOf.at(node);
+    auto site = getStoreSite(i);
+    std::vector<size_t> stored;
+    for (auto value : ssa.getMaterialized(node)) {
+      if (isStored(value, i)) { stored.push_back(value); }
+    }
+    if (stored.empty()) { continue; }
+    for (auto k = site; k < i; k++) {
+      for (const auto& [uid, value] : ssa.getWrites(line[k])) {
+        if (slots.count(uid)) { webs[find(value)].isPromotable = false; }
+      }
+    }
+    for (auto value : stored) {
+      stores[site].push_back(value);
+      webs[find(value)].cost += weights.at(node);
+    }
+  }
+
+  // The webs worth promoting are the candidates for the registers
+  std::vector<size_t> candidates;
+  std::unordered_map<size_t, size_t> candidateOf;
+  for (size_t i = 0; i < values.size(); i++) {
+    const auto& web = webs[i];
+    if (find(i) == i && slots.count(values[i].uid) && web.isPromotable &&
+        web.benefit > web.cost) {
+      candidateOf[i] = candidates.size();
+      candidates.push_back(i);
+    }
+  }
+  if (candidates.empty()) {
+    return uCode;
+  }
+  auto getCandidate = [&](size_t value) -> std::optional<size_t> {
+    auto it = candidateOf.find(find(value));
+    if (it == candidateOf.end()) { return std::nullopt; }
+    return it->second;
+  };
+
+  // Uses and definitions of the candidates at each node (the webs joined by
+  // a phi share the register, so phis are neither)
+  size_t m = order.size();
+  std::unordered_map<SSAForm::NodePtr, size_t> position;
+  std::vector<std::vector<size_t>> uses(m), defs(m);
+  for (size_t p = 0; p < m; p++) {
+    auto node = order[p];
+    position[node] = p;
+    auto i = indexOf.at(node);
+    auto value = getAccessed(i);
+    auto candidate = value ? getCandidate(*value) : std::nullopt;
+    if (candidate) {
+      bool isSet = kindCast<USet>(uCode.getInstruction(i)) != nullptr;
+      (isSet ? defs : uses)[p].push_back(*candidate);
+    }
+    for (auto materialized : ssa.getMaterialized(node)) {
+      auto stored = getCandidate(materialized);
+      if (stored && isStored(materialized, i)) {
+        uses[p].push_back(*stored);
+      }
+    }
+    for (auto defined : ssa.getDefinitions(node)) {
+      auto loaded = getCandidate(defined);
+      if (loaded && values[defined].kind == SSAForm::Value::Memory) {
+        defs[p].push_back(*loaded);
+      }
+    }
+  }
+  for (size_t i = 0; i < values.size(); i++) {
+    auto loaded = getCandidate(i);
+    if (loaded && values[i].kind == SSAForm::Value::Memory &&
+        values[i].node == order.front()) {
+      defs[0].push_back(*loaded);
+    }
+  }
+
+  // Candidates live at the same time interfere, liveness is computed
+  // backwards until nothing changes
+  size_t c = candidates.size();
+  std::vector<std::vector<bool>> liveIn(m, std::vector<bool>(c));
+  std::vector<std::vector<bool>> liveOut(m, std::vector<bool>(c));
+  do {
+    hasChanged = false;
+    for (size_t p = m; p-- > 0;) {
+      std::vector<bool> out(c);
+      for (const auto& succ : order[p]->getSuccessors()) {
+        if (!succ || !position.count(succ)) { continue; }
+        const auto& in = liveIn[position.at(succ)];
+        for (size_t k = 0; k < c; k++) {
+          out[k] = out[k] || in[k];
+        }
+      }
+      auto in = out;
+      for (auto k : defs[p]) { in[k] = false; }
+      for (auto k : uses[p]) { in[k] = true; }
+      if (in != liveIn[p] || out != liveOut[p]) {
+        liveIn[p] = in;
+        liveOut[p] = out;
+        hasChanged = true;
+      }
+    }
+  } while (hasChanged);
+  std::vector<std::vector<bool>> interferes(c, std::vector<bool>(c));
+  for (size_t p = 0; p < m; p++) {
+    for (auto k : defs[p]) {
+      for (size_t l = 0; l < c; l++) {
+        if (l != k && liveOut[p][l]) {
+          interferes[k][l] = interferes[l][k] = true;
+        }
+      }
+    }
+  }
+
+  // Color the candidates with the free registers, most profitable first
+  std::vector<size_t> sorted(c);
+  std::iota(sorted.begin(), sorted.end(), 0);
+  auto profit = [&](size_t k) {
+    const auto& web = webs[candidates[k]];
+    return web.benefit - web.cost;
+  };
+  std::stable_sort(sorted.begin(), sorted.end(), [&](size_t k, size_t l) {
+    return profit(k) > profit(l);
+  });
+  std::vector<std::optional<size_t>> colors(c);
+  for (auto k : sorted) {
+    std::vector<bool> isTaken(free.size());
+    for (size_t l = 0; l < c; l++) {
+      if (interferes[k][l] && colors[l]) { isTaken[*colors[l]] = true; }
+    }
+    for (size_t reg = 0; reg < free.size() && !colors[k]; reg++) {
+      if (!isTaken[reg]) { colors[k] = reg; }
+    }
+  }
+  auto getRegister = [&](size_t value) -> URegister::Ptr {
+    auto candidate = getCandidate(value);
+    if (!candidate || !colors[*candidate]) { return nullptr; }
+    return free[*colors[*candidate]];
+  };
+
+  // Accesses to promoted webs become moves, with the loads and stores
+  Code<UInstruction> uCodePromoted;
+  auto getLocation = [&](size_t value, size_t i) {
+    const auto& slot = slots.at(values[value].uid);
+    return VMUArg::SP(slot.offset - 2 - depths[i], slot.type);
+  };
+  for (size_t i = 0; i < n; i++) {
+    auto instruction = uCode.getInstruction(i);
+    auto cp = instruction->cp;
+    auto vm = instruction->vm;
+    if (stores.count(i)) {
+      for (auto value : stores.at(i)) {
+        if (auto reg = getRegister(value)) {
+          uCodePromoted.add(std::make_shared<USet>(
+              cp, vm, getLocation(value, i), reg));
+        }
+      }
+    }
+
+    auto value = position.count(line[i]) ? getAccessed(i) : std::nullopt;
+    auto reg = value ? getRegister(*value) : nullptr;
+    if (!reg) {
+      uCodePromoted.add(instruction);
+    } else if (auto get = kindCast<UGet>(instruction)) {
+      uCodePromoted.add(std::make_shared<UMove>(cp, vm, get->a, reg));
+      pinned.insert(reg->getReg());
+    } else if (auto set = kindCast<USet>(instruction)) {
+      uCodePromoted.add(std::make_shared<UMove>(cp, vm, reg, set->b));
+      pinned.insert(reg->getReg());
+    } else if (auto tagCheck = kindCast<UTagCheck>(instruction)) {
+      auto promoted = std::make_shared<UTagCheck>(cp, vm, reg, tagCheck->tagA,
+                                                  tagCheck->tagB);
+      promoted->movedSp = tagCheck->movedSp;
+      uCodePromoted.add(promoted);
+      pinned.insert(reg->getReg());
+    }
+
+    if (loads.count(i)) {
+      for (auto value : loads.at(i)) {
+        if (auto reg = getRegister(value)) {
+          uCodePromoted.add(std::make_shared<UGet>(
+              cp, vm, reg, getLocation(value, i + 1)));
+        }
+      }
+    }
+  }
+  return uCodePromoted;
+}
+
+std::optional<RegisterAllocation::Segment>
+    RegisterAllocation::allocateSegment(
+        const Segment& segment,
+        const std::unordered_set<jit_reg_t>& liveOut,
+        const std::vector<URegister::Ptr>& registers,
+        const std::unordered_set<jit_reg_t>& pinned) {
+  // Instructions using virtual registers, with the load to use instead when
+  // the instruction uses a forwarded value which is spilled
+  struct Entry {
+    UInstructionPtr instruction;
+    UInstructionPtr reload;
+  };
+  std::vector<Entry> entries;
+
+  // Each write to a general purpose register defines a new virtual register
+  // (segments sharing registers with other segments are kept as they are)
+  std::vector<URegister::Ptr> virtuals;
+  std::unordered_map<const URegister*, size_t> ids;
+  std::unordered_map<jit_reg_t, URegister::Ptr> current;
+  bool isShared = false;
+  auto isGP = [&](const URegister::Ptr& reg) {
+    return kindCast<URegGP>(reg) != nullptr && !pinned.count(reg->getReg());
+  };
+  RegisterMap read = [&](const URegister::Ptr& reg) {
+    if (!isGP(reg)) { return reg; }
+    auto it = current.find(reg->getReg());
+    if (it == current.end()) {
+      isShared = true;
+      return reg;
+    }
+    return it->second;
+  };
+  RegisterMap write = [&](const URegister::Ptr& reg) {
+    if (!isGP(reg)) { return reg; }
+    isShared |= liveOut.count(reg->getReg()) > 0;
+    URegister::Ptr virtualReg = std::make_shared<URegGP>(
+        "%" + std::to_string(virtuals.size()), reg->getReg());
+    ids.insert({virtualReg.get(), virtuals.size()});
+    virtuals.push_back(virtualReg);
+    current[reg->getReg()] = virtualReg;
+    return virtualReg;
+  };
+
+  // Known values of the stack slots (sp slots are relative to the sp at the
+  // start of the segment, fp slots to the current fp)
+  using Slot = std::tuple<bool, int, VirtualMachine::Type>;
+  std::map<Slot, UOperand::Ptr> slots;
+  int spDelta = 0;
+  auto getSlot = [&](const UArgument::Ptr& arg,
+                     VirtualMachine::Type type) -> std::optional<Slot> {
+    if (auto loc = kindCast<ULocSP>(arg)) {
+      return Slot{false, loc->getOffset() + spDelta, type};
+    }
+    if (auto loc = kindCast<ULocFP>(arg)) {
+      return Slot{true, loc->getOffset(), type};
+    }
+    return std::nullopt;
+  };
+  auto clearSlots = [&](bool isFP) {
+    for (auto it = slots.begin(); it != slots.end();) {
+      it = std::get<0>(it->first) == isFP ? slots.erase(it) : std::next(it);
+    }
+  };
+
+  // Rename the registers and forward the values of the stack slots
+  for (const auto& instruction : segment) {
+    Entry entry;
+    auto get = kindCast<UGet>(instruction);
+    auto set = kindCast<USet>(instruction);
+    auto tagCheck = kindCast<UTagCheck>(instruction);
+    auto getSlotKey = get ? getSlot(get->b, get->b->getType()) : std::nullopt;
+    auto tagSlotKey = tagCheck ? getSlot(tagCheck->a, VMUArg::Tag)
+                               : std::nullopt;
+
+    if (getSlotKey && slots.count(*getSlotKey)) {
+      auto a = write(get->a);
+      entry.instruction = std::make_shared<UMove>(get->cp, get->vm, a,
+                                                  slots.at(*getSlotKey));
+      entry.reload = std::make_shared<UGet>(get->cp, get->vm, a, get->b);
+    } else if (tagSlotKey && slots.count(*tagSlotKey)) {
+      auto cached = std::make_shared<UTagCheck>(
+          tagCheck->cp, tagCheck->vm, slots.at(*tagSlotKey),
+          tagCheck->tagA, tagCheck->tagB);
+      cached->movedSp = tagCheck->movedSp;
+      entry.instruction = cached;
+      entry.reload = instruction;
+    } else {
+      entry.instruction = mapRegisters(instruction, read, write);
+    }
+
+    // The loaded or stored value is now known (compact cells truncate values,
+    // so only their tags can be forwarded)
+    auto isForwarded = [](const Slot& slot) {
+      return !Cell::kCompact || std::get<2>(slot) == VMUArg::Tag;
+    };
+    if (getSlotKey && !slots.count(*getSlotKey) && isForwarded(*getSlotKey) &&
+        isGP(get->a)) {
+      slots[*getSlotKey] = kindCast<UGet>(entry.instruction)->a;
+    }
+    if (set) {
+      if (auto slot = getSlot(set->a, set->a->getType())) {
+        // Slots relative to sp and fp can overlap
+        clearSlots(!std::get<0>(*slot));
+        auto value = kindCast<USet>(entry.instruction)->b;
+        auto valueReg = kindCast<URegister>(value);
+        if ((!valueReg || isGP(valueReg)) && isForwarded(*slot)) {
+          slots[*slot] = value;
+        } else {
+          slots.erase(*slot);
+        }
+      }
+    }
+
+    // Moving sp shifts its slots, other changes of sp and fp invalidate them
+    auto oper = kindCast<UOper>(instruction);
+    auto move = kindCast<UMove>(instruction);
+    auto written = oper ? oper->a : move ? move->a : nullptr;
+    if (written && written->getReg() == JITVM::sp) {
+      auto b = oper ? kindCast<URegister>(oper->b) : nullptr;
+      auto c = oper ? kindCast<UImmediate>(oper->c) : nullptr;
+      if (b && b->getReg() == JITVM::sp && c && oper->op == Add) {
+        spDelta += c->getValue();
+      } else if (b && b->getReg() == JITVM::sp && c && oper->op == Sub) {
+        spDelta -= c->getValue();
+      } else {
+        clearSlots(false);
+      }
+    }
+    if (written && written->getReg() == JITVM::fp) {
+      clearSlots(true);
+    }
+    if (kindCast<UApply>(instruction) ||
+        kindCast<UReturn>(instruction)) {
+      slots.clear();
+    }
+
+    entries.push_back(entry);
+  }
+  if (isShared) {
+    return std::nullopt;
+  }
+
+  // Find the definition and the uses of the virtual registers
+  std::vector<size_t> def(virtuals.size());
+  std::vector<std::vector<size_t>> uses(virtuals.size());
+  std::vector<std::optional<size_t>> defined(entries.size());
+  for (size_t i = 0; i < entries.size(); i++) {
+    mapRegisters(entries[i].instruction,
+        [&](const URegister::Ptr& reg) {
+          if (ids.count(reg.get())) { uses[ids.at(reg.get())].push_back(i); }
+          return reg;
+        },
+        [&](const URegister::Ptr& reg) {
+          if (ids.count(reg.get())) {
+            def[ids.at(reg.get())] = i;
+            defined[i] = ids.at(reg.get());
+          }
+          return reg;
+        });
+  }
+  auto end = [&](size_t id) {
+    return uses[id].empty() ? def[id] : uses[id].back();
+  };
+
+  // Linear scan over the live intervals, in order of definition
+  std::vector<size_t> assigned(virtuals.size());
+  std::vector<size_t> active;
+  for (size_t i = 0; i < entries.size(); i++) {
+    if (!defined[i]) { continue; }
+
+    // Registers are read before the result is written
+    active.erase(std::remove_if(active.begin(), active.end(),
+                                [&](size_t id) { return end(id) <= i; }),
+                 active.end());
+    std::vector<bool> isUsed(registers.size());
+    for (auto id : active) {
+      isUsed[assigned[id]] = true;
+    }
+
+    // Prefer the register of a moved value, so that the move can be removed
+    std::optional<size_t> chosen;
+    if (auto move = kindCast<UMove>(entries[i].instruction)) {
+      auto b = kindCast<URegister>(move->b);
+      if (b && ids.count(b.get()) && !isUsed[assigned[ids.at(b.get())]]) {
+        chosen = assigned[ids.at(b.get())];
+      }
+    }
+    for (size_t reg = 0; reg < registers.size() && !chosen; reg++) {
+      if (!isUsed[reg]) { chosen = reg; }
+    }
+
+    if (!chosen) {
+      // Spill the interval ending last among the ones whose next uses are
+      // all forwarded values, which can be loaded from the stack instead
+      std::optional<size_t> spilled;
+      for (auto id : active) {
+        bool forwardedOnly = std::all_of(
+            std::lower_bound(uses[id].begin(), uses[id].end(), i),
+            uses[id].end(),
+            [&](size_t use) { return entries[use].reload != nullptr; });
+        if (forwardedOnly && (!spilled || end(id) > end(*spilled))) {
+          spilled = id;
+        }
+      }
+      if (!spilled) {
+        return std::nullopt;
+      }
+      while (!uses[*spilled].empty() && uses[*spilled].back() >= i) {
+        auto& entry = entries[uses[*spilled].back()];
+        entry.instruction = entry.reload;
+        entry.reload = nullptr;
+        uses[*spilled].pop_back();
+      }
+      active.erase(std::find(active.begin(), active.end(), *spilled));
+      chosen = assigned[*spilled];
+    }
+
+    assigned[*defined[i]] = *chosen;
+    active.push_back(*defined[i]);
+  }
+
+  // Replace the virtual registers, removing moves to the same register
+  RegisterMap assign = [&](const URegister::Ptr& reg) {
+    return ids.count(reg.get()) ? registers[assigned[ids.at(reg.get())]] : reg;
+  };
+  Segment allocated;
+  for (const auto& entry : entries) {
+    auto instruction = mapRegisters(entry.instruction, assign, assign);
+    if (auto move = kindCast<UMove>(instruction)) {
+      auto b = kindCast<URegister>(move->b);
+      if (b && b->getReg() == move->a->getReg()) { continue; }
+    }
+    allocated.push_back(instruction);
+  }
+  return allocated;
+}
+
+RegisterAllocation::UInstructionPtr
+    RegisterAllocation::mapRegisters(const UInstructionPtr& instruction,
+                                     const RegisterMap& read,
+                                     const RegisterMap& write) {
+  auto operand = [&](const UOperand::Ptr& oper) -> UOperand::Ptr {
+    auto reg = kindCast<URegister>(oper);
+    return reg ? read(reg) : oper;
+  };
+  auto location = [&](const ULocation::Ptr& loc) -> ULocation::Ptr {
+    auto heapLoc = kindCast<ULocHeap>(loc);
+    if (!heapLoc) { return loc; }
+    auto ptr = read(heapLoc->getPtr());
+    if (ptr == heapLoc->getPtr()) { return loc; }
+    return VMUArg::Heap(ptr, heapLoc->getOffset(), heapLoc->getType());
+  };
+
+  // Read registers are mapped before written ones
+  auto cp = instruction->cp;
+  auto vm = instruction->vm;
+  if (auto get = kindCast<UGet>(instruction)) {
+    auto b = location(get->b);
+    return std::make_shared<UGet>(cp, vm, write(get->a), b);
+  }
+  if (auto set = kindCast<USet>(instruction)) {
+    auto a = location(set->a);
+    return std::make_shared<USet>(cp, vm, a, operand(set->b));
+  }
+  if (auto move = kindCast<UMove>(instruction)) {
+    auto b = operand(move->b);
+    return std::make_shared<UMove>(cp, vm, write(move->a), b);
+  }
+  if (auto unary = kindCast<UUnary>(instruction)) {
+    auto b = operand(unary->b);
+    return std::make_shared<UUnary>(cp, vm, unary->op, write(unary->a), b);
+  }
+  if (auto oper = kindCast<UOper>(instruction)) {
+    auto b = operand(oper->b);
+    auto c = operand(oper->c);
+    return std::make_shared<UOper>(cp, vm, oper->op, write(oper->a), b, c);
+  }
+  if (auto memCheck = kindCast<UMemCheck>(instruction)) {
+    auto memCheckNew = std::make_shared<UMemCheck>(cp, vm,
+                                                   location(memCheck->a));
+    memCheckNew->movedSp = memCheck->movedSp;
+    return memCheckNew;
+  }
+  if (auto tagCheck = kindCast<UTagCheck>(instruction)) {
+    UArgument::Ptr a = tagCheck->a;
+    if (auto reg = kindCast<URegister>(a)) {
+      a = read(reg);
+    }
+    if (auto loc = kindCast<ULocation>(a)) {
+      a = location(loc);
+    }
+    auto tagCheckNew = std::make_shared<UTagCheck>(cp, vm, a, tagCheck->tagA,
+                                                   tagCheck->tagB);
+    tagCheckNew->movedSp = tagCheck->movedSp;
+    return tagCheckNew;
+  }
+  if (auto branch = kindCast<UBranch>(instruction)) {
+    return std::make_shared<UBranch>(cp, vm, read(branch->a),
+                                     branch->destination);
+  }
+  return instruction;
+}
@@ -0,0 +1,65 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <unordered_set>
+#include <vector>
+
+#include "../data_structures/code.h"
+#include "../u_dlang/u_instruction.h"
+
+// Register allocation of the optimized u-code.
+// In functions, the stack slots are first promoted to the registers not used
+// by the u-code, across blocks: the SSA form of the slots gives the webs of
+// values joined by phis, each web is held in one register, loaded where the
+// code is entered (at the start and after calls) and stored only where the
+// SSA form needs it in memory (exits, calls and safepoints).
+// Then in each straight-line segment of code the general purpose registers
+// are renamed to virtual registers (except the ones live across segments,
+// found by a liveness analysis over the segments), and values stored on the
+// stack are forwarded to the following loads of the same slot. The virtual
+// registers are assigned to the remaining allocatable lightning registers
+// with a linear scan, turning forwarded values back into loads when there
+// are not enough registers.
+class RegisterAllocation {
+ public:
+  RegisterAllocation();
+  explicit RegisterAllocation(std::vector<URegister::Ptr> registers);
+
+  Code<UInstruction> allocate(const Code<UInstruction>& uCode,
+                              bool isFunction) const;
+
+ private:
+  using UInstructionPtr = std::shared_ptr<UInstruction>;
+  using Segment = std::vector<UInstructionPtr>;
+  using RegisterMap = std::function<URegister::Ptr(const URegister::Ptr&)>;
+
+  // Accesses in loops weigh more, by this factor for each level of nesting
+  static constexpr size_t kLoopWeight = 8;
+  static constexpr size_t kMaxWeight = 512;
+
+  // Code of a function with the profitable webs of slots held in registers,
+  // which are added to pinned
+  Code<UInstruction> promoteSlots(const Code<UInstruction>& uCode,
+                                  std::unordered_set<jit_reg_t>& pinned) const;
+
+  // Returns nothing if the segment uses registers defined outside of it,
+  // writes registers used outside of it (liveOut), or if there are not
+  // enough registers (pinned registers are left as they are)
+  static std::optional<Segment> allocateSegment(
+      const Segment& segment,
+      const std::unordered_set<jit_reg_t>& liveOut,
+      const std::vector<URegister::Ptr>& registers,
+      const std::unordered_set<jit_reg_t>& pinned);
+
+  // Copy of the instruction with its read and written registers replaced
+  static UInstructionPtr mapRegisters(const UInstructionPtr& instruction,
+                                      const RegisterMap& read,
+                                      const RegisterMap& write);
+
+  std::vector<URegister::Ptr> registers_;
+};
@@ -0,0 +1,387 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include "scalar_replacement.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+#include "ssa_form.h"
+#include "../u_dlang/u_instruction.h"
+
+Code<TInstruction> ScalarReplacement::optimize(
+    const Code<TInstruction>& tCode) {
+  std::vector<TInstructionPtr> line(tCode.begin(), tCode.end());
+  bool isFunction = !line.empty() && line.front()->isFunction();
+  std::unordered_set<size_t> destinations;
+  for (const auto& instruction : line) {
+    if (auto branch = kindCast<TInstructionBranch>(instruction)) {
+      destinations.insert(branch->destination);
+    }
+  }
+
+  // The instructions replacing some of the code, by index
+  std::unordered_map<size_t, std::vector<TInstructionPtr>> replaced;
+
+  // The objects allocated, and the one whose fields are being stored
+  std::vector<Object> objects;
+  std::optional<size_t> allocating;
+
+  // The versions of the variables and of the names of each kind, the offset
+  // of sp, the other holders of the value of each variable, and the objects
+  // whose pointer is held by each variable
+  std::unordered_map<size_t, size_t> versions;
+  std::vector<size_t> epochs(3, 0);
+  int spOffset = 0;
+  std::unordered_map<size_t, std::vector<Holder>> sources;
+  std::unordered_map<size_t, std::pair<size_t, Kind>> holds;
+  std::unordered_map<jit_reg_t, size_t> registerUIDs;
+
+  auto getKind = [](const TArgument::Ptr& arg) {
+    if (kindCast<ULocSP>(arg->getUArgument())) { return SP; }
+    if (kindCast<ULocFP>(arg->getUArgument())) { return FP; }
+    return Register;
+  };
+  auto getUID = [](const TArgument::Ptr& arg) {
+    return kindCast<TVariable>(arg)->getUID();
+  };
+  auto isValid = [&](const Holder& holder) {
+    return !SSAForm::isVariable(holder.arg) ||
+           (versions[getUID(holder.arg)] == holder.version &&
+            epochs[getKind(holder.arg)] == holder.epoch);
+  };
+  auto getHolders = [&](const TArgument::Ptr& arg) {
+    std::vector<Holder> holders;
+    if (kindCast<TImmediate>(arg)) {
+      holders.push_back({arg, 0, 0, 0});
+    } else if (SSAForm::isVariable(arg)) {
+      auto uid = getUID(arg);
+      holders.push_back({arg, versions[uid], epochs[getKind(arg)], spOffset});
+      for (const auto& holder : sources[uid]) {
+        if (isValid(holder) && holders.size() < kMaxHolders_) {
+          holders.push_back(holder);
+        }
+      }
+    }
+    return holders;
+  };
+
+  // The argument of a holder where sp is now
+  auto getArgument = [&](const Holder& holder) -> TArgument::Ptr {
+    auto loc = kindCast<ULocSP>(holder.arg->getUArgument());
+    if (!loc || holder.sp == spOffset) {
+      return holder.arg;
+    }
+    return kindCast<TVariable>(holder.arg)->copy(
+        VMUArg::SP(loc->getOffset() + holder.sp - spOffset, loc->getType()));
+  };
+
+  // The object pointed to by a variable, or by the pointer of a location
+  auto getObject = [&](const TArgument::Ptr& arg) -> std::optional<size_t> {
+    if (SSAForm::isVariable(arg) && holds.count(getUID(arg))) {
+      return holds.at(getUID(arg)).first;
+    }
+    auto loc = kindCast<ULocHeap>(arg->getUArgument());
+    if (loc && registerUIDs.count(loc->getPtr()->getReg())) {
+      auto uid = registerUIDs.at(loc->getPtr()->getReg());
+      if (holds.count(uid)) {
+        return holds.at(uid).first;
+      }
+    }
+    return std::nullopt;
+  };
+
+  // The valid holder of a field of the object, among those fitting
+  auto getField = [&](const Object& object, int offset,
+                      VirtualMachine::Type type, bool isSlotAllowed) {
+    std::optional<Holder> field;
+    auto it = object.fields.find({offset, static_cast<int>(type)});
+    if (it == object.fields.end() || !isImmutable(object)) {
+      return field;
+    }
+    for (const auto& holder : it->second) {
+      if (isValid(holder) && (isSlotAllowed || !SSAForm::isSlot(holder.arg))) {
+        field = holder;
+        break;
+      }
+    }
+    return field;
+  };
+
+  // The objects held by variables of some kinds escape when the code can be
+  // left, and are lost when the variables are renamed
+  auto escape = [&](const std::vector<Kind>& kinds, bool isLost) {
+    for (auto it = holds.begin(); it != holds.end();) {
+      auto [object, kind] = it->second;
+      bool isMatching =
+          std::find(kinds.begin(), kinds.end(), kind) != kinds.end();
+      if (isMatching) {
+        objects.at(object).isEscaped = true;
+      }
+      it = isMatching && isLost ? holds.erase(it) : std::next(it);
+    }
+  };
+
+  // Nothing is known at the start of a region, while the registers are not
+  // looked at once the code is left
+  auto startRegion = [&](bool isLeaving) {
+    if (isLeaving) {
+      escape({SP, FP}, true);
+    } else {
+      escape({SP, FP, Register}, true);
+    }
+    holds.clear();
+    if (allocating) {
+      objects.at(*allocating).isEscaped = true;
+      allocating.reset();
+    }
+    sources.clear();
+    for (auto& epoch : epochs) {
+      epoch++;
+    }
+  };
+
+  // The object being allocated, from its first check or store
+  auto getAllocating = [&]() -> Object& {
+    if (!allocating) {
+      allocating = objects.size();
+      objects.emplace_back();
+    }
+    return objects.at(*allocating);
+  };
+
+  size_t labels = 0;
+  bool afterApply = false;
+  for (size_t i = 0; i < line.size(); i++) {
+    const auto& instruction = line[i];
+
+    // Values from other code can reach a label from an entry or a branch
+    if (kindCast<TLabel>(instruction)) {
+      size_t cp = instruction->getUInstruction()->cp;
+      bool isEntry = afterApply || (isFunction && labels == 1);
+      if (isEntry || labels == 0 || destinations.count(cp)) {
+        startRegion(false);
+      }
+      afterApply = false;
+      labels++;
+    }
+    for (const auto& args : {instruction->getReadArgs(),
+                             instruction->getWriteArgs()}) {
+      for (const auto& arg : args) {
+        auto reg = kindCast<URegGP>(arg->getUArgument());
+        if (reg && SSAForm::isVariable(arg)) {
+          registerUIDs[reg->getReg()] = getUID(arg);
+        }
+      }
+    }
+
+    // The uses of the pointers to the objects which are understood, the
+    // holders of the value copied by the instruction, and the object whose
+    // pointer it copies
+    std::unordered_set<TArgument::Ptr> understood;
+    std::optional<std::vector<Holder>> copied;
+    std::optional<size_t> pointer;
+
+    if (auto move = kindCast<TMove>(instruction)) {
+      auto aLoc = kindCast<ULocHeap>(move->a->getUArgument());
+      auto bLoc = kindCast<ULocHeap>(move->b->getUArgument());
+      auto bReg = kindCast<URegister>(move->b->getUArgument());
+      auto loaded = move->ptr ? getObject(move->ptr) : std::nullopt;
+      if (aLoc && aLoc->getPtr()->getReg() == JITVM::hp) {
+        // Store of a field of the object being allocated
+        auto& object = getAllocating();
+        object.fields[{aLoc->getOffset(), static_cast<int>(aLoc->getType())}] =
+            getHolders(move->b);
+        object.allocation.push_back(i);
+      } else if (bLoc && loaded) {
+        // Load of a field, from where the value stored still is
+        understood.insert({move->b, move->ptr});
+        auto& object = objects.at(*loaded);
+        auto isRegister = kindCast<URegister>(
+            move->a->getUArgument()) != nullptr;
+        if (auto field = getField(object, bLoc->getOffset(), bLoc->getType(),
+                                  isRegister)) {
+          auto arg = getArgument(*field);
+          replaced[i] = {std::make_shared<TMove>(
+              instruction->getUInstruction(), instruction->isFunction(),
+              move->a, arg)};
+          copied = getHolders(arg);
+          pointer = getObject(arg);
+        } else {
+          object.isEscaped = true;
+        }
+      } else if (!bLoc || !SSAForm::isVariable(move->a)) {
+        // Copy of a value, or of the pointer to the object being allocated
+        copied = getHolders(move->b);
+        if (SSAForm::isVariable(move->a)) {
+          pointer = getObject(move->b);
+          if (pointer) { understood.insert(move->b); }
+          if (bReg && bReg->getReg() == JITVM::hp && allocating) {
+            pointer = allocating;
+          }
+        }
+      }
+    } else if (auto check = kindCast<TMemCheck>(instruction)) {
+      // The fields of the objects are allocated
+      auto loc = kindCast<ULocation>(check->a->getUArgument());
+      if (loc->getPtr()->getReg() == JITVM::hp) {
+        getAllocating().allocation.push_back(i);
+      } else if (auto object = getObject(check->ptr)) {
+        understood.insert({check->a, check->ptr});
+        auto size = objects.at(*object).size;
+        if (size && loc->getOffset() >= 0 && loc->getOffset() < *size) {
+          replaced[i] = {};
+        } else {
+          objects.at(*object).isEscaped = true;
+        }
+      }
+    } else if (auto check = kindCast<TTagCheck>(instruction)) {
+      // The tags of the fields are known, or held by other variables
+      auto loc = kindCast<ULocHeap>(check->a->getUArgument());
+      auto object = getObject(check->a);
+      if (loc && object) {
+        understood.insert({check->a, check->ptr});
+        auto field = getField(objects.at(*object), loc->getOffset(),
+                              VirtualMachine::Tag, true);
+        auto imm = field ? kindCast<UImmediate>(
+                               field->arg->getUArgument()) : nullptr;
+        if (imm && (imm->getValue() == check->tagA ||
+                    imm->getValue() == check->tagB)) {
+          replaced[i] = {};
+        } else if (field) {
+          // A known tag which does not match always fails the check here,
+          // without reading the pointer
+          replaced[i] = {std::make_shared<TTagCheck>(
+              instruction->getUInstruction(), instruction->isFunction(),
+              getArgument(*field), check->tagA, check->tagB)};
+          if (imm) { objects.at(*object).isEscaped = true; }
+        } else {
+          objects.at(*object).isEscaped = true;
+        }
+      }
+    }
+
+    // Any other use of a pointer lets the object escape
+    for (const auto& arg : instruction->getReadArgs()) {
+      auto object = understood.count(arg) ? std::nullopt : getObject(arg);
+      if (object) { objects.at(*object).isEscaped = true; }
+    }
+    for (const auto& arg : instruction->getWriteArgs()) {
+      auto isHeap = kindCast<ULocHeap>(arg->getUArgument()) != nullptr;
+      auto object = isHeap ? getObject(arg) : std::nullopt;
+      if (object) { objects.at(*object).isEscaped = true; }
+    }
+
+    // The vm can look at the stack, and branches can reach code looking at
+    // the registers too
+    if (kindCast<TSafepoint>(instruction) ||
+        kindCast<TGuard>(instruction)) {
+      escape({SP, FP}, false);
+    }
+    if (kindCast<TInstructionBranch>(instruction)) {
+      escape({SP, FP, Register}, false);
+    }
+
+    for (const auto& arg : instruction->getWriteArgs()) {
+      // Follow the allocations and the moves of sp and fp
+      auto reg = kindCast<URegister>(arg->getUArgument());
+      if (reg && !SSAForm::isVariable(arg)) {
+        int delta = 0;
+        bool isConstant = isConstantMove(instruction, reg, &delta);
+        if (reg->getReg() == JITVM::sp && isConstant) {
+          spOffset += delta;
+        } else if (reg->getReg() == JITVM::sp || reg->getReg() == JITVM::fp) {
+          escape({SP, FP}, true);
+          epochs[reg->getReg() == JITVM::sp ? SP : FP]++;
+        } else if (reg->getReg() == JITVM::hp && allocating) {
+          auto& object = objects.at(*allocating);
+          if (isConstant) {
+            object.size = delta;
+            object.allocation.push_back(i);
+          } else {
+            object.isEscaped = true;
+          }
+          allocating.reset();
+        }
+        continue;
+      }
+      if (!SSAForm::isVariable(arg)) {
+        continue;
+      }
+
+      // The variable written holds a new value
+      auto uid = getUID(arg);
+      versions[uid]++;
+      holds.erase(uid);
+      sources.erase(uid);
+      if (!isFunction && getKind(arg) != Register) {
+        // In traces the slots named after sp and fp can be the same
+        auto other = getKind(arg) == SP ? FP : SP;
+        escape({other}, true);
+        epochs[other]++;
+      }
+      auto move = kindCast<TMove>(instruction);
+      if (move && arg == move->a) {
+        if (copied) { sources[uid] = *copied; }
+        if (pointer) { holds[uid] = {*pointer, getKind(arg)}; }
+      }
+    }
+
+    // Calls and returns leave the code
+    if (kindCast<TApply>(instruction) ||
+        kindCast<TReturn>(instruction) ||
+        kindCast<THalt>(instruction)) {
+      startRegion(true);
+      afterApply = kindCast<TApply>(instruction) != nullptr;
+    }
+  }
+  startRegion(false);
+
+  // The objects which did not escape are not allocated
+  for (const auto& object : objects) {
+    if (!object.isEscaped && object.size && isImmutable(object)) {
+      for (auto index : object.allocation) {
+        replaced[index] = {};
+      }
+    }
+  }
+
+  Code<TInstruction> tCodeOptimized;
+  for (size_t i = 0; i < line.size(); i++) {
+    if (!replaced.count(i)) {
+      tCodeOptimized.add(line[i]);
+      continue;
+    }
+    for (const auto& instruction : replaced.at(i)) {
+      tCodeOptimized.add(instruction);
+    }
+  }
+  return tCodeOptimized;
+}
+
+bool ScalarReplacement::isImmutable(const Object& object) {
+  // Pairs, sums and closures are never written, while references have no
+  // header
+  auto it = object.fields.find({0, static_cast<int>(VirtualMachine::Tag)});
+  if (it == object.fields.end() || it->second.empty()) {
+    return false;
+  }
+  auto imm = kindCast<UImmediate>(it->second.front().arg->getUArgument());
+  return imm && (imm->getValue() == PairHeader ||
+                 imm->getValue() == InlHeader ||
+                 imm->getValue() == InrHeader ||
+                 imm->getValue() == ClosureHeader);
+}
+
+bool ScalarReplacement::isConstantMove(const TInstructionPtr& instruction,
+                                       const URegister::Ptr& reg, int* delta) {
+  auto oper = kindCast<TOper>(instruction);
+  auto uOper = oper ? kindCast<UOper>(oper->getUInstruction()) : nullptr;
+  auto b = uOper ? kindCast<URegister>(uOper->b) : nullptr;
+  auto c = uOper ? kindCast<UImmediate>(uOper->c) : nullptr;
+  if (!b || !c || b->getReg() != reg->getReg() ||
+      (uOper->op != Add && uOper->op != Sub)) {
+    return false;
+  }
+  *delta = uOper->op == Add ? c->getValue() : -c->getValue();
+  return true;
+}
@@ -0,0 +1,59 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "optimization.h"
+#include "../u_dlang/u_argument.h"
+
+// Scalar replacement of the pairs, sums and closures allocated by the code.
+// The pointers to the objects allocated are followed through the registers
+// and slots holding them, and the fields read through them are taken from
+// where the stored values still are. Objects whose pointer is only used to
+// read them, and is gone from the stack before the code can be left, are not
+// allocated at all (the others are kept as they are, as the code can be left
+// at almost any instruction).
+class ScalarReplacement : public Optimization {
+ public:
+  virtual Code<TInstruction> optimize(const Code<TInstruction>& tCode);
+
+ private:
+  using TInstructionPtr = std::shared_ptr<TInstruction>;
+
+  // The kinds of variables, which are renamed in different ways
+  enum Kind { SP, FP, Register };
+
+  // An argument holding a value, while its variable is not written and its
+  // kind is not renamed (with the offset of sp when slots are named after it)
+  struct Holder {
+    TArgument::Ptr arg;
+    size_t version;
+    size_t epoch;
+    int sp;
+  };
+
+  // An object allocated by the code, with the holders of its fields (by
+  // offset and type) and the instructions allocating it
+  struct Object {
+    std::map<std::pair<int, int>, std::vector<Holder>> fields;
+    std::vector<size_t> allocation;
+    std::optional<int> size;
+    bool isEscaped = false;
+  };
+
+  // Most holders kept for each value
+  static constexpr size_t kMaxHolders_ = 4;
+
+  // True if the instruction moves reg by a constant, stored in delta
+  static bool isConstantMove(const TInstructionPtr& instruction,
+                             const URegister::Ptr& reg, int* delta);
+
+  // True if the fields of the object are never written after allocation
+  static bool isImmutable(const Object& object);
+};
@@ -0,0 +1,384 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include "ssa_form.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "../u_dlang/u_argument.h"
+
+SSAForm::SSAForm(GraphPtr graph) {
+  computeOrder(graph);
+  computeDominators();
+  placePhis();
+  rename();
+}
+
+bool SSAForm::isSlot(const TArgument::Ptr& arg) {
+  return arg->getKind() == TArgument::Variable &&
+         ULocStack::isKind(arg->getUArgument()->getKind());
+}
+
+bool SSAForm::isVariable(const TArgument::Ptr& arg) {
+  return isSlot(arg) ||
+         (arg->getKind() == TArgument::Variable &&
+          arg->getUArgument()->getKind() == UArgument::RegGP);
+}
+
+const std::vector<SSAForm::NodePtr>& SSAForm::getOrder() const {
+  return order_;
+}
+
+SSAForm::NodePtr SSAForm::getImmediateDominator(const NodePtr& node) const {
+  if (!index_.count(node) || node == order_.front()) {
+    return nullptr;
+  }
+  return order_.at(idom_.at(index_.at(node)));
+}
+
+bool SSAForm::dominates(const NodePtr& a, const NodePtr& b) const {
+  if (!index_.count(a) || !index_.count(b)) {
+    return false;
+  }
+  // Walk up the dominator tree, where indices only decrease
+  auto i = index_.at(a);
+  auto j = index_.at(b);
+  while (j > i) {
+    j = idom_.at(j);
+  }
+  return i == j;
+}
+
+std::vector<SSAForm::NodePtr> SSAForm::getDominated(
+    const NodePtr& node) const {
+  std::vector<NodePtr> dominated;
+  if (index_.count(node)) {
+    for (auto i : dominated_.at(index_.at(node))) {
+      dominated.push_back(order_.at(i));
+    }
+  }
+  return dominated;
+}
+
+const std::vector<SSAForm::Value>& SSAForm::getValues() const {
+  return values_;
+}
+
+const std::vector<size_t>& SSAForm::getPhis(const NodePtr& node) const {
+  static const std::vector<size_t> kEmpty;
+  return index_.count(node) ? phis_.at(index_.at(node)) : kEmpty;
+}
+
+const SSAForm::ValueMap& SSAForm::getReads(const NodePtr& node) const {
+  static const ValueMap kEmpty;
+  return index_.count(node) ? reads_.at(index_.at(node)) : kEmpty;
+}
+
+const SSAForm::ValueMap& SSAForm::getWrites(const NodePtr& node) const {
+  static const ValueMap kEmpty;
+  return index_.count(node) ? writes_.at(index_.at(node)) : kEmpty;
+}
+
+const std::vector<size_t>& SSAForm::getDefinitions(
+    const NodePtr& node) const {
+  static const std::vector<size_t> kEmpty;
+  return index_.count(node) ? definitions_.at(index_.at(node)) : kEmpty;
+}
+
+const std::vector<size_t>& SSAForm::getMaterialized(
+    const NodePtr& node) const {
+  static const std::vector<size_t> kEmpty;
+  return index_.count(node) ? materialized_.at(index_.at(node)) : kEmpty;
+}
+
+void SSAForm::computeOrder(const GraphPtr& graph) {
+  // Postorder of the nodes reachable from the start (without recursion, as
+  // nodes are single instructions and the graph can be deep)
+  auto start = graph->getStartNode();
+  if (!start) { return; }
+  std::unordered_set<NodePtr> visited = {start};
+  std::vector<std::pair<NodePtr, size_t>> stack = {{start, 0}};
+  while (!stack.empty()) {
+    auto& [node, next] = stack.back();
+    if (next < node->getSuccessors().size()) {
+      auto succ = node->getSuccessors().at(next++);
+      if (succ && !visited.count(succ)) {
+        visited.insert(succ);
+        stack.emplace_back(succ, 0);
+      }
+    } else {
+      order_.push_back(node);
+      stack.pop_back();
+    }
+  }
+  std::reverse(order_.begin(), order_.end());
+
+  // Index the nodes and collect the variables
+  std::unordered_set<size_t> variables, slots;
+  for (size_t i = 0; i < order_.size(); i++) {
+    index_[order_[i]] = i;
+    ids_.insert(order_[i]->getId());
+    auto instruction = order_[i]->getValue();
+    for (const auto& args : {instruction->getReadArgs(),
+                             instruction->getWriteArgs()}) {
+      for (const auto& arg : args) {
+        auto var = kindCast<TVariable>(arg);
+        if (isVariable(arg)) { variables.insert(var->getUID()); }
+        if (isSlot(arg)) { slots.insert(var->getUID()); }
+      }
+    }
+  }
+  if (!order_.empty()) {
+    variables.insert(kHeap);
+  }
+  variables_.assign(variables.begin(), variables.end());
+  std::sort(variables_.begin(), variables_.end());
+  slots_.assign(slots.begin(), slots.end());
+  std::sort(slots_.begin(), slots_.end());
+}
+
+void SSAForm::computeDominators() {
+  // Iterative algorithm over the reverse postorder (Cooper, Harvey, Kennedy)
+  size_t n = order_.size();
+  const size_t kUndefined = n;
+  idom_.assign(n, kUndefined);
+  if (n == 0) { return; }
+  idom_[0] = 0;
+  bool hasChanged;
+  do {
+    hasChanged = false;
+    for (size_t i = 1; i < n; i++) {
+      size_t newIdom = kUndefined;
+      for (const auto& pred : order_[i]->getPredecessors()) {
+        if (!index_.count(pred) || idom_[index_.at(pred)] == kUndefined) {
+          continue;
+        }
+        size_t p = index_.at(pred);
+        if (newIdom == kUndefined) {
+          newIdom = p;
+          continue;
+        }
+        while (p != newIdom) {
+          while (p > newIdom) { p = idom_[p]; }
+          while (newIdom > p) { newIdom = idom_[newIdom]; }
+        }
+      }
+      if (idom_[i] != newIdom) {
+        idom_[i] = newIdom;
+        hasChanged = true;
+      }
+    }
+  } while (hasChanged);
+
+  // Dominator tree and dominance frontiers
+  dominated_.assign(n, {});
+  frontier_.assign(n, {});
+  for (size_t i = 1; i < n; i++) {
+    dominated_[idom_[i]].push_back(i);
+  }
+  for (size_t i = 0; i < n; i++) {
+    const auto& preds = order_[i]->getPredecessors();
+    if (preds.size() < 2) { continue; }
+    for (const auto& pred : preds) {
+      if (!index_.count(pred)) { continue; }
+      for (size_t runner = index_.at(pred); runner != idom_[i];
+           runner = idom_[runner]) {
+        if (std::find(frontier_[runner].begin(), frontier_[runner].end(), i) ==
+            frontier_[runner].end()) {
+          frontier_[runner].push_back(i);
+        }
+        if (runner == 0) { break; }
+      }
+    }
+  }
+}
+
+void SSAForm::placePhis() {
+  // The nodes defining each variable (calls define all of them)
+  std::unordered_map<size_t, std::vector<size_t>> defSites;
+  std::vector<size_t> calls;
+  for (size_t i = 0; i < order_.size(); i++) {
+    auto instruction = order_[i]->getValue();
+    if (instruction->getKind() == TInstruction::Apply) {
+      calls.push_back(i);
+    }
+    for (const auto& arg : instruction->getWriteArgs()) {
+      if (isVariable(arg)) {
+        defSites[kindCast<TVariable>(arg)->getUID()].push_back(i);
+      }
+    }
+    if (writesHeap(instruction)) {
+      defSites[kHeap].push_back(i);
+    }
+  }
+
+  // Place phis on the iterated dominance frontiers of the definitions
+  phis_.assign(order_.size(), {});
+  for (auto uid : variables_) {
+    auto workList = defSites[uid];
+    workList.insert(workList.end(), calls.begin(), calls.end());
+    std::vector<bool> hasPhi(order_.size(), false);
+    std::vector<bool> isQueued(order_.size(), false);
+    for (auto i : workList) { isQueued[i] = true; }
+    while (!workList.empty()) {
+      auto i = workList.back();
+      workList.pop_back();
+      for (auto j : frontier_[i]) {
+        if (!hasPhi[j]) {
+          hasPhi[j] = true;
+          phis_[j].push_back(addValue(Value::Phi, order_[j], uid));
+          if (!isQueued[j]) {
+            isQueued[j] = true;
+            workList.push_back(j);
+          }
+        }
+      }
+    }
+  }
+}
+
+void SSAForm::rename() {
+  size_t n = order_.size();
+  reads_.assign(n, {});
+  writes_.assign(n, {});
+  definitions_.assign(n, {});
+  materialized_.assign(n, {});
+  if (n == 0) { return; }
+
+  // The variables hold unknown items when entering the code
+  std::unordered_map<size_t, std::vector<size_t>> current;
+  for (auto uid : variables_) {
+    current[uid].push_back(addValue(Value::Memory, order_[0], uid));
+  }
+  for (auto& value : values_) {
+    if (value.kind == Value::Phi) {
+      value.operands.assign(value.node->getPredecessors().size(),
+                            current.at(value.uid).front());
+    }
+  }
+
+  // Walk the dominator tree, keeping the current value of each variable
+  std::vector<std::pair<size_t, bool>> stack = {{0, false}};
+  std::vector<std::vector<size_t>> pushed(n);
+  while (!stack.empty()) {
+    auto [i, isExit] = stack.back();
+    stack.pop_back();
+    if (isExit) {
+      for (auto uid : pushed[i]) {
+        current.at(uid).pop_back();
+      }
+      continue;
+    }
+    auto node = order_[i];
+    auto instruction = node->getValue();
+    auto define = [&](size_t value) {
+      current.at(values_[value].uid).push_back(value);
+      pushed[i].push_back(values_[value].uid);
+      definitions_[i].push_back(value);
+    };
+
+    // Phis, then reads, then writes
+    for (auto phi : phis_[i]) {
+      define(phi);
+    }
+    for (const auto& arg : instruction->getReadArgs()) {
+      if (isVariable(arg)) {
+        auto uid = kindCast<TVariable>(arg)->getUID();
+        reads_[i][uid] = current.at(uid).back();
+      }
+    }
+    if (readsHeap(instruction)) {
+      reads_[i][kHeap] = current.at(kHeap).back();
+    }
+    if (isMaterializing(node)) {
+      for (auto uid : slots_) {
+        materialized_[i].push_back(current.at(uid).back());
+      }
+    }
+    for (const auto& arg : instruction->getWriteArgs()) {
+      if (isVariable(arg)) {
+        auto uid = kindCast<TVariable>(arg)->getUID();
+        writes_[i][uid] = addValue(Value::Write, node, uid);
+        define(writes_[i][uid]);
+      }
+    }
+    if (writesHeap(instruction)) {
+      auto kind = instruction->getKind() == TInstruction::Safepoint
+                      ? Value::Memory : Value::Write;
+      writes_[i][kHeap] = addValue(kind, node, kHeap);
+      define(writes_[i][kHeap]);
+    }
+    if (instruction->getKind() == TInstruction::Apply) {
+      for (auto uid : variables_) {
+        define(addValue(Value::Memory, node, uid));
+      }
+    }
+
+    // Fill in the operands of the phis of the successors
+    for (const auto& succ : node->getSuccessors()) {
+      if (!succ || !index_.count(succ)) { continue; }
+      const auto& preds = succ->getPredecessors();
+      for (size_t k = 0; k < preds.size(); k++) {
+        if (preds[k] != node) { continue; }
+        for (auto phi : phis_[index_.at(succ)]) {
+          values_[phi].operands[k] = current.at(values_[phi].uid).back();
+        }
+      }
+    }
+
+    stack.emplace_back(i, true);
+    for (auto j : dominated_[i]) {
+      stack.emplace_back(j, false);
+    }
+  }
+}
+
+bool SSAForm::isMaterializing(const NodePtr& node) const {
+  auto instruction = node->getValue();
+  switch (instruction->getKind()) {
+    case TInstruction::Apply:
+    case TInstruction::Safepoint:
+    case TInstruction::Return:
+    case TInstruction::Halt:
+      return true;
+    default:
+      break;
+  }
+  // Branches to code which is not part of the function
+  auto branch = kindCast<TInstructionBranch>(instruction);
+  if (branch && !ids_.count(branch->destination)) {
+    return true;
+  }
+  const auto& succs = node->getSuccessors();
+  return succs.empty() ||
+         std::find(succs.begin(), succs.end(), nullptr) != succs.end();
+}
+
+bool SSAForm::readsHeap(const std::shared_ptr<TInstruction>& instruction) {
+  for (const auto& arg : instruction->getReadArgs()) {
+    if (arg->getUArgument()->getKind() == UArgument::LocHeap) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SSAForm::writesHeap(const std::shared_ptr<TInstruction>& instruction) {
+  // The garbage collector moves items, while the writes through hp are to
+  // newly allocated items, which are not read before
+  if (instruction->getKind() == TInstruction::Safepoint) {
+    return true;
+  }
+  for (const auto& arg : instruction->getWriteArgs()) {
+    auto loc = kindCast<ULocHeap>(arg->getUArgument());
+    if (loc && loc->getPtr() != VMUArg::hp) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t SSAForm::addValue(Value::Kind kind, const NodePtr& node, size_t uid) {
+  values_.push_back({kind, node, uid, {}});
+  return values_.size() - 1;
+}
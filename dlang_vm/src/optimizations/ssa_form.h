@@ -0,0 +1,86 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../data_structures/flow_graph.h"
+#include "../t_dlang/t_instruction.h"
+
+// SSA form of the stack slots and registers of a function, where each read
+// of a variable is linked to the write defining its value, or to a phi where
+// paths join (only the slots are kept in memory when leaving the code)
+// The heap is one more variable, written by assignments, calls and safepoints
+class SSAForm {
+ public:
+  using GraphPtr = std::shared_ptr<FlowGraph<TInstruction>>;
+  using NodePtr = FlowGraph<TInstruction>::NodePtr;
+  using ValueMap = std::unordered_map<size_t, size_t>;
+
+  struct Value {
+    // The item in memory (when entering the code or after a call), the item
+    // written by a node, or the phi of the items joining before a node
+    enum Kind { Memory, Write, Phi };
+    Kind kind;
+    NodePtr node;
+    size_t uid;
+    std::vector<size_t> operands;
+  };
+
+  static constexpr size_t kHeap = SIZE_MAX;
+
+  explicit SSAForm(GraphPtr graph);
+
+  static bool isSlot(const TArgument::Ptr& arg);
+  static bool isVariable(const TArgument::Ptr& arg);
+
+  // The nodes reachable from the start, in reverse postorder
+  const std::vector<NodePtr>& getOrder() const;
+  NodePtr getImmediateDominator(const NodePtr& node) const;
+  bool dominates(const NodePtr& a, const NodePtr& b) const;
+  std::vector<NodePtr> getDominated(const NodePtr& node) const;
+
+  const std::vector<Value>& getValues() const;
+  const std::vector<size_t>& getPhis(const NodePtr& node) const;
+
+  // The values of the variables read and written by a node (by uid)
+  const ValueMap& getReads(const NodePtr& node) const;
+  const ValueMap& getWrites(const NodePtr& node) const;
+
+  // All the values defined at a node (phis, writes and calls), in order
+  const std::vector<size_t>& getDefinitions(const NodePtr& node) const;
+
+  // The values which have to be in memory at a node, because it leaves the
+  // code or lets the vm look at the stack
+  const std::vector<size_t>& getMaterialized(const NodePtr& node) const;
+
+ private:
+  void computeOrder(const GraphPtr& graph);
+  void computeDominators();
+  void placePhis();
+  void rename();
+  bool isMaterializing(const NodePtr& node) const;
+  static bool readsHeap(const std::shared_ptr<TInstruction>& instruction);
+  static bool writesHeap(const std::shared_ptr<TInstruction>& instruction);
+  size_t addValue(Value::Kind kind, const NodePtr& node, size_t uid);
+
+  std::vector<NodePtr> order_;
+  std::unordered_map<NodePtr, size_t> index_;
+  std::vector<size_t> idom_;
+  std::vector<std::vector<size_t>> dominated_;
+  std::vector<std::vector<size_t>> frontier_;
+  std::vector<size_t> variables_;
+  std::vector<size_t> slots_;
+  std::unordered_set<size_t> ids_;
+
+  std::vector<Value> values_;
+  std::vector<std::vector<size_t>> phis_;
+  std::vector<ValueMap> reads_;
+  std::vector<ValueMap> writes_;
+  std::vector<std::vector<size_t>> definitions_;
+  std::vector<std::vector<size_t>> materialized_;
+};
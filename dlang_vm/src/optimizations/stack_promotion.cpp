@@ -0,0 +1,142 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include "stack_promotion.h"
+
+#include "../u_dlang/u_argument.h"
+
+void StackPromotion::optimizeGraph(GraphPtr graph) {
+  // Slots are named consistently across blocks only in functions
+  auto start = graph->getStartNode();
+  if (!start || !start->getValue()->isFunction()) {
+    return;
+  }
+  SSAForm ssa(graph);
+  const auto& values = ssa.getValues();
+  auto immediates = findImmediates(ssa);
+
+  // Use the known immediates instead of reading the variables
+  for (const auto& node : ssa.getOrder()) {
+    const auto& reads = ssa.getReads(node);
+    for (const auto& arg : node->getValue()->getReadArgs()) {
+      if (!SSAForm::isVariable(arg)) { continue; }
+      auto var = kindCast<TVariable>(arg);
+      if (auto immediate = immediates.at(reads.at(var->getUID()))) {
+        node->getValue()->propagateCopy(var, immediate);
+      }
+    }
+    if (kindCast<TTagCheck>(node->getValue())) {
+      if (!node->getValue()->fold()) {
+        removeNode(node);
+      }
+    }
+  }
+
+  // Find the values still read from memory, or needed at exits
+  std::vector<bool> isLive(values.size(), false);
+  std::vector<size_t> workList;
+  auto setLive = [&](size_t value) {
+    if (!isLive[value]) {
+      isLive[value] = true;
+      workList.push_back(value);
+    }
+  };
+  for (const auto& node : ssa.getOrder()) {
+    const auto& reads = ssa.getReads(node);
+    for (const auto& arg : node->getValue()->getReadArgs()) {
+      if (SSAForm::isSlot(arg)) {
+        setLive(reads.at(
+            kindCast<TVariable>(arg)->getUID()));
+      }
+    }
+    for (auto value : ssa.getMaterialized(node)) {
+      setLive(value);
+    }
+  }
+  while (!workList.empty()) {
+    auto value = workList.back();
+    workList.pop_back();
+    for (auto operand : values.at(value).operands) {
+      setLive(operand);
+    }
+  }
+
+  // Remove the writes to slots which are never needed in memory
+  for (const auto& node : ssa.getOrder()) {
+    auto var = node->getValue()->getEffects().getWrite();
+    if (var && SSAForm::isSlot(var) &&
+        !isLive.at(ssa.getWrites(node).at(var->getUID()))) {
+      removeNode(node);
+    }
+  }
+}
+
+std::vector<TArgument::Ptr> StackPromotion::findImmediates(
+    const SSAForm& ssa) {
+  const auto& values = ssa.getValues();
+  std::vector<TArgument::Ptr> immediates(values.size());
+
+  // Phis and copies start as unknown, and become varying when the values
+  // they join differ (or when the copied value is varying)
+  enum State { Unknown, Immediate, Varying };
+  std::vector<State> states(values.size(), Varying);
+  std::vector<std::vector<size_t>> sources(values.size());
+  for (size_t i = 0; i < values.size(); i++) {
+    const auto& value = values[i];
+    if (value.kind == SSAForm::Value::Phi) {
+      states[i] = Unknown;
+      sources[i] = value.operands;
+    }
+    if (value.kind == SSAForm::Value::Write) {
+      auto move = kindCast<TMove>(value.node->getValue());
+      if (value.uid == SSAForm::kHeap) {
+        continue;
+      }
+      if (move && kindCast<TImmediate>(move->b)) {
+        states[i] = Immediate;
+        immediates[i] = move->b;
+      } else if (move && SSAForm::isVariable(move->b)) {
+        states[i] = Unknown;
+        sources[i] = {ssa.getReads(value.node).at(
+            kindCast<TVariable>(move->b)->getUID())};
+      }
+    }
+  }
+
+  auto getImmediate = [](const TArgument::Ptr& arg) {
+    return kindCast<UImmediate>(arg->getUArgument())
+        ->getValue();
+  };
+  bool hasChanged;
+  do {
+    hasChanged = false;
+    for (size_t i = 0; i < values.size(); i++) {
+      if (sources[i].empty() || states[i] == Varying) {
+        continue;
+      }
+      for (auto operand : sources[i]) {
+        if (states[operand] == Unknown) { continue; }
+        if (states[operand] == Varying ||
+            (states[i] == Immediate &&
+             getImmediate(immediates[i]) !=
+                 getImmediate(immediates[operand]))) {
+          states[i] = Varying;
+          immediates[i] = nullptr;
+          hasChanged = true;
+          break;
+        }
+        if (states[i] == Unknown) {
+          states[i] = Immediate;
+          immediates[i] = immediates[operand];
+          hasChanged = true;
+        }
+      }
+    }
+  } while (hasChanged);
+
+  for (size_t i = 0; i < values.size(); i++) {
+    if (states[i] != Immediate) {
+      immediates[i] = nullptr;
+    }
+  }
+  return immediates;
+}
@@ -0,0 +1,20 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include <vector>
+
+#include "optimization.h"
+#include "ssa_form.h"
+
+// Promotes the stack slots of functions to SSA values: the immediates known
+// at each read (through copies and the phis at joins) are used instead of
+// reading memory, and only the writes reaching a read or an exit are kept
+class StackPromotion : public OptimizationGraph {
+ public:
+  virtual void optimizeGraph(GraphPtr graph);
+
+ private:
+  // The immediates known for the values (nullptr if not an immediate)
+  std::vector<TArgument::Ptr> findImmediates(const SSAForm& ssa);
+};
@@ -0,0 +1,190 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include "type_specialization.h"
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+Code<UInstruction>
+    TypeSpecialization::makeGuards(const Code<UInstruction>& uCode,
+                                   const JITSequence& jitSequence) const {
+  Code<UInstruction> guards;
+  auto entrySpOffset = jitSequence.getEntrySpOffset();
+  if (jitSequence.isFunction() || !entrySpOffset || uCode.size() == 0 ||
+      !jitSequence.getEntryPoints().empty() ||
+      !jitSequence.getInlined().empty()) {
+    return guards;
+  }
+
+  // Find the tags read before any write to their item (until sp or fp are
+  // changed by an unknown amount)
+  auto start = uCode.getInstruction(0);
+  std::unordered_set<int> seen;
+  int spOffset = *entrySpOffset;
+  for (const auto& instruction : uCode) {
+    auto get = kindCast<UGet>(instruction);
+    auto check = kindCast<UTagCheck>(instruction);
+    auto read = get ? get->b : check ? check->a : nullptr;
+    auto loc = kindCast<ULocation>(read);
+    auto item = loc && loc->getType() == VMUArg::Tag
+                    ? getItem(read, spOffset) : std::nullopt;
+    if (item && !seen.count(*item)) {
+      // The guard reads the item like the trace does, so that the
+      // optimizations see the same variable
+      auto tag = jitSequence.getEntryTag(*item);
+      if (tag && kindCast<ULocSP>(loc)) {
+        guards.add(std::make_shared<UTypeGuard>(
+            start->cp, start->vm,
+            VMUArg::SP(*item - *entrySpOffset, VMUArg::Tag), *tag));
+      } else if (tag) {
+        guards.add(std::make_shared<UTypeGuard>(
+            start->cp, start->vm, VMUArg::FP(*item, VMUArg::Tag), *tag));
+      }
+    }
+    if (item) {
+      seen.insert(*item);
+    }
+
+    auto set = kindCast<USet>(instruction);
+    if (set && set->a->getType() == VMUArg::Tag) {
+      if (auto written = getItem(set->a, spOffset)) {
+        seen.insert(*written);
+      }
+    }
+    if (!updateSpOffset(instruction, &spOffset)) {
+      break;
+    }
+  }
+  return guards;
+}
+
+bool TypeSpecialization::isLoopInvariant(
+    const Code<UInstruction>& uCode, const Code<UInstruction>& guards,
+    const JITSequence& jitSequence) const {
+  auto entrySpOffset = jitSequence.getEntrySpOffset();
+  if (!entrySpOffset || uCode.size() == 0) {
+    return false;
+  }
+
+  // Known tags of the items (starting from the guarded ones), and of the
+  // registers holding tags
+  std::map<int, Tag> guarded, items;
+  std::unordered_map<jit_reg_t, Tag> registers;
+  for (const auto& guard : guards) {
+    auto typeGuard = kindCast<UTypeGuard>(guard);
+    if (auto item = getItem(typeGuard->a, *entrySpOffset)) {
+      guarded[*item] = typeGuard->tagA;
+    }
+  }
+  items = guarded;
+
+  // Follow the trace up to each jump back to its start
+  auto startCp = uCode.getInstruction(0)->cp;
+  auto cps = jitSequence.getCps();
+  int spOffset = *entrySpOffset;
+  for (const auto& instruction : uCode) {
+    auto get = kindCast<UGet>(instruction);
+    auto set = kindCast<USet>(instruction);
+    auto move = kindCast<UMove>(instruction);
+    auto oper = kindCast<UOper>(instruction);
+    auto unary = kindCast<UUnary>(instruction);
+    auto check = kindCast<UTagCheck>(instruction);
+    auto uGoto = kindCast<UGoto>(instruction);
+    auto uBranch = kindCast<UBranch>(instruction);
+
+    if (get) {
+      auto item = getItem(get->b, spOffset);
+      if (item && get->b->getType() == VMUArg::Tag && items.count(*item)) {
+        registers[get->a->getReg()] = items.at(*item);
+      } else {
+        registers.erase(get->a->getReg());
+      }
+    }
+    if (move) {
+      auto b = kindCast<URegister>(move->b);
+      if (b && registers.count(b->getReg())) {
+        registers[move->a->getReg()] = registers.at(b->getReg());
+      } else {
+        registers.erase(move->a->getReg());
+      }
+    }
+    if (oper || unary) {
+      registers.erase(oper ? oper->a->getReg() : unary->a->getReg());
+    }
+    if (set && set->a->getType() == VMUArg::Tag) {
+      if (auto item = getItem(set->a, spOffset)) {
+        auto imm = kindCast<UImmTag>(set->b);
+        auto reg = kindCast<URegister>(set->b);
+        if (imm) {
+          items[*item] = static_cast<Tag>(imm->getValue());
+        } else if (reg && registers.count(reg->getReg())) {
+          items[*item] = registers.at(reg->getReg());
+        } else {
+          items.erase(*item);
+        }
+      }
+    }
+    if (check && check->tagA == check->tagB) {
+      if (auto item = getItem(check->a, spOffset)) {
+        items[*item] = check->tagA;
+      }
+    }
+
+    // Jumps back to the start must keep the guarded tags, and jumps to the
+    // middle of the trace are not followed
+    if (uGoto || uBranch) {
+      auto destination = uGoto ? uGoto->destination : uBranch->destination;
+      if (destination == startCp) {
+        if (spOffset != *entrySpOffset) {
+          return false;
+        }
+        for (const auto& [item, tag] : guarded) {
+          if (!items.count(item) || items.at(item) != tag) {
+            return false;
+          }
+        }
+      } else if (std::find(cps.begin(), cps.end(), destination) !=
+                 cps.end()) {
+        return false;
+      }
+    }
+    if (!updateSpOffset(instruction, &spOffset)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::optional<int> TypeSpecialization::getItem(const UArgument::Ptr& arg,
+                                               int spOffset) {
+  if (auto loc = kindCast<ULocSP>(arg)) {
+    return spOffset + loc->getOffset();
+  }
+  if (auto loc = kindCast<ULocFP>(arg)) {
+    return loc->getOffset();
+  }
+  return std::nullopt;
+}
+
+bool TypeSpecialization::updateSpOffset(const UInstructionPtr& instruction,
+                                        int* spOffset) {
+  auto oper = kindCast<UOper>(instruction);
+  auto move = kindCast<UMove>(instruction);
+  auto written = oper ? oper->a : move ? move->a : nullptr;
+  if (written && written->getReg() == JITVM::sp) {
+    auto b = oper ? kindCast<URegister>(oper->b) : nullptr;
+    auto c = oper ? kindCast<UImmediate>(oper->c) : nullptr;
+    if (b && b->getReg() == JITVM::sp && c && oper->op == Add) {
+      *spOffset += c->getValue();
+    } else if (b && b->getReg() == JITVM::sp && c && oper->op == Sub) {
+      *spOffset -= c->getValue();
+    } else {
+      return false;
+    }
+  }
+  return !(written && written->getReg() == JITVM::fp) &&
+         !kindCast<UApply>(instruction) &&
+         !kindCast<UReturn>(instruction);
+}
@@ -0,0 +1,41 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include <memory>
+#include <optional>
+
+#include "../data_structures/code.h"
+#include "../jit_policies/jit_sequence.h"
+#include "../u_dlang/u_instruction.h"
+
+// Type specialization of traces.
+// The tags of the stack items read by a trace before it writes them are
+// guarded once at its start, with the tags observed when the trace was
+// recorded. The trace is then optimized assuming that the guards hold, which
+// removes the tag checks of these items and of their copies, and it runs
+// unspecialized if a guard fails.
+class TypeSpecialization {
+ public:
+  // Guards for the items read by the trace (none for functions, or if no tag
+  // was observed)
+  Code<UInstruction> makeGuards(const Code<UInstruction>& uCode,
+                                const JITSequence& jitSequence) const;
+
+  // True if the guarded tags still hold whenever the trace jumps back to its
+  // start, so the guards are only needed when the trace is entered
+  bool isLoopInvariant(const Code<UInstruction>& uCode,
+                       const Code<UInstruction>& guards,
+                       const JITSequence& jitSequence) const;
+
+ private:
+  using UInstructionPtr = std::shared_ptr<UInstruction>;
+
+  // Offset from fp of the item at a stack location (when sp is at spOffset)
+  static std::optional<int> getItem(const UArgument::Ptr& arg, int spOffset);
+
+  // Moves spOffset after the instruction, returns false if it changes sp or
+  // fp by an unknown amount
+  static bool updateSpOffset(const UInstructionPtr& instruction,
+                             int* spOffset);
+};
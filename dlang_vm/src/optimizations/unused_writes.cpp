@@ -9,9 +9,8 @@ void RemoveUnusedWrites::optimizeGraph(GraphPtr graph) {
     std::unordered_map<TArgument::Ptr, TNodePtr> unusedWrite;
     for (auto node : block) {
       for (const auto& var : node->getValue()->getWriteArgs()) {
-        if (std::dynamic_pointer_cast<ULocSP>(var->getUArgument()) ||
-            std::dynamic_pointer_cast<ULocFP>(var->getUArgument()) ||
-            std::dynamic_pointer_cast<URegGP>(var->getUArgument())) {
+        auto kind = var->getUArgument()->getKind();
+        if (ULocStack::isKind(kind) || kind == UArgument::RegGP) {
           if (unusedWrite.count(var)) {
             removeNode(unusedWrite.at(var));
           }
@@ -0,0 +1,202 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include "value_numbering.h"
+
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+#include "../u_dlang/u_instruction.h"
+
+size_t GlobalValueNumbering::KeyHash::operator()(const Key& key) const {
+  size_t hash = key.size();
+  for (auto x : key) {
+    hash ^= std::hash<int64_t>()(x) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+  }
+  return hash;
+}
+
+void GlobalValueNumbering::optimizeGraph(GraphPtr graph) {
+  auto start = graph->getStartNode();
+  if (!start) {
+    return;
+  }
+  // The slots of traces can be named both after sp and after fp, so only
+  // the slots of functions are numbered
+  bool isFunction = start->getValue()->isFunction();
+  SSAForm ssa(graph);
+  const auto& values = ssa.getValues();
+
+  // The numbers of the values, which start as the values themselves
+  std::vector<size_t> numbers(values.size());
+  std::iota(numbers.begin(), numbers.end(), 0);
+
+  // The computations made by the dominating nodes, the registers holding
+  // each number (with the value they have then) and the current values
+  std::unordered_map<Key, size_t, KeyHash> computations;
+  std::unordered_map<size_t, std::vector<std::pair<TVariable::Ptr, size_t>>>
+      holders;
+  std::unordered_map<size_t, std::vector<size_t>> current;
+  struct Scope {
+    std::vector<Key> computations;
+    std::vector<size_t> holders;
+    std::vector<size_t> uids;
+  };
+  std::unordered_map<TNodePtr, Scope> scopes;
+
+  // Walk the dominator tree
+  std::vector<std::pair<TNodePtr, bool>> stack = {{start, false}};
+  while (!stack.empty()) {
+    auto [node, isExit] = stack.back();
+    stack.pop_back();
+    auto& scope = scopes[node];
+    if (isExit) {
+      for (const auto& key : scope.computations) {
+        computations.erase(key);
+      }
+      for (auto number : scope.holders) {
+        holders.at(number).pop_back();
+      }
+      for (auto uid : scope.uids) {
+        current.at(uid).pop_back();
+      }
+      scopes.erase(node);
+      continue;
+    }
+    auto define = [&](size_t value) {
+      current[values[value].uid].push_back(value);
+      scope.uids.push_back(values[value].uid);
+    };
+    for (auto phi : ssa.getPhis(node)) {
+      define(phi);
+    }
+
+    // Appends the number of an operand to a key
+    auto instruction = node->getValue();
+    const auto& reads = ssa.getReads(node);
+    auto addOperand = [&](Key* key, const TArgument::Ptr& arg) {
+      if (auto imm = kindCast<UImmediate>(arg->getUArgument())) {
+        key->insert(key->end(), {Immediate, imm->getValue()});
+        return true;
+      }
+      if (SSAForm::isVariable(arg) && (isFunction || !SSAForm::isSlot(arg))) {
+        auto uid = kindCast<TVariable>(arg)->getUID();
+        key->insert(key->end(), {Operand, static_cast<int64_t>(
+                                              numbers.at(reads.at(uid)))});
+        return true;
+      }
+      return false;
+    };
+
+    // The key of the computation made by the node, or the operand it copies
+    Key key, copy;
+    TVariable::Ptr result;
+    bool isLoad = false;
+    if (auto check = kindCast<TTagCheck>(instruction)) {
+      key = {TagCheck, check->tagA, check->tagB};
+      if (!addOperand(&key, check->a)) {
+        key.clear();
+      }
+    } else if (auto move = kindCast<TMove>(instruction)) {
+      result = kindCast<TVariable>(move->a);
+      auto loc = kindCast<ULocHeap>(move->b->getUArgument());
+      if (loc && move->ptr) {
+        key = {HeapLoad,
+               static_cast<int64_t>(numbers.at(reads.at(SSAForm::kHeap))),
+               loc->getOffset(), static_cast<int64_t>(loc->getType())};
+        if (!addOperand(&key, move->ptr)) {
+          key.clear();
+        }
+      } else if (addOperand(&copy, move->b)) {
+        isLoad = SSAForm::isSlot(move->b);
+      }
+    } else if (auto oper = kindCast<TOper>(instruction)) {
+      auto op = kindCast<UOper>(oper->getUInstruction())->op;
+      Key b, c;
+      result = kindCast<TVariable>(oper->a);
+      if (addOperand(&b, oper->b) && addOperand(&c, oper->c)) {
+        bool isCommutative =
+            op == And || op == Or || op == Eq || op == Add || op == Mul;
+        if (isCommutative && c < b) {
+          std::swap(b, c);
+        }
+        key = {Oper, op};
+        key.insert(key.end(), b.begin(), b.end());
+        key.insert(key.end(), c.begin(), c.end());
+      }
+    } else if (auto unary = kindCast<TUnary>(instruction)) {
+      auto op = kindCast<UUnary>(unary->getUInstruction())->op;
+      result = kindCast<TVariable>(unary->a);
+      key = {Unary, op};
+      if (op == Read || !addOperand(&key, unary->b)) {
+        key.clear();
+      }
+    }
+
+    // Remove the checks already made
+    if (!result && !key.empty()) {
+      if (computations.count(key)) {
+        removeNode(node);
+      } else {
+        computations[key] = 0;
+        scope.computations.push_back(key);
+      }
+    }
+
+    // Number the value written, and copy it from a register if possible
+    const auto& writes = ssa.getWrites(node);
+    if (result && writes.count(result->getUID())) {
+      auto value = writes.at(result->getUID());
+      std::optional<size_t> number;
+      if (!copy.empty() && copy.front() == Operand) {
+        number = copy.back();
+      } else if (!copy.empty()) {
+        key = copy;
+      }
+      if (!key.empty()) {
+        if (computations.count(key)) {
+          number = computations.at(key);
+        } else {
+          computations[key] = value;
+          scope.computations.push_back(key);
+        }
+      }
+      bool isComputation = !key.empty() && key != copy;
+      if (number) {
+        numbers[value] = *number;
+      }
+      if (number && (isComputation || isLoad) && !SSAForm::isSlot(result)) {
+        for (const auto& [holder, holderValue] : holders[*number]) {
+          const auto& holderValues = current[holder->getUID()];
+          if (holderValues.empty() || holderValues.back() != holderValue) {
+            continue;
+          }
+          if (*holder == *result) {
+            removeNode(node);
+          } else {
+            node->setValue(std::make_shared<TMove>(
+                instruction->getUInstruction(), instruction->isFunction(),
+                result, holder));
+          }
+          break;
+        }
+      }
+      if (!SSAForm::isSlot(result)) {
+        holders[numbers[value]].emplace_back(result, value);
+        scope.holders.push_back(numbers[value]);
+      }
+    }
+
+    for (auto value : ssa.getDefinitions(node)) {
+      if (values[value].kind != SSAForm::Value::Phi) {
+        define(value);
+      }
+    }
+    stack.emplace_back(node, true);
+    for (const auto& child : ssa.getDominated(node)) {
+      stack.emplace_back(child, false);
+    }
+  }
+}
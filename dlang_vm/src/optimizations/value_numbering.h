@@ -0,0 +1,25 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "optimization.h"
+#include "ssa_form.h"
+
+// Numbers the values computed by operations, loads and checks, walking the
+// dominator tree: a computation already made by a dominating node is
+// replaced by a copy of the register still holding it, and a check already
+// made is removed (heap loads are numbered on the version of the heap)
+class GlobalValueNumbering : public OptimizationGraph {
+ public:
+  virtual void optimizeGraph(GraphPtr graph);
+
+ private:
+  using Key = std::vector<int64_t>;
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+  enum KeyKind { Immediate, Operand, Oper, Unary, HeapLoad, TagCheck };
+};
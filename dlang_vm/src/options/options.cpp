@@ -17,6 +17,10 @@ Options::Options(int argc, char** argv)
       optionsDescription("Usage: dlang_vm [options] [<file>]");
   optionsDescription.add_options()
       ("help", "Display this list of options")
+      ("to-binary",
+          boost::program_options::value<std::string>(),
+          "Convert the bytecode file to the binary format, "
+          "writing it to the given file instead of running it")
       ("verbosity",
           boost::program_options::value<std::string>()
               ->default_value("output"),
@@ -26,10 +30,25 @@ Options::Options(int argc, char** argv)
             "\t  - time:       timing statistics to stderr\n"
             "\t  - statistics: all statistics to stderr\n"
             "\t  - debug:      output to stdout, debug to stderr")
+      ("interpreter",
+          boost::program_options::value<std::string>()
+              ->default_value("standard"),
+          "One of:\n"
+            "\t  - standard: one virtual call per instruction\n"
+            "\t  - threaded: direct-threaded (only with jit-policy no)")
       ("jit-threshold",
           boost::program_options::value<size_t>()
               ->default_value(0),
           "The value of the threshold for jit compilation")
+      ("inline-budget",
+          boost::program_options::value<size_t>()
+              ->default_value(32),
+          "Instructions of monomorphic callees that can be inlined in each "
+          "function (with jit-policy function)")
+      ("background-jit",
+          "Compile on a separate thread, interpreting until the code is ready")
+      ("superinstructions",
+          "Fuse frequent sequences of instructions (with interpreter standard)")
       ("jit-policy",
           boost::program_options::value<std::string>()
               ->default_value("no"),
@@ -45,13 +64,24 @@ Options::Options(int argc, char** argv)
           "One of:\n"
             "\t  - none\n"
             "\t  - amortized\n"
-            "\t  - mark-and-sweep")
+            "\t  - mark-and-sweep\n"
+            "\t  - generational")
       ("optimizations",
           boost::program_options::value<std::string>()
               ->default_value(""),
           "A list of:\n"
             "\t  - redundant-checks\n"
-            "\t  - unused-writes");
+            "\t  - unused-writes\n"
+            "\t  - copy-propagation\n"
+            "\t  - dead-code\n"
+            "\t  - constant-folding\n"
+            "\t  - stack-promotion (function jit)\n"
+            "\t  - gvn\n"
+            "\t  - licm (function jit)\n"
+            "\t  - bounds-checks\n"
+            "\t  - scalar-replacement\n"
+            "\t  - register-allocation\n"
+            "\t  - type-specialization (tracing jit)");
 
 
   // Required positional argument (bytecode file)
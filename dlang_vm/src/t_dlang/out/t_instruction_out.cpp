@@ -74,12 +74,12 @@ std::string Out::print(const FlowGraph<TInstruction>& graph) {
 std::string TMove::print() const { return Out::printSpaced("MOVE", a, b); }
 
 std::string TUnary::print() const {
-  auto op = std::dynamic_pointer_cast<UUnary>(getUInstruction())->op;
+  auto op = kindCast<UUnary>(getUInstruction())->op;
   return Out::printSpaced("UNARY", a, op, b);
 }
 
 std::string TOper::print() const {
-  auto op = std::dynamic_pointer_cast<UOper>(getUInstruction())->op;
+  auto op = kindCast<UOper>(getUInstruction())->op;
   return Out::printSpaced("OPER", a, b, op, c);
 }
 
@@ -91,6 +91,10 @@ std::string TGuard::print() const {
   return "GUARD";
 }
 
+std::string TSafepoint::print() const {
+  return "SAFEPOINT";
+}
+
 std::string TMemCheck::print() const {
   return Out::printSpaced("MEM-CHECK", a);
 }
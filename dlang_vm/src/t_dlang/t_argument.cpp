@@ -2,23 +2,37 @@
 
 #include "t_argument.h"
 
-TArgument::TArgument(UArgPtr uArgument) : uArgument_(uArgument) {}
+TArgument::TArgument(UArgPtr uArgument, Kind kind)
+    : uArgument_(uArgument), kind_(kind) {}
+
+TArgument::Kind TArgument::getKind() const {
+  return kind_;
+}
 
 TArgument::UArgPtr TArgument::getUArgument() const {
   return uArgument_;
 }
 
-TImmediate::TImmediate(UArgPtr uArgument) : TArgument(uArgument) {}
+TImmediate::TImmediate(UArgPtr uArgument)
+    : TArgument(uArgument, Immediate) {}
+
+bool TImmediate::isKind(Kind kind) {
+  return kind == Immediate;
+}
 
 std::string TImmediate::getName() const {
   return "imm";
 }
 
 TVariable::TVariable(UArgPtr uArgument)
-    : TArgument(uArgument), uid_(nextUid()) {}
+    : TArgument(uArgument, Variable), uid_(nextUid()) {}
 
 TVariable::TVariable(UArgPtr uArgument, size_t uid)
-    : TArgument(uArgument), uid_(uid) {}
+    : TArgument(uArgument, Variable), uid_(uid) {}
+
+bool TVariable::isKind(Kind kind) {
+  return kind == Variable;
+}
 
 std::string TVariable::getName() const {
   return "x" + std::to_string(uid_);
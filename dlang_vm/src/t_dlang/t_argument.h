@@ -3,10 +3,12 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <memory>
 #include <string>
 
 #include "t_state.h"
+#include "../data_structures/kind_cast.h"
 
 class UArgument;
 
@@ -17,12 +19,17 @@ class TArgument {
  public:
   using Ptr = std::shared_ptr<TArgument>;
 
-  explicit TArgument(UArgPtr uArgument);
+  // The kinds of arguments, one for each concrete class (for kindCast)
+  enum Kind { Immediate, Variable };
+
+  TArgument(UArgPtr uArgument, Kind kind);
+  Kind getKind() const;
   UArgPtr getUArgument() const;
   virtual std::string getName() const = 0;
 
  private:
   UArgPtr uArgument_;
+  const Kind kind_;
 };
 
 class TImmediate : public TArgument {
@@ -30,6 +37,7 @@ class TImmediate : public TArgument {
   using Ptr = std::shared_ptr<TImmediate>;
 
   explicit TImmediate(UArgPtr uArgument);
+  static bool isKind(Kind kind);
   virtual std::string getName() const;
 };
 
@@ -39,6 +47,7 @@ class TVariable : public TArgument {
 
   explicit TVariable(UArgPtr uArgument);
   TVariable(UArgPtr uArgument, size_t uid);
+  static bool isKind(Kind kind);
 
   virtual std::string getName() const;
   std::shared_ptr<TVariable> copy(UArgPtr uArgument);
@@ -48,5 +57,5 @@ class TVariable : public TArgument {
  private:
   static size_t nextUid();
   const size_t uid_;
-  static inline size_t nextUid_ = 0;
+  static inline std::atomic<size_t> nextUid_ = 0;
 };
@@ -5,8 +5,12 @@
 #include "../u_dlang/u_instruction.h"
 
 TInstruction::TInstruction(std::shared_ptr<UInstruction> uInstruction,
-                           bool isFunction)
-    : uInstruction(uInstruction), isFunction_(isFunction) {}
+                           bool isFunction, Kind kind)
+    : uInstruction(uInstruction), isFunction_(isFunction), kind_(kind) {}
+
+TInstruction::Kind TInstruction::getKind() const {
+  return kind_;
+}
 
 void TInstruction::makeFlowGraph(
     std::shared_ptr<FlowGraph<TInstruction>> graph) {
@@ -34,8 +38,8 @@ bool TInstruction::isFunction() const {
 void TInstruction::propagate(TArgument::Ptr* argOld,
                              const TVariable::Ptr& var,
                              const TArgument::Ptr& argNew) {
-  if (!std::dynamic_pointer_cast<URegSP>(var->getUArgument())) {
-    if (auto varOld = std::dynamic_pointer_cast<TVariable>(*argOld)) {
+  if (!kindCast<URegSP>(var->getUArgument())) {
+    if (auto varOld = kindCast<TVariable>(*argOld)) {
       if (*var == *varOld) {
         *argOld = argNew;
       }
@@ -45,8 +49,8 @@ void TInstruction::propagate(TArgument::Ptr* argOld,
 
 TInstructionBranch::TInstructionBranch(
     std::shared_ptr<UInstruction> uInstruction,
-    bool isFunction, size_t destination)
-    : TInstruction(uInstruction, isFunction), destination(destination) {}
+    bool isFunction, size_t destination, Kind kind)
+    : TInstruction(uInstruction, isFunction, kind), destination(destination) {}
 
 void TInstructionBranch::makeFlowGraph(
     std::shared_ptr<FlowGraph<TInstruction>> graph) {
@@ -61,20 +65,20 @@ void TGuard::makeFlowGraph(std::shared_ptr<FlowGraph<TInstruction>> graph) {
 
 std::shared_ptr<UInstruction> TMove::getUInstruction() const {
   std::shared_ptr<UInstruction> uInstructionNew = nullptr;
-  if (auto aLoc = std::dynamic_pointer_cast<ULocation>(a->getUArgument())) {
-    if (auto bOper = std::dynamic_pointer_cast<UOperand>(b->getUArgument())) {
+  if (auto aLoc = kindCast<ULocation>(a->getUArgument())) {
+    if (auto bOper = kindCast<UOperand>(b->getUArgument())) {
       uInstructionNew = std::make_shared<USet>(
         uInstruction->cp, uInstruction->vm, aLoc, bOper);
     }
   }
-  if (auto aReg = std::dynamic_pointer_cast<URegister>(a->getUArgument())) {
-    if (auto bLoc = std::dynamic_pointer_cast<ULocation>(b->getUArgument())) {
+  if (auto aReg = kindCast<URegister>(a->getUArgument())) {
+    if (auto bLoc = kindCast<ULocation>(b->getUArgument())) {
       uInstructionNew = std::make_shared<UGet>(
         uInstruction->cp, uInstruction->vm, aReg, bLoc);
     }
   }
-  if (auto aReg = std::dynamic_pointer_cast<URegister>(a->getUArgument())) {
-    if (auto bOper = std::dynamic_pointer_cast<UOperand>(b->getUArgument())) {
+  if (auto aReg = kindCast<URegister>(a->getUArgument())) {
+    if (auto bOper = kindCast<UOperand>(b->getUArgument())) {
       uInstructionNew = std::make_shared<UMove>(
         uInstruction->cp, uInstruction->vm, aReg, bOper);
     }
@@ -85,19 +89,19 @@ std::shared_ptr<UInstruction> TMove::getUInstruction() const {
 std::shared_ptr<UInstruction> TUnary::getUInstruction() const {
   auto uInstructionNew = std::make_shared<UUnary>(
     uInstruction->cp, uInstruction->vm,
-    std::dynamic_pointer_cast<UUnary>(uInstruction)->op,
-    std::dynamic_pointer_cast<URegister>(a->getUArgument()),
-    std::dynamic_pointer_cast<UOperand>(b->getUArgument()));
+    kindCast<UUnary>(uInstruction)->op,
+    kindCast<URegister>(a->getUArgument()),
+    kindCast<UOperand>(b->getUArgument()));
   return uInstructionNew;
 }
 
 std::shared_ptr<UInstruction> TOper::getUInstruction() const {
   auto uInstructionNew = std::make_shared<UOper>(
     uInstruction->cp, uInstruction->vm,
-    std::dynamic_pointer_cast<UOper>(uInstruction)->op,
-    std::dynamic_pointer_cast<URegister>(a->getUArgument()),
-    std::dynamic_pointer_cast<UOperand>(b->getUArgument()),
-    std::dynamic_pointer_cast<UOperand>(c->getUArgument()));
+    kindCast<UOper>(uInstruction)->op,
+    kindCast<URegister>(a->getUArgument()),
+    kindCast<UOperand>(b->getUArgument()),
+    kindCast<UOperand>(c->getUArgument()));
   return uInstructionNew;
 }
 
@@ -105,31 +109,32 @@ std::shared_ptr<UInstruction> TTagCheck::getUInstruction() const {
   auto uInstructionNew = std::make_shared<UTagCheck>(
     uInstruction->cp, uInstruction->vm,
     a->getUArgument(), tagA, tagB);
+  uInstructionNew->movedSp = kindCast<UTagCheck>(uInstruction)->movedSp;
   return uInstructionNew;
 }
 
 TEffects TInstructionWrite::getEffects() {
-  if (std::dynamic_pointer_cast<ULocHeap>(var_->getUArgument())) {
+  if (kindCast<ULocHeap>(var_->getUArgument())) {
     return TEffects::makeOther();
   }
-  if (std::dynamic_pointer_cast<ULocSP>(var_->getUArgument()) ||
-      std::dynamic_pointer_cast<ULocFP>(var_->getUArgument())) {
+  if (kindCast<ULocSP>(var_->getUArgument()) ||
+      kindCast<ULocFP>(var_->getUArgument())) {
     if (isFunction()) {
-      return TEffects::makeWrite(std::dynamic_pointer_cast<TVariable>(var_));
+      return TEffects::makeWrite(kindCast<TVariable>(var_));
     } else {
       return TEffects::makeOther();
     }
   }
-  if (std::dynamic_pointer_cast<URegSP>(var_->getUArgument())) {
+  if (kindCast<URegSP>(var_->getUArgument())) {
     return TEffects::makeOther();
   }
-  if (std::dynamic_pointer_cast<URegGP>(var_->getUArgument())) {
-    return TEffects::makeWrite(std::dynamic_pointer_cast<TVariable>(var_));
+  if (kindCast<URegGP>(var_->getUArgument())) {
+    return TEffects::makeWrite(kindCast<TVariable>(var_));
   }
 }
 
 TEffects TUnary::getEffects() {
-  if (std::dynamic_pointer_cast<UUnary>(uInstruction)->op == Read) {
+  if (kindCast<UUnary>(uInstruction)->op == Read) {
     return TEffects::makeOther();
   } else {
     return TInstructionWrite::getEffects();
@@ -138,7 +143,7 @@ TEffects TUnary::getEffects() {
 
 
 TEffects TOper::getEffects() {
-  if (std::dynamic_pointer_cast<UOper>(uInstruction)->op == Div) {
+  if (kindCast<UOper>(uInstruction)->op == Div) {
     return TEffects::makeOther();
   } else {
     return TInstructionWrite::getEffects();
@@ -153,9 +158,18 @@ TEffects TMemCheck::getEffects() {
   return TEffects::makeBoundsCheck(a);
 }
 
+std::shared_ptr<UInstruction> TMemCheck::getUInstruction() const {
+  auto uInstructionNew = std::make_shared<UMemCheck>(
+    uInstruction->cp, uInstruction->vm,
+    kindCast<ULocation>(a->getUArgument()));
+  uInstructionNew->movedSp = kindCast<UMemCheck>(uInstruction)->movedSp;
+  return uInstructionNew;
+}
+
 TMove::TMove(std::shared_ptr<UInstruction> uInstruction, bool isFunction,
              TArgument::Ptr a, TArgument::Ptr b, TArgument::Ptr ptr)
-    : TInstructionWrite(uInstruction, isFunction, a), a(a), b(b), ptr(ptr) {}
+    : TInstructionWrite(uInstruction, isFunction, a, Move),
+      a(a), b(b), ptr(ptr) {}
 
 std::vector<TArgument::Ptr> TMove::getReadArgs() const {
   if (ptr) {
@@ -174,8 +188,8 @@ void TMove::propagateCopy(TVariable::Ptr var, TArgument::Ptr arg) {
 }
 
 std::shared_ptr<TInstruction> TMove::fold() {
-  if (auto varA = std::dynamic_pointer_cast<TVariable>(a)) {
-    if (auto varB = std::dynamic_pointer_cast<TVariable>(b)) {
+  if (auto varA = kindCast<TVariable>(a)) {
+    if (auto varB = kindCast<TVariable>(b)) {
       if (*varA == *varB) {
         return {};
       }
@@ -185,7 +199,7 @@ std::shared_ptr<TInstruction> TMove::fold() {
 
 TUnary::TUnary(std::shared_ptr<UInstruction> uInstruction, bool isFunction,
                TArgument::Ptr a, TArgument::Ptr b)
-    : TInstructionWrite(uInstruction, isFunction, a), a(a), b(b) {}
+    : TInstructionWrite(uInstruction, isFunction, a, Unary), a(a), b(b) {}
 
 std::vector<TArgument::Ptr> TUnary::getReadArgs() const {
   return {b};
@@ -200,8 +214,8 @@ void TUnary::propagateCopy(TVariable::Ptr var, TArgument::Ptr arg) {
 }
 
 std::shared_ptr<TInstruction> TUnary::fold() {
-  if (auto bUImm = std::dynamic_pointer_cast<UImmediate>(b->getUArgument())) {
-    auto op = std::dynamic_pointer_cast<UUnary>(getUInstruction())->op;
+  if (auto bUImm = kindCast<UImmediate>(b->getUArgument())) {
+    auto op = kindCast<UUnary>(getUInstruction())->op;
     UOperand::Ptr newB;
     if (op == Not) {
       newB = std::make_shared<UImmInt>(1 - bUImm->getValue());
@@ -218,7 +232,7 @@ std::shared_ptr<TInstruction> TUnary::fold() {
 
 TOper::TOper(std::shared_ptr<UInstruction> uInstruction, bool isFunction,
              TArgument::Ptr a, TArgument::Ptr b, TArgument::Ptr c)
-    : TInstructionWrite(uInstruction, isFunction, a), a(a), b(b), c(c) {}
+    : TInstructionWrite(uInstruction, isFunction, a, Oper), a(a), b(b), c(c) {}
 
 std::vector<TArgument::Ptr> TOper::getReadArgs() const {
   return {b, c};
@@ -234,9 +248,9 @@ void TOper::propagateCopy(TVariable::Ptr var, TArgument::Ptr arg) {
 }
 
 std::shared_ptr<TInstruction> TOper::fold() {
-  if (auto bUImm = std::dynamic_pointer_cast<UImmediate>(b->getUArgument())) {
-    if (auto cUImm = std::dynamic_pointer_cast<UImmediate>(c->getUArgument())) {
-      auto op = std::dynamic_pointer_cast<UOper>(getUInstruction())->op;
+  if (auto bUImm = kindCast<UImmediate>(b->getUArgument())) {
+    if (auto cUImm = kindCast<UImmediate>(c->getUArgument())) {
+      auto op = kindCast<UOper>(getUInstruction())->op;
       UOperand::Ptr newArg;
       if (op == And) {
         newArg =
@@ -281,7 +295,7 @@ std::shared_ptr<TInstruction> TOper::fold() {
 }
 
 TLabel::TLabel(std::shared_ptr<UInstruction> uInstruction, bool isFunction)
-    : TInstruction(uInstruction, isFunction) {}
+    : TInstruction(uInstruction, isFunction, Label) {}
 
 std::vector<TArgument::Ptr> TLabel::getReadArgs() const {
   return {};
@@ -292,7 +306,7 @@ std::vector<TArgument::Ptr> TLabel::getWriteArgs() const {
 }
 
 TGuard::TGuard(std::shared_ptr<UInstruction> uInstruction, bool isFunction)
-    : TInstruction(uInstruction, isFunction) {}
+    : TInstruction(uInstruction, isFunction, Guard) {}
 
 std::vector<TArgument::Ptr> TGuard::getReadArgs() const {
   return {};
@@ -302,9 +316,21 @@ std::vector<TArgument::Ptr> TGuard::getWriteArgs() const {
   return {};
 }
 
+TSafepoint::TSafepoint(std::shared_ptr<UInstruction> uInstruction,
+                       bool isFunction, TArgument::Ptr hp)
+    : TInstruction(uInstruction, isFunction, Safepoint), hp(hp) {}
+
+std::vector<TArgument::Ptr> TSafepoint::getReadArgs() const {
+  return {hp};
+}
+
+std::vector<TArgument::Ptr> TSafepoint::getWriteArgs() const {
+  return {};
+}
+
 TMemCheck::TMemCheck(std::shared_ptr<UInstruction> uInstruction,
                      bool isFunction, TArgument::Ptr a, TArgument::Ptr ptr)
-    : TInstruction(uInstruction, isFunction), a(a), ptr(ptr) {}
+    : TInstruction(uInstruction, isFunction, MemCheck), a(a), ptr(ptr) {}
 
 std::vector<TArgument::Ptr> TMemCheck::getReadArgs() const {
   return {ptr};
@@ -315,11 +341,17 @@ std::vector<TArgument::Ptr> TMemCheck::getWriteArgs() const {
 }
 
 TTagCheck::TTagCheck(std::shared_ptr<UInstruction> uInstruction,
-                     bool isFunction, TArgument::Ptr a, Tag tagA, Tag tagB)
-    : TInstruction(uInstruction, isFunction), a(a), tagA(tagA), tagB(tagB) {}
+                     bool isFunction, TArgument::Ptr a, Tag tagA, Tag tagB,
+                     TArgument::Ptr ptr)
+    : TInstruction(uInstruction, isFunction, TagCheck),
+      a(a), ptr(ptr), tagA(tagA), tagB(tagB) {}
 
 std::vector<TArgument::Ptr> TTagCheck::getReadArgs() const {
-  return {a};
+  if (ptr) {
+    return {a, ptr};
+  } else {
+    return {a};
+  }
 }
 
 std::vector<TArgument::Ptr> TTagCheck::getWriteArgs() const {
@@ -327,7 +359,7 @@ std::vector<TArgument::Ptr> TTagCheck::getWriteArgs() const {
 }
 
 std::shared_ptr<TInstruction> TTagCheck::fold() {
-  if (auto aUImm = std::dynamic_pointer_cast<UImmediate>(a->getUArgument())) {
+  if (auto aUImm = kindCast<UImmediate>(a->getUArgument())) {
     if (aUImm->getValue() == tagA || aUImm->getValue() == tagB) {
       return {};
     }
@@ -345,9 +377,10 @@ TApply::TApply(std::shared_ptr<UInstruction> uInstruction, bool isFunction,
                 TArgument::Ptr fpTag, TArgument::Ptr fpVal,
                 TArgument::Ptr cpTag, TArgument::Ptr cpVal,
                 TArgument::Ptr r0, TArgument::Ptr r1, TArgument::Ptr r2)
-    : TInstruction(uInstruction, isFunction), argTag(argTag), argVal(argVal),
-      cloTag(cloTag), cloVal(cloVal), fpTag(fpTag), fpVal(fpVal),
-      cpTag(cpTag), cpVal(cpVal), r0(r0), r1(r1), r2(r2) {}
+    : TInstruction(uInstruction, isFunction, Apply),
+      argTag(argTag), argVal(argVal), cloTag(cloTag), cloVal(cloVal),
+      fpTag(fpTag), fpVal(fpVal), cpTag(cpTag), cpVal(cpVal),
+      r0(r0), r1(r1), r2(r2) {}
 
 std::vector<TArgument::Ptr> TApply::getReadArgs() const  {
   if (isFunction()) {
@@ -368,7 +401,7 @@ std::vector<TArgument::Ptr> TApply::getWriteArgs() const {
 
 TReturn::TReturn(std::shared_ptr<UInstruction> uInstruction, bool isFunction,
                  TArgument::Ptr aTag, TArgument::Ptr aVal)
-    : TInstruction(uInstruction, isFunction), aTag(aTag), aVal(aVal) {}
+    : TInstruction(uInstruction, isFunction, Return), aTag(aTag), aVal(aVal) {}
 
 std::vector<TArgument::Ptr> TReturn::getReadArgs() const {
   if (isFunction()) {
@@ -383,7 +416,7 @@ std::vector<TArgument::Ptr> TReturn::getWriteArgs() const {
 }
 
 THalt::THalt(std::shared_ptr<UInstruction> uInstruction, bool isFunction)
-    : TInstruction(uInstruction, isFunction) {}
+    : TInstruction(uInstruction, isFunction, Halt) {}
 
 std::vector<TArgument::Ptr> THalt::getReadArgs() const {
   return {};
@@ -395,7 +428,7 @@ std::vector<TArgument::Ptr> THalt::getWriteArgs() const {
 
 TGoto::TGoto(std::shared_ptr<UInstruction> uInstruction, bool isFunction,
              size_t destination)
-    : TInstructionBranch(uInstruction, isFunction, destination) {}
+    : TInstructionBranch(uInstruction, isFunction, destination, Goto) {}
 
 std::vector<TArgument::Ptr> TGoto::getReadArgs() const {
   return {};
@@ -407,7 +440,7 @@ std::vector<TArgument::Ptr> TGoto::getWriteArgs() const {
 
 TBranch::TBranch(std::shared_ptr<UInstruction> uInstruction, bool isFunction,
                  TArgument::Ptr a, size_t destination)
-    : TInstructionBranch(uInstruction, isFunction, destination), a(a) {}
+    : TInstructionBranch(uInstruction, isFunction, destination, Branch), a(a) {}
 
 std::vector<TArgument::Ptr> TBranch::getReadArgs() const {
   return {a};
@@ -418,7 +451,7 @@ std::vector<TArgument::Ptr> TBranch::getWriteArgs() const {
 }
 
 std::shared_ptr<TInstruction> TBranch::fold() {
-  if (auto aUImm = std::dynamic_pointer_cast<UImmediate>(a->getUArgument())) {
+  if (auto aUImm = kindCast<UImmediate>(a->getUArgument())) {
     if (aUImm->getValue()) {
       return std::make_shared<TGoto>(getUInstruction(), isFunction(),
                                      destination);
@@ -15,7 +15,15 @@ class UInstruction;
 
 class TInstruction : public std::enable_shared_from_this<TInstruction> {
  public:
-  TInstruction(std::shared_ptr<UInstruction> uInstruction, bool isFunction);
+  // The kinds of instructions, one for each concrete class (for kindCast)
+  enum Kind {
+    Move, Unary, Oper, Label, Guard, Safepoint, MemCheck, TagCheck, Apply,
+    Return, Halt, Goto, Branch
+  };
+
+  TInstruction(std::shared_ptr<UInstruction> uInstruction, bool isFunction,
+               Kind kind);
+  Kind getKind() const;
 
   virtual std::string print() const = 0;
   virtual void makeFlowGraph(std::shared_ptr<FlowGraph<TInstruction>> graph);
@@ -35,12 +43,16 @@ class TInstruction : public std::enable_shared_from_this<TInstruction> {
                  const TArgument::Ptr& argNew);
   std::shared_ptr<UInstruction> uInstruction;
   bool isFunction_;
+
+ private:
+  const Kind kind_;
 };
 
 class TInstructionBranch : public TInstruction {
  public:
   TInstructionBranch(std::shared_ptr<UInstruction> uInstruction,
-                     bool isFunction, size_t destination);
+                     bool isFunction, size_t destination, Kind kind);
+  static bool isKind(Kind kind) { return kind == Goto || kind == Branch; }
   virtual void makeFlowGraph(std::shared_ptr<FlowGraph<TInstruction>> graph);
   size_t destination;
 };
@@ -48,9 +60,12 @@ class TInstructionBranch : public TInstruction {
 class TInstructionWrite : public TInstruction {
  public:
   TInstructionWrite(std::shared_ptr<UInstruction> uInstruction,
-                    bool isFunction, TArgument::Ptr arg)
-      : TInstruction(uInstruction, isFunction),
-        var_(std::dynamic_pointer_cast<TVariable>(arg)) {}
+                    bool isFunction, TArgument::Ptr arg, Kind kind)
+      : TInstruction(uInstruction, isFunction, kind),
+        var_(kindCast<TVariable>(arg)) {}
+  static bool isKind(Kind kind) {
+    return kind == Move || kind == Unary || kind == Oper;
+  }
   virtual TEffects getEffects();
   TVariable::Ptr var_;
 };
@@ -59,6 +74,7 @@ class TMove : public TInstructionWrite {
  public:
   TMove(std::shared_ptr<UInstruction> uInstruction, bool isFunction,
         TArgument::Ptr a, TArgument::Ptr b, TArgument::Ptr ptr = {});
+  static bool isKind(Kind kind) { return kind == Move; }
   std::string print() const;
   std::vector<TArgument::Ptr> getReadArgs() const;
   std::vector<TArgument::Ptr> getWriteArgs() const;
@@ -72,6 +88,7 @@ class TUnary : public TInstructionWrite {
  public:
   TUnary(std::shared_ptr<UInstruction> uInstruction, bool isFunction,
          TArgument::Ptr a, TArgument::Ptr b);
+  static bool isKind(Kind kind) { return kind == Unary; }
   std::string print() const;
   std::vector<TArgument::Ptr> getReadArgs() const;
   std::vector<TArgument::Ptr> getWriteArgs() const;
@@ -86,6 +103,7 @@ class TOper : public TInstructionWrite {
  public:
   TOper(std::shared_ptr<UInstruction> uInstruction, bool isFunction,
         TArgument::Ptr a, TArgument::Ptr b, TArgument::Ptr c);
+  static bool isKind(Kind kind) { return kind == Oper; }
   std::string print() const;
   std::vector<TArgument::Ptr> getReadArgs() const;
   std::vector<TArgument::Ptr> getWriteArgs() const;
@@ -99,6 +117,7 @@ class TOper : public TInstructionWrite {
 class TLabel : public TInstruction {
  public:
   TLabel(std::shared_ptr<UInstruction> uInstruction, bool isFunction);
+  static bool isKind(Kind kind) { return kind == Label; }
   std::string print() const;
   std::vector<TArgument::Ptr> getReadArgs() const;
   std::vector<TArgument::Ptr> getWriteArgs() const;
@@ -107,27 +126,42 @@ class TLabel : public TInstruction {
 class TGuard : public TInstruction {
  public:
   TGuard(std::shared_ptr<UInstruction> uInstruction, bool isFunction);
+  static bool isKind(Kind kind) { return kind == Guard; }
   std::string print() const;
   std::vector<TArgument::Ptr> getReadArgs() const;
   std::vector<TArgument::Ptr> getWriteArgs() const;
   void makeFlowGraph(std::shared_ptr<FlowGraph<TInstruction>> graph);
 };
 
+class TSafepoint : public TInstruction {
+ public:
+  TSafepoint(std::shared_ptr<UInstruction> uInstruction, bool isFunction,
+             TArgument::Ptr hp);
+  static bool isKind(Kind kind) { return kind == Safepoint; }
+  std::string print() const;
+  std::vector<TArgument::Ptr> getReadArgs() const;
+  std::vector<TArgument::Ptr> getWriteArgs() const;
+  TArgument::Ptr hp;
+};
+
 class TMemCheck : public TInstruction {
  public:
   TMemCheck(std::shared_ptr<UInstruction> uInstruction, bool isFunction,
             TArgument::Ptr a, TArgument::Ptr ptr);
+  static bool isKind(Kind kind) { return kind == MemCheck; }
   std::string print() const;
   std::vector<TArgument::Ptr> getReadArgs() const;
   std::vector<TArgument::Ptr> getWriteArgs() const;
   virtual TEffects getEffects();
+  virtual std::shared_ptr<UInstruction> getUInstruction() const;
   TArgument::Ptr a, ptr;
 };
 
 class TTagCheck : public TInstruction {
  public:
   TTagCheck(std::shared_ptr<UInstruction> uInstruction, bool isFunction,
-            TArgument::Ptr a, Tag tagA, Tag tagB);
+            TArgument::Ptr a, Tag tagA, Tag tagB, TArgument::Ptr ptr = {});
+  static bool isKind(Kind kind) { return kind == TagCheck; }
   std::string print() const;
   std::vector<TArgument::Ptr> getReadArgs() const;
   std::vector<TArgument::Ptr> getWriteArgs() const;
@@ -135,7 +169,7 @@ class TTagCheck : public TInstruction {
   virtual std::shared_ptr<TInstruction> fold();
   virtual std::shared_ptr<UInstruction> getUInstruction() const;
   virtual TEffects getEffects();
-  TArgument::Ptr a;
+  TArgument::Ptr a, ptr;
   Tag tagA, tagB;
 };
 
@@ -147,6 +181,7 @@ class TApply : public TInstruction {
                   TArgument::Ptr fpTag, TArgument::Ptr fpVal,
                   TArgument::Ptr cpTag, TArgument::Ptr cpVal,
                   TArgument::Ptr r0, TArgument::Ptr r1, TArgument::Ptr r2);
+  static bool isKind(Kind kind) { return kind == Apply; }
   std::string print() const;
   std::vector<TArgument::Ptr> getReadArgs() const;
   std::vector<TArgument::Ptr> getWriteArgs() const;
@@ -158,6 +193,7 @@ class TReturn : public TInstruction {
  public:
   TReturn(std::shared_ptr<UInstruction> uInstruction, bool isFunction,
           TArgument::Ptr aTag, TArgument::Ptr aVal);
+  static bool isKind(Kind kind) { return kind == Return; }
   std::string print() const;
   std::vector<TArgument::Ptr> getReadArgs() const;
   std::vector<TArgument::Ptr> getWriteArgs() const;
@@ -167,6 +203,7 @@ class TReturn : public TInstruction {
 class THalt : public TInstruction {
  public:
   THalt(std::shared_ptr<UInstruction> uInstruction, bool isFunction);
+  static bool isKind(Kind kind) { return kind == Halt; }
   std::string print() const;
   std::vector<TArgument::Ptr> getReadArgs() const;
   std::vector<TArgument::Ptr> getWriteArgs() const;
@@ -176,6 +213,7 @@ class TGoto : public TInstructionBranch {
  public:
   TGoto(std::shared_ptr<UInstruction> uInstruction, bool isFunction,
         size_t destination);
+  static bool isKind(Kind kind) { return kind == Goto; }
   std::string print() const;
   std::vector<TArgument::Ptr> getReadArgs() const;
   std::vector<TArgument::Ptr> getWriteArgs() const;
@@ -185,6 +223,7 @@ class TBranch : public TInstructionBranch {
  public:
   TBranch(std::shared_ptr<UInstruction> uInstruction, bool isFunction,
           TArgument::Ptr a, size_t destination);
+  static bool isKind(Kind kind) { return kind == Branch; }
   std::string print() const;
   std::vector<TArgument::Ptr> getReadArgs() const;
   std::vector<TArgument::Ptr> getWriteArgs() const;
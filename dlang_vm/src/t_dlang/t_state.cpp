@@ -8,6 +8,10 @@ void TState::updateSp(int val) {
   sp_ += val;
 }
 
+int TState::getSp() const {
+  return sp_;
+}
+
 void TState::resetSP() {
   if (!isFunction_) {
     sp_ = 0;
@@ -35,6 +39,15 @@ std::shared_ptr<TVariable>
 }
 
 std::shared_ptr<TVariable> TState::makeTArgument(std::shared_ptr<ULocSP> uLoc) {
+  // In functions sp starts at fp + 2, so the slots are named after fp
+  if (isFunction_) {
+    int id = 2 * (sp_ + uLoc->getOffset() + 2) +
+             static_cast<int>(uLoc->getType());
+    if (!uFPLocations_.count(id)) {
+      uFPLocations_.insert({id, std::make_shared<TVariable>(uLoc)});
+    }
+    return uFPLocations_.at(id)->copy(uLoc);
+  }
   int id = 2 * (sp_ + uLoc->getOffset()) + static_cast<int>(uLoc->getType());
   if (!uSPLocations_.count(id)) {
     uSPLocations_.insert({id, std::make_shared<TVariable>(uLoc)});
@@ -21,6 +21,7 @@ class ULocHeap;
 class TState {
  public:
   void updateSp(int val);
+  int getSp() const;
   void resetSP();
   void resetFP();
 
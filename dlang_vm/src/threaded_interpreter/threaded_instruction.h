@@ -0,0 +1,31 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include <cstdint>
+
+// Flat representation of an instruction used by the threaded interpreter,
+// the operation and its arguments are decided when the code is loaded
+// (it has no padding, so it is also the record of the binary bytecode)
+struct ThreadedInstruction {
+  enum Opcode : uint32_t {
+    Not, Neg, Read,
+    And, Or, Eq, Lt, Add, Sub, Mul, Div,
+    MkPair, Fst, Snd, MkInl, MkInr,
+    PushUnit, PushBool, PushInt,
+    Apply, LookupStack, LookupHeap, Return, MkClosure,
+    Swap, Pop, Label, Function, Deref, MkRef, Assign,
+    Halt, Goto, Test, Case,
+    // Superinstructions, made when the code is loaded and never stored in
+    // binary files (named after the opcodes they fuse)
+    EqTest, LtTest, AndTest, PushIntAdd, PushIntSub,
+    PushIntEqTest, PushUnitEqTest,
+    LookupStackPushInt, LookupStackPushIntEq, LookupStackPushIntSub,
+    LookupStackLookupStack, LookupStackLookupHeap,
+    LookupHeapLookupStack, LookupHeapLookupHeap, LookupHeapDeref
+  };
+
+  Opcode opcode;
+  int32_t arg0 = 0;
+  int32_t arg1 = 0;
+};
@@ -0,0 +1,619 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include "threaded_interpreter.h"
+
+#include <memory>
+#include <vector>
+
+#include "../virtual_machine/exception.h"
+#include "../virtual_machine/runtime_system.h"
+
+ThreadedInterpreter::ThreadedInterpreter(const Code<BInstruction>& code) {
+  instructions_.reserve(code.size());
+  for (const auto& instruction : code) {
+    instructions_.push_back(instruction->getThreadedInstruction());
+  }
+}
+
+ThreadedInterpreter::ThreadedInterpreter(
+    const ThreadedInstruction* instructions, size_t size)
+    : instructions_(instructions, instructions + size) {}
+
+size_t ThreadedInterpreter::size() const {
+  return instructions_.size();
+}
+
+const ThreadedInstruction& ThreadedInterpreter::getInstruction(
+    size_t cp) const {
+  return instructions_.at(cp);
+}
+
+void ThreadedInterpreter::run(
+    std::shared_ptr<VirtualMachine> vm,
+    std::shared_ptr<MemoryManager> memoryManager) const {
+  // Handlers addresses, in the same order as ThreadedInstruction::Opcode
+  static const void* const kHandlers[] = {
+    &&opNot, &&opNeg, &&opRead,
+    &&opAnd, &&opOr, &&opEq, &&opLt, &&opAdd, &&opSub, &&opMul, &&opDiv,
+    &&opMkPair, &&opFst, &&opSnd, &&opMkInl, &&opMkInr,
+    &&opPushUnit, &&opPushBool, &&opPushInt,
+    &&opApply, &&opLookupStack, &&opLookupHeap, &&opReturn, &&opMkClosure,
+    &&opSwap, &&opPop, &&opNop, &&opNop, &&opDeref, &&opMkRef, &&opAssign,
+    &&opHalt, &&opGoto, &&opTest, &&opCase,
+    &&opEqTest, &&opLtTest, &&opAndTest, &&opPushIntAdd, &&opPushIntSub,
+    &&opPushIntEqTest, &&opPushUnitEqTest,
+    &&opLookupStackPushInt, &&opLookupStackPushIntEq, &&opLookupStackPushIntSub,
+    &&opLookupStackLookupStack, &&opLookupStackLookupHeap,
+    &&opLookupHeapLookupStack, &&opLookupHeapLookupHeap, &&opLookupHeapDeref
+  };
+
+  // Replace the opcodes with the addresses of their handlers
+  std::vector<Handler> handlers;
+  handlers.reserve(instructions_.size());
+  for (const auto& instruction : instructions_) {
+    handlers.push_back({kHandlers[instruction.opcode],
+                        instruction.arg0, instruction.arg1});
+  }
+  const Handler* code = handlers.data();
+
+  // Registers are kept in locals and only written back to the vm
+  // when the memory manager needs them or the execution stops
+  const Handler* ip = code + vm->cp;
+  size_t sp = vm->sp, fp = vm->fp, hp = vm->hp;
+
+  Cell* stack;
+  Cell* heap;
+  size_t stackSize, heapSize;
+  auto loadMemory = [&]() {
+    stack = *vm->stack.getDataPtr();
+    heap = *vm->heap.getDataPtr();
+    stackSize = vm->stack.size();
+    heapSize = vm->heap.size();
+  };
+  auto storeRegisters = [&]() {
+    vm->cp = ip - code;
+    vm->sp = sp;
+    vm->fp = fp;
+    vm->hp = hp;
+  };
+
+  // Accesses are bounds checked, and the memory grows through its manager
+  // (references are invalidated when the same memory grows)
+  auto stackAt = [&](size_t idx) -> Cell& {
+    if (idx >= stackSize) {
+      vm->stack.checkSize(idx);
+      loadMemory();
+    }
+    return stack[idx];
+  };
+  auto heapAt = [&](size_t idx) -> Cell& {
+    if (idx >= heapSize) {
+      vm->heap.checkSize(idx);
+      loadMemory();
+    }
+    return heap[idx];
+  };
+
+  // Garbage collection can only start after the heap pointer has changed,
+  // and the memory manager is called when it reaches the limit
+  auto collectGarbage = [&]() {
+    if (hp >= vm->hpLimit) {
+      storeRegisters();
+      memoryManager->collectGarbage(vm);
+      hp = vm->hp;
+      loadMemory();
+    }
+  };
+
+  try {
+    collectGarbage();
+    goto *ip->address;
+
+  opNot: {
+    auto& a = stackAt(sp - 1);
+    if (a.getTag() != Tag::Bool) { goto error; }
+    a.setValue(!static_cast<bool>(a.getValue()));
+    ip++;
+    goto *ip->address;
+  }
+
+  opNeg: {
+    auto& a = stackAt(sp - 1);
+    if (a.getTag() != Tag::Int) { goto error; }
+    a.setValue(static_cast<size_t>(-static_cast<int>(a.getValue())));
+    ip++;
+    goto *ip->address;
+  }
+
+  opRead: {
+    auto& a = stackAt(sp - 1);
+    if (a.getTag() != Tag::Unit) { goto error; }
+    a = {Tag::Int, static_cast<size_t>(RuntimeSystem::readInt())};
+    ip++;
+    goto *ip->address;
+  }
+
+  opAnd: {
+    auto b = stackAt(sp - 1);
+    auto& a = stackAt(sp - 2);
+    if (a.getTag() != Tag::Bool || b.getTag() != Tag::Bool) { goto error; }
+    a.setValue(static_cast<bool>(a.getValue()) &&
+               static_cast<bool>(b.getValue()));
+    sp--;
+    ip++;
+    goto *ip->address;
+  }
+
+  opOr: {
+    auto b = stackAt(sp - 1);
+    auto& a = stackAt(sp - 2);
+    if (a.getTag() != Tag::Bool || b.getTag() != Tag::Bool) { goto error; }
+    a.setValue(static_cast<bool>(a.getValue()) ||
+               static_cast<bool>(b.getValue()));
+    sp--;
+    ip++;
+    goto *ip->address;
+  }
+
+  opEq: {
+    auto b = stackAt(sp - 1);
+    auto& a = stackAt(sp - 2);
+    if (a.getTag() == Tag::Unit && b.getTag() == Tag::Unit) {
+      a = {Tag::Bool, true};
+    } else if (a.getTag() == b.getTag()) {
+      a = {Tag::Bool,
+           static_cast<int>(a.getValue()) == static_cast<int>(b.getValue())};
+    } else {
+      a = {Tag::Bool, false};
+    }
+    sp--;
+    ip++;
+    goto *ip->address;
+  }
+
+  opLt: {
+    auto b = stackAt(sp - 1);
+    auto& a = stackAt(sp - 2);
+    if (a.getTag() != Tag::Int || b.getTag() != Tag::Int) { goto error; }
+    a = {Tag::Bool,
+         static_cast<int>(a.getValue()) < static_cast<int>(b.getValue())};
+    sp--;
+    ip++;
+    goto *ip->address;
+  }
+
+  opAdd: {
+    auto b = stackAt(sp - 1);
+    auto& a = stackAt(sp - 2);
+    if (a.getTag() != Tag::Int || b.getTag() != Tag::Int) { goto error; }
+    a.setValue(static_cast<size_t>(static_cast<int>(a.getValue()) +
+                                   static_cast<int>(b.getValue())));
+    sp--;
+    ip++;
+    goto *ip->address;
+  }
+
+  opSub: {
+    auto b = stackAt(sp - 1);
+    auto& a = stackAt(sp - 2);
+    if (a.getTag() != Tag::Int || b.getTag() != Tag::Int) { goto error; }
+    a.setValue(static_cast<size_t>(static_cast<int>(a.getValue()) -
+                                   static_cast<int>(b.getValue())));
+    sp--;
+    ip++;
+    goto *ip->address;
+  }
+
+  opMul: {
+    auto b = stackAt(sp - 1);
+    auto& a = stackAt(sp - 2);
+    if (a.getTag() != Tag::Int || b.getTag() != Tag::Int) { goto error; }
+    a.setValue(static_cast<size_t>(static_cast<int>(a.getValue()) *
+                                   static_cast<int>(b.getValue())));
+    sp--;
+    ip++;
+    goto *ip->address;
+  }
+
+  opDiv: {
+    auto b = stackAt(sp - 1);
+    auto& a = stackAt(sp - 2);
+    if (a.getTag() != Tag::Int || b.getTag() != Tag::Int) { goto error; }
+    if (b.getValue() == 0) { goto error; }
+    a.setValue(static_cast<size_t>(static_cast<int>(a.getValue()) /
+                                   static_cast<int>(b.getValue())));
+    sp--;
+    ip++;
+    goto *ip->address;
+  }
+
+  opMkPair: {
+    heapAt(hp) = {Tag::PairHeader, 3};
+    heapAt(hp + 1) = stackAt(sp - 2);
+    heapAt(hp + 2) = stackAt(sp - 1);
+    stackAt(sp - 2) = {Tag::HeapIndex, hp};
+    sp--;
+    hp += 3;
+    ip++;
+    collectGarbage();
+    goto *ip->address;
+  }
+
+  opFst: {
+    auto& a = stackAt(sp - 1);
+    if (a.getTag() != Tag::HeapIndex) { goto error; }
+    if (heapAt(a.getValue()).getTag() != Tag::PairHeader) { goto error; }
+    a = heapAt(a.getValue() + 1);
+    ip++;
+    goto *ip->address;
+  }
+
+  opSnd: {
+    auto& a = stackAt(sp - 1);
+    if (a.getTag() != Tag::HeapIndex) { goto error; }
+    if (heapAt(a.getValue()).getTag() != Tag::PairHeader) { goto error; }
+    a = heapAt(a.getValue() + 2);
+    ip++;
+    goto *ip->address;
+  }
+
+  opMkInl: {
+    heapAt(hp) = {Tag::InlHeader, 2};
+    heapAt(hp + 1) = stackAt(sp - 1);
+    stackAt(sp - 1) = {Tag::HeapIndex, hp};
+    hp += 2;
+    ip++;
+    collectGarbage();
+    goto *ip->address;
+  }
+
+  opMkInr: {
+    heapAt(hp) = {Tag::InrHeader, 2};
+    heapAt(hp + 1) = stackAt(sp - 1);
+    stackAt(sp - 1) = {Tag::HeapIndex, hp};
+    hp += 2;
+    ip++;
+    collectGarbage();
+    goto *ip->address;
+  }
+
+  opPushUnit: {
+    stackAt(sp) = {Tag::Unit, {}};
+    sp++;
+    ip++;
+    goto *ip->address;
+  }
+
+  opPushBool: {
+    stackAt(sp) = {Tag::Bool, static_cast<size_t>(ip->arg0)};
+    sp++;
+    ip++;
+    goto *ip->address;
+  }
+
+  opPushInt: {
+    stackAt(sp) = {Tag::Int, static_cast<size_t>(ip->arg0)};
+    sp++;
+    ip++;
+    goto *ip->address;
+  }
+
+  opApply: {
+    stackAt(sp) = {Tag::FramePointer, fp};
+    stackAt(sp + 1) = {Tag::ReturnAddress, static_cast<size_t>(ip - code) + 1};
+    auto closure = stackAt(sp - 1);
+    if (closure.getTag() != Tag::HeapIndex) { goto error; }
+    auto codeIndex = heapAt(closure.getValue() + 1);
+    if (codeIndex.getTag() != Tag::CodeIndex) { goto error; }
+    ip = code + codeIndex.getValue();
+    fp = sp;
+    sp += 2;
+    goto *ip->address;
+  }
+
+  opLookupStack: {
+    auto item = stackAt(fp + ip->arg0);
+    stackAt(sp) = item;
+    sp++;
+    ip++;
+    goto *ip->address;
+  }
+
+  opLookupHeap: {
+    auto closure = stackAt(fp - 1);
+    if (closure.getTag() != Tag::HeapIndex) { goto error; }
+    stackAt(sp) = heapAt(closure.getValue() + ip->arg0 + 1);
+    sp++;
+    ip++;
+    goto *ip->address;
+  }
+
+  opReturn: {
+    auto result = stackAt(sp - 1);
+    stackAt(fp - 2) = result;
+    sp = fp - 1;
+    auto returnAddress = stackAt(fp + 1);
+    if (returnAddress.getTag() != Tag::ReturnAddress) { goto error; }
+    ip = code + returnAddress.getValue();
+    auto framePointer = stackAt(fp);
+    if (framePointer.getTag() != Tag::FramePointer) { goto error; }
+    fp = framePointer.getValue();
+    goto *ip->address;
+  }
+
+  opMkClosure: {
+    size_t size = ip->arg1;
+    heapAt(hp) = {Tag::ClosureHeader, 2 + size};
+    heapAt(hp + 1) = {Tag::CodeIndex, static_cast<size_t>(ip->arg0)};
+    for (size_t i = 0; i < size; i++) {
+      heapAt(hp + 2 + i) = stackAt(sp - 1 - i);
+    }
+    stackAt(sp - size) = {Tag::HeapIndex, hp};
+    sp -= size - 1;
+    hp += 2 + size;
+    ip++;
+    collectGarbage();
+    goto *ip->address;
+  }
+
+  opSwap: {
+    auto a = stackAt(sp - 2);
+    auto b = stackAt(sp - 1);
+    stackAt(sp - 1) = a;
+    stackAt(sp - 2) = b;
+    ip++;
+    goto *ip->address;
+  }
+
+  opPop: {
+    sp--;
+    ip++;
+    goto *ip->address;
+  }
+
+  opNop: {
+    ip++;
+    goto *ip->address;
+  }
+
+  opDeref: {
+    auto& a = stackAt(sp - 1);
+    if (a.getTag() != Tag::HeapRef) { goto error; }
+    a = heapAt(a.getValue());
+    ip++;
+    goto *ip->address;
+  }
+
+  opMkRef: {
+    heapAt(hp) = stackAt(sp - 1);
+    stackAt(sp - 1) = {Tag::HeapRef, hp};
+    hp++;
+    ip++;
+    collectGarbage();
+    goto *ip->address;
+  }
+
+  opAssign: {
+    auto item = stackAt(sp - 1);
+    auto& reference = stackAt(sp - 2);
+    if (reference.getTag() != Tag::HeapRef) { goto error; }
+    heapAt(reference.getValue()) = item;
+    vm->heap.recordWrite(reference.getValue());
+    reference = {Tag::Unit, {}};
+    sp--;
+    ip++;
+    goto *ip->address;
+  }
+
+  opHalt: {
+    storeRegisters();
+    vm->status = VirtualMachine::Status::Halted;
+    return;
+  }
+
+  opGoto: {
+    ip = code + ip->arg0;
+    goto *ip->address;
+  }
+
+  opTest: {
+    auto a = stackAt(sp - 1);
+    if (a.getTag() != Tag::Bool) { goto error; }
+    ip = a.getValue() ? ip + 1 : code + ip->arg0;
+    sp--;
+    goto *ip->address;
+  }
+
+  opCase: {
+    auto& a = stackAt(sp - 1);
+    if (a.getTag() != Tag::HeapIndex) { goto error; }
+    auto header = heapAt(a.getValue());
+    a = heapAt(a.getValue() + 1);
+    if (header.getTag() == Tag::InlHeader) {
+      ip++;
+    } else if (header.getTag() == Tag::InrHeader) {
+      ip = code + ip->arg0;
+    } else {
+      goto error;
+    }
+    goto *ip->address;
+  }
+
+  // Superinstructions write the same cells as the instructions they fuse,
+  // without dispatching between them or checking the tags they have pushed,
+  // and errors are reported at the cp of the instruction failing
+
+  opEqTest: {
+    auto b = stackAt(sp - 1);
+    auto a = stackAt(sp - 2);
+    bool equal = a.getTag() == b.getTag() &&
+        (a.getTag() == Tag::Unit ||
+         static_cast<int>(a.getValue()) == static_cast<int>(b.getValue()));
+    sp -= 2;
+    ip = equal ? ip + 2 : code + ip->arg0;
+    goto *ip->address;
+  }
+
+  opLtTest: {
+    auto b = stackAt(sp - 1);
+    auto a = stackAt(sp - 2);
+    if (a.getTag() != Tag::Int || b.getTag() != Tag::Int) { goto error; }
+    bool less = static_cast<int>(a.getValue()) < static_cast<int>(b.getValue());
+    sp -= 2;
+    ip = less ? ip + 2 : code + ip->arg0;
+    goto *ip->address;
+  }
+
+  opAndTest: {
+    auto b = stackAt(sp - 1);
+    auto a = stackAt(sp - 2);
+    if (a.getTag() != Tag::Bool || b.getTag() != Tag::Bool) { goto error; }
+    bool both = static_cast<bool>(a.getValue()) &&
+                static_cast<bool>(b.getValue());
+    sp -= 2;
+    ip = both ? ip + 2 : code + ip->arg0;
+    goto *ip->address;
+  }
+
+  opPushIntAdd: {
+    auto value = ip->arg0;
+    stackAt(sp) = {Tag::Int, static_cast<size_t>(value)};
+    sp++;
+    ip++;
+    auto& a = stackAt(sp - 2);
+    if (a.getTag() != Tag::Int) { goto error; }
+    a.setValue(static_cast<size_t>(static_cast<int>(a.getValue()) + value));
+    sp--;
+    ip++;
+    goto *ip->address;
+  }
+
+  opPushIntSub: {
+    auto value = ip->arg0;
+    stackAt(sp) = {Tag::Int, static_cast<size_t>(value)};
+    sp++;
+    ip++;
+    auto& a = stackAt(sp - 2);
+    if (a.getTag() != Tag::Int) { goto error; }
+    a.setValue(static_cast<size_t>(static_cast<int>(a.getValue()) - value));
+    sp--;
+    ip++;
+    goto *ip->address;
+  }
+
+  opPushIntEqTest: {
+    auto value = ip->arg0;
+    stackAt(sp) = {Tag::Int, static_cast<size_t>(value)};
+    auto a = stackAt(sp - 1);
+    bool equal = a.getTag() == Tag::Int &&
+                 static_cast<int>(a.getValue()) == value;
+    sp--;
+    ip = equal ? ip + 3 : code + ip->arg1;
+    goto *ip->address;
+  }
+
+  opPushUnitEqTest: {
+    stackAt(sp) = {Tag::Unit, {}};
+    bool equal = stackAt(sp - 1).getTag() == Tag::Unit;
+    sp--;
+    ip = equal ? ip + 3 : code + ip->arg0;
+    goto *ip->address;
+  }
+
+  opLookupStackPushInt: {
+    auto item = stackAt(fp + ip->arg0);
+    stackAt(sp) = item;
+    stackAt(sp + 1) = {Tag::Int, static_cast<size_t>(ip->arg1)};
+    sp += 2;
+    ip += 2;
+    goto *ip->address;
+  }
+
+  opLookupStackPushIntEq: {
+    auto item = stackAt(fp + ip->arg0);
+    auto value = ip->arg1;
+    stackAt(sp + 1) = {Tag::Int, static_cast<size_t>(value)};
+    stackAt(sp) = {Tag::Bool, item.getTag() == Tag::Int &&
+                              static_cast<int>(item.getValue()) == value};
+    sp++;
+    ip += 3;
+    goto *ip->address;
+  }
+
+  opLookupStackPushIntSub: {
+    auto item = stackAt(fp + ip->arg0);
+    auto value = ip->arg1;
+    stackAt(sp) = item;
+    stackAt(sp + 1) = {Tag::Int, static_cast<size_t>(value)};
+    sp += 2;
+    ip += 2;
+    if (item.getTag() != Tag::Int) { goto error; }
+    stackAt(sp - 2).setValue(
+        static_cast<size_t>(static_cast<int>(item.getValue()) - value));
+    sp--;
+    ip++;
+    goto *ip->address;
+  }
+
+  opLookupStackLookupStack: {
+    auto first = stackAt(fp + ip->arg0);
+    stackAt(sp) = first;
+    auto second = stackAt(fp + ip->arg1);
+    stackAt(sp + 1) = second;
+    sp += 2;
+    ip += 2;
+    goto *ip->address;
+  }
+
+  opLookupStackLookupHeap: {
+    auto item = stackAt(fp + ip->arg0);
+    stackAt(sp) = item;
+    sp++;
+    ip++;
+    auto closure = stackAt(fp - 1);
+    if (closure.getTag() != Tag::HeapIndex) { goto error; }
+    stackAt(sp) = heapAt(closure.getValue() + (ip - 1)->arg1 + 1);
+    sp++;
+    ip++;
+    goto *ip->address;
+  }
+
+  opLookupHeapLookupStack: {
+    auto closure = stackAt(fp - 1);
+    if (closure.getTag() != Tag::HeapIndex) { goto error; }
+    stackAt(sp) = heapAt(closure.getValue() + ip->arg0 + 1);
+    auto item = stackAt(fp + ip->arg1);
+    stackAt(sp + 1) = item;
+    sp += 2;
+    ip += 2;
+    goto *ip->address;
+  }
+
+  opLookupHeapLookupHeap: {
+    auto closure = stackAt(fp - 1);
+    if (closure.getTag() != Tag::HeapIndex) { goto error; }
+    stackAt(sp) = heapAt(closure.getValue() + ip->arg0 + 1);
+    stackAt(sp + 1) = heapAt(closure.getValue() + ip->arg1 + 1);
+    sp += 2;
+    ip += 2;
+    goto *ip->address;
+  }
+
+  opLookupHeapDeref: {
+    auto closure = stackAt(fp - 1);
+    if (closure.getTag() != Tag::HeapIndex) { goto error; }
+    auto& a = stackAt(sp);
+    a = heapAt(closure.getValue() + ip->arg0 + 1);
+    sp++;
+    ip++;
+    if (a.getTag() != Tag::HeapRef) { goto error; }
+    a = heapAt(a.getValue());
+    ip++;
+    goto *ip->address;
+  }
+  } catch (const RuntimeError&) {}
+
+error:
+  storeRegisters();
+  vm->status = VirtualMachine::Status::RuntimeError;
+}
@@ -0,0 +1,37 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "threaded_instruction.h"
+#include "../b_dlang/b_instruction.h"
+#include "../data_structures/code.h"
+#include "../memory_managers/memory_manager.h"
+#include "../virtual_machine/virtual_machine.h"
+
+// Interpreter running the whole program with direct-threaded dispatch,
+// the code is lowered once to a flat array of instructions
+class ThreadedInterpreter {
+ public:
+  explicit ThreadedInterpreter(const Code<BInstruction>& code);
+  ThreadedInterpreter(const ThreadedInstruction* instructions, size_t size);
+
+  // Runs the program until it halts or a runtime error occurs
+  void run(std::shared_ptr<VirtualMachine> vm,
+           std::shared_ptr<MemoryManager> memoryManager) const;
+
+  size_t size() const;
+  const ThreadedInstruction& getInstruction(size_t cp) const;
+
+ private:
+  // Instruction with the address of its handler in place of the opcode
+  struct Handler {
+    const void* address;
+    int32_t arg0;
+    int32_t arg1;
+  };
+
+  std::vector<ThreadedInstruction> instructions_;
+};
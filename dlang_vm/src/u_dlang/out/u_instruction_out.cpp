@@ -43,6 +43,10 @@ std::string UGuard::print() const {
   return "GUARD";
 }
 
+std::string USafepoint::print() const {
+  return "SAFEPOINT";
+}
+
 std::string UMemCheck::print() const {
   return Out::printSpaced("MEM-CHECK", a);
 }
@@ -55,6 +59,10 @@ std::string UTagCheck::print() const {
   }
 }
 
+std::string UTypeGuard::print() const {
+  return Out::printSpaced("TYPE-GUARD", tagA, a);
+}
+
 std::string UApply::print() const {
   return "APPLY";
 }
@@ -2,13 +2,35 @@
 
 #include "u_argument.h"
 
+UArgument::UArgument(Kind kind) : kind_(kind) {}
+
+UArgument::Kind UArgument::getKind() const {
+  return kind_;
+}
+
+UOperand::UOperand(Kind kind) : UArgument(kind) {}
+
+bool UOperand::isKind(Kind kind) {
+  return UImmediate::isKind(kind) || URegister::isKind(kind);
+}
+
+UImmediate::UImmediate(Kind kind) : UOperand(kind) {}
+
+bool UImmediate::isKind(Kind kind) {
+  return kind == ImmInt || kind == ImmTag || kind == ImmStatus;
+}
+
 TArgument::Ptr
     UImmediate::makeTArgument(std::shared_ptr<TState> tArgumentsState) {
   return tArgumentsState->makeTArgument(shared_from_this());
 }
 
-URegister::URegister(std::string name, jit_reg_t reg)
-    : name_(name), reg_(reg) {}
+URegister::URegister(std::string name, jit_reg_t reg, Kind kind)
+    : UOperand(kind), name_(name), reg_(reg) {}
+
+bool URegister::isKind(Kind kind) {
+  return kind == RegGP || kind == RegSP;
+}
 
 jit_reg_t URegister::getReg() const {
   return reg_;
@@ -19,8 +41,13 @@ TArgument::Ptr
   return tArgumentsState->makeTArgument(shared_from_this());
 }
 
-ULocation::ULocation(URegister::Ptr ptr, int offset, VirtualMachine::Type type)
-    : ptr_(ptr), offset_(offset), type_(type) {}
+ULocation::ULocation(URegister::Ptr ptr, int offset, VirtualMachine::Type type,
+                     Kind kind)
+    : UArgument(kind), ptr_(ptr), offset_(offset), type_(type) {}
+
+bool ULocation::isKind(Kind kind) {
+  return kind == LocSP || kind == LocFP || kind == LocHeap;
+}
 
 URegister::Ptr ULocation::getPtr() const {
   return ptr_;
@@ -34,36 +61,66 @@ VirtualMachine::Type ULocation::getType() const {
   return type_;
 }
 
-UImmInt::UImmInt(int value) : value_(value) {}
+UImmInt::UImmInt(int value)
+    : UImmediate(ImmInt), value_(value) {}
+
+bool UImmInt::isKind(Kind kind) {
+  return kind == ImmInt;
+}
 
 int UImmInt::getValue() const {
   return value_;
 }
 
-UImmTag::UImmTag(Tag value) : value_(value) {}
+UImmTag::UImmTag(Tag value)
+    : UImmediate(ImmTag), value_(value) {}
+
+bool UImmTag::isKind(Kind kind) {
+  return kind == ImmTag;
+}
 
 int UImmTag::getValue() const {
   return value_;
 }
 
-UImmStatus::UImmStatus(VirtualMachine::Status value) : value_(value) {}
+UImmStatus::UImmStatus(VirtualMachine::Status value)
+    : UImmediate(ImmStatus), value_(value) {}
+
+bool UImmStatus::isKind(Kind kind) {
+  return kind == ImmStatus;
+}
 
 int UImmStatus::getValue() const {
   return value_;
 }
 
-URegGP::URegGP(std::string name, jit_reg_t reg) : URegister(name, reg) {}
+URegGP::URegGP(std::string name, jit_reg_t reg)
+    : URegister(name, reg, RegGP) {}
+
+bool URegGP::isKind(Kind kind) {
+  return kind == RegGP;
+}
+
+URegSP::URegSP(std::string name, jit_reg_t reg)
+    : URegister(name, reg, RegSP) {}
+
+bool URegSP::isKind(Kind kind) {
+  return kind == RegSP;
+}
 
-URegSP::URegSP(std::string name, jit_reg_t reg) : URegister(name, reg) {}
+ULocStack::ULocStack(URegister::Ptr ptr, int offset, VirtualMachine::Type type,
+                     Kind kind)
+    : ULocation(ptr, offset, type, kind) {}
 
-ULocStack::ULocStack(URegister::Ptr ptr, int offset, VirtualMachine::Type type)
-    : ULocation(ptr, offset, type) {}
+bool ULocStack::isKind(Kind kind) {
+  return kind == LocSP || kind == LocFP;
+}
 
 Memory* ULocStack::getMemoryPtr(VMPtr vm) const {
   return &vm->stack;
 }
 
-Item** ULocStack::getDataPtr(VMPtr vm) const {
+Cell** ULocStack::getDataPtr(VMPtr vm) const {
   return vm->stack.getDataPtr();
 }
 
@@ -72,13 +129,17 @@ size_t* ULocStack::getSizePtr(VMPtr vm) const {
 }
 
 ULocHeap::ULocHeap(URegister::Ptr ptr, size_t offset, VirtualMachine::Type type)
-    : ULocation(ptr, offset, type) {}
+    : ULocation(ptr, offset, type, LocHeap) {}
+
+bool ULocHeap::isKind(Kind kind) {
+  return kind == LocHeap;
+}
 
 Memory* ULocHeap::getMemoryPtr(VMPtr vm) const {
   return &vm->heap;
 }
 
-Item** ULocHeap::getDataPtr(VMPtr vm) const {
+Cell** ULocHeap::getDataPtr(VMPtr vm) const {
   return vm->heap.getDataPtr();
 }
 
@@ -96,7 +157,12 @@ TArgument::Ptr
 }
 
 ULocSP::ULocSP(size_t offset, VirtualMachine::Type type)
-    : ULocStack(std::make_shared<URegSP>("sp", JITVM::sp), offset, type) {}
+    : ULocStack(std::make_shared<URegSP>("sp", JITVM::sp), offset, type,
+                LocSP) {}
+
+bool ULocSP::isKind(Kind kind) {
+  return kind == LocSP;
+}
 
 ULocation::Ptr ULocSP::withType(VirtualMachine::Type type) {
   return std::make_shared<ULocSP>(getOffset(), type);
@@ -107,7 +173,12 @@ TArgument::Ptr ULocSP::makeTArgument(std::shared_ptr<TState> tArgumentsState) {
 }
 
 ULocFP::ULocFP(size_t offset, VirtualMachine::Type type)
-    : ULocStack(std::make_shared<URegSP>("fp", JITVM::fp), offset, type) {}
+    : ULocStack(std::make_shared<URegSP>("fp", JITVM::fp), offset, type,
+                LocFP) {}
+
+bool ULocFP::isKind(Kind kind) {
+  return kind == LocFP;
+}
 
 ULocation::Ptr ULocFP::withType(VirtualMachine::Type type) {
   return std::make_shared<ULocFP>(getOffset(), type);
@@ -129,6 +200,21 @@ UImmediate::Ptr VMUArg::uImm(VirtualMachine::Status value) {
   return std::make_shared<UImmStatus>(value);
 }
 
+std::vector<URegister::Ptr> VMUArg::allocatable() {
+  std::vector<URegister::Ptr> registers = {r0, r1, r2};
+  for (int i = 3; i < JIT_R_NUM && i < JITVM::kMaxCallerSaved; i++) {
+    registers.push_back(
+        std::make_shared<URegGP>("r" + std::to_string(i), JIT_R(i)));
+  }
+  // The first callee-saved registers hold the vm registers, tmp and the
+  // cached data pointers
+  for (int i = 5 + JITVM::kCachedData; i < JIT_V_NUM; i++) {
+    registers.push_back(
+        std::make_shared<URegGP>("v" + std::to_string(i), JIT_V(i)));
+  }
+  return registers;
+}
+
 ULocHeap::Ptr VMUArg::Heap(URegister::Ptr reg, int offset,
                            VirtualMachine::Type type) {
   return std::make_shared<ULocHeap>(reg, offset, type);
@@ -4,7 +4,9 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
+#include "../data_structures/kind_cast.h"
 #include "../jit/jit.h"
 #include "../jit/jit_vm.h"
 #include "../t_dlang/t_argument.h"
@@ -18,23 +20,37 @@ class TVariable;
 class UArgument {
  public:
   using Ptr = std::shared_ptr<UArgument>;
+
+  // The kinds of arguments, one for each concrete class (for kindCast)
+  enum Kind { ImmInt, ImmTag, ImmStatus, RegGP, RegSP, LocSP, LocFP, LocHeap };
+
+  explicit UArgument(Kind kind);
+  Kind getKind() const;
+
   virtual TArgument::Ptr
       makeTArgument(std::shared_ptr<TState> tArgumentsState) = 0;
   virtual std::string print() const = 0;
 
  protected:
   using VMPtr = std::shared_ptr<VirtualMachine>;
+
+ private:
+  const Kind kind_;
 };
 
 class UOperand : public UArgument {
  public:
   using Ptr = std::shared_ptr<UOperand>;
+  explicit UOperand(Kind kind);
+  static bool isKind(Kind kind);
 };
 
 class UImmediate : public UOperand,
                    public std::enable_shared_from_this<UImmediate> {
  public:
   using Ptr = std::shared_ptr<UImmediate>;
+  explicit UImmediate(Kind kind);
+  static bool isKind(Kind kind);
   virtual int getValue() const = 0;
   TArgument::Ptr makeTArgument(std::shared_ptr<TState> tArgumentsState);
 };
@@ -43,7 +59,8 @@ class URegister : public UOperand,
                   public std::enable_shared_from_this<URegister> {
  public:
   using Ptr = std::shared_ptr<URegister>;
-  URegister(std::string name, jit_reg_t reg);
+  URegister(std::string name, jit_reg_t reg, Kind kind);
+  static bool isKind(Kind kind);
 
   jit_reg_t getReg() const;
   std::string print() const;
@@ -57,7 +74,9 @@ class URegister : public UOperand,
 class ULocation : public UArgument {
  public:
   using Ptr = std::shared_ptr<ULocation>;
-  ULocation(URegister::Ptr ptr, int offset, VirtualMachine::Type type);
+  ULocation(URegister::Ptr ptr, int offset, VirtualMachine::Type type,
+            Kind kind);
+  static bool isKind(Kind kind);
 
   URegister::Ptr getPtr() const;
   int getOffset() const;
@@ -65,7 +84,7 @@ class ULocation : public UArgument {
 
   virtual ULocation::Ptr withType(VirtualMachine::Type type) = 0;
   virtual Memory* getMemoryPtr(VMPtr vm) const = 0;
-  virtual Item** getDataPtr(VMPtr vm) const = 0;
+  virtual Cell** getDataPtr(VMPtr vm) const = 0;
   virtual size_t* getSizePtr(VMPtr vm) const = 0;
 
   std::string print() const;
@@ -80,6 +99,7 @@ class UImmInt : public UImmediate {
  public:
   using Ptr = std::shared_ptr<UImmInt>;
   explicit UImmInt(int value);
+  static bool isKind(Kind kind);
 
   virtual int getValue() const;
   std::string print() const;
@@ -92,6 +112,7 @@ class UImmTag : public UImmediate {
  public:
   using Ptr = std::shared_ptr<UImmTag>;
   explicit UImmTag(Tag value);
+  static bool isKind(Kind kind);
 
   virtual int getValue() const;
   std::string print() const;
@@ -104,6 +125,7 @@ class UImmStatus : public UImmediate {
  public:
   using Ptr = std::shared_ptr<UImmStatus>;
   explicit UImmStatus(VirtualMachine::Status value);
+  static bool isKind(Kind kind);
 
   virtual int getValue() const;
   std::string print() const;
@@ -116,21 +138,25 @@ class URegGP : public URegister {
  public:
   using Ptr = std::shared_ptr<URegGP>;
   URegGP(std::string name, jit_reg_t reg);
+  static bool isKind(Kind kind);
 };
 
 class URegSP : public URegister {
  public:
   using Ptr = std::shared_ptr<URegSP>;
   URegSP(std::string name, jit_reg_t reg);
+  static bool isKind(Kind kind);
 };
 
 class ULocStack : public ULocation {
  public:
   using Ptr = std::shared_ptr<ULocStack>;
-  ULocStack(URegister::Ptr ptr, int offset, VirtualMachine::Type type);
+  ULocStack(URegister::Ptr ptr, int offset, VirtualMachine::Type type,
+            Kind kind);
+  static bool isKind(Kind kind);
 
   virtual Memory* getMemoryPtr(VMPtr vm) const;
-  virtual Item** getDataPtr(VMPtr vm) const;
+  virtual Cell** getDataPtr(VMPtr vm) const;
   virtual size_t* getSizePtr(VMPtr vm) const;
 };
 
@@ -139,9 +165,10 @@ class ULocHeap : public ULocation,
  public:
   using Ptr = std::shared_ptr<ULocHeap>;
   ULocHeap(URegister::Ptr ptr, size_t offset, VirtualMachine::Type type);
+  static bool isKind(Kind kind);
 
   virtual Memory* getMemoryPtr(VMPtr vm) const;
-  virtual Item** getDataPtr(VMPtr vm) const;
+  virtual Cell** getDataPtr(VMPtr vm) const;
   virtual size_t* getSizePtr(VMPtr vm) const;
   virtual ULocation::Ptr withType(VirtualMachine::Type type);
   TArgument::Ptr makeTArgument(std::shared_ptr<TState> tArgumentsState);
@@ -151,6 +178,7 @@ class ULocSP : public ULocStack, public std::enable_shared_from_this<ULocSP> {
  public:
   using Ptr = std::shared_ptr<ULocSP>;
   ULocSP(size_t offset, VirtualMachine::Type type);
+  static bool isKind(Kind kind);
 
   virtual ULocation::Ptr withType(VirtualMachine::Type type);
   TArgument::Ptr makeTArgument(std::shared_ptr<TState> tArgumentsState);
@@ -160,6 +188,7 @@ class ULocFP : public ULocStack, public std::enable_shared_from_this<ULocFP> {
  public:
   using Ptr = std::shared_ptr<ULocFP>;
   ULocFP(size_t offset, VirtualMachine::Type type);
+  static bool isKind(Kind kind);
 
   virtual ULocation::Ptr withType(VirtualMachine::Type type);
   TArgument::Ptr makeTArgument(std::shared_ptr<TState> tArgumentsState);
@@ -180,6 +209,9 @@ class VMUArg : public JIT {
   static inline auto r1 {std::make_shared<URegGP>("r1", JIT_R1)};
   static inline auto r2 {std::make_shared<URegGP>("r2", JIT_R2)};
 
+  // General purpose registers the register allocator can assign
+  static std::vector<URegister::Ptr> allocatable();
+
   static const auto Val = VirtualMachine::Type::Val;
   static const auto Tag = VirtualMachine::Type::Tag;
 
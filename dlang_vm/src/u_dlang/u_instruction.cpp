@@ -2,47 +2,62 @@
 
 #include "u_instruction.h"
 
-UInstruction::UInstruction(size_t cp, VMPtr vm) : cp(cp), vm(vm) {}
+UInstruction::UInstruction(size_t cp, VMPtr vm, Kind kind)
+    : cp(cp), vm(vm), kind_(kind) {}
+
+UInstruction::Kind UInstruction::getKind() const {
+  return kind_;
+}
 
 UGet::UGet(size_t cp, VMPtr vm, URegister::Ptr a, ULocation::Ptr b)
-    : UInstruction(cp, vm), a(a), b(b) {}
+    : UInstruction(cp, vm, Get), a(a), b(b) {}
 
 USet::USet(size_t cp, VMPtr vm, ULocation::Ptr a, UOperand::Ptr b)
-    : UInstruction(cp, vm), a(a), b(b) {}
+    : UInstruction(cp, vm, Set), a(a), b(b) {}
 
 UMove::UMove(size_t cp, VMPtr vm, URegister::Ptr a,
              UOperand::Ptr b)
-    : UInstruction(cp, vm), a(a), b(b) {}
+    : UInstruction(cp, vm, Move), a(a), b(b) {}
 
 UUnary::UUnary(size_t cp, VMPtr vm, UnaryOp op, URegister::Ptr a,
                UOperand::Ptr b)
-    : UInstruction(cp, vm), op(op), a(a), b(b) {}
+    : UInstruction(cp, vm, Unary), op(op), a(a), b(b) {}
 
 UOper::UOper(size_t cp, VMPtr vm, BinaryOp op, URegister::Ptr a,
              UOperand::Ptr b, UOperand::Ptr c)
-    : UInstruction(cp, vm), op(op), a(a), b(b), c(c) {}
+    : UInstruction(cp, vm, Oper), op(op), a(a), b(b), c(c) {}
+
+ULabel::ULabel(size_t cp, VMPtr vm) : UInstruction(cp, vm, Label) {}
 
-ULabel::ULabel(size_t cp, VMPtr vm) : UInstruction(cp, vm) {}
+UGuard::UGuard(size_t cp, VMPtr vm) : UInstruction(cp, vm, Guard) {}
 
-UGuard::UGuard(size_t cp, VMPtr vm) : UInstruction(cp, vm) {}
+USafepoint::USafepoint(size_t cp, VMPtr vm)
+    : UInstruction(cp, vm, Safepoint) {}
 
 UMemCheck::UMemCheck(size_t cp, VMPtr vm, ULocation::Ptr a)
-    : UInstruction(cp, vm), a(a) {}
+    : UInstruction(cp, vm, MemCheck), a(a) {}
 
 UTagCheck::UTagCheck(size_t cp, VMPtr vm, UArgument::Ptr a, Tag tagA)
-    : UInstruction(cp, vm), a(a), tagA(tagA), tagB(tagA) {}
+    : UInstruction(cp, vm, TagCheck), a(a), tagA(tagA), tagB(tagA) {}
 
 UTagCheck::UTagCheck(size_t cp, VMPtr vm, UArgument::Ptr a, Tag tagA, Tag tagB)
-    : UInstruction(cp, vm), a(a), tagA(tagA), tagB(tagB) {}
+    : UInstruction(cp, vm, TagCheck), a(a), tagA(tagA), tagB(tagB) {}
+
+UTagCheck::UTagCheck(size_t cp, VMPtr vm, UArgument::Ptr a, Tag tagA,
+                     Kind kind)
+    : UInstruction(cp, vm, kind), a(a), tagA(tagA), tagB(tagA) {}
+
+UTypeGuard::UTypeGuard(size_t cp, VMPtr vm, UArgument::Ptr a, Tag tag)
+    : UTagCheck(cp, vm, a, tag, TypeGuard) {}
 
-UApply::UApply(size_t cp, VMPtr vm) : UInstruction(cp, vm) {}
+UApply::UApply(size_t cp, VMPtr vm) : UInstruction(cp, vm, Apply) {}
 
-UReturn::UReturn(size_t cp, VMPtr vm) : UInstruction(cp, vm) {}
+UReturn::UReturn(size_t cp, VMPtr vm) : UInstruction(cp, vm, Return) {}
 
-UHalt::UHalt(size_t cp, VMPtr vm) : UInstruction(cp, vm) {}
+UHalt::UHalt(size_t cp, VMPtr vm) : UInstruction(cp, vm, Halt) {}
 
 UGoto::UGoto(size_t cp, VMPtr vm, size_t destination)
-    : UInstruction(cp, vm), destination(destination) {}
+    : UInstruction(cp, vm, Goto), destination(destination) {}
 
 UBranch::UBranch(size_t cp, VMPtr vm, URegister::Ptr a, size_t destination)
-    : UInstruction(cp, vm), a(a), destination(destination) {}
+    : UInstruction(cp, vm, Branch), a(a), destination(destination) {}
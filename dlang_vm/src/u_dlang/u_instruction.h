@@ -3,9 +3,12 @@
 #pragma once
 
 #include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 
 #include "u_argument.h"
+#include "../data_structures/kind_cast.h"
 #include "../jit/jit_vm.h"
 #include "../jit/jit_state.h"
 #include "../virtual_machine/exception.h"
@@ -22,8 +25,22 @@ class UInstruction : public JIT,
   using VMPtr = std::shared_ptr<VirtualMachine>;
   using JITPtr = std::shared_ptr<JITState>;
 
+  // Registers holding byte offsets are shifted to indices while they are used
+  // as values, and shifted back afterwards (unless they hold the result)
+  static std::vector<jit_reg_t> toIndices(
+      const std::vector<UArgument::Ptr>& args);
+  static void toOffsets(const std::vector<jit_reg_t>& scaled,
+                        const URegister::Ptr& result);
+
  public:
-  explicit UInstruction(size_t cp, VMPtr vm);
+  // The kinds of instructions, one for each concrete class (for kindCast)
+  enum Kind {
+    Get, Set, Move, Unary, Oper, Label, Guard, Safepoint, MemCheck, TagCheck,
+    TypeGuard, Apply, Return, Halt, Goto, Branch
+  };
+
+  UInstruction(size_t cp, VMPtr vm, Kind kind);
+  Kind getKind() const;
 
   // Emits jit code according to the instruction definition
   virtual void jitCompile(VMPtr vm, JITPtr jit) const = 0;
@@ -36,11 +53,15 @@ class UInstruction : public JIT,
 
   const size_t cp;
   VMPtr vm;
+
+ private:
+  const Kind kind_;
 };
 
-class UGet : virtual public UInstruction {
+class UGet : public UInstruction {
  public:
   UGet(size_t cp, VMPtr vm, URegister::Ptr a, ULocation::Ptr b);
+  static bool isKind(Kind kind) { return kind == Get; }
 
   void jitCompile(VMPtr vm, JITPtr jit) const;
   std::shared_ptr<TInstruction>
@@ -52,9 +73,10 @@ class UGet : virtual public UInstruction {
   ULocation::Ptr b;
 };
 
-class USet : virtual public UInstruction {
+class USet : public UInstruction {
  public:
   USet(size_t cp, VMPtr vm, ULocation::Ptr a, UOperand::Ptr b);
+  static bool isKind(Kind kind) { return kind == Set; }
 
   void jitCompile(VMPtr vm, JITPtr jit) const;
   std::shared_ptr<TInstruction>
@@ -66,9 +88,10 @@ class USet : virtual public UInstruction {
   UOperand::Ptr b;
 };
 
-class UMove : virtual public UInstruction {
+class UMove : public UInstruction {
  public:
   UMove(size_t cp, VMPtr vm, URegister::Ptr a, UOperand::Ptr b);
+  static bool isKind(Kind kind) { return kind == Move; }
 
   void jitCompile(VMPtr vm, JITPtr jit) const;
   std::shared_ptr<TInstruction>
@@ -80,10 +103,11 @@ class UMove : virtual public UInstruction {
   UOperand::Ptr b;
 };
 
-class UUnary : virtual public UInstruction {
+class UUnary : public UInstruction {
  public:
   UUnary(size_t cp, VMPtr vm,
          UnaryOp op, URegister::Ptr a, UOperand::Ptr b);
+  static bool isKind(Kind kind) { return kind == Unary; }
 
   void jitCompile(VMPtr vm, JITPtr jit) const;
   std::shared_ptr<TInstruction>
@@ -96,10 +120,11 @@ class UUnary : virtual public UInstruction {
   UOperand::Ptr b;
 };
 
-class UOper : virtual public UInstruction {
+class UOper : public UInstruction {
  public:
   UOper(size_t cp, VMPtr vm,
         BinaryOp op, URegister::Ptr a, UOperand::Ptr b, UOperand::Ptr c);
+  static bool isKind(Kind kind) { return kind == Oper; }
 
   void jitCompile(VMPtr vm, JITPtr jit) const;
   std::shared_ptr<TInstruction>
@@ -112,9 +137,10 @@ class UOper : virtual public UInstruction {
   UOperand::Ptr b, c;
 };
 
-class ULabel : virtual public UInstruction {
+class ULabel : public UInstruction {
  public:
   ULabel(size_t cp, VMPtr vm);
+  static bool isKind(Kind kind) { return kind == Label; }
 
   void jitCompile(VMPtr vm, JITPtr jit) const;
   std::shared_ptr<TInstruction>
@@ -123,9 +149,22 @@ class ULabel : virtual public UInstruction {
   std::string print() const;
 };
 
-class UGuard : virtual public UInstruction {
+class UGuard : public UInstruction {
  public:
   UGuard(size_t cp, VMPtr vm);
+  static bool isKind(Kind kind) { return kind == Guard; }
+
+  void jitCompile(VMPtr vm, JITPtr jit) const;
+  std::shared_ptr<TInstruction>
+      getTInstruction(std::shared_ptr<TState> tState);
+
+  std::string print() const;
+};
+
+class USafepoint : public UInstruction {
+ public:
+  USafepoint(size_t cp, VMPtr vm);
+  static bool isKind(Kind kind) { return kind == Safepoint; }
 
   void jitCompile(VMPtr vm, JITPtr jit) const;
   std::shared_ptr<TInstruction>
@@ -134,9 +173,10 @@ class UGuard : virtual public UInstruction {
   std::string print() const;
 };
 
-class UMemCheck : virtual public UInstruction {
+class UMemCheck : public UInstruction {
  public:
   UMemCheck(size_t cp, VMPtr vm, ULocation::Ptr a);
+  static bool isKind(Kind kind) { return kind == MemCheck; }
 
   void jitCompile(VMPtr vm, JITPtr jit) const;
   std::shared_ptr<TInstruction>
@@ -145,12 +185,19 @@ class UMemCheck : virtual public UInstruction {
   std::string print() const;
 
   ULocation::Ptr a;
+
+  // Set if the check was moved before a loop, it fails as if it ran at cp,
+  // where sp is moved by this from where it runs
+  std::optional<int> movedSp;
 };
 
-class UTagCheck : virtual public UInstruction {
+class UTagCheck : public UInstruction {
  public:
   UTagCheck(size_t cp, VMPtr vm, UArgument::Ptr a, Tag tagA);
   UTagCheck(size_t cp, VMPtr vm, UArgument::Ptr a, Tag tagA, Tag tagB);
+  static bool isKind(Kind kind) {
+    return kind == TagCheck || kind == TypeGuard;
+  }
 
   void jitCompile(VMPtr vm, JITPtr jit) const;
   std::shared_ptr<TInstruction>
@@ -160,11 +207,33 @@ class UTagCheck : virtual public UInstruction {
 
   UArgument::Ptr a;
   Tag tagA, tagB;
+
+  // Set if the check was moved before a loop, as in UMemCheck
+  std::optional<int> movedSp;
+
+ protected:
+  UTagCheck(size_t cp, VMPtr vm, UArgument::Ptr a, Tag tagA, Kind kind);
+
+  // Loads the tag of a into a register, and returns the register
+  jit_reg_t jitLoadTag(VMPtr vm) const;
+};
+
+// Tag check at the start of code specialized on the tag, if it fails the
+// unspecialized code runs instead (it is not a runtime error)
+class UTypeGuard : public UTagCheck {
+ public:
+  UTypeGuard(size_t cp, VMPtr vm, UArgument::Ptr a, Tag tag);
+  static bool isKind(Kind kind) { return kind == TypeGuard; }
+
+  void jitCompile(VMPtr vm, JITPtr jit) const;
+
+  std::string print() const;
 };
 
-class UApply : virtual public UInstruction {
+class UApply : public UInstruction {
  public:
   UApply(size_t cp, VMPtr vm);
+  static bool isKind(Kind kind) { return kind == Apply; }
 
   void jitCompile(VMPtr vm, JITPtr jit) const;
   std::shared_ptr<TInstruction>
@@ -173,9 +242,10 @@ class UApply : virtual public UInstruction {
   std::string print() const;
 };
 
-class UReturn : virtual public UInstruction {
+class UReturn : public UInstruction {
  public:
   UReturn(size_t cp, VMPtr vm);
+  static bool isKind(Kind kind) { return kind == Return; }
 
   void jitCompile(VMPtr vm, JITPtr jit) const;
   std::shared_ptr<TInstruction>
@@ -184,9 +254,10 @@ class UReturn : virtual public UInstruction {
   std::string print() const;
 };
 
-class UHalt : virtual public UInstruction {
+class UHalt : public UInstruction {
  public:
   UHalt(size_t cp, VMPtr vm);
+  static bool isKind(Kind kind) { return kind == Halt; }
 
   void jitCompile(VMPtr vm, JITPtr jit) const;
   std::shared_ptr<TInstruction>
@@ -195,9 +266,10 @@ class UHalt : virtual public UInstruction {
   std::string print() const;
 };
 
-class UGoto : virtual public UInstruction {
+class UGoto : public UInstruction {
  public:
   UGoto(size_t cp, VMPtr vm, size_t destination);
+  static bool isKind(Kind kind) { return kind == Goto; }
 
   void jitCompile(VMPtr vm, JITPtr jit) const;
   std::shared_ptr<TInstruction>
@@ -208,9 +280,10 @@ class UGoto : virtual public UInstruction {
   size_t destination;
 };
 
-class UBranch : virtual public UInstruction {
+class UBranch : public UInstruction {
  public:
   UBranch(size_t cp, VMPtr vm, URegister::Ptr a, size_t destination);
+  static bool isKind(Kind kind) { return kind == Branch; }
 
   void jitCompile(VMPtr vm, JITPtr jit) const;
   std::shared_ptr<TInstruction>
@@ -2,66 +2,164 @@
 
 #include "u_instruction.h"
 
-void UGet::jitCompile(VMPtr vm, JITPtr jit) const {
-  const auto& bReg = b->getPtr()->getReg();
-  jit_muli(bReg, bReg, sizeof(Item));
-  jit_ldi_l(JITVM::tmp, b->getDataPtr(vm));
-  if (b->getType() == VirtualMachine::Type::Val) {
-    jit_addi(JITVM::tmp, JITVM::tmp,
-              offsetof(Item, value) + b->getOffset() * sizeof(Item));
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+// Offset of the word holding the tag or value inside a cell
+static size_t fieldOffset(VirtualMachine::Type type) {
+  return (type == VirtualMachine::Type::Val) ? Cell::kValueOffset
+                                             : Cell::kTagOffset;
+}
+
+// State of the vm where a check fails, if it was moved away from its cp
+static std::optional<JITState::ErrorState> errorState(
+    size_t cp, std::optional<int> movedSp) {
+  if (!movedSp) { return {}; }
+  return JITState::ErrorState{cp, *movedSp};
+}
+
+std::vector<jit_reg_t> UInstruction::toIndices(
+    const std::vector<UArgument::Ptr>& args) {
+  std::vector<jit_reg_t> scaled;
+  for (const auto& arg : args) {
+    auto reg = kindCast<URegister>(arg);
+    if (reg && JITVM::isScaled(reg->getReg()) &&
+        std::find(scaled.begin(), scaled.end(), reg->getReg()) ==
+            scaled.end()) {
+      scaled.push_back(reg->getReg());
+      jit_rshi(reg->getReg(), reg->getReg(), JITVM::kCellShift);
+    }
   }
-  if (b->getType() == VirtualMachine::Type::Tag) {
-    jit_addi(JITVM::tmp, JITVM::tmp,
-              offsetof(Item, tag) + b->getOffset() * sizeof(Item));
+  return scaled;
+}
+
+void UInstruction::toOffsets(const std::vector<jit_reg_t>& scaled,
+                             const URegister::Ptr& result) {
+  for (auto reg : scaled) {
+    if (reg != result->getReg()) {
+      jit_lshi(reg, reg, JITVM::kCellShift);
+    }
   }
+  if (JITVM::isScaled(result->getReg())) {
+    jit_lshi(result->getReg(), result->getReg(), JITVM::kCellShift);
+  }
+}
+
+void UGet::jitCompile(VMPtr vm, JITPtr jit) const {
+  // Indices in general purpose registers are scaled in place
+  const auto& bReg = b->getPtr()->getReg();
+  bool isIndex = !JITVM::isScaled(bReg);
+  if (isIndex) { jit_lshi(bReg, bReg, JITVM::kCellShift); }
+  jit_addi(JITVM::tmp, JITVM::getData(vm, b->getMemoryPtr(vm)),
+           fieldOffset(b->getType()) + b->getOffset() * sizeof(Cell));
   // reg = (pointer + offset)->value or (pointer + offset)->tag
   jit_ldxr_l(a->getReg(), bReg, JITVM::tmp);
-  if (a->getReg() != bReg) {
-    jit_divi(bReg, bReg, sizeof(Item));
+  if (isIndex && a->getReg() != bReg) {
+    jit_rshi(bReg, bReg, JITVM::kCellShift);
+  }
+  // In compact cells, extract the field from the word
+  if (Cell::kCompact && b->getType() == VirtualMachine::Type::Tag) {
+    jit_andi(a->getReg(), a->getReg(), Cell::kTagMask);
+  }
+  if (Cell::kCompact && b->getType() == VirtualMachine::Type::Val) {
+    jit_rshi(a->getReg(), a->getReg(), Cell::kTagBits);
   }
+  toOffsets({}, a);
 }
 
 void USet::jitCompile(VMPtr vm, JITPtr jit) const {
   const auto& aReg = a->getPtr()->getReg();
+  bool isIndex = !JITVM::isScaled(aReg);
 
   // Compute the offset of the tag or value
-  size_t offset = (a->getType() == VirtualMachine::Type::Val)
-      ? offsetof(Item, value) + a->getOffset() * sizeof(Item)
-      : offsetof(Item, tag) + a->getOffset() * sizeof(Item);
+  size_t offset = fieldOffset(a->getType()) + a->getOffset() * sizeof(Cell);
 
-  // a = 8 * a + offset
-  jit_ldi_l(JITVM::tmp, a->getDataPtr(vm));
-  jit_muli(aReg, aReg, sizeof(Item));
-  jit_addr(aReg, aReg, JITVM::tmp);
-  jit_addi(aReg, aReg, offset);
+  // a = data + a (the offset is added by the store), and b is stored as an
+  // index if it holds an offset
+  if (isIndex) { jit_lshi(aReg, aReg, JITVM::kCellShift); }
+  jit_addr(aReg, aReg, JITVM::getData(vm, a->getMemoryPtr(vm)));
+  auto scaled = toIndices({b});
 
-  // a->value or a->tag = b
-  if (auto bReg = std::dynamic_pointer_cast<URegister>(b)) {
-    jit_str_l(aReg, bReg->getReg());
+  if (Cell::kCompact) {
+    // Replace the tag or value bits of the word with b
+    bool isTag = a->getType() == VirtualMachine::Type::Tag;
+    jit_ldxi_l(JITVM::tmp, aReg, offset);
+    jit_andi(JITVM::tmp, JITVM::tmp,
+             isTag ? ~Cell::kTagMask : Cell::kTagMask);
+    if (auto bReg = kindCast<URegister>(b)) {
+      // The value is shifted in place, and shifted back afterwards
+      const auto& bb = bReg->getReg();
+      if (!isTag) { jit_lshi(bb, bb, Cell::kTagBits); }
+      jit_orr(JITVM::tmp, JITVM::tmp, bb);
+      if (!isTag) { jit_rshi(bb, bb, Cell::kTagBits); }
+    }
+    if (auto bImm = kindCast<UImmediate>(b)) {
+      jit_ori(JITVM::tmp, JITVM::tmp,
+              isTag ? static_cast<jit_word_t>(bImm->getValue())
+                    : static_cast<jit_word_t>(bImm->getValue())
+                          << Cell::kTagBits);
+    }
+    jit_stxi_l(offset, aReg, JITVM::tmp);
+  } else {
+    // a->value or a->tag = b
+    if (auto bReg = kindCast<URegister>(b)) {
+      jit_stxi_l(offset, aReg, bReg->getReg());
+    }
+    if (auto bImm = kindCast<UImmediate>(b)) {
+      jit_movi(JITVM::tmp, bImm->getValue());
+      jit_stxi_l(offset, aReg, JITVM::tmp);
+    }
   }
-  if (auto bImm = std::dynamic_pointer_cast<UImmediate>(b)) {
-    jit_movi(JITVM::tmp, bImm->getValue());
-    jit_str_l(aReg, JITVM::tmp);
+
+  // a = a - data
+  for (auto reg : scaled) {
+    jit_lshi(reg, reg, JITVM::kCellShift);
   }
+  jit_subr(aReg, aReg, JITVM::getData(vm, a->getMemoryPtr(vm)));
+  if (isIndex) { jit_rshi(aReg, aReg, JITVM::kCellShift); }
 
-  // a = (a - offset) / 8
-  jit_ldi_l(JITVM::tmp, a->getDataPtr(vm));
-  jit_subi(aReg, aReg, offset);
-  jit_subr(aReg, aReg, JITVM::tmp);
-  jit_divi(aReg, aReg, sizeof(Item));
+  // Write barrier, a heap item is written once for its tag and value
+  if (a->getKind() == UArgument::LocHeap &&
+      a->getType() == VirtualMachine::Type::Tag) {
+    jit_ldi_l(JITVM::tmp, a->getMemoryPtr(vm)->getWriteBarrierPtr());
+    jit_subi(JITVM::tmp, JITVM::tmp, a->getOffset());
+    if (!isIndex) { jit_lshi(JITVM::tmp, JITVM::tmp, JITVM::kCellShift); }
+    auto barrierCheck = jit_bger(aReg, JITVM::tmp);
+    if (isIndex) {
+      jit_addi(JITVM::tmp, aReg, a->getOffset());
+    } else {
+      jit_rshi(JITVM::tmp, aReg, JITVM::kCellShift);
+      jit_addi(JITVM::tmp, JITVM::tmp, a->getOffset());
+    }
+    JITVM::call(JITVM::tmp, Memory::recordWriteStatic, a->getMemoryPtr(vm),
+                JITVM::tmp);
+    jit_patch(barrierCheck);
+  }
 }
 
 void UMove::jitCompile(VMPtr vm, JITPtr jit) const {
-  if (auto bReg = std::dynamic_pointer_cast<URegister>(b)) {
-    jit_movr(a->getReg(), bReg->getReg());
+  // Offsets and indices are converted when moved between registers
+  if (auto bReg = kindCast<URegister>(b)) {
+    bool aScaled = JITVM::isScaled(a->getReg());
+    bool bScaled = JITVM::isScaled(bReg->getReg());
+    if (aScaled == bScaled) {
+      jit_movr(a->getReg(), bReg->getReg());
+    } else if (aScaled) {
+      jit_lshi(a->getReg(), bReg->getReg(), JITVM::kCellShift);
+    } else {
+      jit_rshi(a->getReg(), bReg->getReg(), JITVM::kCellShift);
+    }
   }
-  if (auto bImm = std::dynamic_pointer_cast<UImmediate>(b)) {
+  if (auto bImm = kindCast<UImmediate>(b)) {
     jit_movi(a->getReg(), bImm->getValue());
+    toOffsets({}, a);
   }
 }
 
 void UUnary::jitCompile(VMPtr vm, JITPtr jit) const {
-  if (auto bReg = std::dynamic_pointer_cast<URegister>(b)) {
+  auto scaled = toIndices({b});
+  if (auto bReg = kindCast<URegister>(b)) {
     if (op == Not) {
       jit_subi(a->getReg(), bReg->getReg(), 1);
       jit_negr(a->getReg(), a->getReg());
@@ -73,7 +171,7 @@ void UUnary::jitCompile(VMPtr vm, JITPtr jit) const {
       throw InternalError();
     }
   }
-  if (auto bImm = std::dynamic_pointer_cast<UImmediate>(b)) {
+  if (auto bImm = kindCast<UImmediate>(b)) {
     if (op == Not) {
       jit_movi(a->getReg(), 1 - bImm->getValue());
     } else if (op == Neg) {
@@ -85,20 +183,33 @@ void UUnary::jitCompile(VMPtr vm, JITPtr jit) const {
       throw InternalError();
     }
   }
+  toOffsets(scaled, a);
 }
 
 void UOper::jitCompile(VMPtr vm, JITPtr jit) const {
+  // Offsets are moved by scaled immediates (the common case for sp and hp)
+  auto bReg = kindCast<URegister>(b);
+  auto cImm = kindCast<UImmediate>(c);
+  if (JITVM::isScaled(a->getReg()) && bReg &&
+      JITVM::isScaled(bReg->getReg()) && cImm && (op == Add || op == Sub)) {
+    jit_word_t delta = static_cast<jit_word_t>(cImm->getValue())
+                       << JITVM::kCellShift;
+    jit_addi(a->getReg(), bReg->getReg(), op == Add ? delta : -delta);
+    return;
+  }
+  auto scaled = toIndices({b, c});
+
   // Get b's register or use a temporary if it is an immediate
   jit_reg_t bb;
-  if (auto bImm = std::dynamic_pointer_cast<UImmediate>(b)) {
+  if (auto bImm = kindCast<UImmediate>(b)) {
     jit_movi(JITVM::tmp, bImm->getValue());
     bb = JITVM::tmp;
   }
-  if (auto bReg = std::dynamic_pointer_cast<URegister>(b)) {
+  if (auto bReg = kindCast<URegister>(b)) {
     bb = bReg->getReg();
   }
 
-  if (auto cReg = std::dynamic_pointer_cast<URegister>(c)) {
+  if (auto cReg = kindCast<URegister>(c)) {
     if (op == And) { jit_andr(a->getReg(), bb, cReg->getReg()); }
     if (op == Or)  { jit_orr (a->getReg(), bb, cReg->getReg()); }
     if (op == Eq)  { jit_eqr (a->getReg(), bb, cReg->getReg()); }
@@ -111,7 +222,7 @@ void UOper::jitCompile(VMPtr vm, JITPtr jit) const {
       jit_divr(a->getReg(), bb, cReg->getReg());
     }
   }
-  if (auto cImm = std::dynamic_pointer_cast<UImmediate>(c)) {
+  if (auto cImm = kindCast<UImmediate>(c)) {
     if (op == And) { jit_andi(a->getReg(), bb, cImm->getValue()); }
     if (op == Or)  { jit_ori (a->getReg(), bb, cImm->getValue()); }
     if (op == Eq)  { jit_eqi (a->getReg(), bb, cImm->getValue()); }
@@ -126,77 +237,142 @@ void UOper::jitCompile(VMPtr vm, JITPtr jit) const {
       jit_divi(a->getReg(), bb, cImm->getValue());
     }
   }
+  toOffsets(scaled, a);
 }
 
 void ULabel::jitCompile(VMPtr vm, JITPtr jit) const {
-  jit->addLabel(cp, jit_label());
-  jit->addIndirectBranch(jit_bnei(JITVM::cp, cp));
+  jit->addLabel(cp, jit->isEntryPoint(cp) ? jit_indirect() : jit_label());
+  if (jit->needsCpCheck(cp)) {
+    jit->addIndirectBranch(jit_bnei(JITVM::cp, cp));
+  }
 }
 
 void UGuard::jitCompile(VMPtr vm, JITPtr jit) const {}
 
+void USafepoint::jitCompile(VMPtr vm, JITPtr jit) const {
+  // If the heap reached the collection limit, go back to the vm loop, which
+  // runs the garbage collector (all the vm state is in memory at this point)
+  // (the limit is scaled like hp, SIZE_MAX stays above any offset)
+  jit_ldi_l(JITVM::tmp, &vm->hpLimit);
+  jit_lshi(JITVM::tmp, JITVM::tmp, JITVM::kCellShift);
+  jit->addIndirectBranch(jit_bger_u(JITVM::hp, JITVM::tmp));
+}
+
 void UMemCheck::jitCompile(VMPtr vm, JITPtr jit) const {
   // If trying to access memory below 0, runtime error
   // If trying to access memory above max,
   //   keep allocating more memory until it gets into the bounds
 
-  // If ptr + offset < 0, throw a runtime error
-  jit->addRuntimeErrorBranch(
-      jit_blti(a->getPtr()->getReg(), -a->getOffset()));
+  // Offsets are compared with scaled bounds
+  bool isIndex = !JITVM::isScaled(a->getPtr()->getReg());
+  jit_word_t scale = isIndex ? 1 : sizeof(Cell);
+
+  // If ptr + offset < 0, throw a runtime error (hp is never negative)
+  if (a->getPtr()->getReg() != JITVM::hp || a->getOffset() < 0) {
+    jit->addRuntimeErrorBranch(
+        jit_blti(a->getPtr()->getReg(), -a->getOffset() * scale),
+        errorState(cp, movedSp));
+  }
 
   auto checkStartLabel = jit_label();
 
-  // If ptr + offset >= maxSize, allocate more memory
+  // If ptr + offset >= maxSize, allocate more memory out of line
   jit_ldi_l(JITVM::tmp, a->getSizePtr(vm));
   jit_subi(JITVM::tmp, JITVM::tmp, a->getOffset());
-  auto boundCheck = jit_bltr(a->getPtr()->getReg(), JITVM::tmp);
-
-  // Failed bound check case, allocate memory
-  JITVM::call(JITVM::tmp, Memory::allocateStatic, a->getMemoryPtr(vm));
-  jit->addRuntimeErrorBranch(jit_bnei(JITVM::tmp, 0));
-
-  // Jump back to the bound check
-  auto allocationEndJump = jit_jmpi();
-  jit_patch_at(allocationEndJump, checkStartLabel);
-
-  jit_patch(boundCheck);
+  if (!isIndex) { jit_lshi(JITVM::tmp, JITVM::tmp, JITVM::kCellShift); }
+  jit->addAllocationBranch(jit_bger(a->getPtr()->getReg(), JITVM::tmp),
+                           checkStartLabel, a->getMemoryPtr(vm),
+                           errorState(cp, movedSp));
 }
 
-void UTagCheck::jitCompile(VMPtr vm, JITPtr jit) const {
+jit_reg_t UTagCheck::jitLoadTag(VMPtr vm) const {
   // Get a's register or use a temporary if it is an immediate or location
   jit_reg_t aa;
-  if (auto aImm = std::dynamic_pointer_cast<UImmediate>(a)) {
+  if (auto aImm = kindCast<UImmediate>(a)) {
     jit_movi(JITVM::tmp, aImm->getValue());
     aa = JITVM::tmp;
-  } else if (auto aReg = std::dynamic_pointer_cast<URegister>(a)) {
+  } else if (auto aReg = kindCast<URegister>(a)) {
     aa = aReg->getReg();
-  } else if (auto aLoc = std::dynamic_pointer_cast<ULocation>(a)) {
+    if (JITVM::isScaled(aa)) {
+      jit_rshi(JITVM::tmp, aa, JITVM::kCellShift);
+      aa = JITVM::tmp;
+    }
+  } else if (auto aLoc = kindCast<ULocation>(a)) {
     const auto& aReg = aLoc->getPtr()->getReg();
-    jit_muli(aReg, aReg, sizeof(Item));
-    jit_ldi_l(JITVM::tmp, aLoc->getDataPtr(vm));
-    jit_addi(JITVM::tmp, JITVM::tmp,
-             offsetof(Item, tag) + aLoc->getOffset() * sizeof(Item));
+    bool isIndex = !JITVM::isScaled(aReg);
+    if (isIndex) { jit_lshi(aReg, aReg, JITVM::kCellShift); }
+    jit_addi(JITVM::tmp, JITVM::getData(vm, aLoc->getMemoryPtr(vm)),
+             fieldOffset(VirtualMachine::Type::Tag) +
+             aLoc->getOffset() * sizeof(Cell));
     jit_ldxr_l(JITVM::tmp, aReg, JITVM::tmp);
-    jit_divi(aReg, aReg, sizeof(Item));
+    if (isIndex) { jit_rshi(aReg, aReg, JITVM::kCellShift); }
+    if (Cell::kCompact) {
+      jit_andi(JITVM::tmp, JITVM::tmp, Cell::kTagMask);
+    }
     aa = JITVM::tmp;
   }
+  return aa;
+}
 
+void UTagCheck::jitCompile(VMPtr vm, JITPtr jit) const {
+  auto aa = jitLoadTag(vm);
   if (tagA != tagB) {
     auto branch = jit_beqi(aa, tagA);
-    jit->addRuntimeErrorBranch(jit_bnei(aa, tagB));
+    jit->addRuntimeErrorBranch(jit_bnei(aa, tagB), errorState(cp, movedSp));
     jit_patch(branch);
   } else {
-    jit->addRuntimeErrorBranch(jit_bnei(aa, tagA));
+    jit->addRuntimeErrorBranch(jit_bnei(aa, tagA), errorState(cp, movedSp));
   }
 }
 
-void UApply::jitCompile(VMPtr vm, JITPtr jit) const {}
+void UTypeGuard::jitCompile(VMPtr vm, JITPtr jit) const {
+  jit->addGuardBranch(jit_bnei(jitLoadTag(vm), tagA));
+}
+
+void UApply::jitCompile(VMPtr vm, JITPtr jit) const {
+  jit->setCpUnknown();
+  if (!jit->callsNatively(cp)) {
+    return;
+  }
 
-void UReturn::jitCompile(VMPtr vm, JITPtr jit) const {}
+  // If the callee is compiled, call it directly instead of leaving the code
+  // (general purpose registers are not live after the call)
+  jit_ldi(JIT_R0, &JITVM::callDepth);
+  auto tooDeep = jit_bgei(JIT_R0, JITVM::kMaxCallDepth);
+  jit_ldi(JIT_R1, &JITVM::compiledCode);
+  jit_lshi(JIT_R2, JITVM::cp, __builtin_ctz(sizeof(void*)));
+  jit_ldxr(JIT_R1, JIT_R1, JIT_R2);
+  auto notCompiled = jit_beqi(JIT_R1, 0);
+  jit_addi(JIT_R0, JIT_R0, 1);
+  jit_sti(&JITVM::callDepth, JIT_R0);
+
+  // The callee runs on the frame set up by the apply, with the vm state in
+  // memory, and leaves it there when it returns or exits
+  JITVM::storeState(vm);
+  jit_prepare();
+  jit_finishr(JIT_R1);
+  JITVM::loadState(vm);
+  jit_ldi(JIT_R0, &JITVM::callDepth);
+  jit_subi(JIT_R0, JIT_R0, 1);
+  jit_sti(&JITVM::callDepth, JIT_R0);
+
+  // Leave if the vm stopped, the cp check at the next label leaves if the
+  // callee exited before returning
+  jit_ldi_i(JITVM::tmp, &vm->status);
+  jit->addIndirectBranch(jit_bnei(JITVM::tmp, VirtualMachine::Running));
+
+  jit_patch(tooDeep);
+  jit_patch(notCompiled);
+}
+
+void UReturn::jitCompile(VMPtr vm, JITPtr jit) const {
+  jit->setCpUnknown();
+}
 
 void UHalt::jitCompile(VMPtr vm, JITPtr jit) const {
   jit_movi(JITVM::tmp, VirtualMachine::Status::Halted);
   jit_sti(&vm->status, JITVM::tmp);
+  jit->setCpUnknown();
 }
 
 void UGoto::jitCompile(VMPtr vm, JITPtr jit) const {
@@ -37,7 +37,7 @@ std::shared_ptr<TInstruction> UUnary::getTInstruction(
 std::shared_ptr<TInstruction> UOper::getTInstruction(
     std::shared_ptr<TState> tState) {
   if (a == VMUArg::sp && b == VMUArg::sp) {
-    int offset = std::dynamic_pointer_cast<UImmediate>(c)->getValue();
+    int offset = kindCast<UImmediate>(c)->getValue();
     if (op == Add) {
       tState->updateSp(+offset);
     } else if (op == Sub) {
@@ -65,6 +65,12 @@ std::shared_ptr<TInstruction> UGuard::getTInstruction(
   return std::make_shared<TGuard>(shared_from_this(), tState->isFunction());
 }
 
+std::shared_ptr<TInstruction> USafepoint::getTInstruction(
+    std::shared_ptr<TState> tState) {
+  return std::make_shared<TSafepoint>(shared_from_this(), tState->isFunction(),
+                                      VMUArg::hp->makeTArgument(tState));
+}
+
 std::shared_ptr<TInstruction> UMemCheck::getTInstruction(
     std::shared_ptr<TState> tState) {
   return std::make_shared<TMemCheck>(shared_from_this(),
@@ -75,11 +81,14 @@ std::shared_ptr<TInstruction> UMemCheck::getTInstruction(
 
 std::shared_ptr<TInstruction> UTagCheck::getTInstruction(
     std::shared_ptr<TState> tState) {
+  // The tag of a heap location is read through its pointer
+  auto aLoc = kindCast<ULocHeap>(a);
   return std::make_shared<TTagCheck>(
       shared_from_this(),
       tState->isFunction(),
       a->makeTArgument(tState),
-      tagA, tagB);
+      tagA, tagB,
+      aLoc ? aLoc->getPtr()->makeTArgument(tState) : nullptr);
 }
 
 std::shared_ptr<TInstruction> UApply::getTInstruction(
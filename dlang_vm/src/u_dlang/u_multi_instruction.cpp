@@ -40,6 +40,23 @@ UMoveAndCheck::UMoveAndCheck(size_t cp, std::shared_ptr<VirtualMachine> vm,
         .add<USetAndCheck>(locTo, reg)
     ) {}
 
+// The cells are allocated at once, checking the last one is in the heap
+UAllocate::UAllocate(size_t cp, std::shared_ptr<VirtualMachine> vm, int size)
+    : Code<UInstruction>(
+      UCodeBuilder(cp, vm)
+        .add<UMemCheck>(VMUArg::HP(size - 1, VMUArg::Val))
+    ) {}
+
+// The heap location was checked when allocated
+UMoveToHeap::UMoveToHeap(size_t cp, std::shared_ptr<VirtualMachine> vm,
+                         URegister::Ptr reg, ULocation::Ptr locFrom,
+                         ULocation::Ptr locTo)
+    : Code<UInstruction>(
+      UCodeBuilder(cp, vm)
+        .add<UGetAndCheck>(reg, locFrom)
+        .add<USet>(locTo, reg)
+    ) {}
+
 UMakeHeapPointer::UMakeHeapPointer(size_t cp,
                                    std::shared_ptr<VirtualMachine> vm,
                                    ULocation::Ptr loc, UImmediate::Ptr heapTag)
@@ -31,6 +31,18 @@ class UMoveAndCheck : public Code<UInstruction> {
                 ULocation::Ptr locTo);
 };
 
+class UAllocate : public Code<UInstruction> {
+ public:
+  UAllocate(size_t cp, std::shared_ptr<VirtualMachine> vm, int size);
+};
+
+class UMoveToHeap : public Code<UInstruction> {
+ public:
+  UMoveToHeap(size_t cp, std::shared_ptr<VirtualMachine> vm,
+              URegister::Ptr reg, ULocation::Ptr locFrom,
+              ULocation::Ptr locTo);
+};
+
 class UMakeHeapPointer : public Code<UInstruction> {
  public:
   UMakeHeapPointer(size_t cp, std::shared_ptr<VirtualMachine> vm,
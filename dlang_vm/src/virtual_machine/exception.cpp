@@ -22,6 +22,9 @@ UnkownInstruction::UnkownInstruction(std::string token,
   setExceptionMessage(message);
 }
 
+InvalidBytecode::InvalidBytecode(const std::string& message)
+    : Exception("Invalid bytecode: " + message) {}
+
 RuntimeError::RuntimeError() : Exception("Runtime error") {}
 
 InternalError::InternalError() : Exception("Internal error") {}
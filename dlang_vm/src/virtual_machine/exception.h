@@ -22,6 +22,12 @@ class UnkownInstruction : public Exception {
   UnkownInstruction(std::string token, std::vector<std::string> instruction);
 };
 
+// Thrown when a binary bytecode file is malformed or fails verification
+class InvalidBytecode : public Exception {
+ public:
+  explicit InvalidBytecode(const std::string& message);
+};
+
 // Thrown when there an instruction is missing an "if" statement
 class InternalError : public Exception {
  public:
@@ -7,7 +7,7 @@
 #include "../memory_managers/memory_manager.h"
 #include "../virtual_machine/exception.h"
 
-Memory::Memory(size_t size) : size_(size), items_(new Item[size]) {}
+Memory::Memory(size_t size) : size_(size), items_(new Cell[size]) {}
 
 Memory::~Memory() {
   delete[] items_;
@@ -16,7 +16,7 @@ Memory::~Memory() {
 Memory& Memory::operator=(const Memory& other) {
   delete[] items_;
   size_ = other.size_;
-  items_ = new Item[size_];
+  items_ = new Cell[size_];
   std::copy(other.items_, other.items_ + size_, items_);
   return *this;
 }
@@ -29,14 +29,6 @@ void Memory::setMemoryManager(std::shared_ptr<MemoryManager> memoryManager) {
   memoryManager_ = memoryManager;
 }
 
-size_t Memory::size() const {
-  return size_;
-}
-
-Item& Memory::operator[](size_t idx) {
-  return items_[idx];
-}
-
 void Memory::checkSize(size_t idx) {
   while (idx >= size_) {
     allocate();
@@ -45,7 +37,7 @@ void Memory::checkSize(size_t idx) {
 
 void Memory::checkTag(size_t idx, Tag tag) {
   checkSize(idx);
-  if (items_[idx].tag != tag) {
+  if (items_[idx].getTag() != tag) {
     throw RuntimeError();
   }
 }
@@ -63,6 +55,7 @@ Item Memory::getAndCheck(size_t idx, Tag tag) {
 void Memory::set(size_t idx, Item item) {
   checkSize(idx);
   items_[idx] = item;
+  recordWrite(idx);
 }
 
 void Memory::allocate() {
@@ -73,8 +66,19 @@ void Memory::allocate() {
   }
 }
 
+void Memory::setWriteBarrier(size_t bound) {
+  writeBarrier_ = bound;
+}
+
+void Memory::recordWrite(size_t idx) {
+  if (idx < writeBarrier_) {
+    memoryManager_->recordWrite(this, idx);
+  }
+}
+
 size_t* Memory::getSizePtr() { return &size_; }
-Item** Memory::getDataPtr() { return &items_; }
+Cell** Memory::getDataPtr() { return &items_; }
+size_t* Memory::getWriteBarrierPtr() { return &writeBarrier_; }
 
 int Memory::allocateStatic(Memory* memory) {
   try {
@@ -84,3 +88,7 @@ int Memory::allocateStatic(Memory* memory) {
   }
   return 0;
 }
+
+void Memory::recordWriteStatic(Memory* memory, size_t idx) {
+  memory->recordWrite(idx);
+}
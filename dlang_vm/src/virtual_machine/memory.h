@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 
 enum Tag {
@@ -27,6 +29,63 @@ struct Item {
   Value value;
 };
 
+#ifdef DLANG_COMPACT_ITEMS
+
+// Cell storing an item in one word: the tag is in the low bits, and the value
+// (sign extended when read) in the others, so headers also encode the size
+class Cell {
+ public:
+  static constexpr bool kCompact = true;
+  static constexpr int kTagBits = 4;
+  static constexpr uint64_t kTagMask = (1 << kTagBits) - 1;
+  static constexpr size_t kTagOffset = 0;
+  static constexpr size_t kValueOffset = 0;
+
+  Cell() = default;
+  Cell(Tag tag, Value value) : word_((value << kTagBits) | tag) {}
+  Cell(Item item) : Cell(item.tag, item.value) {}  // NOLINT
+  operator Item() const { return {getTag(), getValue()}; }
+
+  Tag getTag() const { return static_cast<Tag>(word_ & kTagMask); }
+  Value getValue() const {
+    return static_cast<int64_t>(word_) >> kTagBits;
+  }
+  void setTag(Tag tag) { word_ = (word_ & ~kTagMask) | tag; }
+  void setValue(Value value) {
+    word_ = (value << kTagBits) | (word_ & kTagMask);
+  }
+
+ private:
+  uint64_t word_;
+};
+
+#else
+
+// Cell storing an item as it is, tag and value are separate words
+class Cell {
+ public:
+  static constexpr bool kCompact = false;
+  static constexpr int kTagBits = 0;
+  static constexpr uint64_t kTagMask = ~static_cast<uint64_t>(0);
+  static constexpr size_t kTagOffset = offsetof(Item, tag);
+  static constexpr size_t kValueOffset = offsetof(Item, value);
+
+  Cell() = default;
+  Cell(Tag tag, Value value) : item_{tag, value} {}
+  Cell(Item item) : item_(item) {}  // NOLINT
+  operator Item() const { return item_; }
+
+  Tag getTag() const { return item_.tag; }
+  Value getValue() const { return item_.value; }
+  void setTag(Tag tag) { item_.tag = tag; }
+  void setValue(Value value) { item_.value = value; }
+
+ private:
+  Item item_;
+};
+
+#endif
+
 class MemoryManager;
 
 // Object representing a readable and writable chunk of memory
@@ -44,7 +103,7 @@ class Memory {
 
   // Methods used to access the underlying data
   size_t size() const;
-  Item& operator[](size_t idx);
+  Cell& operator[](size_t idx);
 
   // Methods used to access thorough the memory manager
   void checkSize(size_t idx);
@@ -54,13 +113,29 @@ class Memory {
   void set(size_t idx, Item item);
   void allocate();
 
+  // Writes below the bound are reported to the memory manager
+  void setWriteBarrier(size_t bound);
+  void recordWrite(size_t idx);
+
   // Methods used for Just-In-Time compilation
   size_t* getSizePtr();
-  Item** getDataPtr();
+  Cell** getDataPtr();
+  size_t* getWriteBarrierPtr();
   static int allocateStatic(Memory* memory);
+  static void recordWriteStatic(Memory* memory, size_t idx);
 
  private:
   size_t size_;
-  Item* items_;
+  Cell* items_;
+  size_t writeBarrier_ = 0;
   std::shared_ptr<MemoryManager> memoryManager_;
 };
+
+// The underlying data is accessed directly by the interpreter handlers
+inline size_t Memory::size() const {
+  return size_;
+}
+
+inline Cell& Memory::operator[](size_t idx) {
+  return items_[idx];
+}
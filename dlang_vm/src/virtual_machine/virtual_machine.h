@@ -16,6 +16,9 @@ class VirtualMachine {
   // Virtual Machine state
   enum Status {Halted, Running, RuntimeError} status = Running;
   size_t sp = 0, fp = 0, cp = 0, hp = 0;
+
+  // The memory manager is called when hp reaches this limit
+  size_t hpLimit = 0;
   Memory stack, heap;
 
   // Get the result from the vm (a string representing the top of the stack)
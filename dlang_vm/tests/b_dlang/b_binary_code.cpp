@@ -0,0 +1,142 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../../src/b_dlang/b_binary_code.h"
+#include "../../src/b_dlang/b_code_builder.h"
+
+void verifyString(const std::string& codeString) {
+  std::vector<ThreadedInstruction> instructions;
+  for (const auto& instruction : BCodeBuilder::fromString(codeString)) {
+    instructions.push_back(instruction->getThreadedInstruction());
+  }
+  BBinaryCode::verify(instructions.data(), instructions.size());
+}
+
+TEST(BBinaryCode, WriteAndMap) {
+  // Write a small program in binary format
+  auto filename = testing::TempDir() + "write_and_map.bin";
+  auto code = BCodeBuilder::fromString("PUSH STACK_INT -7\n"
+                                       "MK_CLOSURE L0 0\n"
+                                       "APPLY\n"
+                                       "HALT\n"
+                                       "FUNCTION L0\n"
+                                       "LOOKUP STACK_LOCATION -2\n"
+                                       "TEST L1\n"
+                                       "PUSH STACK_BOOL true\n"
+                                       "POP\n"
+                                       "LABEL L1\n"
+                                       "PUSH STACK_UNIT\n"
+                                       "RETURN\n");
+  ASSERT_NO_THROW(BBinaryCode::write(code, filename));
+  ASSERT_TRUE(BBinaryCode::isBinary(filename));
+
+  // Map the file and test the records
+  BBinaryCode binaryCode(filename);
+  ASSERT_EQ(binaryCode.size(), code.size());
+  for (size_t cp = 0; cp < code.size(); cp++) {
+    auto expected = code.getInstruction(cp)->getThreadedInstruction();
+    EXPECT_EQ(binaryCode.data()[cp].opcode, expected.opcode);
+    EXPECT_EQ(binaryCode.data()[cp].arg0, expected.arg0);
+    EXPECT_EQ(binaryCode.data()[cp].arg1, expected.arg1);
+  }
+  EXPECT_EQ(binaryCode.data()[0].arg0, -7);
+  EXPECT_EQ(binaryCode.data()[1].arg0, 4);
+  EXPECT_EQ(binaryCode.data()[6].arg0, 9);
+
+  // Rebuild the instructions from the records
+  auto rebuilt = BCodeBuilder::fromBinary(binaryCode);
+  ASSERT_EQ(rebuilt.size(), code.size());
+  for (size_t cp = 0; cp < code.size(); cp++) {
+    EXPECT_EQ(rebuilt.getInstruction(cp)->getThreadedInstruction().opcode,
+              code.getInstruction(cp)->getThreadedInstruction().opcode);
+  }
+}
+
+TEST(BBinaryCode, TextIsNotBinary) {
+  // Write a program in text format
+  auto filename = testing::TempDir() + "text_is_not_binary.out";
+  std::ofstream(filename) << "PUSH STACK_UNIT\nHALT\n";
+
+  // Test the file is not recognised, and cannot be mapped
+  EXPECT_FALSE(BBinaryCode::isBinary(filename));
+  EXPECT_THROW(BBinaryCode binaryCode(filename), InvalidBytecode);
+}
+
+TEST(BBinaryCode, Truncated) {
+  // Write a program and remove its last byte
+  auto filename = testing::TempDir() + "truncated.bin";
+  BBinaryCode::write(BCodeBuilder::fromString("PUSH STACK_UNIT\nHALT\n"),
+                     filename);
+  std::string contents;
+  {
+    std::ifstream fileStream(filename, std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(fileStream),
+                    std::istreambuf_iterator<char>());
+  }
+  contents.pop_back();
+  std::ofstream(filename, std::ios::binary) << contents;
+
+  // Test the file is rejected
+  EXPECT_TRUE(BBinaryCode::isBinary(filename));
+  EXPECT_THROW(BBinaryCode binaryCode(filename), InvalidBytecode);
+}
+
+TEST(BBinaryCode, VerifyValid) {
+  // Verify a program with functions and branches
+  EXPECT_NO_THROW(verifyString("PUSH STACK_INT 1\n"
+                               "MK_CLOSURE L0 1\n"
+                               "PUSH STACK_BOOL true\n"
+                               "TEST L1\n"
+                               "LOOKUP STACK_LOCATION 2\n"
+                               "POP\n"
+                               "LABEL L1\n"
+                               "HALT\n"
+                               "FUNCTION L0\n"
+                               "LOOKUP HEAP_LOCATION 0\n"
+                               "LOOKUP STACK_LOCATION -2\n"
+                               "SWAP\n"
+                               "POP\n"
+                               "RETURN\n"));
+}
+
+TEST(BBinaryCode, VerifyJumpTargets) {
+  // Jumps must go to labels, and closures to functions
+  EXPECT_THROW(verifyString("GOTO L0\n"
+                            "FUNCTION L0\n"
+                            "PUSH STACK_UNIT\n"
+                            "RETURN\n"),
+               InvalidBytecode);
+  EXPECT_THROW(verifyString("MK_CLOSURE L0 0\n"
+                            "HALT\n"
+                            "LABEL L0\n"
+                            "HALT\n"),
+               InvalidBytecode);
+}
+
+TEST(BBinaryCode, VerifyStackEffects) {
+  // Empty code and code running past its end
+  EXPECT_THROW(verifyString(""), InvalidBytecode);
+  EXPECT_THROW(verifyString("PUSH STACK_UNIT\n"), InvalidBytecode);
+
+  // Stack underflow
+  EXPECT_THROW(verifyString("POP\nHALT\n"), InvalidBytecode);
+  EXPECT_THROW(verifyString("PUSH STACK_INT 1\nOPER ADD\nHALT\n"),
+               InvalidBytecode);
+
+  // Different stack depths when reaching a label
+  EXPECT_THROW(verifyString("PUSH STACK_BOOL true\n"
+                            "TEST L0\n"
+                            "PUSH STACK_INT 1\n"
+                            "LABEL L0\n"
+                            "HALT\n"),
+               InvalidBytecode);
+
+  // Stack lookup outside of the current frame
+  EXPECT_THROW(verifyString("LOOKUP STACK_LOCATION 2\nHALT\n"),
+               InvalidBytecode);
+}
@@ -0,0 +1,94 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "../../src/b_dlang/b_code_builder.h"
+#include "../../src/memory_managers/no_allocation.h"
+#include "../../src/u_dlang/u_instruction.h"
+
+std::shared_ptr<VirtualMachine> interpretCode(const Code<BInstruction>& code) {
+  // Create the Virtual Machine as done by DlangVM
+  auto memoryManager = std::make_shared<NoAllocation>();
+  auto vm = std::make_shared<VirtualMachine>();
+  vm->stack.setMemoryManager(memoryManager);
+  vm->heap.setMemoryManager(memoryManager);
+  vm->stack.set(0, {Tag::FramePointer, 0});
+  vm->stack.set(1, {Tag::ReturnAddress, 0});
+  vm->sp = 2;
+
+  // Run the program
+  while (vm->status == VirtualMachine::Running) {
+    code.getInstruction(vm->cp)->interpret(vm);
+  }
+  return vm;
+}
+
+TEST(BCodeBuilder, Superinstructions) {
+  // Loop counting down from 3
+  auto code = BCodeBuilder::fromString("PUSH STACK_INT 3\n"
+                                       "LABEL L0\n"
+                                       "LOOKUP STACK_LOCATION 2\n"
+                                       "PUSH STACK_INT 0\n"
+                                       "OPER EQ\n"
+                                       "TEST L1\n"
+                                       "HALT\n"
+                                       "LABEL L1\n"
+                                       "LOOKUP STACK_LOCATION 2\n"
+                                       "PUSH STACK_INT 1\n"
+                                       "OPER SUB\n"
+                                       "SWAP\n"
+                                       "POP\n"
+                                       "GOTO L0\n");
+  auto fusedCode = BCodeBuilder::fuseSuperinstructions(code);
+
+  // Test the instructions are fused at their first cp, keeping all cps
+  ASSERT_EQ(fusedCode.size(), code.size());
+  std::pair<size_t, size_t> lengths[] = {{2, 3}, {8, 2}};
+  for (auto [cp, length] : lengths) {
+    auto fused = kindCast<BSuperinstruction>(fusedCode.getInstruction(cp));
+    ASSERT_TRUE(fused);
+    EXPECT_EQ(fused->getLength(), length);
+    EXPECT_EQ(fused->getInstructions().front(), code.getInstruction(cp));
+    EXPECT_EQ(fused->getInstructions().back(),
+              code.getInstruction(cp + length - 1));
+  }
+  EXPECT_EQ(fusedCode.getInstruction(3), code.getInstruction(3));
+  EXPECT_EQ(fusedCode.getInstruction(10)->getLength(), 1);
+
+  // Test the flat form has the fused opcode and the arguments
+  auto flat = fusedCode.getInstruction(2)->getThreadedInstruction();
+  EXPECT_EQ(flat.opcode, ThreadedInstruction::LookupStackPushIntEq);
+  EXPECT_EQ(flat.arg0, 2);
+  EXPECT_EQ(flat.arg1, 0);
+
+  // Test the u-code includes the labels of all the fused instructions
+  size_t labels = 0;
+  auto vm = std::make_shared<VirtualMachine>();
+  for (const auto& instruction : fusedCode.getInstruction(2)
+                                     ->getUInstructions(vm)) {
+    labels += kindCast<ULabel>(instruction) != nullptr;
+  }
+  EXPECT_EQ(labels, 3);
+
+  // Test the fused code runs like the original one
+  auto expected = interpretCode(code);
+  auto actual = interpretCode(fusedCode);
+  EXPECT_EQ(actual->status, expected->status);
+  EXPECT_EQ(actual->sp, expected->sp);
+  EXPECT_EQ(actual->stack.get(2).value, expected->stack.get(2).value);
+}
+
+TEST(BCodeBuilder, SuperinstructionsErrors) {
+  // Addition of a boolean, fused after the first instruction
+  auto code = BCodeBuilder::fromString("PUSH STACK_BOOL 1\n"
+                                       "PUSH STACK_INT 1\n"
+                                       "OPER ADD\n"
+                                       "HALT\n");
+  auto fusedCode = BCodeBuilder::fuseSuperinstructions(code);
+  ASSERT_EQ(fusedCode.getInstruction(1)->getLength(), 2);
+
+  // Test the generic form of the addition reports the error
+  EXPECT_THROW(interpretCode(fusedCode), RuntimeError);
+}
@@ -0,0 +1,104 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "../../src/b_dlang/b_code_builder.h"
+#include "../../src/b_dlang/b_quickened.h"
+#include "../../src/memory_managers/no_allocation.h"
+
+std::shared_ptr<VirtualMachine> makeQuickenedVM() {
+  // Create the Virtual Machine as done by DlangVM
+  auto memoryManager = std::make_shared<NoAllocation>();
+  auto vm = std::make_shared<VirtualMachine>();
+  vm->stack.setMemoryManager(memoryManager);
+  vm->heap.setMemoryManager(memoryManager);
+  vm->stack.set(0, {Tag::FramePointer, 0});
+  vm->stack.set(1, {Tag::ReturnAddress, 0});
+  vm->sp = 2;
+  return vm;
+}
+
+TEST(BQuickened, Oper) {
+  auto code = BCodeBuilder::fromString("OPER ADD\n");
+  auto vm = makeQuickenedVM();
+  vm->stack.set(2, {Tag::Int, 3});
+  vm->stack.set(3, {Tag::Int, 4});
+  vm->sp = 4;
+
+  // Test the quickened form keeps the kind of the generic one
+  auto quickened = code.getInstruction(0)->quicken();
+  ASSERT_TRUE(quickened);
+  EXPECT_TRUE(kindCast<BOper>(quickened));
+  EXPECT_EQ(quickened->getCp(), 0);
+
+  // Test the specialized handler on integers
+  quickened->interpret(vm);
+  EXPECT_EQ(vm->stack.get(2).tag, Tag::Int);
+  EXPECT_EQ(vm->stack.get(2).value, 7);
+  EXPECT_EQ(vm->sp, 3);
+  EXPECT_EQ(vm->cp, 1);
+
+  // Test the generic form reports the error when the guard fails
+  vm->stack.set(3, {Tag::Bool, true});
+  vm->sp = 4;
+  vm->cp = 0;
+  EXPECT_THROW(quickened->interpret(vm), RuntimeError);
+}
+
+TEST(BQuickened, Eq) {
+  auto quickened = BCodeBuilder::fromString("OPER EQ\n").getInstruction(0)
+      ->quicken();
+  auto vm = makeQuickenedVM();
+
+  // Test equality on equal integers, units and items with different tags
+  Item items[][2] = {{{Tag::Int, 5}, {Tag::Int, 5}},
+                     {{Tag::Unit, 1}, {Tag::Unit, 2}},
+                     {{Tag::Int, 1}, {Tag::Bool, 1}}};
+  bool results[] = {true, true, false};
+  for (int i = 0; i < 3; i++) {
+    vm->stack.set(2, items[i][0]);
+    vm->stack.set(3, items[i][1]);
+    vm->sp = 4;
+    quickened->interpret(vm);
+    EXPECT_EQ(vm->stack.get(2).tag, Tag::Bool);
+    EXPECT_EQ(vm->stack.get(2).value, results[i]);
+  }
+}
+
+TEST(BQuickened, PushLookupAndTest) {
+  auto code = BCodeBuilder::fromString("PUSH STACK_INT 5\n"
+                                       "LOOKUP STACK_LOCATION 2\n"
+                                       "PUSH STACK_BOOL 0\n"
+                                       "TEST label\n"
+                                       "LABEL label\n");
+  auto vm = makeQuickenedVM();
+
+  // Test the quickened forms move to the label
+  while (vm->cp < 4) {
+    auto quickened = code.getInstruction(vm->cp)->quicken();
+    ASSERT_TRUE(quickened);
+    quickened->interpret(vm);
+  }
+  EXPECT_EQ(vm->cp, 4);
+  EXPECT_EQ(vm->sp, 4);
+  for (size_t idx = 2; idx < 4; idx++) {
+    EXPECT_EQ(vm->stack.get(idx).tag, Tag::Int);
+    EXPECT_EQ(vm->stack.get(idx).value, 5);
+  }
+
+  // Test instructions without a specialized form
+  EXPECT_FALSE(code.getInstruction(4)->quicken());
+}
+
+TEST(BQuickened, Memory) {
+  auto code = BCodeBuilder::fromString("PUSH STACK_INT 1\n");
+  auto vm = makeQuickenedVM();
+
+  // Test the generic form reports the error when the stack is full (the
+  // memory manager does not allocate more)
+  vm->sp = vm->stack.size();
+  EXPECT_THROW(code.getInstruction(0)->quicken()->interpret(vm), RuntimeError);
+  EXPECT_EQ(vm->sp, vm->stack.size());
+}
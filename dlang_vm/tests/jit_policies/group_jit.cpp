@@ -0,0 +1,47 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include <gtest/gtest.h>
+
+#include "../../src/b_dlang/b_code_builder.h"
+#include "../../src/jit_policies/group_jit.h"
+
+const char* kCallCode = "HALT\n"
+                        "FUNCTION L0\n"
+                        "LOOKUP STACK_LOCATION -2\n"
+                        "APPLY\n"
+                        "RETURN\n"
+                        "FUNCTION L1\n"
+                        "LOOKUP STACK_LOCATION -2\n"
+                        "RETURN\n";
+
+TEST(GroupJIT, InlineMonomorphic) {
+  // The call at cp 3 always applies the function at cp 5
+  auto code = BCodeBuilder::fromString(kCallCode);
+  GroupJIT<Function> jitPolicy(0, 32);
+  jitPolicy.notifyCall(3, 5);
+  jitPolicy.notifyCall(3, 5);
+  auto jitSequence = jitPolicy.makeJITSequence(code, 1);
+
+  // Test the callee is inlined after the call
+  JITSequence::Inlined inlined = {{3, {5, 6, 7}}};
+  JITSequence::Cps compiledCps = {1, 2, 3, 4, 5, 6, 7};
+  EXPECT_EQ(jitSequence.getInlined(), inlined);
+  EXPECT_EQ(jitSequence.getCompiledCps(), compiledCps);
+}
+
+TEST(GroupJIT, InlinePolymorphic) {
+  // The call at cp 3 applies two different functions
+  auto code = BCodeBuilder::fromString(kCallCode);
+  GroupJIT<Function> jitPolicy(0, 32);
+  jitPolicy.notifyCall(3, 5);
+  jitPolicy.notifyCall(3, 1);
+  EXPECT_TRUE(jitPolicy.makeJITSequence(code, 1).getInlined().empty());
+}
+
+TEST(GroupJIT, InlineBudget) {
+  // The callee is larger than the budget
+  auto code = BCodeBuilder::fromString(kCallCode);
+  GroupJIT<Function> jitPolicy(0, 2);
+  jitPolicy.notifyCall(3, 5);
+  EXPECT_TRUE(jitPolicy.makeJITSequence(code, 1).getInlined().empty());
+}
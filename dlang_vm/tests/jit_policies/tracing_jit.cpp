@@ -0,0 +1,58 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "../../src/b_dlang/b_code_builder.h"
+#include "../../src/jit_policies/tracing_jit.h"
+
+// Notifies the landings at cps like the vm loop, compiling every sequence
+// (compiled sequences run until the next landing)
+std::vector<JITSequence::Cps> land(TracingJIT* jitPolicy,
+                                   const Code<BInstruction>& code,
+                                   std::vector<bool>* compiled,
+                                   const std::vector<size_t>& cps) {
+  std::vector<JITSequence::Cps> sequences;
+  for (auto cp : cps) {
+    jitPolicy->notifyLanding(cp);
+    if (!(*compiled)[cp] || jitPolicy->isRecording()) {
+      auto jitSequence = jitPolicy->makeJITSequence(code, cp);
+      if (!jitSequence.isEmpty()) {
+        sequences.push_back(jitSequence.getCps());
+        (*compiled)[jitSequence.getCps().front()] = true;
+      }
+    }
+    if ((*compiled)[cp]) {
+      jitPolicy->notifyRunJIT(cp);
+    }
+  }
+  return sequences;
+}
+
+TEST(TracingJIT, BranchTrace) {
+  // Loop from 1 to 5, where the branch at 2 can skip 3
+  auto code = BCodeBuilder::fromString("PUSH STACK_INT 0\n"
+                                       "LABEL L0\n"
+                                       "TEST L1\n"
+                                       "PUSH STACK_INT 0\n"
+                                       "LABEL L1\n"
+                                       "GOTO L0\n"
+                                       "HALT\n");
+  TracingJIT jitPolicy(2);
+  std::vector<bool> compiled(code.size());
+
+  // Test the loop is traced once it is hot
+  EXPECT_TRUE(land(&jitPolicy, code, &compiled, {0, 1, 2, 3, 4, 5}).empty());
+  auto sequences = land(&jitPolicy, code, &compiled,
+                        {1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1});
+  ASSERT_EQ(sequences.size(), 1);
+  EXPECT_EQ(sequences[0], JITSequence::Cps({1, 2, 3, 4, 5}));
+
+  // Test the hot exit from the trace at 4 is traced until the loop header
+  EXPECT_TRUE(land(&jitPolicy, code, &compiled, {4, 5, 1, 4}).empty());
+  sequences = land(&jitPolicy, code, &compiled, {5, 1});
+  ASSERT_EQ(sequences.size(), 1);
+  EXPECT_EQ(sequences[0], JITSequence::Cps({4, 5}));
+  EXPECT_FALSE(jitPolicy.isRecording());
+}
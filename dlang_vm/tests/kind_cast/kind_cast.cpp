@@ -0,0 +1,54 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "../../src/data_structures/kind_cast.h"
+#include "../../src/t_dlang/t_instruction.h"
+#include "../../src/u_dlang/u_argument.h"
+
+TEST(KindCast, Arguments) {
+  // Create arguments of different kinds
+  UArgument::Ptr imm = VMUArg::uImm(1);
+  UArgument::Ptr reg = VMUArg::r0;
+  UArgument::Ptr slot = VMUArg::SP(0, VMUArg::Val);
+  UArgument::Ptr heap = VMUArg::Heap(VMUArg::r1, 0, VMUArg::Tag);
+
+  // Test casts to the concrete classes
+  EXPECT_TRUE(kindCast<UImmInt>(imm));
+  EXPECT_FALSE(kindCast<UImmTag>(imm));
+  EXPECT_TRUE(kindCast<URegGP>(reg));
+  EXPECT_FALSE(kindCast<URegSP>(reg));
+  EXPECT_TRUE(kindCast<ULocSP>(slot));
+  EXPECT_FALSE(kindCast<ULocFP>(slot));
+  EXPECT_EQ(kindCast<ULocHeap>(heap)->getPtr(), VMUArg::r1);
+
+  // Test casts to the abstract classes
+  EXPECT_TRUE(kindCast<UOperand>(imm));
+  EXPECT_TRUE(kindCast<UOperand>(reg));
+  EXPECT_FALSE(kindCast<UOperand>(slot));
+  EXPECT_TRUE(kindCast<ULocStack>(slot));
+  EXPECT_FALSE(kindCast<ULocStack>(heap));
+  EXPECT_TRUE(kindCast<ULocation>(heap));
+  EXPECT_FALSE(kindCast<URegister>(UArgument::Ptr()));
+}
+
+TEST(KindCast, Instructions) {
+  // Create a move and a goto
+  auto a = std::make_shared<TVariable>(VMUArg::r0);
+  auto b = std::make_shared<TImmediate>(VMUArg::uImm(1));
+  std::shared_ptr<TInstruction> move =
+      std::make_shared<TMove>(nullptr, false, a, b, nullptr);
+  std::shared_ptr<TInstruction> jump =
+      std::make_shared<TGoto>(nullptr, false, 0);
+
+  // Test casts to the classes of instructions and arguments
+  EXPECT_EQ(kindCast<TMove>(move)->b, b);
+  EXPECT_TRUE(kindCast<TInstructionWrite>(move));
+  EXPECT_FALSE(kindCast<TInstructionBranch>(move));
+  EXPECT_TRUE(kindCast<TInstructionBranch>(jump));
+  EXPECT_FALSE(kindCast<TBranch>(jump));
+  EXPECT_TRUE(kindCast<TVariable>(kindCast<TMove>(move)->a));
+  EXPECT_FALSE(kindCast<TVariable>(kindCast<TMove>(move)->b));
+}
@@ -0,0 +1,81 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "../../src/memory_managers/generational_gc.h"
+#include "../../src/virtual_machine/virtual_machine.h"
+
+std::shared_ptr<VirtualMachine> makeVM(std::shared_ptr<MemoryManager> gc) {
+  // Create a Virtual Machine with a pair and a reference in the heap
+  auto vm = std::make_shared<VirtualMachine>();
+  vm->stack.setMemoryManager(gc);
+  vm->heap.setMemoryManager(gc);
+  vm->stack.set(0, {FramePointer, 0});
+  vm->stack.set(1, {ReturnAddress, 0});
+  vm->stack.set(2, {HeapIndex, 3});
+  vm->sp = 3;
+  vm->heap.set(0, {PairHeader, 3});
+  vm->heap.set(1, {Int, 1});
+  vm->heap.set(2, {Int, 2});
+  vm->heap.set(3, {PairHeader, 3});
+  vm->heap.set(4, {Int, 7});
+  vm->heap.set(5, {HeapRef, 6});
+  vm->heap.set(6, {Int, 8});
+  vm->hp = 7;
+  return vm;
+}
+
+TEST(GenerationalGC, MinorCollection) {
+  // Collect a nursery with one live pair
+  auto gc = std::make_shared<GenerationalGC>(4, 100);
+  auto vm = makeVM(gc);
+  gc->collectGarbage(vm);
+
+  // Test the pair and its reference were copied to the old space
+  ASSERT_EQ(vm->hp, 4);
+  EXPECT_EQ(vm->stack.get(2).value, 0);
+  EXPECT_EQ(vm->heap.get(0).tag, PairHeader);
+  EXPECT_EQ(vm->heap.get(1).value, 7);
+  EXPECT_EQ(vm->heap.get(2).tag, HeapRef);
+  EXPECT_EQ(vm->heap.get(2).value, 3);
+  EXPECT_EQ(vm->heap.get(3).value, 8);
+  EXPECT_EQ(*vm->heap.getWriteBarrierPtr(), 4);
+}
+
+TEST(GenerationalGC, RememberedSet) {
+  // Promote the pair, then allocate a new pair only reachable from it
+  auto gc = std::make_shared<GenerationalGC>(4, 100);
+  auto vm = makeVM(gc);
+  gc->collectGarbage(vm);
+  vm->heap.set(4, {Int, 0});
+  vm->heap.set(5, {PairHeader, 3});
+  vm->heap.set(6, {Int, 9});
+  vm->heap.set(7, {Int, 10});
+  vm->heap.set(3, {HeapIndex, 5});
+  vm->hp = 8;
+  gc->collectGarbage(vm);
+
+  // Test the new pair survived, and the old item points to its copy
+  ASSERT_EQ(vm->hp, 7);
+  EXPECT_EQ(vm->heap.get(3).tag, HeapIndex);
+  EXPECT_EQ(vm->heap.get(3).value, 4);
+  EXPECT_EQ(vm->heap.get(4).tag, PairHeader);
+  EXPECT_EQ(vm->heap.get(5).value, 9);
+  EXPECT_EQ(vm->heap.get(6).value, 10);
+}
+
+TEST(GenerationalGC, MajorCollection) {
+  // Fill the old space, then drop the only root
+  auto gc = std::make_shared<GenerationalGC>(4, 4);
+  auto vm = makeVM(gc);
+  gc->collectGarbage(vm);
+  vm->sp = 2;
+  vm->hp = 8;
+  gc->collectGarbage(vm);
+
+  // Test the whole heap was collected
+  EXPECT_EQ(vm->hp, 0);
+  EXPECT_EQ(*vm->heap.getWriteBarrierPtr(), 0);
+}
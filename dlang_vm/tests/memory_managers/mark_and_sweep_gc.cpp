@@ -0,0 +1,71 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "../../src/memory_managers/mark_and_sweep_gc.h"
+#include "../../src/virtual_machine/virtual_machine.h"
+
+TEST(MarkAndSweepGC, LongList) {
+  // Create a long list, with a garbage pair after each of its pairs
+  const size_t length = 100'000;
+  auto gc = std::make_shared<MarkAndSweepGC>(6 * length);
+  auto vm = std::make_shared<VirtualMachine>();
+  vm->stack.setMemoryManager(gc);
+  vm->heap.setMemoryManager(gc);
+  vm->stack.set(0, {HeapIndex, 0});
+  vm->sp = 1;
+  for (size_t i = 0; i < length; i++) {
+    vm->heap.set(6 * i, {PairHeader, 3});
+    vm->heap.set(6 * i + 1, {Int, i});
+    vm->heap.set(6 * i + 2, {HeapIndex, 6 * i + 6});
+    vm->heap.set(6 * i + 3, {PairHeader, 3});
+    vm->heap.set(6 * i + 4, {Int, 0});
+    vm->heap.set(6 * i + 5, {Int, 0});
+  }
+  vm->heap.set(6 * length - 4, {Unit, 0});
+  vm->hp = 6 * length;
+  gc->collectGarbage(vm);
+
+  // Test the list was compacted and keeps its order
+  ASSERT_EQ(vm->hp, 3 * length);
+  ASSERT_EQ(vm->stack.get(0).value, 0);
+  for (size_t i = 0; i < length; i++) {
+    ASSERT_EQ(vm->heap.get(3 * i).tag, PairHeader);
+    ASSERT_EQ(vm->heap.get(3 * i + 1).value, i);
+    if (i + 1 < length) {
+      ASSERT_EQ(vm->heap.get(3 * i + 2).value, 3 * i + 3);
+    }
+  }
+}
+
+TEST(MarkAndSweepGC, References) {
+  // Create a reference to a pair, and a pair with a reference to itself
+  auto gc = std::make_shared<MarkAndSweepGC>(10);
+  auto vm = std::make_shared<VirtualMachine>();
+  vm->stack.setMemoryManager(gc);
+  vm->heap.setMemoryManager(gc);
+  vm->heap.set(0, {Int, 1});
+  vm->heap.set(1, {PairHeader, 3});
+  vm->heap.set(2, {Int, 2});
+  vm->heap.set(3, {Int, 3});
+  vm->heap.set(4, {HeapIndex, 1});
+  vm->heap.set(5, {PairHeader, 3});
+  vm->heap.set(6, {HeapRef, 7});
+  vm->heap.set(7, {HeapIndex, 5});
+  vm->heap.set(8, {Int, 4});
+  vm->stack.set(0, {HeapRef, 4});
+  vm->stack.set(1, {HeapIndex, 5});
+  vm->sp = 2;
+  vm->hp = 9;
+  gc->collectGarbage(vm);
+
+  // Test only the first item was collected
+  ASSERT_EQ(vm->hp, 7);
+  EXPECT_EQ(vm->stack.get(0).value, 3);
+  EXPECT_EQ(vm->stack.get(1).value, 4);
+  EXPECT_EQ(vm->heap.get(3).value, 0);
+  EXPECT_EQ(vm->heap.get(5).value, 6);
+  EXPECT_EQ(vm->heap.get(6).value, 4);
+}
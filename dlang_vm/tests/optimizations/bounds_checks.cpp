@@ -0,0 +1,129 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+
+#include "optimizations_test.h"
+#include "../../src/optimizations/bounds_checks.h"
+
+// Number of bounds checks of locations of type T
+template<typename T>
+size_t countMemChecks(const Code<UInstruction>& uCode) {
+  size_t count = 0;
+  for (const auto& instruction : uCode) {
+    if (auto check = kindCast<UMemCheck>(instruction)) {
+      count += kindCast<T>(check->a) != nullptr;
+    }
+  }
+  return count;
+}
+
+TEST(BoundsCheckElimination, FrameChecks) {
+  // Function adding 1 to the first item of a pair made from its argument
+  std::string code = "FUNCTION F0\n"
+                     "LOOKUP STACK_LOCATION -2\n"
+                     "PUSH STACK_INT 1\n"
+                     "MK_PAIR\n"
+                     "FST\n"
+                     "PUSH STACK_INT 1\n"
+                     "OPER ADD\n"
+                     "RETURN\n";
+  auto uCode = makeUCode(code);
+  auto uCodeEliminated = optimizeFunction(
+      uCode, {std::make_shared<BoundsCheckElimination>()});
+
+  // Test the frame is checked once, for its lowest and highest items, at the
+  // start of the function
+  EXPECT_GT(countMemChecks<ULocStack>(uCode), 2);
+  EXPECT_EQ(countMemChecks<ULocStack>(uCodeEliminated), 2);
+  size_t labels = 0;
+  for (size_t i = 0; i < uCodeEliminated.size() && labels < 2; i++) {
+    auto instruction = uCodeEliminated.getInstruction(i);
+    labels += kindCast<ULabel>(instruction) != nullptr;
+    if (labels == 2) {
+      auto check = kindCast<UMemCheck>(
+          uCodeEliminated.getInstruction(i + 1));
+      ASSERT_TRUE(check);
+      EXPECT_TRUE(kindCast<ULocFP>(check->a));
+    }
+  }
+
+  // Test the pair is checked for its last cell when allocated, and for its
+  // first and last cells when read
+  EXPECT_EQ(countMemChecks<ULocHeap>(uCodeEliminated), 3);
+  EXPECT_LT(countMemChecks<ULocHeap>(uCodeEliminated),
+            countMemChecks<ULocHeap>(uCode));
+
+  // Test the function returns the same result
+  UCodeState state;
+  state.push(Int, 5);
+  state.call();
+  auto result = runUCode(uCodeEliminated, state);
+  EXPECT_EQ(result, runUCode(uCode, state));
+  EXPECT_FALSE(result.isError);
+  EXPECT_EQ(result.stack.at({2, VirtualMachine::Val}), 6);
+}
+
+TEST(BoundsCheckElimination, TraceChecks) {
+  // Trace pushing two items and adding them
+  std::string code = "PUSH STACK_INT 1\n"
+                     "PUSH STACK_INT 2\n"
+                     "OPER ADD\n"
+                     "POP\n";
+  auto uCode = makeUCode(code);
+  auto uCodeEliminated = optimizeTrace(
+      uCode, {std::make_shared<BoundsCheckElimination>()});
+
+  // Test the stack is checked for its lowest and highest items only
+  EXPECT_GT(countMemChecks<ULocSP>(uCode), 2);
+  EXPECT_EQ(countMemChecks<ULocSP>(uCodeEliminated), 2);
+  auto isChecked = [&](int offset) {
+    for (const auto& instruction : uCodeEliminated) {
+      if (auto check = kindCast<UMemCheck>(instruction)) {
+        if (check->a->getOffset() == offset) { return true; }
+      }
+    }
+    return false;
+  };
+  EXPECT_TRUE(isChecked(0));
+  EXPECT_TRUE(isChecked(1));
+
+  // Test the trace leaves the same stack
+  EXPECT_EQ(runUCode(uCodeEliminated), runUCode(uCode));
+  EXPECT_EQ(runUCode(uCodeEliminated).sp, 2);
+}
+
+TEST(BoundsCheckElimination, TraceEntryChecks) {
+  // Trace making two pairs
+  std::string code = "PUSH STACK_INT 1\n"
+                     "PUSH STACK_INT 2\n"
+                     "MK_PAIR\n"
+                     "PUSH STACK_INT 3\n"
+                     "PUSH STACK_INT 4\n"
+                     "MK_PAIR\n";
+  auto uCode = makeUCode(code);
+  auto uCodeEliminated = optimizeTrace(
+      uCode, {std::make_shared<BoundsCheckElimination>()});
+
+  // Test the stack and the heap grown by the trace are checked once, for
+  // their lowest and highest items, at the start of the trace (the heap
+  // check covers the second pair)
+  EXPECT_GT(countMemChecks<ULocSP>(uCode), 2);
+  EXPECT_EQ(countMemChecks<ULocSP>(uCodeEliminated), 2);
+  EXPECT_EQ(countMemChecks<ULocHeap>(uCodeEliminated), 2);
+  ASSERT_TRUE(kindCast<ULabel>(uCodeEliminated.getInstruction(0)));
+  for (size_t i = 1; i < uCodeEliminated.size(); i++) {
+    auto instruction = uCodeEliminated.getInstruction(i);
+    EXPECT_EQ(kindCast<UMemCheck>(instruction) != nullptr, i <= 4);
+  }
+  auto heapCheck = kindCast<UMemCheck>(uCodeEliminated.getInstruction(4));
+  ASSERT_TRUE(heapCheck);
+  EXPECT_TRUE(kindCast<ULocHeap>(heapCheck->a));
+  EXPECT_EQ(heapCheck->a->getOffset(), 5);
+
+  // Test the trace leaves the same stack and heap
+  EXPECT_EQ(runUCode(uCodeEliminated), runUCode(uCode));
+  EXPECT_EQ(runUCode(uCodeEliminated).hp, 6);
+}
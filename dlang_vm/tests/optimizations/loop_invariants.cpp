@@ -0,0 +1,120 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+
+#include "optimizations_test.h"
+#include "../../src/optimizations/loop_invariants.h"
+
+// Number of instructions of type T after the label of the loop at cp
+template<typename T>
+size_t countInLoop(const Code<UInstruction>& uCode, size_t cp) {
+  size_t count = 0;
+  bool isInLoop = false;
+  for (const auto& instruction : uCode) {
+    if (kindCast<ULabel>(instruction) &&
+        instruction->cp == cp) {
+      isInLoop = true;
+    }
+    count += isInLoop && kindCast<T>(instruction);
+  }
+  return count;
+}
+
+TEST(LoopInvariantCodeMotion, InvariantChecks) {
+  // Loop adding 1 to the argument forever
+  std::string code = "FUNCTION F0\n"
+                     "LABEL L0\n"
+                     "LOOKUP STACK_LOCATION -2\n"
+                     "PUSH STACK_INT 1\n"
+                     "OPER ADD\n"
+                     "POP\n"
+                     "GOTO L0\n";
+  auto uCode = makeUCode(code);
+  auto uCodeHoisted = optimizeFunction(
+      uCode, {std::make_shared<LoopInvariantCodeMotion>()});
+
+  // Test the bounds of the stack are checked once, before the loop
+  EXPECT_GT(countInLoop<UMemCheck>(uCode, 1), 0);
+  EXPECT_EQ(countInLoop<UMemCheck>(uCodeHoisted, 1), 0);
+  EXPECT_EQ(uCodeHoisted.size(), uCode.size());
+
+  // Test the tag of the argument is checked before the loop, on the argument
+  // itself rather than on its copy
+  EXPECT_LT(countInLoop<UTagCheck>(uCodeHoisted, 1),
+            countInLoop<UTagCheck>(uCode, 1));
+  bool isArgumentChecked = false;
+  for (const auto& instruction : uCodeHoisted) {
+    if (auto check = kindCast<UTagCheck>(instruction)) {
+      auto loc = kindCast<ULocFP>(check->a);
+      isArgumentChecked |= loc && loc->getOffset() == -2;
+    }
+  }
+  EXPECT_TRUE(isArgumentChecked);
+}
+
+TEST(LoopInvariantCodeMotion, VariantChecks) {
+  // Function counting up forever, the counter changes at each iteration
+  std::string code = "FUNCTION F0\n"
+                     "PUSH STACK_INT 0\n"
+                     "LABEL L0\n"
+                     "LOOKUP STACK_LOCATION 2\n"
+                     "PUSH STACK_INT 1\n"
+                     "OPER ADD\n"
+                     "SWAP\n"
+                     "POP\n"
+                     "GOTO L0\n";
+  auto uCode = makeUCode(code);
+  auto uCodeHoisted = optimizeFunction(
+      uCode, {std::make_shared<LoopInvariantCodeMotion>()});
+
+  // Test the tags of the counter are still checked at each iteration
+  EXPECT_GT(countInLoop<UTagCheck>(uCodeHoisted, 2), 0);
+  EXPECT_EQ(countInLoop<UTagCheck>(uCodeHoisted, 2),
+            countInLoop<UTagCheck>(uCode, 2));
+}
+
+TEST(LoopInvariantCodeMotion, SameResult) {
+  auto uCode = makeUCode(kCountdownCode);
+  auto uCodeHoisted = optimizeFunction(
+      uCode, {std::make_shared<LoopInvariantCodeMotion>()});
+
+  // Test the checks of the argument are hoisted, and the function returns
+  // the same result
+  EXPECT_LT(countInLoop<UTagCheck>(uCodeHoisted, 2),
+            countInLoop<UTagCheck>(uCode, 2));
+  UCodeState state;
+  state.push(Int, 3);
+  state.call();
+  auto result = runUCode(uCodeHoisted, state);
+  EXPECT_EQ(result, runUCode(uCode, state));
+  EXPECT_EQ(result.stack.at({2, VirtualMachine::Val}), -2);
+
+  // Test the same checks fail with an argument of the wrong type
+  state = UCodeState();
+  state.push(Bool, 1);
+  state.call();
+  EXPECT_TRUE(runUCode(uCodeHoisted, state).isError);
+  EXPECT_TRUE(runUCode(uCode, state).isError);
+}
+
+TEST(LoopInvariantCodeMotion, HoistedCheckFails) {
+  // Function pushing a copy of the counter inside the loop before reading
+  // the argument, whose tag check is hoisted
+  auto uCode = makeUCode(kCountdownCode);
+  auto uCodeHoisted = optimizeFunction(
+      uCode, {std::make_shared<LoopInvariantCodeMotion>()});
+
+  // Test the hoisted check fails at the cp and sp of the original check
+  UCodeState state;
+  state.push(Bool, 1);
+  state.call();
+  auto result = runUCode(uCodeHoisted, state);
+  auto expected = runUCode(uCode, state);
+  EXPECT_TRUE(result.isError);
+  EXPECT_EQ(result.cp, expected.cp);
+  EXPECT_EQ(result.sp, expected.sp);
+  EXPECT_GT(expected.cp, 2);
+}
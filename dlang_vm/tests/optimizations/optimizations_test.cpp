@@ -0,0 +1,241 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include "optimizations_test.h"
+
+#include <gtest/gtest.h>
+
+#include <iterator>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../../src/b_dlang/b_code_builder.h"
+#include "../../src/optimizations/optimizations_sequence.h"
+
+const char* const kCountdownCode = "FUNCTION F0\n"
+                                   "PUSH STACK_INT 10\n"
+                                   "LABEL L0\n"
+                                   "LOOKUP STACK_LOCATION 2\n"
+                                   "LOOKUP STACK_LOCATION -2\n"
+                                   "OPER SUB\n"
+                                   "SWAP\n"
+                                   "POP\n"
+                                   "PUSH STACK_INT 0\n"
+                                   "LOOKUP STACK_LOCATION 2\n"
+                                   "OPER LT\n"
+                                   "TEST L1\n"
+                                   "GOTO L0\n"
+                                   "LABEL L1\n"
+                                   "RETURN\n";
+
+Code<UInstruction> makeUCode(const std::string& codeString) {
+  auto vm = std::make_shared<VirtualMachine>();
+  Code<UInstruction> uCode;
+  for (const auto& instruction : BCodeBuilder::fromString(codeString)) {
+    uCode += instruction->getUInstructions(vm);
+  }
+  return uCode;
+}
+
+Code<UInstruction> makeUCode(const Code<BInstruction>& code,
+                             const JITSequence::Cps& cps) {
+  auto vm = std::make_shared<VirtualMachine>();
+  Code<UInstruction> uCode;
+  for (auto cp : cps) {
+    uCode += code.getInstruction(cp)->getUInstructions(vm);
+  }
+  return uCode;
+}
+
+Code<UInstruction> optimizeFunction(
+    const Code<UInstruction>& uCode,
+    const std::vector<std::shared_ptr<Optimization>>& optimizations) {
+  OptimizationsSequence optimizationsSequence;
+  for (const auto& optimization : optimizations) {
+    optimizationsSequence.add(optimization);
+  }
+  return optimizationsSequence.optimizeFunction(uCode);
+}
+
+Code<UInstruction> optimizeTrace(
+    const Code<UInstruction>& uCode,
+    const std::vector<std::shared_ptr<Optimization>>& optimizations,
+    const Code<UInstruction>& guards) {
+  OptimizationsSequence optimizationsSequence;
+  for (const auto& optimization : optimizations) {
+    optimizationsSequence.add(optimization);
+  }
+  return optimizationsSequence.optimizeTrace(uCode, guards);
+}
+
+UCodeState::UCodeState()
+    : sp(0), fp(0), hp(0), cp(0), isError(false) {
+  push(FramePointer, 0);
+  push(ReturnAddress, 0);
+}
+
+void UCodeState::push(Tag tag, int value) {
+  stack[{sp, VirtualMachine::Tag}] = tag;
+  stack[{sp, VirtualMachine::Val}] = value;
+  sp++;
+}
+
+void UCodeState::allocate(Tag tag, int value) {
+  heap[{hp, VirtualMachine::Tag}] = tag;
+  heap[{hp, VirtualMachine::Val}] = value;
+  hp++;
+}
+
+void UCodeState::call(const std::vector<std::pair<Tag, int>>& captured) {
+  // Push the closure above the argument
+  auto closure = hp;
+  allocate(ClosureHeader, 2 + captured.size());
+  allocate(CodeIndex, 0);
+  for (const auto& [tag, value] : captured) {
+    allocate(tag, value);
+  }
+  push(HeapIndex, closure);
+
+  // Push the frame pointer and the return address, as done by apply
+  push(FramePointer, fp);
+  push(ReturnAddress, cp);
+  fp = sp - 2;
+}
+
+bool UCodeState::operator==(const UCodeState& other) const {
+  return stack == other.stack && heap == other.heap && sp == other.sp &&
+         fp == other.fp && hp == other.hp && cp == other.cp &&
+         isError == other.isError;
+}
+
+UCodeState runUCode(const Code<UInstruction>& uCode, UCodeState state) {
+  // Loops in the tests are short, so the code is left after a few steps
+  constexpr size_t kMaxSteps = 100000;
+
+  std::map<jit_reg_t, int> registers = {{JITVM::sp, state.sp},
+                                        {JITVM::fp, state.fp},
+                                        {JITVM::hp, state.hp}};
+  auto cells = [&](const ULocation::Ptr& loc) -> UCodeState::Cells& {
+    return kindCast<ULocHeap>(loc) ? state.heap : state.stack;
+  };
+  auto index = [&](const ULocation::Ptr& loc) {
+    return std::make_pair(registers[loc->getPtr()->getReg()] +
+                          loc->getOffset(), static_cast<int>(loc->getType()));
+  };
+  auto value = [&](const UArgument::Ptr& arg) {
+    if (auto imm = kindCast<UImmediate>(arg)) {
+      return imm->getValue();
+    }
+    if (auto reg = kindCast<URegister>(arg)) {
+      return registers[reg->getReg()];
+    }
+    auto loc = kindCast<ULocation>(arg);
+    return cells(loc)[index(loc)];
+  };
+
+  // Branches go to the label of the destination, or leave the code
+  std::map<size_t, size_t> labels;
+  for (size_t i = uCode.size(); i-- > 0;) {
+    if (kindCast<ULabel>(uCode.getInstruction(i))) {
+      labels[uCode.getInstruction(i)->cp] = i;
+    }
+  }
+  size_t end = uCode.size();
+  auto jump = [&](size_t destination) {
+    registers[JITVM::cp] = destination;
+    return labels.count(destination) ? labels.at(destination) : end;
+  };
+
+  // Checks moved before a loop fail as if they ran at their cp
+  auto fail = [&](std::optional<int> movedSp, size_t cp) {
+    if (movedSp) {
+      registers[JITVM::cp] = cp;
+      registers[JITVM::sp] += *movedSp;
+    }
+    state.isError = true;
+  };
+
+  registers[JITVM::cp] = uCode.size() ? uCode.getInstruction(0)->cp : 0;
+  size_t i = 0;
+  for (size_t steps = 0; i < end; steps++) {
+    if (steps == kMaxSteps) {
+      ADD_FAILURE() << "The u-code does not leave the loop";
+      break;
+    }
+    auto instruction = uCode.getInstruction(i);
+    i++;
+    if (auto get = kindCast<UGet>(instruction)) {
+      registers[get->a->getReg()] = value(get->b);
+    } else if (auto set = kindCast<USet>(instruction)) {
+      cells(set->a)[index(set->a)] = value(set->b);
+    } else if (auto move = kindCast<UMove>(instruction)) {
+      registers[move->a->getReg()] = value(move->b);
+    } else if (auto unary = kindCast<UUnary>(instruction)) {
+      auto b = value(unary->b);
+      EXPECT_NE(unary->op, Read);
+      registers[unary->a->getReg()] = unary->op == Not ? 1 - b : -b;
+    } else if (auto oper = kindCast<UOper>(instruction)) {
+      auto b = value(oper->b), c = value(oper->c);
+      if (oper->op == Div && !c) {
+        state.isError = true;
+        break;
+      }
+      registers[oper->a->getReg()] = oper->op == Add ? b + c
+                                   : oper->op == Sub ? b - c
+                                   : oper->op == Mul ? b * c
+                                   : oper->op == Div ? b / c
+                                   : oper->op == Lt  ? b < c
+                                   : oper->op == Eq  ? b == c
+                                   : oper->op == And ? b && c
+                                   : b || c;
+    } else if (auto memCheck = kindCast<UMemCheck>(instruction)) {
+      if (index(memCheck->a).first < 0) {
+        fail(memCheck->movedSp, memCheck->cp);
+        break;
+      }
+    } else if (auto tagCheck = kindCast<UTagCheck>(instruction)) {
+      auto loc = kindCast<ULocation>(tagCheck->a);
+      auto tag = loc ? value(loc->withType(VirtualMachine::Tag))
+                     : value(tagCheck->a);
+      if (tag != tagCheck->tagA && tag != tagCheck->tagB) {
+        // Failing type guards run the unspecialized code instead
+        if (!kindCast<UTypeGuard>(instruction)) {
+          fail(tagCheck->movedSp, tagCheck->cp);
+        }
+        break;
+      }
+    } else if (auto jumpTo = kindCast<UGoto>(instruction)) {
+      if (jumpTo->destination != jumpTo->cp + 1) {
+        i = jump(jumpTo->destination);
+      } else {
+        registers[JITVM::cp] = jumpTo->destination;
+      }
+    } else if (auto branch = kindCast<UBranch>(instruction)) {
+      if (!registers[branch->a->getReg()]) {
+        i = jump(branch->destination);
+      } else {
+        registers[JITVM::cp]++;
+      }
+    } else if (kindCast<UApply>(instruction) ||
+               kindCast<UReturn>(instruction) ||
+               kindCast<UHalt>(instruction)) {
+      break;
+    }
+  }
+
+  // Only the cells below sp and hp are part of the result
+  state.sp = registers[JITVM::sp];
+  state.fp = registers[JITVM::fp];
+  state.hp = registers[JITVM::hp];
+  state.cp = registers[JITVM::cp];
+  for (auto it = state.stack.begin(); it != state.stack.end();) {
+    it = it->first.first >= state.sp ? state.stack.erase(it) : std::next(it);
+  }
+  for (auto it = state.heap.begin(); it != state.heap.end();) {
+    it = it->first.first >= state.hp ? state.heap.erase(it) : std::next(it);
+  }
+  return state;
+}
@@ -0,0 +1,74 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../../src/b_dlang/b_instruction.h"
+#include "../../src/data_structures/code.h"
+#include "../../src/jit_policies/jit_sequence.h"
+#include "../../src/optimizations/optimization.h"
+#include "../../src/u_dlang/u_instruction.h"
+
+// Helpers shared by the tests of the optimizations
+
+// U-code of all the instructions of the b-code
+Code<UInstruction> makeUCode(const std::string& codeString);
+
+// U-code of the trace made of the instructions at cps
+Code<UInstruction> makeUCode(const Code<BInstruction>& code,
+                             const JITSequence::Cps& cps);
+
+// U-code optimized as a function or as a trace, by the optimizations in order
+Code<UInstruction> optimizeFunction(
+    const Code<UInstruction>& uCode,
+    const std::vector<std::shared_ptr<Optimization>>& optimizations);
+Code<UInstruction> optimizeTrace(
+    const Code<UInstruction>& uCode,
+    const std::vector<std::shared_ptr<Optimization>>& optimizations,
+    const Code<UInstruction>& guards = {});
+
+// Function subtracting its argument from a counter starting at 10, until the
+// counter is not positive, and returning the counter (the loop is at cp 2)
+extern const char* const kCountdownCode;
+
+// Number of instructions of kind T
+template<typename T>
+size_t countInstructions(const Code<UInstruction>& uCode) {
+  size_t count = 0;
+  for (const auto& instruction : uCode) {
+    count += kindCast<T>(instruction) != nullptr;
+  }
+  return count;
+}
+
+// Registers and memory of the vm as seen by u-code (the cells are indexed by
+// their index and type, and only those below sp and hp are kept at the end)
+struct UCodeState {
+  using Cells = std::map<std::pair<int, int>, int>;
+
+  // Frame of the main function
+  UCodeState();
+
+  void push(Tag tag, int value);
+  void allocate(Tag tag, int value);
+
+  // Makes the frame of a call to a closure with the captured items (the
+  // argument is the item on top of the stack)
+  void call(const std::vector<std::pair<Tag, int>>& captured = {});
+
+  bool operator==(const UCodeState& other) const;
+
+  Cells stack, heap;
+  int sp, fp, hp, cp;
+  bool isError;
+};
+
+// Runs the u-code from its first instruction until it leaves the code, starting
+// from the cp of that instruction (checks which fail are runtime errors)
+UCodeState runUCode(const Code<UInstruction>& uCode,
+                    UCodeState state = UCodeState());
@@ -0,0 +1,242 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "optimizations_test.h"
+#include "../../src/optimizations/register_allocation.h"
+
+bool usesOnly(const Code<UInstruction>& uCode,
+              const std::vector<URegister::Ptr>& registers) {
+  bool result = true;
+  auto check = [&](const UArgument::Ptr& arg) {
+    auto reg = kindCast<URegGP>(arg);
+    if (auto loc = kindCast<ULocation>(arg)) {
+      reg = kindCast<URegGP>(loc->getPtr());
+    }
+    if (reg && std::find(registers.begin(), registers.end(), reg) ==
+               registers.end()) {
+      result = false;
+    }
+  };
+  for (const auto& instruction : uCode) {
+    if (auto get = kindCast<UGet>(instruction)) {
+      check(get->a);
+      check(get->b);
+    } else if (auto set = kindCast<USet>(instruction)) {
+      check(set->a);
+      check(set->b);
+    } else if (auto move = kindCast<UMove>(instruction)) {
+      check(move->a);
+      check(move->b);
+    } else if (auto oper = kindCast<UOper>(instruction)) {
+      check(oper->a);
+      check(oper->b);
+      check(oper->c);
+    }
+  }
+  return result;
+}
+
+const char* kStackCode = "PUSH STACK_INT 3\n"
+                         "PUSH STACK_INT 4\n"
+                         "OPER ADD\n"
+                         "LOOKUP STACK_LOCATION 2\n"
+                         "PUSH STACK_INT 5\n"
+                         "SWAP\n"
+                         "OPER SUB\n"
+                         "OPER MUL\n"
+                         "PUSH STACK_INT 2\n"
+                         "OPER LT\n"
+                         "HALT\n";
+
+TEST(RegisterAllocation, ForwardsStores) {
+  // Allocate a trace with many extra registers
+  std::vector<URegister::Ptr> registers = {
+      VMUArg::r0, VMUArg::r1, VMUArg::r2,
+      std::make_shared<URegGP>("v5", JIT_V(5)),
+      std::make_shared<URegGP>("v6", JIT_V(6))};
+  auto uCode = makeUCode(kStackCode);
+  auto uCodeAllocated = RegisterAllocation(registers).allocate(uCode, false);
+
+  // Test loads are forwarded, and stores are all kept
+  EXPECT_LT(countInstructions<UGet>(uCodeAllocated), countInstructions<UGet>(uCode));
+  EXPECT_EQ(countInstructions<USet>(uCodeAllocated), countInstructions<USet>(uCode));
+  EXPECT_TRUE(usesOnly(uCodeAllocated, registers));
+
+  // Test the result is the same
+  EXPECT_EQ(runUCode(uCodeAllocated), runUCode(uCode));
+  EXPECT_EQ(runUCode(uCode).stack.at({2, VirtualMachine::Val}), 1);
+}
+
+TEST(RegisterAllocation, FewRegisters) {
+  // Allocate the same trace only with the registers used by the u-code
+  std::vector<URegister::Ptr> registers = {VMUArg::r0, VMUArg::r1,
+                                           VMUArg::r2};
+  auto uCode = makeUCode(kStackCode);
+  auto uCodeAllocated = RegisterAllocation(registers).allocate(uCode, false);
+
+  // Test some values are loaded again, but the result is the same
+  EXPECT_LE(countInstructions<UGet>(uCodeAllocated), countInstructions<UGet>(uCode));
+  EXPECT_TRUE(usesOnly(uCodeAllocated, registers));
+  EXPECT_EQ(runUCode(uCodeAllocated), runUCode(uCode));
+}
+
+TEST(RegisterAllocation, BranchDestinations) {
+  // The value stored before the label must be loaded again after it
+  auto uCode = makeUCode("PUSH STACK_BOOL true\n"
+                         "LABEL L0\n"
+                         "LOOKUP STACK_LOCATION 2\n"
+                         "TEST L0\n"
+                         "HALT\n");
+  auto uCodeAllocated = RegisterAllocation().allocate(uCode, false);
+  auto it = uCodeAllocated.begin();
+  while (!kindCast<ULabel>(*it) || (*it)->cp != 1) {
+    it++;
+  }
+  while (!kindCast<UGet>(*it) &&
+         !kindCast<UMove>(*it)) {
+    it++;
+  }
+  EXPECT_TRUE(kindCast<UGet>(*it));
+}
+
+TEST(RegisterAllocation, SharedRegisters) {
+  // The register written before the label is read after it
+  auto vm = std::make_shared<VirtualMachine>();
+  Code<UInstruction> uCode;
+  uCode.add(std::make_shared<ULabel>(0, vm));
+  uCode.add(std::make_shared<UMove>(0, vm, VMUArg::r0, VMUArg::uImm(7)));
+  uCode.add(std::make_shared<ULabel>(1, vm));
+  uCode.add(std::make_shared<USet>(1, vm, VMUArg::SP(0, VMUArg::Val),
+                                   VMUArg::r0));
+  uCode.add(std::make_shared<UGoto>(1, vm, 1));
+
+  // Test the register is not renamed, even if it is not allocatable
+  std::vector<URegister::Ptr> registers = {VMUArg::r1, VMUArg::r2};
+  auto uCodeAllocated = RegisterAllocation(registers).allocate(uCode, false);
+  EXPECT_TRUE(usesOnly(uCodeAllocated, {VMUArg::r0}));
+}
+
+TEST(RegisterAllocation, SegmentLiveness) {
+  // The register written before the exit is read after the label, which is
+  // not reached from the exit
+  auto vm = std::make_shared<VirtualMachine>();
+  Code<UInstruction> uCode;
+  uCode.add(std::make_shared<ULabel>(0, vm));
+  uCode.add(std::make_shared<UMove>(0, vm, VMUArg::r0, VMUArg::uImm(7)));
+  uCode.add(std::make_shared<USet>(0, vm, VMUArg::SP(0, VMUArg::Val),
+                                   VMUArg::r0));
+  uCode.add(std::make_shared<UGoto>(0, vm, 5));
+  uCode.add(std::make_shared<ULabel>(1, vm));
+  uCode.add(std::make_shared<USet>(1, vm, VMUArg::SP(0, VMUArg::Val),
+                                   VMUArg::r0));
+  uCode.add(std::make_shared<UGoto>(1, vm, 1));
+
+  // Test only the register read after the label is kept
+  std::vector<URegister::Ptr> registers = {VMUArg::r1, VMUArg::r2};
+  auto uCodeAllocated = RegisterAllocation(registers).allocate(uCode, false);
+  for (const auto& instruction : uCodeAllocated) {
+    if (auto set = kindCast<USet>(instruction)) {
+      auto reg = kindCast<URegister>(set->b);
+      ASSERT_TRUE(reg);
+      EXPECT_EQ(reg->getReg() == JIT_R0, set->cp == 1);
+    }
+  }
+}
+
+TEST(RegisterAllocation, AllocatableRegisters) {
+  // Test the registers holding the vm state and the cached data pointers
+  // are never assigned
+  std::vector<jit_reg_t> reserved = {JITVM::sp, JITVM::fp, JITVM::cp,
+                                     JITVM::hp, JITVM::tmp};
+  if (JITVM::kCachesStack) { reserved.push_back(JITVM::stackData); }
+  if (JITVM::kCachesHeap) { reserved.push_back(JITVM::heapData); }
+  for (const auto& reg : VMUArg::allocatable()) {
+    EXPECT_EQ(std::count(reserved.begin(), reserved.end(), reg->getReg()), 0);
+  }
+}
+
+// Registers used by the u-code, and many extra ones for the slots
+std::vector<URegister::Ptr> makeSlotRegisters() {
+  std::vector<URegister::Ptr> registers = {VMUArg::r0, VMUArg::r1,
+                                           VMUArg::r2};
+  for (int i = 5; i < 13; i++) {
+    registers.push_back(
+        std::make_shared<URegGP>("v" + std::to_string(i), JIT_V(i)));
+  }
+  return registers;
+}
+
+// Number of loads and stores of stack slots by the instructions at cps from
+// first to last
+size_t countStackAccesses(const Code<UInstruction>& uCode,
+                          size_t first, size_t last) {
+  size_t count = 0;
+  for (const auto& instruction : uCode) {
+    if (instruction->cp < first || instruction->cp > last) { continue; }
+    auto get = kindCast<UGet>(instruction);
+    auto set = kindCast<USet>(instruction);
+    count += (get && kindCast<ULocStack>(get->b)) ||
+             (set && kindCast<ULocStack>(set->a));
+  }
+  return count;
+}
+
+TEST(RegisterAllocation, PromotesSlotsAcrossBlocks) {
+  auto uCode = makeUCode(kCountdownCode);
+  auto uCodeAllocated =
+      RegisterAllocation(makeSlotRegisters()).allocate(uCode, true);
+
+  // Test the loop (from cp 2 to 12) keeps its slots in registers (compact
+  // cells only let tags be promoted)
+  EXPECT_LT(countStackAccesses(uCodeAllocated, 2, 12),
+            countStackAccesses(uCode, 2, 12));
+  if (!Cell::kCompact) {
+    EXPECT_EQ(countStackAccesses(uCodeAllocated, 2, 12), 0);
+  }
+
+  // Test the function returns the same result
+  UCodeState state;
+  state.push(Int, 3);
+  state.call();
+  auto result = runUCode(uCodeAllocated, state);
+  EXPECT_EQ(result, runUCode(uCode, state));
+  EXPECT_EQ(result.stack.at({2, VirtualMachine::Val}), -2);
+}
+
+TEST(RegisterAllocation, PromotedSlotsStoredAtCalls) {
+  // The countdown applies its own closure to the counter after the loop
+  auto uCode = makeUCode("FUNCTION F0\n"
+                         "PUSH STACK_INT 10\n"
+                         "LABEL L0\n"
+                         "LOOKUP STACK_LOCATION 2\n"
+                         "LOOKUP STACK_LOCATION -2\n"
+                         "OPER SUB\n"
+                         "SWAP\n"
+                         "POP\n"
+                         "PUSH STACK_INT 0\n"
+                         "LOOKUP STACK_LOCATION 2\n"
+                         "OPER LT\n"
+                         "TEST L1\n"
+                         "GOTO L0\n"
+                         "LABEL L1\n"
+                         "LOOKUP STACK_LOCATION -1\n"
+                         "APPLY\n"
+                         "RETURN\n");
+  auto uCodeAllocated =
+      RegisterAllocation(makeSlotRegisters()).allocate(uCode, true);
+
+  // Test the counter is in memory when the call leaves the code (above the
+  // frame of the function, which starts at 4)
+  UCodeState state;
+  state.push(Int, 3);
+  state.call();
+  auto result = runUCode(uCodeAllocated, state);
+  EXPECT_EQ(result, runUCode(uCode, state));
+  EXPECT_EQ(result.stack.at({6, VirtualMachine::Val}), -2);
+}
@@ -0,0 +1,143 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "optimizations_test.h"
+#include "../../src/b_dlang/b_code_builder.h"
+#include "../../src/optimizations/copy_propagation.h"
+#include "../../src/optimizations/dead_code.h"
+#include "../../src/optimizations/scalar_replacement.h"
+
+// Number of checks and writes of the heap, and of moves of hp
+size_t countAllocations(const Code<UInstruction>& uCode) {
+  size_t count = 0;
+  for (const auto& instruction : uCode) {
+    if (auto check = kindCast<UMemCheck>(instruction)) {
+      count += check->a->getPtr()->getReg() == JITVM::hp;
+    }
+    if (auto set = kindCast<USet>(instruction)) {
+      count += kindCast<ULocHeap>(set->a) != nullptr;
+    }
+    if (auto oper = kindCast<UOper>(instruction)) {
+      auto reg = kindCast<URegister>(oper->a);
+      count += reg && reg->getReg() == JITVM::hp;
+    }
+  }
+  return count;
+}
+
+TEST(ScalarReplacement, ConsumedPair) {
+  // Function returning the first item of a pair made from its argument
+  std::string code = "FUNCTION F0\n"
+                     "LOOKUP STACK_LOCATION -2\n"
+                     "PUSH STACK_INT 1\n"
+                     "MK_PAIR\n"
+                     "FST\n"
+                     "RETURN\n";
+  auto uCode = makeUCode(code);
+  auto uCodeReplaced = optimizeFunction(
+      uCode, {std::make_shared<ScalarReplacement>()});
+
+  // Test the pair is not allocated, and its item is read from the stack
+  EXPECT_GT(countAllocations(uCode), 0);
+  EXPECT_EQ(countAllocations(uCodeReplaced), 0);
+  for (const auto& instruction : uCodeReplaced) {
+    if (auto get = kindCast<UGet>(instruction)) {
+      EXPECT_FALSE(kindCast<ULocHeap>(get->b));
+    }
+  }
+
+  // Test the function returns the same item, without changing the heap
+  UCodeState state;
+  state.push(Int, 5);
+  state.call();
+  auto result = runUCode(uCodeReplaced, state);
+  auto expected = runUCode(uCode, state);
+  EXPECT_EQ(result.stack, expected.stack);
+  EXPECT_EQ(result.sp, expected.sp);
+  EXPECT_EQ(result.fp, expected.fp);
+  EXPECT_EQ(result.cp, expected.cp);
+  EXPECT_EQ(result.stack.at({2, VirtualMachine::Val}), 5);
+  EXPECT_EQ(result.hp, state.hp);
+}
+
+TEST(ScalarReplacement, EscapingPair) {
+  // Function returning a pair made from its argument
+  std::string code = "FUNCTION F0\n"
+                     "LOOKUP STACK_LOCATION -2\n"
+                     "PUSH STACK_INT 1\n"
+                     "MK_PAIR\n"
+                     "RETURN\n";
+  auto uCode = makeUCode(code);
+  auto uCodeReplaced = optimizeFunction(
+      uCode, {std::make_shared<ScalarReplacement>()});
+
+  // Test the pair is still allocated
+  EXPECT_GT(countAllocations(uCodeReplaced), 0);
+  EXPECT_EQ(countAllocations(uCodeReplaced), countAllocations(uCode));
+
+  // Test the function returns the same pair
+  UCodeState state;
+  state.push(Int, 5);
+  state.call();
+  EXPECT_EQ(runUCode(uCodeReplaced, state), runUCode(uCode, state));
+}
+
+// Runs the trace at the cps of the code, before and after the optimizations
+// run by the tests of the programs, expecting the same runtime error (the
+// heap starts with the object, so pointers which are not loaded point to it)
+UCodeState runReplacedTrace(const std::string& code,
+                            const JITSequence::Cps& cps,
+                            const std::vector<std::pair<Tag, int>>& object) {
+  auto uCode = makeUCode(BCodeBuilder::fromString(code), cps);
+  auto uCodeReplaced = optimizeTrace(
+      uCode, {std::make_shared<CopyPropagation>(),
+              std::make_shared<ScalarReplacement>(),
+              std::make_shared<DeadCodeElimination>()});
+  UCodeState state;
+  for (const auto& [tag, value] : object) {
+    state.allocate(tag, value);
+  }
+  auto expected = runUCode(uCode, state);
+  auto result = runUCode(uCodeReplaced, state);
+  EXPECT_TRUE(expected.isError);
+  EXPECT_EQ(result.isError, expected.isError);
+  EXPECT_EQ(result.cp, expected.cp);
+  return result;
+}
+
+TEST(ScalarReplacement, FstOfClosure) {
+  // Trace taking the first item of a closure
+  std::string code = "MK_CLOSURE L0 0\n"
+                     "FST\n"
+                     "SND\n"
+                     "HALT\n"
+                     "FUNCTION L0\n"
+                     "LOOKUP STACK_LOCATION -2\n"
+                     "RETURN\n";
+
+  // Test the header check fails at FST, while a pair is at 0
+  auto result = runReplacedTrace(code, {0, 1, 2, 3},
+                                 {{PairHeader, 3}, {Int, 0}, {Int, 0}});
+  EXPECT_EQ(result.cp, 1);
+}
+
+TEST(ScalarReplacement, ApplyOfPair) {
+  // Trace applying a pair
+  std::string code = "PUSH STACK_INT 0\n"
+                     "PUSH STACK_INT 0\n"
+                     "PUSH STACK_INT 0\n"
+                     "MK_PAIR\n"
+                     "APPLY\n"
+                     "HALT\n";
+
+  // Test the header check fails at APPLY, while a closure is at 0
+  auto result = runReplacedTrace(code, {0, 1, 2, 3, 4, 5},
+                                 {{ClosureHeader, 2}, {CodeIndex, 0}});
+  EXPECT_EQ(result.cp, 4);
+}
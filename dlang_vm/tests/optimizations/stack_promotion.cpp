@@ -0,0 +1,81 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "optimizations_test.h"
+#include "../../src/optimizations/copy_propagation.h"
+#include "../../src/optimizations/stack_promotion.h"
+
+TEST(StackPromotion, TagsAcrossJoins) {
+  // Function counting up forever, the counter is always an integer
+  auto uCode = makeUCode("FUNCTION F0\n"
+                         "PUSH STACK_INT 0\n"
+                         "LABEL L0\n"
+                         "LOOKUP STACK_LOCATION 2\n"
+                         "PUSH STACK_INT 1\n"
+                         "OPER ADD\n"
+                         "SWAP\n"
+                         "POP\n"
+                         "GOTO L0\n");
+  auto uCodeCopied = optimizeFunction(
+      uCode, {std::make_shared<CopyPropagation>()});
+  auto uCodePromoted = optimizeFunction(
+      uCode, {std::make_shared<CopyPropagation>(),
+              std::make_shared<StackPromotion>()});
+
+  // Test the tag of the counter is not checked after the join of the loop
+  EXPECT_GT(countInstructions<UTagCheck>(uCodeCopied), 0);
+  EXPECT_EQ(countInstructions<UTagCheck>(uCodePromoted), 0);
+
+  // Test the writes overwritten before being read are removed
+  EXPECT_LT(countInstructions<USet>(uCodePromoted),
+            countInstructions<USet>(uCodeCopied));
+}
+
+TEST(StackPromotion, MaterializedAtExits) {
+  // Function returning a constant after a branch
+  auto uCode = makeUCode("FUNCTION F0\n"
+                         "PUSH STACK_BOOL true\n"
+                         "TEST L0\n"
+                         "LABEL L0\n"
+                         "PUSH STACK_INT 7\n"
+                         "RETURN\n");
+  auto uCodePromoted = optimizeFunction(
+      uCode, {std::make_shared<StackPromotion>()});
+
+  // Test the returned item is still read from memory by the return
+  EXPECT_EQ(countInstructions<UReturn>(uCodePromoted), 1);
+  bool isReturnedWritten = false;
+  for (const auto& instruction : uCodePromoted) {
+    if (auto set = kindCast<USet>(instruction)) {
+      auto loc = kindCast<ULocFP>(set->a);
+      isReturnedWritten |= loc && loc->getOffset() == -2;
+    }
+  }
+  EXPECT_TRUE(isReturnedWritten);
+
+  // Test the function returns the same result
+  UCodeState state;
+  state.push(Int, 5);
+  state.call();
+  auto result = runUCode(uCodePromoted, state);
+  EXPECT_EQ(result, runUCode(uCode, state));
+  EXPECT_EQ(result.stack.at({2, VirtualMachine::Val}), 7);
+}
+
+TEST(StackPromotion, SameResult) {
+  auto uCode = makeUCode(kCountdownCode);
+  auto uCodePromoted = optimizeFunction(
+      uCode, {std::make_shared<CopyPropagation>(),
+              std::make_shared<StackPromotion>()});
+
+  // Test the function returns the same result
+  UCodeState state;
+  state.push(Int, 3);
+  state.call();
+  auto result = runUCode(uCodePromoted, state);
+  EXPECT_EQ(result, runUCode(uCode, state));
+  EXPECT_EQ(result.stack.at({2, VirtualMachine::Val}), -2);
+}
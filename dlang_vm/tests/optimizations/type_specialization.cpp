@@ -0,0 +1,76 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "optimizations_test.h"
+#include "../../src/b_dlang/b_code_builder.h"
+#include "../../src/optimizations/redundant_checks.h"
+#include "../../src/optimizations/type_specialization.h"
+
+TEST(TypeSpecialization, GuardsLoop) {
+  // Loop adding the first item of the frame to the second one
+  auto code = BCodeBuilder::fromString("PUSH STACK_INT 1\n"
+                                       "PUSH STACK_INT 0\n"
+                                       "LABEL L0\n"
+                                       "LOOKUP STACK_LOCATION 3\n"
+                                       "LOOKUP STACK_LOCATION 2\n"
+                                       "OPER ADD\n"
+                                       "SWAP\n"
+                                       "POP\n"
+                                       "GOTO L0\n");
+  JITSequence::Cps cps = {2, 3, 4, 5, 6, 7, 8};
+  JITSequence jitSequence(cps, {});
+  jitSequence.setEntryTags(0, {FramePointer, ReturnAddress, Int, Int});
+  auto uCode = makeUCode(code, cps);
+
+  // Test the items read by the trace are guarded once
+  TypeSpecialization typeSpecialization;
+  auto guards = typeSpecialization.makeGuards(uCode, jitSequence);
+  ASSERT_EQ(guards.size(), 2);
+  for (const auto& guard : guards) {
+    auto typeGuard = kindCast<UTypeGuard>(guard);
+    ASSERT_TRUE(typeGuard);
+    EXPECT_EQ(typeGuard->tagA, Int);
+  }
+
+  // Test the checks of the copies of the guarded items are removed
+  auto redundantChecks = std::make_shared<RemoveRedundantChecks>();
+  auto uCodeOptimized = optimizeTrace(uCode, {redundantChecks});
+  auto uCodeSpecialized = optimizeTrace(uCode, {redundantChecks}, guards);
+  EXPECT_GT(countInstructions<UTagCheck>(uCodeOptimized), 0);
+  EXPECT_EQ(countInstructions<UTagCheck>(uCodeSpecialized), 0);
+
+  // Test the tags are the same when jumping back to the start
+  EXPECT_TRUE(typeSpecialization.isLoopInvariant(uCode, guards, jitSequence));
+}
+
+TEST(TypeSpecialization, ChangingTag) {
+  // Loop replacing the item with a boolean
+  auto code = BCodeBuilder::fromString("PUSH STACK_INT 1\n"
+                                       "LABEL L0\n"
+                                       "LOOKUP STACK_LOCATION 2\n"
+                                       "PUSH STACK_INT 0\n"
+                                       "OPER LT\n"
+                                       "SWAP\n"
+                                       "POP\n"
+                                       "GOTO L0\n");
+  JITSequence::Cps cps = {1, 2, 3, 4, 5, 6, 7};
+  JITSequence jitSequence(cps, {});
+  jitSequence.setEntryTags(0, {FramePointer, ReturnAddress, Int});
+  auto uCode = makeUCode(code, cps);
+
+  // Test the item is guarded, but the guard is needed at every iteration
+  TypeSpecialization typeSpecialization;
+  auto guards = typeSpecialization.makeGuards(uCode, jitSequence);
+  ASSERT_EQ(guards.size(), 1);
+  EXPECT_FALSE(typeSpecialization.isLoopInvariant(uCode, guards,
+                                                  jitSequence));
+
+  // Test nothing is guarded without the observed tags
+  EXPECT_EQ(typeSpecialization.makeGuards(uCode, JITSequence(cps, {})).size(),
+            0);
+}
@@ -0,0 +1,81 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+
+#include "optimizations_test.h"
+#include "../../src/optimizations/value_numbering.h"
+
+// Number of checks of integer tags
+size_t countIntChecks(const Code<UInstruction>& uCode) {
+  size_t count = 0;
+  for (const auto& instruction : uCode) {
+    auto check = kindCast<UTagCheck>(instruction);
+    count += check && check->tagA == Int;
+  }
+  return count;
+}
+
+// State calling the function on a reference to an integer
+UCodeState makeReferenceCall(int value) {
+  UCodeState state;
+  state.allocate(Int, value);
+  state.push(HeapRef, 0);
+  state.call();
+  return state;
+}
+
+TEST(GlobalValueNumbering, RepeatedLoads) {
+  // Function adding the value of its argument to itself
+  std::string code = "FUNCTION F0\n"
+                     "LOOKUP STACK_LOCATION -2\n"
+                     "DEREF\n"
+                     "LOOKUP STACK_LOCATION -2\n"
+                     "DEREF\n"
+                     "OPER ADD\n"
+                     "RETURN\n";
+
+  auto uCode = makeUCode(code);
+  auto uCodeNumbered = optimizeFunction(
+      uCode, {std::make_shared<GlobalValueNumbering>()});
+
+  // Test the second dereference has the number of the first one, so the
+  // tag of its value is not checked again
+  EXPECT_EQ(countIntChecks(uCode), 2);
+  EXPECT_EQ(countIntChecks(uCodeNumbered), 1);
+
+  // Test the function returns the same result
+  auto state = makeReferenceCall(4);
+  auto result = runUCode(uCodeNumbered, state);
+  EXPECT_EQ(result, runUCode(uCode, state));
+  EXPECT_EQ(result.stack.at({2, VirtualMachine::Val}), 8);
+}
+
+TEST(GlobalValueNumbering, LoadsAfterAssignments) {
+  // Function assigning to its argument between the two dereferences
+  std::string code = "FUNCTION F0\n"
+                     "LOOKUP STACK_LOCATION -2\n"
+                     "DEREF\n"
+                     "LOOKUP STACK_LOCATION -2\n"
+                     "PUSH STACK_INT 1\n"
+                     "ASSIGN\n"
+                     "POP\n"
+                     "LOOKUP STACK_LOCATION -2\n"
+                     "DEREF\n"
+                     "OPER ADD\n"
+                     "RETURN\n";
+
+  auto uCode = makeUCode(code);
+  auto uCodeNumbered = optimizeFunction(
+      uCode, {std::make_shared<GlobalValueNumbering>()});
+
+  // Test the value loaded after the assignment is checked again, and it is
+  // the assigned one
+  EXPECT_EQ(countIntChecks(uCodeNumbered), countIntChecks(uCode));
+  auto state = makeReferenceCall(4);
+  auto result = runUCode(uCodeNumbered, state);
+  EXPECT_EQ(result, runUCode(uCode, state));
+  EXPECT_EQ(result.stack.at({2, VirtualMachine::Val}), 5);
+}
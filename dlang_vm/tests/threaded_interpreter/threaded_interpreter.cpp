@@ -0,0 +1,190 @@
+// Copyright 2022 Federico Stazi. Subject to the MIT license.
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+
+#include "../../src/b_dlang/b_code_builder.h"
+#include "../../src/memory_managers/mark_and_sweep_gc.h"
+#include "../../src/memory_managers/no_allocation.h"
+#include "../../src/threaded_interpreter/threaded_interpreter.h"
+
+std::shared_ptr<VirtualMachine> runThreaded(
+    const std::string& codeString,
+    std::shared_ptr<MemoryManager> memoryManager,
+    bool superinstructions = false) {
+  // Create the Virtual Machine as done by DlangVM
+  auto vm = std::make_shared<VirtualMachine>();
+  vm->stack.setMemoryManager(memoryManager);
+  vm->heap.setMemoryManager(memoryManager);
+  vm->stack.set(0, {Tag::FramePointer, 0});
+  vm->stack.set(1, {Tag::ReturnAddress, 0});
+  vm->sp = 2;
+
+  // Run the program
+  auto code = BCodeBuilder::fromString(codeString);
+  if (superinstructions) {
+    code = BCodeBuilder::fuseSuperinstructions(code);
+  }
+  ThreadedInterpreter(code).run(vm, memoryManager);
+  return vm;
+}
+
+TEST(ThreadedInterpreter, Lowering) {
+  // Create the interpreter for a small program
+  ThreadedInterpreter interpreter(BCodeBuilder::fromString(
+      "PUSH STACK_INT -3\n"
+      "LOOKUP STACK_LOCATION -2\n"
+      "MK_CLOSURE L0 2\n"
+      "LABEL L0\n"
+      "TEST L0\n"
+      "HALT\n"));
+
+  // Test the flat instructions
+  ASSERT_EQ(interpreter.size(), 6);
+  EXPECT_EQ(interpreter.getInstruction(0).opcode,
+            ThreadedInstruction::PushInt);
+  EXPECT_EQ(interpreter.getInstruction(0).arg0, -3);
+  EXPECT_EQ(interpreter.getInstruction(1).opcode,
+            ThreadedInstruction::LookupStack);
+  EXPECT_EQ(interpreter.getInstruction(1).arg0, -2);
+  EXPECT_EQ(interpreter.getInstruction(2).opcode,
+            ThreadedInstruction::MkClosure);
+  EXPECT_EQ(interpreter.getInstruction(2).arg0, 3);
+  EXPECT_EQ(interpreter.getInstruction(2).arg1, 2);
+  EXPECT_EQ(interpreter.getInstruction(3).opcode, ThreadedInstruction::Label);
+  EXPECT_EQ(interpreter.getInstruction(4).opcode, ThreadedInstruction::Test);
+  EXPECT_EQ(interpreter.getInstruction(4).arg0, 3);
+  EXPECT_EQ(interpreter.getInstruction(5).opcode, ThreadedInstruction::Halt);
+}
+
+TEST(ThreadedInterpreter, Arithmetic) {
+  // Run (2 + 3) * 4
+  auto vm = runThreaded("PUSH STACK_INT 2\n"
+                        "PUSH STACK_INT 3\n"
+                        "OPER ADD\n"
+                        "PUSH STACK_INT 4\n"
+                        "OPER MUL\n"
+                        "HALT\n",
+                        std::make_shared<NoAllocation>());
+
+  // Test the result
+  EXPECT_EQ(vm->status, VirtualMachine::Status::Halted);
+  EXPECT_EQ(vm->cp, 5);
+  EXPECT_EQ(vm->getResult(), "20");
+}
+
+TEST(ThreadedInterpreter, Function) {
+  // Run (fun x -> x + 1) 20
+  auto vm = runThreaded("PUSH STACK_INT 20\n"
+                        "MK_CLOSURE L0 0\n"
+                        "APPLY\n"
+                        "HALT\n"
+                        "FUNCTION L0\n"
+                        "LOOKUP STACK_LOCATION -2\n"
+                        "PUSH STACK_INT 1\n"
+                        "OPER ADD\n"
+                        "RETURN\n",
+                        std::make_shared<NoAllocation>());
+
+  // Test the result
+  EXPECT_EQ(vm->status, VirtualMachine::Status::Halted);
+  EXPECT_EQ(vm->getResult(), "21");
+}
+
+TEST(ThreadedInterpreter, Loop) {
+  // Run a loop allocating a pair at each iteration, so that
+  // the garbage collector runs many times
+  auto vm = runThreaded("PUSH STACK_INT 1000\n"
+                        "MK_REF\n"
+                        "LABEL L0\n"
+                        "LOOKUP STACK_LOCATION 2\n"
+                        "DEREF\n"
+                        "PUSH STACK_INT 0\n"
+                        "OPER EQ\n"
+                        "UNARY NOT\n"
+                        "TEST L1\n"
+                        "LOOKUP STACK_LOCATION 2\n"
+                        "LOOKUP STACK_LOCATION 2\n"
+                        "DEREF\n"
+                        "PUSH STACK_INT 1\n"
+                        "MK_PAIR\n"
+                        "FST\n"
+                        "PUSH STACK_INT 1\n"
+                        "OPER SUB\n"
+                        "ASSIGN\n"
+                        "POP\n"
+                        "GOTO L0\n"
+                        "LABEL L1\n"
+                        "LOOKUP STACK_LOCATION 2\n"
+                        "DEREF\n"
+                        "HALT\n",
+                        std::make_shared<MarkAndSweepGC>(100));
+
+  // Test the result
+  EXPECT_EQ(vm->status, VirtualMachine::Status::Halted);
+  EXPECT_EQ(vm->getResult(), "0");
+  EXPECT_LT(vm->hp, 100);
+}
+
+TEST(ThreadedInterpreter, RuntimeError) {
+  // Run 1 + true
+  auto vm = runThreaded("PUSH STACK_INT 1\n"
+                        "PUSH STACK_BOOL true\n"
+                        "OPER ADD\n"
+                        "HALT\n",
+                        std::make_shared<NoAllocation>());
+
+  // Test the error position
+  EXPECT_EQ(vm->status, VirtualMachine::Status::RuntimeError);
+  EXPECT_EQ(vm->cp, 2);
+}
+
+TEST(ThreadedInterpreter, Superinstructions) {
+  // Loop counting down from 3, fused at cps 2 and 8
+  std::string codeString = "PUSH STACK_INT 3\n"
+                           "LABEL L0\n"
+                           "LOOKUP STACK_LOCATION 2\n"
+                           "PUSH STACK_INT 0\n"
+                           "OPER EQ\n"
+                           "TEST L1\n"
+                           "HALT\n"
+                           "LABEL L1\n"
+                           "LOOKUP STACK_LOCATION 2\n"
+                           "PUSH STACK_INT 1\n"
+                           "OPER SUB\n"
+                           "SWAP\n"
+                           "POP\n"
+                           "GOTO L0\n";
+  auto vm = runThreaded(codeString, std::make_shared<NoAllocation>(), true);
+  auto expected = runThreaded(codeString, std::make_shared<NoAllocation>());
+
+  // Test the result
+  EXPECT_EQ(vm->status, VirtualMachine::Status::Halted);
+  EXPECT_EQ(vm->sp, expected->sp);
+  EXPECT_EQ(vm->getResult(), expected->getResult());
+
+  // Test the error is reported at the fused addition
+  vm = runThreaded("PUSH STACK_BOOL true\n"
+                   "PUSH STACK_INT 1\n"
+                   "OPER ADD\n"
+                   "HALT\n",
+                   std::make_shared<NoAllocation>(), true);
+  EXPECT_EQ(vm->status, VirtualMachine::Status::RuntimeError);
+  EXPECT_EQ(vm->cp, 2);
+}
+
+TEST(ThreadedInterpreter, HeapOverflow) {
+  // Run a loop allocating references until the heap is full
+  auto vm = runThreaded("LABEL L0\n"
+                        "PUSH STACK_UNIT\n"
+                        "MK_REF\n"
+                        "POP\n"
+                        "GOTO L0\n",
+                        std::make_shared<NoAllocation>(10));
+
+  // Test the error position
+  EXPECT_EQ(vm->status, VirtualMachine::Status::RuntimeError);
+  EXPECT_EQ(vm->cp, 2);
+}
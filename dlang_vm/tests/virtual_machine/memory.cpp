@@ -72,3 +72,26 @@ TEST(Memory, CopyFromLarge) {
   ASSERT_EQ(memoryA.get(0).tag, memoryB.get(0).tag);
   ASSERT_EQ(memoryA.get(0).value, memoryB.get(0).value);
 }
+
+TEST(Memory, Cell) {
+  // Create cells with negative values and headers
+  Cell intCell(Int, static_cast<Value>(-7));
+  Cell headerCell(Item{PairHeader, 3});
+
+  // Test the cells
+  ASSERT_EQ(intCell.getTag(), Int);
+  ASSERT_EQ(static_cast<int>(intCell.getValue()), -7);
+  ASSERT_EQ(static_cast<Item>(headerCell).tag, PairHeader);
+  ASSERT_EQ(static_cast<Item>(headerCell).value, 3);
+
+  // Change the tag and the value separately
+  intCell.setTag(Bool);
+  ASSERT_EQ(intCell.getTag(), Bool);
+  ASSERT_EQ(static_cast<int>(intCell.getValue()), -7);
+  intCell.setValue(1);
+  ASSERT_EQ(intCell.getTag(), Bool);
+  ASSERT_EQ(intCell.getValue(), 1);
+
+  // Compact cells take one word
+  ASSERT_EQ(sizeof(Cell), Cell::kCompact ? 8 : sizeof(Item));
+}
@@ -7,6 +7,7 @@
 import os
 import subprocess
 import math
+import sys
 
 
 def compile_dlang(program, compiled):
@@ -35,6 +36,23 @@ def benchmark(command, cpu = 1, timeout = 120):
   return time, space
 
 
+def benchmark_compilation(command, cpu = 1, timeout = 120):
+  """Run the command on the given core, and get the time spent compiling"""
+  command_full = (f"taskset -c {cpu} "
+                  f"timeout {timeout} "
+                  + command + " --verbosity statistics")
+
+  output = subprocess.run(command_full.split(" "),
+                          stderr = subprocess.PIPE,
+                          stdout = subprocess.DEVNULL,
+                          text = True).stderr
+
+  for line in output.split("\n"):
+    if line.startswith("Total compilation time (us):"):
+      return int(line.split(":")[1]) / 1000.0
+  return 0.0
+
+
 def evaluate(idx, results, z_confidence):
   """Print the mean and confidence interval for the results"""
   results_cnt = len(results)
@@ -46,7 +64,7 @@ def evaluate(idx, results, z_confidence):
   print(f"id: {idx} {results_mean:.3f}ms±{confidence_range:.3f}ms")
 
 
-def make_commands():
+def make_commands(compilation = False):
   """Generate the commands to be tested"""
   opt = ("--optimizations "
          "redundant-checks,copy-propagation,constant-folding,dead-code")
@@ -65,6 +83,11 @@ def make_commands():
   }
   tests = ["fib", "ack", "prim", "queen", "sort", "hanoi"]
 
+  # Only the jit compilers are timed when compiling, without the verbosity
+  if compilation:
+    interpreters = {i: c.replace(f" {verb}", "")
+                    for i, c in interpreters.items() if "dlang_vm " in c}
+
   for test in tests:
     compile_dlang(f"inputs/{test}.dlang", f"{test}.out")
 
@@ -80,16 +103,22 @@ if __name__ == "__main__":
   Z_CONFIDENCE = 1.96
   NUM_TESTS = 1000
 
+  # With --compilation the time spent compiling is measured instead
+  COMPILATION = "--compilation" in sys.argv[1:]
+
   file_path = os.path.dirname(os.path.realpath(__file__))
   os.chdir(file_path)
 
-  commands = make_commands()
+  commands = make_commands(COMPILATION)
 
   results = {i:[] for i in commands}
 
   for test in range(NUM_TESTS):
     print(f"{test} out of {NUM_TESTS}")
     for command_id, command in commands.items():
-      t, _ = benchmark(command)
+      if COMPILATION:
+        t = benchmark_compilation(command)
+      else:
+        t, _ = benchmark(command)
       results[command_id].append(t)
       evaluate(command_id, results[command_id], Z_CONFIDENCE)
@@ -18,7 +18,7 @@ def get_commands():
   # Options for dlang-vm
   jit_thresholds = ["0", "3"]
   jit_policies = ["no", "tracing", "individual", "block", "function"]
-  memory_managers = ["none", "amortized", "mark-and-sweep"]
+  memory_managers = ["none", "amortized", "mark-and-sweep", "generational"]
   optimizations = [
     "",
     "redundant-checks",
@@ -36,7 +36,24 @@ def get_commands():
     "copy-propagation,constant-folding,dead-code,redundant-checks",
     "copy-propagation,dead-code,redundant-checks,constant-folding",
     "copy-propagation,dead-code,constant-folding,redundant-checks",
-    "redundant-checks,copy-propagation,dead-code,constant-folding"
+    "redundant-checks,copy-propagation,dead-code,constant-folding",
+    "copy-propagation,stack-promotion",
+    "copy-propagation,stack-promotion,constant-folding,dead-code",
+    "gvn",
+    "copy-propagation,gvn,dead-code,redundant-checks",
+    "licm",
+    "copy-propagation,licm,redundant-checks",
+    "bounds-checks",
+    "copy-propagation,licm,bounds-checks,redundant-checks",
+    "scalar-replacement",
+    "copy-propagation,scalar-replacement,dead-code",
+    "register-allocation",
+    "copy-propagation,unused-writes,register-allocation",
+    "redundant-checks,copy-propagation,constant-folding,dead-code,"
+    "register-allocation",
+    "type-specialization,redundant-checks",
+    "type-specialization,redundant-checks,copy-propagation,dead-code,"
+    "register-allocation"
   ]
 
   # Construct the commands
@@ -48,6 +65,16 @@ def get_commands():
           commands.append(("../dlang_vm/dlang_vm",
                            jit_threshold + jit_policy +
                            memory_manager + optimization))
+  for memory_manager in [("--memory", x) for x in memory_managers]:
+    commands.append(("../dlang_vm/dlang_vm",
+                     ("--interpreter", "threaded") + memory_manager))
+  for jit_policy in [("--jit-policy", x) for x in jit_policies]:
+    commands.append(("../dlang_vm/dlang_vm",
+                     ("--background-jit", "--memory", "generational") +
+                     jit_policy))
+  for jit_policy in [("--jit-policy", x) for x in jit_policies]:
+    commands.append(("../dlang_vm/dlang_vm",
+                     ("--superinstructions",) + jit_policy))
   commands.append(("../meta_dlang_vm.py", []))
   commands.append(("../meta_dlang_vm", []))
 